@@ -11,9 +11,11 @@
 #include <linux/string.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
-#include <linux/spinlock.h>
 #include <linux/kobject.h>
 #include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/rculist.h>
+#include <linux/sort.h>
 
 #define MAX_INSERT_DIGIT 4
 
@@ -42,259 +44,474 @@ extern unsigned long get_max_capacity(int cpu);
 static unsigned long calc_fps_required_util(unsigned long max_cap, unsigned long dur);
 static struct task_fps_util_info *get_target_task(int tid);
 
-static spinlock_t write_slock;
+#define GPIS_TID_HASH_BITS	6
+#define GPIS_GROUP_HASH_BITS	3
+#define GPIS_EST_MAX_WINDOW	64
+#define GPIS_BATCH_CHUNK	16
+
+/*
+ * Tasks drawing for the same group_id.  Besides the member list, a group
+ * keeps the durations of its last est_window frames, from which the frame
+ * duration that FRAME_END scales the utilization by is estimated.
+ */
+struct gpis_group {
+	int group_id;
+	int nr_tasks;
+	struct hlist_node node;
+	struct list_head tasks;
+	u64 dur[GPIS_EST_MAX_WINDOW];
+	unsigned int nr_dur;
+	unsigned int pos;
+	u64 ewma;
+	struct rcu_head rcu;
+};
+
+/* Serializes all updates; get_max_fps_util() only takes rcu_read_lock(). */
+static DEFINE_MUTEX(gpis_lock);
+static DEFINE_HASHTABLE(gpis_tid_hash, GPIS_TID_HASH_BITS);
+static DEFINE_HASHTABLE(gpis_group_hash, GPIS_GROUP_HASH_BITS);
 struct list_head gpis_hlist;
 int fps_task_count;
 unsigned long us_frame_time;
 int g_fps;
 int fps_margin_percent;
 int hold_frame_count;
+int est_window;
+int est_percentile;
+int est_ewma_shift;
 
 static struct kobject *perf_kobject;
 
-static long perf_mgr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+static struct gpis_group *gpis_find_group(int group_id)
 {
-	void __user *uarg = (void __user *)arg;
-	long ret = -EINVAL;
-	int target_tid;
-	int pFps;
-	struct fps_info fps_info_val, ofi;
-	struct task_struct *task, *tmp_task;
+	struct gpis_group *grp;
 
-	//unsigned long rn_sum = 0, lttl_max_capa = 0;
-	unsigned long rn_sum = 0;
-	unsigned long duration = 0;
-	struct task_fps_util_info *fi, *target_fi = NULL;
-	unsigned long prev_fps_util, new_fps_util;
-	unsigned long fiSize = 0;
-
-	if (!uarg) {
-		pr_err("[GPIS] : invalid user uarg!\n");
-		return -EINVAL;
+	hlist_for_each_entry_rcu(grp,
+			&gpis_group_hash[hash_min(group_id, GPIS_GROUP_HASH_BITS)],
+			node, lockdep_is_held(&gpis_lock)) {
+		if (grp->group_id == group_id)
+			return grp;
 	}
+	return NULL;
+}
 
-	switch (cmd) {
-	case PERF_MGR_FPS_CHANGE:
-		if (copy_from_user(&pFps, uarg, sizeof(int))) {
-			pr_err("[GPIS] :prsc kill: fail to copy from user");
-			return -EFAULT;
-		}
+static int gpis_cmp_dur(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
 
-#ifdef CONFIG_SEC_PERF_MANAGER_MTK
-		if (pFps < 30)
-			return -EFAULT;
+	return x < y ? -1 : x > y;
+}
 
-		trace_printk("[GPIS] ::: FPS Changed (%d -> %d)\n",
-			g_fps, pFps);
+/*
+ * Account a frame of dur ns to grp and return the duration to scale the
+ * utilization by: the larger of the EWMA of the frame durations and their
+ * est_percentile-th percentile over the last est_window frames.  The
+ * percentile keeps periodic janky frames from being averaged away, the
+ * EWMA follows a sustained change before the window has filled with it.
+ * With est_window <= 1 the frame's own duration is used, as it used to be.
+ */
+static u64 gpis_est_update(struct gpis_group *grp, u64 dur)
+{
+	u64 sorted[GPIS_EST_MAX_WINDOW];
+	unsigned int window, shift, pct, idx;
 
-		g_fps = pFps;
+	window = clamp(est_window, 1, GPIS_EST_MAX_WINDOW);
+	shift = clamp(est_ewma_shift, 0, 8);
+	pct = clamp(est_percentile, 1, 100);
 
-		if (g_fps <= 60)
-			fps_margin_percent = 10;
+	grp->ewma = grp->nr_dur ?
+		grp->ewma - (grp->ewma >> shift) + (dur >> shift) : dur;
 
-		us_frame_time = 1000000 / g_fps;
-#endif
-		break;
+	/* est_window may have shrunk since the last frame */
+	if (grp->pos >= window)
+		grp->pos = 0;
+	grp->nr_dur = min(grp->nr_dur, window);
 
-	/*
-	 * There are two cases removing the task from the list.
-	 * F/G Tasks changed and tasks killed.
-	 */
+	grp->dur[grp->pos] = dur;
+	grp->pos = (grp->pos + 1) % window;
+	if (grp->nr_dur < window)
+		grp->nr_dur++;
 
-	case PERF_MGR_PROCESS_KILL:
-		if (copy_from_user(&target_tid, uarg, sizeof(int))) {
-			pr_err("[GPIS] :prsc kill: fail to copy from user");
-			return -EFAULT;
-		}
-		if (fps_task_count <= 1)
-			break;
+	if (window == 1)
+		return dur;
 
-		 /* When drawing action get finished, init boost information */
-		if (target_tid < 0) {
-			rcu_read_lock();
-			list_for_each_entry_rcu(fi, &gpis_hlist, list) {
-				if ( fi == NULL )
-					continue;
-
-				fi->last_update_frame = 0;
-				fi->updated_fps_util = 0;
-				task = find_task_by_vpid( fi->orig_fps_info.tid);
-
-				if (task == NULL ||  fi->orig_fps_info.tid != task->pid)
-					continue;
-
-				get_task_struct(task);
-				task->drawing_mig_boost = 0;
-				put_task_struct(task);
-			}
-			rcu_read_unlock();
-		} else {
-			//Drawing Flag OFF on Task Struct
-			rcu_read_lock();
-			task = find_task_by_vpid(target_tid);
-			if (task != NULL) {
-				get_task_struct(task);
-				task->drawing_flag = 0;
-				put_task_struct(task);
-			}
-			rcu_read_unlock();
-
-			fi = get_target_task(target_tid);
-			if (fi == NULL)
-				break;
-
-			spin_lock(&write_slock);
-			list_del_rcu(&(fi->list));
-			spin_unlock(&write_slock);
-			fps_task_count--;
-			synchronize_rcu();
-			kfree(fi);
-		}
-		trace_printk("[GPIS] ::: Delete TID is %d, Task Cnt : %d\n",
-			target_tid, fps_task_count);
-		break;
+	memcpy(sorted, grp->dur, grp->nr_dur * sizeof(u64));
+	sort(sorted, grp->nr_dur, sizeof(u64), gpis_cmp_dur, NULL);
+	idx = DIV_ROUND_UP(grp->nr_dur * pct, 100) - 1;
 
-	/*
-	 * New tasks start to drawing frames as top-app.
-	 * we add all the new drawing tasks to lists.
-	 */
+	return max(grp->ewma, sorted[idx]);
+}
 
-	case PERF_MGR_TASK_ADD:
-		if (copy_from_user(&fps_info_val, uarg, sizeof(struct fps_info))) {
-			pr_err("[GPIS] : PERF_MGR_TASK_ADD: fail to copy data from user");
-			return -EFAULT;
-		}
+static void gpis_est_reset(void)
+{
+	struct gpis_group *grp;
+	int bkt;
 
-		task = find_task_by_vpid(fps_info_val.tid);
-		if (task == NULL)
-			break;
+	hash_for_each(gpis_group_hash, bkt, grp, node) {
+		grp->nr_dur = 0;
+		grp->pos = 0;
+		grp->ewma = 0;
+	}
+}
 
-		fi = get_target_task(fps_info_val.tid);
-		/* task already exist on drawing task list */
-		if (fi != NULL)
-			break;
+/*
+ * New tasks start to drawing frames as top-app.
+ * we add all the new drawing tasks to lists.
+ */
+static int gpis_task_add(struct fps_info *info)
+{
+	struct task_fps_util_info *fi;
+	struct task_struct *task;
+	struct gpis_group *grp;
 
-		fi = kmalloc(sizeof(struct task_fps_util_info), GFP_KERNEL);
-		if (!fi)
-			return -EAGAIN;
+	lockdep_assert_held(&gpis_lock);
 
-		task->drawing_flag = fps_info_val.group_id;
+	/* task already exist on drawing task list */
+	if (get_target_task(info->tid))
+		return 0;
 
-		fi->orig_fps_info.tid = fps_info_val.tid;
-		fi->orig_fps_info.group_id = fps_info_val.group_id;
-		fi->updated_fps_util = 0;
-		fi->orig_fps_info.boosting_lvl = BOOST_OFF;
+	rcu_read_lock();
+	task = find_task_by_vpid(info->tid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (task == NULL)
+		return 0;
 
-		spin_lock(&write_slock);
-		list_add_tail_rcu(&(fi->list), &gpis_hlist);
-		spin_unlock(&write_slock);
-		fps_task_count++;
-		trace_printk("[GPIS] ::: Add Tid : %d in Group %d, Cnt : %d\n",
-			fi->orig_fps_info.tid, fps_info_val.group_id,
-			fps_task_count);
-		break;
+	fi = kmalloc(sizeof(struct task_fps_util_info), GFP_KERNEL);
+	if (!fi)
+		goto nomem;
 
-	/*
-	 * In case of drawing frames finished, F/W calls this command.
-	 * It checks if it's jank situation.
-	 * if so, calculating fps boosted util on target task.
-	 */
+	grp = gpis_find_group(info->group_id);
+	if (!grp) {
+		grp = kzalloc(sizeof(*grp), GFP_KERNEL);
+		if (!grp) {
+			kfree(fi);
+			goto nomem;
+		}
+		grp->group_id = info->group_id;
+		INIT_LIST_HEAD(&grp->tasks);
+		hash_add_rcu(gpis_group_hash, &grp->node, grp->group_id);
+	}
 
-	case PERF_MGR_FRAME_END:
-		fiSize = sizeof(struct fps_info);
+	task->drawing_flag = info->group_id;
+	put_task_struct(task);
+
+	fi->orig_fps_info.tid = info->tid;
+	fi->orig_fps_info.group_id = info->group_id;
+	fi->orig_fps_info.boosting_lvl = BOOST_OFF;
+	fi->orig_fps_info.duration = 0;
+	fi->updated_fps_util = 0;
+	fi->last_update_frame = 0;
+	fi->group = grp;
+
+	list_add_tail_rcu(&fi->list, &gpis_hlist);
+	hash_add_rcu(gpis_tid_hash, &fi->tid_node, fi->orig_fps_info.tid);
+	list_add_tail_rcu(&fi->group_list, &grp->tasks);
+	grp->nr_tasks++;
+	fps_task_count++;
+	trace_printk("[GPIS] ::: Add Tid : %d in Group %d, Cnt : %d\n",
+		fi->orig_fps_info.tid, info->group_id, fps_task_count);
+	return 0;
 
-		if (copy_from_user(&fps_info_val, uarg, fiSize)) {
-			pr_err("[GPIS] : FrameEnd: fail to copy from user");
-			return -EFAULT;
-		}
-		task = find_task_by_vpid(fps_info_val.tid);
+nomem:
+	put_task_struct(task);
+	return -EAGAIN;
+}
 
-		if (list_empty(&gpis_hlist) || !task || !task->drawing_flag)
-			break;
+/*
+ * There are two cases removing the task from the list.
+ * F/G Tasks changed and tasks killed.
+ */
+static void gpis_task_kill(pid_t target_tid)
+{
+	struct task_fps_util_info *fi;
+	struct task_struct *task;
+	struct gpis_group *grp;
+
+	lockdep_assert_held(&gpis_lock);
 
+	if (fps_task_count <= 1)
+		return;
+
+	 /* When drawing action get finished, init boost information */
+	if (target_tid < 0) {
 		rcu_read_lock();
 		list_for_each_entry_rcu(fi, &gpis_hlist, list) {
-			if (fi == NULL)
+			fi->last_update_frame = 0;
+			fi->updated_fps_util = 0;
+			task = find_task_by_vpid(fi->orig_fps_info.tid);
+
+			if (task == NULL || fi->orig_fps_info.tid != task->pid)
 				continue;
 
-			ofi = fi->orig_fps_info;
+			task->drawing_mig_boost = 0;
+		}
+		rcu_read_unlock();
+		gpis_est_reset();
+	} else {
+		//Drawing Flag OFF on Task Struct
+		rcu_read_lock();
+		task = find_task_by_vpid(target_tid);
+		if (task != NULL)
+			task->drawing_flag = 0;
+		rcu_read_unlock();
+
+		fi = get_target_task(target_tid);
+		if (fi == NULL)
+			return;
+
+		grp = fi->group;
+		list_del_rcu(&fi->list);
+		hash_del_rcu(&fi->tid_node);
+		list_del_rcu(&fi->group_list);
+		if (--grp->nr_tasks == 0) {
+			hash_del_rcu(&grp->node);
+			kfree_rcu(grp, rcu);
+		}
+		fps_task_count--;
+		kfree_rcu(fi, rcu);
+	}
+	trace_printk("[GPIS] ::: Delete TID is %d, Task Cnt : %d\n",
+		target_tid, fps_task_count);
+}
+
+/*
+ * In case of drawing frames finished, F/W calls this command.
+ * It checks if it's jank situation.
+ * if so, calculating fps boosted util on target task.
+ */
+static void gpis_frame_end(struct fps_info *info)
+{
+	struct task_fps_util_info *fi, *target_fi;
+	struct task_struct *task, *tmp_task;
+	struct gpis_group *grp;
+	unsigned long rn_sum = 0;
+	unsigned long duration = 0;
+	unsigned long prev_fps_util, new_fps_util;
+	u64 est;
 
-			if (ofi.tid == fps_info_val.tid)
-				target_fi = fi;
+	lockdep_assert_held(&gpis_lock);
 
+	rcu_read_lock();
+	task = find_task_by_vpid(info->tid);
+	if (!task || !task->drawing_flag)
+		goto out;
+
+	target_fi = get_target_task(info->tid);
+	grp = gpis_find_group(task->drawing_flag);
+	if (target_fi == NULL || grp == NULL) {
+		pr_err("[GPIS] PID %d not found. skip cal util\n", info->tid);
+		goto out;
+	}
+
+	list_for_each_entry(fi, &grp->tasks, group_list) {
 		/*
 		 *Find target task which is drawing the frame currently
 		 *If the drawing task keeps boosting value more than 2 frames,
 		 *we initialize boosting information of the task.
 		 */
-			tmp_task = find_task_by_vpid(ofi.tid);
+		tmp_task = find_task_by_vpid(fi->orig_fps_info.tid);
 
-			if (tmp_task == NULL ||
-				tmp_task->drawing_flag != task->drawing_flag)
-				continue;
-				
-			if (++(fi->last_update_frame) > hold_frame_count) {
-				fi->last_update_frame = 0;
-				fi->updated_fps_util = 0;
-				tmp_task->drawing_mig_boost = 0;
-			}
+		if (tmp_task == NULL ||
+			tmp_task->drawing_flag != task->drawing_flag)
+			continue;
+
+		if (++(fi->last_update_frame) > hold_frame_count) {
+			fi->last_update_frame = 0;
+			fi->updated_fps_util = 0;
+			tmp_task->drawing_mig_boost = 0;
+		}
 
 #ifdef CONFIG_SEC_PERF_MANAGER_MTK
-			rn_sum += get_boosted_task_util(tmp_task);
+		rn_sum += get_boosted_task_util(tmp_task);
 #endif
 #ifdef CONFIG_SEC_PERF_MANAGER_QC
-			rn_sum += get_task_util(tmp_task);
+		rn_sum += get_task_util(tmp_task);
 #endif
+	}
+
+	/* We can choose the maximum value
+	 * between current calculated value and previous saved value.
+	 */
+	prev_fps_util = target_fi->updated_fps_util;
+	est = gpis_est_update(grp, max_t(s64, info->duration, 0));
+	duration = (info->boosting_lvl > BOOST_OFF) ?
+		(us_frame_time * 1000) : est;
+	new_fps_util = calc_fps_required_util(rn_sum, duration);
+
+	if (new_fps_util > 0 && info->boosting_lvl != BOOST_LOW) {
+		list_for_each_entry(fi, &grp->tasks, group_list) {
+			tmp_task = find_task_by_vpid(fi->orig_fps_info.tid);
+			if (tmp_task != NULL)
+				tmp_task->drawing_mig_boost = 1;
 		}
-		rcu_read_unlock();
+	}
+
+	/* Once we can choose boosted values between new and prev,
+	 * initialize update info
+	 */
+
+	if (info->boosting_lvl != BOOST_MID) {
+		target_fi->updated_fps_util =
+			max(target_fi->updated_fps_util, new_fps_util);
+	} else {
+		target_fi->updated_fps_util = 0;
+	}
+
+	if (target_fi->updated_fps_util != prev_fps_util)
+		target_fi->last_update_frame = 0;
+
+	trace_printk("[GPIS] FPS, Tid, Mig, CalUtil = %d, %d, %d, %lu\n",
+		g_fps, target_fi->orig_fps_info.tid,
+		task->drawing_mig_boost, new_fps_util);
+out:
+	rcu_read_unlock();
+}
 
-		if (target_fi == NULL) {
-			pr_err("[GPIS] PID %d not found. skip cal util\n",
-				fps_info_val.tid);
+/* Returns the number of entries handled before the first failure. */
+static int gpis_batch_run(unsigned int cmd, struct fps_info *infos, int nr)
+{
+	int i, err;
+
+	lockdep_assert_held(&gpis_lock);
+
+	for (i = 0; i < nr; i++) {
+		switch (cmd) {
+		case TASK_ADD:
+			err = gpis_task_add(&infos[i]);
+			if (err)
+				return i ? i : err;
+			break;
+		case FRAME_END:
+			gpis_frame_end(&infos[i]);
 			break;
+		case PROCESS_KILL:
+			gpis_task_kill(infos[i].tid);
+			break;
+		default:
+			return -EINVAL;
 		}
+	}
+	return nr;
+}
 
-		/* We can choose the maximum value
-		 * between current calculated value and previous saved value.
-		 */
-		prev_fps_util = target_fi->updated_fps_util;
-		duration = (fps_info_val.boosting_lvl > BOOST_OFF) ?
-			(us_frame_time * 1000) : fps_info_val.duration;
-		new_fps_util = calc_fps_required_util(rn_sum, duration);
-
-		if (new_fps_util > 0 &&
-			fps_info_val.boosting_lvl != BOOST_LOW) {
-			rcu_read_lock();
-			list_for_each_entry_rcu(fi, &gpis_hlist, list) {
-				ofi = fi->orig_fps_info;
-				if (ofi.group_id == task->drawing_flag) {
-					tmp_task = find_task_by_vpid(ofi.tid);
-					if (tmp_task != NULL)
-						tmp_task->drawing_mig_boost = 1;
-				}
-			}
-			rcu_read_unlock();
+/*
+ * The F/W reports every drawing thread of a frame, so one call per frame
+ * instead of one per thread saves most of the syscall and lock overhead.
+ * Entries are copied in chunks, the lock is taken once per chunk.
+ */
+static long gpis_batch(struct fps_info_batch __user *ubatch)
+{
+	struct fps_info infos[GPIS_BATCH_CHUNK];
+	struct fps_info __user *uinfos;
+	struct fps_info_batch batch;
+	u32 done = 0, n;
+	int ret = 0;
+
+	if (copy_from_user(&batch, ubatch, sizeof(batch))) {
+		pr_err("[GPIS] : batch: fail to copy from user");
+		return -EFAULT;
+	}
+	if (batch.cmd != TASK_ADD && batch.cmd != FRAME_END &&
+	    batch.cmd != PROCESS_KILL)
+		return -EINVAL;
+	if (batch.nr > GPIS_BATCH_MAX)
+		return -E2BIG;
+
+	uinfos = u64_to_user_ptr(batch.infos);
+	while (done < batch.nr) {
+		n = min_t(u32, batch.nr - done, GPIS_BATCH_CHUNK);
+		if (copy_from_user(infos, uinfos + done, n * sizeof(*infos))) {
+			ret = -EFAULT;
+			break;
 		}
 
-		/* Once we can choose boosted values between new and prev,
-		 * initialize update info
-		 */
+		mutex_lock(&gpis_lock);
+		ret = gpis_batch_run(batch.cmd, infos, n);
+		mutex_unlock(&gpis_lock);
+		if (ret < 0)
+			break;
+		done += ret;
+		if (ret < n)
+			break;
+	}
+
+	return done ? done : ret;
+}
+
+static long perf_mgr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	void __user *uarg = (void __user *)arg;
+	long ret = -EINVAL;
+	int target_tid;
+	int pFps;
+	struct fps_info fps_info_val;
+	int err;
+
+	if (!uarg) {
+		pr_err("[GPIS] : invalid user uarg!\n");
+		return -EINVAL;
+	}
 
-		if (fps_info_val.boosting_lvl != BOOST_MID) {
-			target_fi->updated_fps_util =
-				max(target_fi->updated_fps_util, new_fps_util);
-		} else {
-			target_fi->updated_fps_util = 0;
+	switch (cmd) {
+	case PERF_MGR_FPS_CHANGE:
+		if (copy_from_user(&pFps, uarg, sizeof(int))) {
+			pr_err("[GPIS] :prsc kill: fail to copy from user");
+			return -EFAULT;
 		}
 
-		if (target_fi->updated_fps_util != prev_fps_util)
-			target_fi->last_update_frame = 0;
+#ifdef CONFIG_SEC_PERF_MANAGER_MTK
+		if (pFps < 30)
+			return -EFAULT;
+
+		trace_printk("[GPIS] ::: FPS Changed (%d -> %d)\n",
+			g_fps, pFps);
+
+		g_fps = pFps;
+
+		if (g_fps <= 60)
+			fps_margin_percent = 10;
+
+		us_frame_time = 1000000 / g_fps;
+#endif
+		break;
+
+	case PERF_MGR_PROCESS_KILL:
+		if (copy_from_user(&target_tid, uarg, sizeof(int))) {
+			pr_err("[GPIS] :prsc kill: fail to copy from user");
+			return -EFAULT;
+		}
+		mutex_lock(&gpis_lock);
+		gpis_task_kill(target_tid);
+		mutex_unlock(&gpis_lock);
+		break;
 
-		trace_printk("[GPIS] FPS, Tid, Mig, CalUtil = %d, %d, %d, %lu\n",
-			g_fps, target_fi->orig_fps_info.tid,
-			task->drawing_mig_boost, new_fps_util);
+	case PERF_MGR_TASK_ADD:
+		if (copy_from_user(&fps_info_val, uarg, sizeof(struct fps_info))) {
+			pr_err("[GPIS] : PERF_MGR_TASK_ADD: fail to copy data from user");
+			return -EFAULT;
+		}
+		mutex_lock(&gpis_lock);
+		err = gpis_task_add(&fps_info_val);
+		mutex_unlock(&gpis_lock);
+		if (err)
+			return err;
+		break;
 
+	case PERF_MGR_FRAME_END:
+		if (copy_from_user(&fps_info_val, uarg, sizeof(struct fps_info))) {
+			pr_err("[GPIS] : FrameEnd: fail to copy from user");
+			return -EFAULT;
+		}
+		mutex_lock(&gpis_lock);
+		gpis_frame_end(&fps_info_val);
+		mutex_unlock(&gpis_lock);
 		break;
+
+	case PERF_MGR_BATCH:
+		return gpis_batch(uarg);
+
 	default:
 		break;
 	}
@@ -303,40 +520,35 @@ static long perf_mgr_ioctl(struct file *file, unsigned int cmd, unsigned long ar
 
 static struct task_fps_util_info *get_target_task(pid_t tid)
 {
+	struct task_fps_util_info *fi;
 
-	struct task_fps_util_info *fi = NULL, *ret_fi = NULL;
-
-	if (list_empty(&gpis_hlist))
-		return NULL;
-
-	rcu_read_lock();
-	list_for_each_entry_rcu(fi, &gpis_hlist, list) {
-		if (fi != NULL && fi->orig_fps_info.tid == tid) {
-			ret_fi = fi;
-			break;
-		}
+	hlist_for_each_entry_rcu(fi,
+			&gpis_tid_hash[hash_min(tid, GPIS_TID_HASH_BITS)],
+			tid_node, lockdep_is_held(&gpis_lock)) {
+		if (fi->orig_fps_info.tid == tid)
+			return fi;
 	}
-	rcu_read_unlock();
-
-	return ret_fi;
+	return NULL;
 }
 
 unsigned long get_max_fps_util(int group_id)
 {
 
 	struct task_fps_util_info *fi = NULL;
+	struct gpis_group *grp;
 	unsigned long max_util = 0;
 
-	if (fps_task_count <= 1 || list_empty(&gpis_hlist))
+	if (fps_task_count <= 1)
 		return 0;
 
 	rcu_read_lock();
-		list_for_each_entry_rcu(fi, &gpis_hlist, list) {
-			if (fi != NULL &&
-				fi->orig_fps_info.group_id == group_id &&
-				fi->updated_fps_util > max_util)
+	grp = gpis_find_group(group_id);
+	if (grp) {
+		list_for_each_entry_rcu(fi, &grp->tasks, group_list) {
+			if (fi->updated_fps_util > max_util)
 				max_util = fi->updated_fps_util;
 		}
+	}
 	rcu_read_unlock();
 
 	return max_util;
@@ -452,9 +664,57 @@ static ssize_t hold_frame_count_store(struct kobject *kobj,
 
 perf_attr(hold_frame_count);
 
+static ssize_t est_window_show(struct kobject *kobj,
+			struct kobj_attribute *attr, char *buf)
+{
+		return snprintf(buf, MAX_INSERT_DIGIT, "%d\n", est_window);
+}
+
+static ssize_t est_window_store(struct kobject *kobj,
+			struct kobj_attribute *attr, const char *buf, size_t n)
+{
+		sscanf(buf, "%du", &est_window);
+		return n;
+}
+
+perf_attr(est_window);
+
+static ssize_t est_percentile_show(struct kobject *kobj,
+			struct kobj_attribute *attr, char *buf)
+{
+		return snprintf(buf, MAX_INSERT_DIGIT, "%d\n", est_percentile);
+}
+
+static ssize_t est_percentile_store(struct kobject *kobj,
+			struct kobj_attribute *attr, const char *buf, size_t n)
+{
+		sscanf(buf, "%du", &est_percentile);
+		return n;
+}
+
+perf_attr(est_percentile);
+
+static ssize_t est_ewma_shift_show(struct kobject *kobj,
+			struct kobj_attribute *attr, char *buf)
+{
+		return snprintf(buf, MAX_INSERT_DIGIT, "%d\n", est_ewma_shift);
+}
+
+static ssize_t est_ewma_shift_store(struct kobject *kobj,
+			struct kobj_attribute *attr, const char *buf, size_t n)
+{
+		sscanf(buf, "%du", &est_ewma_shift);
+		return n;
+}
+
+perf_attr(est_ewma_shift);
+
 static struct attribute *g[] = {
 	&fps_margin_percent_attr.attr,
 	&hold_frame_count_attr.attr,
+	&est_window_attr.attr,
+	&est_percentile_attr.attr,
+	&est_ewma_shift_attr.attr,
 	NULL,
 };
 
@@ -489,7 +749,6 @@ static int __init perf_mgr_dev_init(void)
 	}
 
 	INIT_LIST_HEAD(&gpis_hlist);
-	spin_lock_init(&write_slock);
 
 	s = kmalloc(sizeof(struct task_fps_util_info), GFP_KERNEL);
 	if (s == NULL)
@@ -500,11 +759,16 @@ static int __init perf_mgr_dev_init(void)
 	g_fps = 0;
 	fps_margin_percent = 30;
 	hold_frame_count = 2;
+	est_window = 16;
+	est_percentile = 90;
+	est_ewma_shift = 3;
 
 	s->orig_fps_info.tid = 0;
 	s->orig_fps_info.duration = 0;
 	s->updated_fps_util = 0;
 	s->running_cpu = 9999;
+	s->last_update_frame = 0;
+	s->group = NULL;
 	fps_task_count++;
 	list_add_tail(&(s->list), &gpis_hlist);
 
@@ -521,3 +785,7 @@ static void  __exit perf_mgr_dev_exit(void)
 
 module_init(perf_mgr_dev_init);
 module_exit(perf_mgr_dev_exit);
+
+#ifdef CONFIG_SEC_PERF_MANAGER_KUNIT_TEST
+#include "perf_mgr_test.c"
+#endif
@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit test of the GPIS frame duration estimator and FRAME_END cost.
+ *
+ * Included at the end of perf_mgr.c, so that the static helpers can be
+ * called directly.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#define MS(x)	((u64)(x) * NSEC_PER_MSEC)
+
+/* A FRAME_END must stay a small fraction of a 120Hz frame. */
+#define GPIS_TEST_FRAME_END_BUDGET_NS	(100 * NSEC_PER_USEC)
+#define GPIS_TEST_NR_FRAMES		1024
+#define GPIS_TEST_GROUP			4242
+
+struct gpis_test_params {
+	int window, pct, shift;
+};
+
+static void gpis_test_set_params(struct gpis_test_params *saved,
+				 int window, int pct, int shift)
+{
+	saved->window = est_window;
+	saved->pct = est_percentile;
+	saved->shift = est_ewma_shift;
+	est_window = window;
+	est_percentile = pct;
+	est_ewma_shift = shift;
+}
+
+static void gpis_test_restore_params(struct gpis_test_params *saved)
+{
+	est_window = saved->window;
+	est_percentile = saved->pct;
+	est_ewma_shift = saved->shift;
+}
+
+static struct gpis_group *gpis_test_group(struct kunit *test)
+{
+	struct gpis_group *grp = kunit_kzalloc(test, sizeof(*grp), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, grp);
+	INIT_LIST_HEAD(&grp->tasks);
+	return grp;
+}
+
+/* A steady frame time is estimated exactly. */
+static void perf_mgr_test_est_steady(struct kunit *test)
+{
+	struct gpis_group *grp = gpis_test_group(test);
+	struct gpis_test_params saved;
+	u64 est = 0;
+	int i;
+
+	gpis_test_set_params(&saved, 16, 90, 3);
+	for (i = 0; i < 64; i++)
+		est = gpis_est_update(grp, MS(8));
+	gpis_test_restore_params(&saved);
+
+	KUNIT_EXPECT_EQ(test, MS(8), est);
+}
+
+/*
+ * Every tenth frame is a 16ms jank in an 8ms stream.  The 95th percentile
+ * of a 20 frame window sees the janks, the 90th percentile doesn't and is
+ * left with the EWMA, which must stay close to the 8.8ms mean.
+ */
+static void perf_mgr_test_est_spikes(struct kunit *test)
+{
+	struct gpis_group *grp = gpis_test_group(test);
+	struct gpis_test_params saved;
+	u64 est = 0;
+	int i;
+
+	gpis_test_set_params(&saved, 20, 95, 3);
+	for (i = 0; i < 100; i++)
+		est = gpis_est_update(grp, i % 10 ? MS(8) : MS(16));
+	KUNIT_EXPECT_EQ(test, MS(16), est);
+
+	est_percentile = 90;
+	for (i = 0; i < 100; i++) {
+		est = gpis_est_update(grp, i % 10 ? MS(8) : MS(16));
+		KUNIT_EXPECT_GE(test, est, MS(8));
+		KUNIT_EXPECT_LE(test, est, MS(10));
+	}
+	gpis_test_restore_params(&saved);
+}
+
+/*
+ * A step up is picked up as soon as it makes the percentile, a step back
+ * down once the EWMA has decayed.
+ */
+static void perf_mgr_test_est_step(struct kunit *test)
+{
+	struct gpis_group *grp = gpis_test_group(test);
+	struct gpis_test_params saved;
+	u64 est = 0;
+	int i;
+
+	gpis_test_set_params(&saved, 16, 90, 3);
+	for (i = 0; i < 32; i++)
+		est = gpis_est_update(grp, MS(8));
+
+	/* 2 of 16 frames are above the 90th percentile */
+	gpis_est_update(grp, MS(12));
+	est = gpis_est_update(grp, MS(12));
+	KUNIT_EXPECT_EQ(test, MS(12), est);
+
+	for (i = 0; i < 32; i++)
+		est = gpis_est_update(grp, MS(12));
+	KUNIT_EXPECT_EQ(test, MS(12), est);
+
+	for (i = 0; i < 48; i++)
+		est = gpis_est_update(grp, MS(8));
+	gpis_test_restore_params(&saved);
+
+	KUNIT_EXPECT_GE(test, est, MS(8));
+	KUNIT_EXPECT_LT(test, est, MS(8) + 100 * NSEC_PER_USEC);
+}
+
+/* With a window of one frame, the frame's own duration is used. */
+static void perf_mgr_test_est_single(struct kunit *test)
+{
+	struct gpis_group *grp = gpis_test_group(test);
+	struct gpis_test_params saved;
+
+	gpis_test_set_params(&saved, 1, 90, 3);
+	gpis_est_update(grp, MS(16));
+	KUNIT_EXPECT_EQ(test, MS(8), gpis_est_update(grp, MS(8)));
+	KUNIT_EXPECT_EQ(test, MS(20), gpis_est_update(grp, MS(20)));
+	gpis_test_restore_params(&saved);
+}
+
+/* A 16.6ms frame at 120Hz needs twice the utilization. */
+static void perf_mgr_test_required_util(struct kunit *test)
+{
+	int fps = g_fps, margin = fps_margin_percent;
+	unsigned long frame_time = us_frame_time;
+
+	g_fps = 120;
+	us_frame_time = 1000000 / g_fps;
+	fps_margin_percent = 0;
+
+	KUNIT_EXPECT_EQ(test, 800UL, calc_fps_required_util(400, 16666000));
+	KUNIT_EXPECT_EQ(test, 0UL, calc_fps_required_util(400, MS(8)));
+	KUNIT_EXPECT_EQ(test, 1024UL, calc_fps_required_util(800, MS(50)));
+
+	g_fps = fps;
+	us_frame_time = frame_time;
+	fps_margin_percent = margin;
+}
+
+/*
+ * Time FRAME_END for the current task, one locked call per frame as the
+ * single ioctl does it and GPIS_BATCH_CHUNK frames per lock as
+ * PERF_MGR_BATCH does it.  The syscall and copy overhead that batching
+ * saves isn't part of this, it's about the table and estimator staying
+ * cheap.
+ */
+static void perf_mgr_test_frame_end_cost(struct kunit *test)
+{
+	struct fps_info info = {
+		.tid = current->pid,
+		.group_id = GPIS_TEST_GROUP,
+		.boosting_lvl = BOOST_OFF,
+		.duration = MS(8),
+	};
+	struct task_fps_util_info *fi;
+	struct fps_info *infos;
+	u64 start, single_ns, batch_ns;
+	int i, n;
+
+	infos = kunit_kzalloc(test, GPIS_BATCH_CHUNK * sizeof(*infos),
+			      GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, infos);
+	for (i = 0; i < GPIS_BATCH_CHUNK; i++)
+		infos[i] = info;
+
+	mutex_lock(&gpis_lock);
+	KUNIT_EXPECT_EQ(test, 0, gpis_task_add(&info));
+	fi = get_target_task(current->pid);
+	mutex_unlock(&gpis_lock);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, fi);
+
+	start = ktime_get_ns();
+	for (i = 0; i < GPIS_TEST_NR_FRAMES; i++) {
+		mutex_lock(&gpis_lock);
+		gpis_frame_end(&info);
+		mutex_unlock(&gpis_lock);
+	}
+	single_ns = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < GPIS_TEST_NR_FRAMES; i += n) {
+		mutex_lock(&gpis_lock);
+		n = gpis_batch_run(FRAME_END, infos, GPIS_BATCH_CHUNK);
+		mutex_unlock(&gpis_lock);
+		KUNIT_ASSERT_EQ(test, GPIS_BATCH_CHUNK, n);
+	}
+	batch_ns = ktime_get_ns() - start;
+
+	mutex_lock(&gpis_lock);
+	gpis_task_kill(current->pid);
+	fi = get_target_task(current->pid);
+	mutex_unlock(&gpis_lock);
+	KUNIT_EXPECT_PTR_EQ(test, NULL, fi);
+	KUNIT_EXPECT_EQ(test, 0, current->drawing_flag);
+
+	kunit_info(test, "FRAME_END: %llu nsec single, %llu nsec batched\n",
+		   div_u64(single_ns, GPIS_TEST_NR_FRAMES),
+		   div_u64(batch_ns, GPIS_TEST_NR_FRAMES));
+	KUNIT_EXPECT_LT(test, div_u64(single_ns, GPIS_TEST_NR_FRAMES),
+			(u64)GPIS_TEST_FRAME_END_BUDGET_NS);
+	KUNIT_EXPECT_LT(test, div_u64(batch_ns, GPIS_TEST_NR_FRAMES),
+			(u64)GPIS_TEST_FRAME_END_BUDGET_NS);
+}
+
+static struct kunit_case perf_mgr_test_cases[] = {
+	KUNIT_CASE(perf_mgr_test_est_steady),
+	KUNIT_CASE(perf_mgr_test_est_spikes),
+	KUNIT_CASE(perf_mgr_test_est_step),
+	KUNIT_CASE(perf_mgr_test_est_single),
+	KUNIT_CASE(perf_mgr_test_required_util),
+	KUNIT_CASE(perf_mgr_test_frame_end_cost),
+	{}
+};
+
+static struct kunit_suite perf_mgr_test_suite = {
+	.name = "perf_mgr",
+	.test_cases = perf_mgr_test_cases,
+};
+
+kunit_test_suite(perf_mgr_test_suite);
@@ -17,6 +17,11 @@
 #include <net/sock.h>
 #include <linux/hrtimer.h>
 #include <linux/proc_fs.h>
+#include <linux/miscdevice.h>
+#include <linux/vmalloc.h>
+#include <linux/poll.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 
 #define RET_OK   0
@@ -39,6 +44,35 @@ struct priv_data
 
 static freecess_hook mod_recv_handler[MOD_END];
 
+/* Shared memory report channel, see kfreecess_ring_hdr */
+#define RING_RECENT_BITS 6
+
+struct kfreecess_ring
+{
+	struct kfreecess_ring_hdr *hdr;
+	struct kfreecess_msg_data *slots;
+	unsigned int mask;
+	size_t size;
+	int mod;
+	wait_queue_head_t wait;
+	struct {		    //last delivered binder reports
+		int uid;
+		int code;
+		u64 stamp;
+	} recent[1 << RING_RECENT_BITS];
+};
+
+static struct kfreecess_ring *kfreecess_rings[MOD_END];
+static DEFINE_SPINLOCK(kfreecess_ring_lock);
+
+static unsigned int ring_slots = 1024;
+module_param(ring_slots, uint, 0444);
+MODULE_PARM_DESC(ring_slots, "Number of reports a ring holds");
+
+static unsigned int coalesce_ms = 100;
+module_param(coalesce_ms, uint, 0644);
+MODULE_PARM_DESC(coalesce_ms, "Window for coalescing repeated binder reports, 0 to disable");
+
 static int check_msg_type(int type)
 {
 	return (type < MSG_TYPE_END) && (type > 0);
@@ -74,12 +108,114 @@ static void dump_kfreecess_msg(struct kfreecess_msg_data *msg)
 }
 
 
+static void fill_msg(struct kfreecess_msg_data *payload, int type, int mod,
+		     struct priv_data *data)
+{
+	payload->type = type;
+	payload->mod = mod;
+	payload->src_portid = KERNEL_ID_NETLINK;
+	payload->dst_portid = atomic_read(&bind_port[mod]);
+	payload->version = FREECESS_PACK_VERSION(FREECESS_KERNEL_VERSION);
+
+	if (data) {
+		payload->target_uid = data->target_uid;
+		if (payload->mod == MOD_BINDER) {
+			payload->code = data->code;
+			memcpy(payload->rpcname, data->rpcname, sizeof(data->rpcname));
+			payload->pkg_info.cmd = data->pkg_info.cmd;
+		}
+		if (payload->mod == MOD_PKG)
+			memcpy(&payload->pkg_info, &data->pkg_info, sizeof(pkg_info_t));
+		else
+			payload->flag = data->flag;
+	}
+}
+
+/*
+ * Binder storms to a frozen app repeat the same uid/code over and over, the
+ * FW only needs to hear about it once per window. Called with
+ * kfreecess_ring_lock held.
+ */
+static int ring_coalesce(struct kfreecess_ring *ring,
+			 struct kfreecess_msg_data *msg, u64 now)
+{
+	unsigned int i;
+
+	if (msg->mod != MOD_BINDER || !coalesce_ms)
+		return 0;
+
+	i = hash_32((u32)msg->target_uid ^ ((u32)msg->code << 16),
+		    RING_RECENT_BITS);
+	return ring->recent[i].uid == msg->target_uid &&
+	       ring->recent[i].code == msg->code &&
+	       now - ring->recent[i].stamp < (u64)coalesce_ms * NSEC_PER_MSEC;
+}
+
+static void ring_remember(struct kfreecess_ring *ring,
+			  struct kfreecess_msg_data *msg, u64 now)
+{
+	unsigned int i;
+
+	if (msg->mod != MOD_BINDER)
+		return;
+
+	i = hash_32((u32)msg->target_uid ^ ((u32)msg->code << 16),
+		    RING_RECENT_BITS);
+	ring->recent[i].uid = msg->target_uid;
+	ring->recent[i].code = msg->code;
+	ring->recent[i].stamp = now;
+}
+
+/* Queue a report on its mod's ring, -ENODEV if the FW hasn't bound one. */
+static int ring_sendmsg(struct kfreecess_msg_data *msg)
+{
+	struct kfreecess_ring *ring;
+	struct kfreecess_ring_hdr *hdr;
+	unsigned int head, tail;
+	unsigned long flags;
+	u64 now = ktime_get_ns();
+	int ret = 0;
+
+	spin_lock_irqsave(&kfreecess_ring_lock, flags);
+	ring = kfreecess_rings[msg->mod];
+	if (!ring) {
+		ret = -ENODEV;
+		goto out;
+	}
+	hdr = ring->hdr;
+
+	if (ring_coalesce(ring, msg, now)) {
+		hdr->coalesced++;
+		goto out;
+	}
+
+	/* tail comes from the FW, a bogus one just makes the ring look full */
+	head = hdr->head;
+	tail = smp_load_acquire(&hdr->tail);
+	if (head - tail > ring->mask) {
+		hdr->dropped++;
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	ring->slots[head & ring->mask] = *msg;
+	smp_store_release(&hdr->head, head + 1);
+	ring_remember(ring, msg, now);
+
+	if (wq_has_sleeper(&ring->wait))
+		wake_up_interruptible_poll(&ring->wait, EPOLLIN | EPOLLRDNORM);
+out:
+	spin_unlock_irqrestore(&kfreecess_ring_lock, flags);
+	return ret;
+}
+
 int mod_sendmsg(int type, int mod, struct priv_data* data)
 {
 	int ret, msg_len = 0;
 	struct sk_buff *skb = NULL;
 	struct nlmsghdr *nlh = NULL;
 	struct kfreecess_msg_data *payload = NULL;
+	struct kfreecess_msg_data msg;
 
 	if (!atomic_read(&kfreecess_init_suc))
 		return RET_ERR;
@@ -95,6 +231,15 @@ int mod_sendmsg(int type, int mod, struct priv_data* data)
 	}
 
 	msg_len = sizeof(struct	kfreecess_msg_data);
+	memset(&msg, 0, msg_len);
+	fill_msg(&msg, type, mod, data);
+
+	if (type == MSG_TO_USER) {
+		ret = ring_sendmsg(&msg);
+		if (ret != -ENODEV)
+			return ret ? RET_ERR : RET_OK;
+	}
+
 	skb = nlmsg_new(msg_len, GFP_ATOMIC);
 	if (!skb) {
 		pr_err("%s alloc_skb failed! %d\n", __func__, mod);
@@ -108,24 +253,7 @@ int mod_sendmsg(int type, int mod, struct priv_data* data)
 	}
 
 	payload = nlmsg_data(nlh);
-	payload->type = type;
-	payload->mod = mod;
-	payload->src_portid = KERNEL_ID_NETLINK;
-	payload->dst_portid = atomic_read(&bind_port[mod]);
-	payload->version = FREECESS_PACK_VERSION(FREECESS_KERNEL_VERSION);
-
-	if (data) {
-		payload->target_uid = data->target_uid;
-		if (payload->mod == MOD_BINDER) {
-			payload->code = data->code;
-			memcpy(payload->rpcname, data->rpcname, sizeof(data->rpcname));
-			payload->pkg_info.cmd = data->pkg_info.cmd;
-		}
-		if (payload->mod == MOD_PKG)
-			memcpy(&payload->pkg_info, &data->pkg_info, sizeof(pkg_info_t));
-		else
-			payload->flag = data->flag;
-	}
+	memcpy(payload, &msg, msg_len);
 	if ((ret = nlmsg_unicast(kfreecess_mod_sock, skb, payload->dst_portid)) < 0) {
 		pr_err("nlmsg_unicast failed! %s errno %d\n", __func__ , ret);
 		return RET_ERR;
@@ -168,6 +296,7 @@ int binder_report(struct task_struct *p, int code, const char *str, int flag)
 	ret = mod_sendmsg(MSG_TO_USER, MOD_BINDER, &data);
 	return ret;
 }
+EXPORT_SYMBOL_GPL(binder_report);
 
 int pkg_report(int target_uid)
 {
@@ -275,6 +404,140 @@ int unregister_kfreecess_hook(int mod)
 	return RET_OK;
 }
 
+static int kfreecess_open(struct inode *inode, struct file *file)
+{
+	//only allow system user to communicate with Freecess kernel part.
+	if (current_uid().val != 1000 && !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	file->private_data = NULL;
+	return nonseekable_open(inode, file);
+}
+
+static int kfreecess_bind(struct file *file, int mod)
+{
+	struct kfreecess_ring *ring;
+	unsigned int nr_slots, slot_offset;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!check_mod_type(mod))
+		return -EINVAL;
+	/* Rechecked under kfreecess_ring_lock, binds may race. */
+	if (READ_ONCE(file->private_data))
+		return -EBUSY;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	nr_slots = roundup_pow_of_two(clamp(ring_slots, 16U, 65536U));
+	slot_offset = ALIGN(sizeof(struct kfreecess_ring_hdr), 64);
+	ring->size = PAGE_ALIGN(slot_offset +
+				nr_slots * sizeof(struct kfreecess_msg_data));
+	ring->hdr = vmalloc_user(ring->size);
+	if (!ring->hdr) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	ring->hdr->version = FREECESS_RING_VERSION;
+	ring->hdr->nr_slots = nr_slots;
+	ring->hdr->slot_offset = slot_offset;
+	ring->hdr->slot_size = sizeof(struct kfreecess_msg_data);
+	ring->slots = (void *)ring->hdr + slot_offset;
+	ring->mask = nr_slots - 1;
+	ring->mod = mod;
+	init_waitqueue_head(&ring->wait);
+
+	spin_lock_irqsave(&kfreecess_ring_lock, flags);
+	if (file->private_data || kfreecess_rings[mod]) {
+		ret = -EBUSY;
+	} else {
+		kfreecess_rings[mod] = ring;
+		WRITE_ONCE(file->private_data, ring);
+	}
+	spin_unlock_irqrestore(&kfreecess_ring_lock, flags);
+
+	if (ret) {
+		vfree(ring->hdr);
+		kfree(ring);
+	}
+	return ret;
+}
+
+static long kfreecess_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	switch (cmd) {
+	case FREECESS_IOC_BIND:
+		return kfreecess_bind(file, (int)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int kfreecess_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct kfreecess_ring *ring = file->private_data;
+
+	if (!ring)
+		return -EINVAL;
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > ring->size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->hdr, 0);
+}
+
+static __poll_t kfreecess_poll(struct file *file, poll_table *wait)
+{
+	struct kfreecess_ring *ring = file->private_data;
+
+	if (!ring)
+		return EPOLLERR;
+
+	poll_wait(file, &ring->wait, wait);
+	if (smp_load_acquire(&ring->hdr->head) != READ_ONCE(ring->hdr->tail))
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+static int kfreecess_release(struct inode *inode, struct file *file)
+{
+	struct kfreecess_ring *ring = file->private_data;
+	unsigned long flags;
+
+	if (!ring)
+		return 0;
+
+	/* reports go back to netlink until the FW binds again */
+	spin_lock_irqsave(&kfreecess_ring_lock, flags);
+	kfreecess_rings[ring->mod] = NULL;
+	spin_unlock_irqrestore(&kfreecess_ring_lock, flags);
+
+	vfree(ring->hdr);
+	kfree(ring);
+	return 0;
+}
+
+static const struct file_operations kfreecess_fops = {
+	.owner		= THIS_MODULE,
+	.open		= kfreecess_open,
+	.unlocked_ioctl	= kfreecess_ioctl,
+	.compat_ioctl	= kfreecess_ioctl,
+	.mmap		= kfreecess_mmap,
+	.poll		= kfreecess_poll,
+	.release	= kfreecess_release,
+	.llseek		= no_llseek,
+};
+
+static struct miscdevice kfreecess_misc = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "freecess",
+	.fops	= &kfreecess_fops,
+};
+static bool kfreecess_misc_registered;
+
 static int __init kfreecess_init(void)
 {
 	int ret = RET_ERR;
@@ -292,12 +555,20 @@ static int __init kfreecess_init(void)
 	for(i = 1; i<MOD_END; i++)
 		atomic_set(&bind_port[i], 0);
 
+	//the ring channel is optional, netlink keeps working without it
+	if (misc_register(&kfreecess_misc))
+		pr_err("%s: register /dev/freecess failed!\n", __func__);
+	else
+		kfreecess_misc_registered = true;
+
 	atomic_set(&kfreecess_init_suc, 1);
 	return RET_OK;
 }
 
 static void __exit kfreecess_exit(void)
 {
+	if (kfreecess_misc_registered)
+		misc_deregister(&kfreecess_misc);
 	if (kfreecess_mod_sock)
 		netlink_kernel_release(kfreecess_mod_sock);
 }
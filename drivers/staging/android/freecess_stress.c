@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Stress module for the freecess report channel.
+ *
+ * One kthread per online CPU fires nr_reports binder_report() calls, with a
+ * delay of gap_us between them. Each thread reports as its own uid
+ * (UID_MIN_VALUE + cpu) and cycles through its own nr_codes transaction
+ * codes, so reports only coalesce when a uid/code pair repeats within the
+ * coalesce window. The CPU time spent per report and the number of reports
+ * that failed (ring full, or skb allocation/unicast failures on netlink)
+ * are printed.
+ *
+ * Each report carries the CLOCK_MONOTONIC time it was sent at, in usec
+ * truncated to 32 bits, in its flag field. Run
+ * tools/testing/selftests/android/freecess/freecess_reader, which binds the
+ * ring (or netlink with -n) like the FW does, before loading this module to
+ * get the delivery latency as seen by the reader.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/freecess.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cred.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+
+static int nr_reports = 100000;
+module_param(nr_reports, int, 0444);
+MODULE_PARM_DESC(nr_reports, "Number of binder reports fired by each CPU");
+
+static int nr_codes = 1024;
+module_param(nr_codes, int, 0444);
+MODULE_PARM_DESC(nr_codes, "Number of distinct transaction codes each CPU reports");
+
+static int gap_us;
+module_param(gap_us, int, 0444);
+MODULE_PARM_DESC(gap_us, "Delay between two reports of one CPU");
+
+struct stress_thread {
+	int cpu;
+	u64 failed;
+	u64 nsec;
+};
+
+static atomic_t nr_running;
+static DECLARE_COMPLETION(all_done);
+
+static int stress_func(void *private)
+{
+	struct stress_thread *t = private;
+	struct cred *cred;
+	u64 start;
+	int i, stamp;
+
+	/* binder_report() takes the uid of the task it's given */
+	cred = prepare_creds();
+	if (cred) {
+		cred->uid = KUIDT_INIT(UID_MIN_VALUE + t->cpu);
+		commit_creds(cred);
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr_reports; i++) {
+		stamp = (int)div_u64(ktime_get_ns(), NSEC_PER_USEC);
+		if (binder_report(current, t->cpu * nr_codes + i % nr_codes,
+				  "android.freecess.IStress", stamp))
+			t->failed++;
+
+		if (gap_us)
+			udelay(gap_us);
+		if (!(i & 1023))
+			cond_resched();
+	}
+	t->nsec = ktime_get_ns() - start;
+
+	if (atomic_dec_and_test(&nr_running))
+		complete(&all_done);
+	return 0;
+}
+
+static int freecess_stress_init(void)
+{
+	u64 reports = 0, failed = 0, busy = 0;
+	struct stress_thread *threads;
+	struct task_struct *task;
+	int cpu;
+
+	if (nr_reports <= 0 || nr_codes <= 0 || gap_us < 0)
+		return -EINVAL;
+
+	threads = kcalloc(nr_cpu_ids, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	/* Our own reference, so that early finishers can't complete */
+	atomic_set(&nr_running, 1);
+	for_each_online_cpu(cpu) {
+		threads[cpu].cpu = cpu;
+		task = kthread_create_on_cpu(stress_func, &threads[cpu], cpu,
+					     "freecess_stress/%u");
+		if (IS_ERR(task)) {
+			pr_err("Failed to start kthread for %d CPU\n", cpu);
+			continue;
+		}
+		atomic_inc(&nr_running);
+		wake_up_process(task);
+	}
+	if (!atomic_dec_and_test(&nr_running)) {
+		/* 1 second at a time, so the hung task detector stays quiet */
+		while (!wait_for_completion_timeout(&all_done, HZ))
+			;
+	}
+
+	for_each_online_cpu(cpu) {
+		struct stress_thread *t = &threads[cpu];
+
+		if (!t->nsec)
+			continue;
+		reports += nr_reports;
+		failed += t->failed;
+		/* time not spent in the gaps between reports */
+		busy += t->nsec - (u64)nr_reports * gap_us * NSEC_PER_USEC;
+		pr_info("CPU%d: %d reports in %llu usec, %llu failed\n",
+			cpu, nr_reports, div_u64(t->nsec, NSEC_PER_USEC),
+			t->failed);
+	}
+	kfree(threads);
+
+	if (reports)
+		pr_info("Summary: %llu reports, %llu failed, %llu nsec CPU per report\n",
+			reports, failed, div64_u64(busy, reports));
+
+	return -EAGAIN; /* Fail will directly unload the module */
+}
+
+module_init(freecess_stress_init)
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("freecess report channel stress module");
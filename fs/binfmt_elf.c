@@ -41,6 +41,7 @@
 #include <linux/sched/cputime.h>
 #include <linux/cred.h>
 #include <linux/dax.h>
+#include <linux/xattr.h>
 #include <linux/uaccess.h>
 #include <asm/param.h>
 #include <asm/page.h>
@@ -386,6 +387,101 @@ static unsigned long elf_map(struct file *filep, unsigned long addr,
 
 #endif /* !elf_map */
 
+/*
+ * Optional hints for the page cache at exec time, controlled by the
+ * fs.exec_prefetch sysctl.
+ *
+ * With EXEC_PREFETCH_READAHEAD the file ranges backing executable and
+ * relro segments of the binary and its interpreter are read ahead once
+ * the program headers have been checked, before the old mm is torn down
+ * and anything is mapped, so that the I/O for the first instruction
+ * fetches is in flight while the rest of the exec and the dynamic linker
+ * run.
+ *
+ * With EXEC_PREFETCH_POPULATE the page tables for the "hot" text pages of
+ * the image are also filled in up front. The hot pages are recorded per
+ * binary in the ELF_HOT_PAGES_XATTR extended attribute, as a little-endian
+ * bitmap with one bit per PAGE_SIZE page of the file. Only read-only
+ * executable segments are populated, so no pages are ever copied on write.
+ */
+#define ELF_HOT_PAGES_XATTR	XATTR_TRUSTED_PREFIX "elf_hot_pages"
+#define ELF_HOT_PAGES_MAX	PAGE_SIZE
+
+static void elf_readahead_range(struct file *file, loff_t offset, loff_t len)
+{
+	if (len > 0)
+		vfs_fadvise(file, offset, len, POSIX_FADV_WILLNEED);
+}
+
+static void elf_populate_hot(const void *hot, unsigned long nbits,
+			     const struct elf_phdr *eppnt,
+			     unsigned long load_bias)
+{
+	unsigned long first = eppnt->p_offset >> PAGE_SHIFT;
+	unsigned long last = (eppnt->p_offset + eppnt->p_filesz - 1) >> PAGE_SHIFT;
+	unsigned long addr = ELF_PAGESTART(load_bias + eppnt->p_vaddr) -
+			     ELF_PAGESTART(eppnt->p_offset);
+	unsigned long start, end;
+
+	if (last >= nbits)
+		last = nbits - 1;
+
+	for (start = find_next_bit_le(hot, last + 1, first); start <= last;
+	     start = find_next_bit_le(hot, last + 1, end)) {
+		end = find_next_zero_bit_le(hot, last + 1, start);
+		mm_populate(addr + (start << PAGE_SHIFT),
+			    (end - start) << PAGE_SHIFT);
+	}
+}
+
+static void elf_readahead(struct file *file, const struct elf_phdr *phdata,
+			  int nr)
+{
+	const struct elf_phdr *eppnt;
+	int i;
+
+	if (exec_prefetch == EXEC_PREFETCH_OFF)
+		return;
+
+	for (i = 0, eppnt = phdata; i < nr; i++, eppnt++) {
+		if ((eppnt->p_type == PT_LOAD && (eppnt->p_flags & PF_X)) ||
+		    eppnt->p_type == PT_GNU_RELRO)
+			elf_readahead_range(file, eppnt->p_offset,
+					    eppnt->p_filesz);
+	}
+}
+
+/* Needs the segments of @file to be mapped at @load_bias already. */
+static void elf_populate(struct file *file, const struct elf_phdr *phdata,
+			 int nr, unsigned long load_bias)
+{
+	const struct elf_phdr *eppnt;
+	void *hot;
+	ssize_t size;
+	int i;
+
+	if (exec_prefetch < EXEC_PREFETCH_POPULATE)
+		return;
+
+	hot = kzalloc(ELF_HOT_PAGES_MAX, GFP_KERNEL);
+	if (!hot)
+		return;
+	size = __vfs_getxattr(file->f_path.dentry, file_inode(file),
+			      ELF_HOT_PAGES_XATTR, hot, ELF_HOT_PAGES_MAX, 0);
+	if (size <= 0)
+		goto out;
+
+	for (i = 0, eppnt = phdata; i < nr; i++, eppnt++) {
+		if (eppnt->p_type != PT_LOAD || !eppnt->p_filesz)
+			continue;
+		if ((eppnt->p_flags & (PF_X | PF_W)) != PF_X)
+			continue;
+		elf_populate_hot(hot, size * BITS_PER_BYTE, eppnt, load_bias);
+	}
+out:
+	kfree(hot);
+}
+
 static unsigned long total_mapping_size(const struct elf_phdr *cmds, int nr)
 {
 	int i, first_idx = -1, last_idx = -1;
@@ -843,6 +939,11 @@ static int load_elf_binary(struct linux_binprm *bprm)
 	if (retval)
 		goto out_free_dentry;
 
+	elf_readahead(bprm->file, elf_phdata, loc->elf_ex.e_phnum);
+	if (interpreter)
+		elf_readahead(interpreter, interp_elf_phdata,
+			      loc->interp_elf_ex.e_phnum);
+
 	/* Flush all traces of the currently running executable */
 	retval = flush_old_exec(bprm);
 	if (retval)
@@ -1053,6 +1154,8 @@ static int load_elf_binary(struct linux_binprm *bprm)
 		goto out_free_dentry;
 	}
 
+	elf_populate(bprm->file, elf_phdata, loc->elf_ex.e_phnum, load_bias);
+
 	if (interpreter) {
 		unsigned long interp_map_addr = 0;
 
@@ -1075,6 +1178,9 @@ static int load_elf_binary(struct linux_binprm *bprm)
 		}
 		reloc_func_desc = interp_load_addr;
 
+		elf_populate(interpreter, interp_elf_phdata,
+			     loc->interp_elf_ex.e_phnum, interp_load_addr);
+
 		allow_write_access(interpreter);
 		fput(interpreter);
 	} else {
@@ -2349,7 +2455,16 @@ static int elf_core_dump(struct coredump_params *cprm)
 			page = get_dump_page(addr);
 			if (page) {
 				void *kaddr = kmap(page);
-				stop = !dump_emit(cprm, kaddr, PAGE_SIZE);
+
+				/*
+				 * Streamed dumps leave a hole for pages
+				 * that are all zero.
+				 */
+				if (cprm->stream &&
+				    !memchr_inv(kaddr, 0, PAGE_SIZE))
+					stop = !dump_skip(cprm, PAGE_SIZE);
+				else
+					stop = !dump_emit(cprm, kaddr, PAGE_SIZE);
 				kunmap(page);
 				put_page(page);
 			} else
@@ -41,6 +41,9 @@
 #include <linux/fs.h>
 #include <linux/path.h>
 #include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/zstd.h>
 
 #include <linux/uaccess.h>
 #include <asm/mmu_context.h>
@@ -54,6 +57,7 @@
 
 int core_uses_pid;
 unsigned int core_pipe_limit;
+unsigned int core_stream;
 char core_pattern[CORENAME_MAX_SIZE] = "core";
 static int core_name_size = CORENAME_MAX_SIZE;
 
@@ -565,6 +569,275 @@ static int umh_pipe_setup(struct subprocess_info *info, struct cred *new)
 	return err;
 }
 
+/*
+ * Streamed core dumps, selected by kernel.core_stream:
+ *
+ *  0 - every dump_emit() is written straight to the file or pipe.
+ *  1 - the dump is collected in CORE_CHUNK_SIZE chunks and written in
+ *      large sequential writes. A run of holes is seeked over once, when
+ *      the data after it comes.
+ *  2 - as 1, but each chunk is compressed into its own zstd frame on an
+ *      unbound workqueue worker, with up to CORE_MAX_CHUNKS chunks in
+ *      flight so that compression runs in parallel with page collection.
+ *      Frames are written in order, so the output is a single valid zstd
+ *      stream. Holes are compressed as zeroes instead of being seeked
+ *      over. Needs CONFIG_COREDUMP_COMPRESS, otherwise it acts as 1.
+ *
+ * If the buffers cannot be allocated the dump silently falls back to 0.
+ */
+#define CORE_STREAM_DIRECT	0
+#define CORE_STREAM_BUFFERED	1
+#define CORE_STREAM_ZSTD	2
+
+#define CORE_CHUNK_SIZE		(256 * 1024)
+#define CORE_MAX_CHUNKS		4
+#define CORE_ZSTD_LEVEL		1
+
+struct core_chunk {
+	struct work_struct	work;
+	struct completion	done;
+	struct core_stream	*stream;
+	void			*buf;		/* uncompressed data */
+	size_t			len;
+	void			*out;		/* compressed frame */
+	size_t			out_len;
+	void			*wksp;		/* zstd workspace */
+	bool			busy;		/* submitted, not yet written */
+	bool			err;
+};
+
+struct core_stream {
+	struct coredump_params	*cprm;
+	bool			compress;
+	bool			failed;
+	unsigned int		nr_chunks;
+	unsigned int		fill;		/* chunk being filled */
+	unsigned int		head;		/* oldest chunk not written */
+	loff_t			hole;		/* skipped, not seeked over yet */
+#ifdef CONFIG_COREDUMP_COMPRESS
+	ZSTD_parameters		params;
+	size_t			wksp_size;
+	size_t			out_size;
+#endif
+	struct core_chunk	chunks[CORE_MAX_CHUNKS];
+};
+
+static int __dump_write(struct coredump_params *cprm, const void *addr,
+			size_t nr);
+
+#ifdef CONFIG_COREDUMP_COMPRESS
+static void core_chunk_compress(struct work_struct *work)
+{
+	struct core_chunk *chunk = container_of(work, struct core_chunk, work);
+	struct core_stream *s = chunk->stream;
+	ZSTD_CCtx *cctx;
+	size_t ret;
+
+	cctx = ZSTD_initCCtx(chunk->wksp, s->wksp_size);
+	if (!cctx) {
+		chunk->err = true;
+	} else {
+		ret = ZSTD_compressCCtx(cctx, chunk->out, s->out_size,
+					chunk->buf, chunk->len, s->params);
+		chunk->err = ZSTD_isError(ret);
+		chunk->out_len = chunk->err ? 0 : ret;
+	}
+	complete(&chunk->done);
+}
+
+static int core_stream_init_zstd(struct core_stream *s)
+{
+	unsigned int i;
+
+	s->params = ZSTD_getParams(CORE_ZSTD_LEVEL, CORE_CHUNK_SIZE, 0);
+	s->wksp_size = ZSTD_CCtxWorkspaceBound(s->params.cParams);
+	s->out_size = ZSTD_compressBound(CORE_CHUNK_SIZE);
+
+	for (i = 0; i < s->nr_chunks; i++) {
+		struct core_chunk *chunk = &s->chunks[i];
+
+		chunk->wksp = kvmalloc(s->wksp_size, GFP_KERNEL);
+		chunk->out = kvmalloc(s->out_size, GFP_KERNEL);
+		if (!chunk->wksp || !chunk->out)
+			return -ENOMEM;
+		INIT_WORK(&chunk->work, core_chunk_compress);
+		init_completion(&chunk->done);
+	}
+	s->compress = true;
+	return 0;
+}
+#else
+static inline int core_stream_init_zstd(struct core_stream *s)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
+static void core_stream_free(struct core_stream *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < s->nr_chunks; i++) {
+		struct core_chunk *chunk = &s->chunks[i];
+
+		/* Never free buffers a worker may still be using. */
+		if (s->compress && chunk->busy)
+			wait_for_completion(&chunk->done);
+		kvfree(chunk->buf);
+		kvfree(chunk->out);
+		kvfree(chunk->wksp);
+	}
+	kfree(s);
+}
+
+static void core_stream_start(struct coredump_params *cprm)
+{
+	unsigned int mode = READ_ONCE(core_stream);
+	struct core_stream *s;
+	unsigned int i;
+
+	if (mode == CORE_STREAM_DIRECT)
+		return;
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return;
+	s->cprm = cprm;
+	if (!IS_ENABLED(CONFIG_COREDUMP_COMPRESS))
+		mode = CORE_STREAM_BUFFERED;
+
+	s->nr_chunks = 1;
+	if (mode == CORE_STREAM_ZSTD)
+		s->nr_chunks = clamp_t(unsigned int, num_online_cpus(), 1,
+				       CORE_MAX_CHUNKS);
+	for (i = 0; i < s->nr_chunks; i++) {
+		s->chunks[i].stream = s;
+		s->chunks[i].buf = kvmalloc(CORE_CHUNK_SIZE, GFP_KERNEL);
+		if (!s->chunks[i].buf)
+			goto fail;
+	}
+	if (mode == CORE_STREAM_ZSTD && core_stream_init_zstd(s))
+		goto fail;
+	cprm->stream = s;
+	return;
+fail:
+	core_stream_free(s);
+}
+
+/* Write out the oldest submitted chunk, waiting for its compression. */
+static int core_stream_write_head(struct core_stream *s)
+{
+	struct core_chunk *chunk = &s->chunks[s->head];
+	const void *data = chunk->buf;
+	size_t len = chunk->len;
+
+	if (!chunk->busy)
+		return !s->failed;
+
+	if (s->compress) {
+		wait_for_completion(&chunk->done);
+		if (chunk->err)
+			s->failed = true;
+		data = chunk->out;
+		len = chunk->out_len;
+	}
+	if (!s->failed && !__dump_write(s->cprm, data, len))
+		s->failed = true;
+
+	chunk->busy = false;
+	chunk->len = 0;
+	s->head = (s->head + 1) % s->nr_chunks;
+	return !s->failed;
+}
+
+/* Hand the chunk being filled over for compression and writing. */
+static int core_stream_submit(struct core_stream *s)
+{
+	struct core_chunk *chunk = &s->chunks[s->fill];
+
+	if (!chunk->len)
+		return !s->failed;
+
+	chunk->busy = true;
+	s->fill = (s->fill + 1) % s->nr_chunks;
+	if (s->compress) {
+		reinit_completion(&chunk->done);
+		queue_work(system_unbound_wq, &chunk->work);
+		return !s->failed;
+	}
+	return core_stream_write_head(s);
+}
+
+/* Write out everything that has been emitted so far, in order. */
+static int core_stream_flush(struct core_stream *s)
+{
+	struct file *file = s->cprm->file;
+	unsigned int i;
+
+	if (!core_stream_submit(s))
+		return 0;
+	for (i = 0; i < s->nr_chunks; i++)
+		if (!core_stream_write_head(s))
+			return 0;
+
+	if (s->hole) {
+		if (dump_interrupted() ||
+		    file->f_op->llseek(file, s->hole, SEEK_CUR) < 0) {
+			s->failed = true;
+			return 0;
+		}
+		s->hole = 0;
+	}
+	return 1;
+}
+
+/* Append @nr bytes from @addr, or zeroes if @addr is NULL. */
+static int core_stream_emit(struct core_stream *s, const void *addr,
+			    size_t nr)
+{
+	/* The data before the hole has to go out before the seek. */
+	if (s->hole && !core_stream_flush(s))
+		return 0;
+
+	while (nr) {
+		struct core_chunk *chunk = &s->chunks[s->fill];
+		size_t n;
+
+		if (s->failed)
+			return 0;
+		if (chunk->busy && !core_stream_write_head(s))
+			return 0;
+
+		n = min_t(size_t, nr, CORE_CHUNK_SIZE - chunk->len);
+		if (addr) {
+			memcpy(chunk->buf + chunk->len, addr, n);
+			addr += n;
+		} else {
+			memset(chunk->buf + chunk->len, 0, n);
+		}
+		chunk->len += n;
+		s->cprm->pos += n;
+		nr -= n;
+
+		if (chunk->len == CORE_CHUNK_SIZE && !core_stream_submit(s))
+			return 0;
+	}
+	return 1;
+}
+
+static int core_stream_finish(struct coredump_params *cprm)
+{
+	struct core_stream *s = cprm->stream;
+	int ret;
+
+	if (!s)
+		return 1;
+	ret = core_stream_flush(s);
+	cprm->stream = NULL;
+	core_stream_free(s);
+	return ret;
+}
+
 void do_coredump(const kernel_siginfo_t *siginfo)
 {
 	struct core_state core_state;
@@ -798,7 +1071,10 @@ void do_coredump(const kernel_siginfo_t *siginfo)
 			goto close_fail;
 		}
 		file_start_write(cprm.file);
+		core_stream_start(&cprm);
 		core_dumped = binfmt->core_dump(&cprm);
+		if (!core_stream_finish(&cprm))
+			core_dumped = false;
 		file_end_write(cprm.file);
 	}
 	if (ispipe && core_pipe_limit)
@@ -825,7 +1101,8 @@ void do_coredump(const kernel_siginfo_t *siginfo)
  * do on a core-file: use only these functions to write out all the
  * necessary info.
  */
-int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
+static int __dump_write(struct coredump_params *cprm, const void *addr,
+			size_t nr)
 {
 	struct file *file = cprm->file;
 	loff_t pos = file->f_pos;
@@ -840,18 +1117,39 @@ int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
 			return 0;
 		file->f_pos = pos;
 		cprm->written += n;
-		cprm->pos += n;
+		addr += n;
 		nr -= n;
 	}
 	return 1;
 }
+
+int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
+{
+	if (cprm->stream)
+		return core_stream_emit(cprm->stream, addr, nr);
+	if (!__dump_write(cprm, addr, nr))
+		return 0;
+	cprm->pos += nr;
+	return 1;
+}
 EXPORT_SYMBOL(dump_emit);
 
 int dump_skip(struct coredump_params *cprm, size_t nr)
 {
 	static char zeroes[PAGE_SIZE];
 	struct file *file = cprm->file;
-	if (file->f_op->llseek && file->f_op->llseek != no_llseek) {
+	bool seekable = file->f_op->llseek && file->f_op->llseek != no_llseek;
+
+	if (cprm->stream) {
+		/* Compressed streams and pipes cannot have holes. */
+		if (cprm->stream->compress || !seekable)
+			return core_stream_emit(cprm->stream, NULL, nr);
+		/* Seeked over by the next flush. */
+		cprm->stream->hole += nr;
+		cprm->pos += nr;
+		return 1;
+	}
+	if (seekable) {
 		if (dump_interrupted() ||
 		    file->f_op->llseek(file, nr, SEEK_CUR) < 0)
 			return 0;
@@ -887,6 +1185,11 @@ void dump_truncate(struct coredump_params *cprm)
 	struct file *file = cprm->file;
 	loff_t offset;
 
+	if (cprm->stream) {
+		if (cprm->stream->compress ||
+		    !core_stream_flush(cprm->stream))
+			return;
+	}
 	if (file->f_op->llseek && file->f_op->llseek != no_llseek) {
 		offset = file->f_op->llseek(file, 0, SEEK_CUR);
 		if (i_size_read(file->f_mapping->host) < offset)
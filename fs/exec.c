@@ -74,6 +74,7 @@
 #include <trace/events/sched.h>
 
 int suid_dumpable = 0;
+int exec_prefetch = EXEC_PREFETCH_OFF;
 
 static LIST_HEAD(formats);
 static DEFINE_RWLOCK(binfmt_lock);
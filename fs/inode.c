@@ -21,6 +21,7 @@
 #include <linux/ratelimit.h>
 #include <linux/list_lru.h>
 #include <linux/iversion.h>
+#include <linux/bpf.h>
 #include <trace/events/writeback.h>
 #include "internal.h"
 
@@ -198,6 +199,9 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	inode->i_fsnotify_mask = 0;
 #endif
 	inode->i_flctx = NULL;
+#ifdef CONFIG_BPF_SYSCALL
+	RCU_INIT_POINTER(inode->i_bpf_storage, NULL);
+#endif
 
 	if (unlikely(security_inode_alloc(inode)))
 		return -ENOMEM;
@@ -255,6 +259,7 @@ void __destroy_inode(struct inode *inode)
 	inode_detach_wb(inode);
 	security_inode_free(inode);
 	fsnotify_inode_delete(inode);
+	bpf_inode_storage_free(inode);
 	locks_free_lock_context(inode);
 	if (!inode->i_nlink) {
 		WARN_ON(atomic_long_read(&inode->i_sb->s_remove_count) == 0);
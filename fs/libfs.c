@@ -236,6 +236,264 @@ const struct file_operations simple_dir_operations = {
 };
 EXPORT_SYMBOL(simple_dir_operations);
 
+/*
+ * Directory offset maps.
+ *
+ * dcache_readdir() finds its place by walking ->d_subdirs from a cursor,
+ * so every seek, and every getdents() call that has to skip entries
+ * racing in ahead of the cursor, costs time proportional to the size of
+ * the directory. Filesystems that keep their whole tree in the dcache can
+ * instead hand each entry a stable offset when it is linked in, and index
+ * the entries by offset in an xarray; readdir then resumes directly at
+ * ->f_pos. Offsets are allocated cyclically, so a listing comes back in
+ * creation order and new entries never appear behind an open reader.
+ *
+ * Offsets 0 and 1 are "." and "..". The offset of an entry is kept in its
+ * ->d_fsdata. Callers hold the parent's i_rwsem exclusively.
+ */
+static inline void offset_set(struct dentry *dentry, u32 offset)
+{
+	dentry->d_fsdata = (void *)(uintptr_t)offset;
+}
+
+static inline u32 dentry2offset(struct dentry *dentry)
+{
+	return (u32)(uintptr_t)dentry->d_fsdata;
+}
+
+/**
+ * simple_offset_init - initialize an offset_ctx
+ * @octx: directory offset map to be initialized
+ */
+void simple_offset_init(struct offset_ctx *octx)
+{
+	xa_init_flags(&octx->xa, XA_FLAGS_ALLOC1);
+	octx->next_offset = 2;
+}
+EXPORT_SYMBOL(simple_offset_init);
+
+/**
+ * simple_offset_add - add an entry to a directory's offset map
+ * @octx: directory offset ctx to be updated
+ * @dentry: new dentry being added
+ *
+ * Returns zero on success, or a negative errno.
+ */
+int simple_offset_add(struct offset_ctx *octx, struct dentry *dentry)
+{
+	u32 offset;
+	int ret;
+
+	if (dentry2offset(dentry) != 0)
+		return -EBUSY;
+
+	ret = xa_alloc_cyclic(&octx->xa, &offset, dentry, XA_LIMIT(2, U32_MAX),
+			      &octx->next_offset, GFP_KERNEL);
+	if (ret < 0)
+		return ret;
+
+	offset_set(dentry, offset);
+	return 0;
+}
+EXPORT_SYMBOL(simple_offset_add);
+
+/**
+ * simple_offset_remove - remove an entry from a directory's offset map
+ * @octx: directory offset ctx to be updated
+ * @dentry: dentry being removed
+ */
+void simple_offset_remove(struct offset_ctx *octx, struct dentry *dentry)
+{
+	u32 offset = dentry2offset(dentry);
+
+	if (offset == 0)
+		return;
+
+	xa_erase(&octx->xa, offset);
+	offset_set(dentry, 0);
+}
+EXPORT_SYMBOL(simple_offset_remove);
+
+static int simple_offset_replace(struct offset_ctx *octx,
+				 struct dentry *dentry, u32 offset)
+{
+	void *ret;
+
+	ret = xa_store(&octx->xa, offset, dentry, GFP_KERNEL);
+	if (xa_is_err(ret))
+		return xa_err(ret);
+	offset_set(dentry, offset);
+	return 0;
+}
+
+/**
+ * simple_offset_rename - move an entry to another directory's offset map
+ * @old_dir: parent of dentry being moved
+ * @old_dentry: dentry being moved
+ * @new_dir: destination parent
+ *
+ * Both directories must implement ->get_offset_ctx. On failure the
+ * original offset is restored.
+ *
+ * Returns zero on success, or a negative errno.
+ */
+int simple_offset_rename(struct inode *old_dir, struct dentry *old_dentry,
+			 struct inode *new_dir)
+{
+	struct offset_ctx *old_ctx = old_dir->i_op->get_offset_ctx(old_dir);
+	struct offset_ctx *new_ctx = new_dir->i_op->get_offset_ctx(new_dir);
+	u32 old_index = dentry2offset(old_dentry);
+	int ret;
+
+	simple_offset_remove(old_ctx, old_dentry);
+	ret = simple_offset_add(new_ctx, old_dentry);
+	if (ret)
+		simple_offset_replace(old_ctx, old_dentry, old_index);
+	return ret;
+}
+EXPORT_SYMBOL(simple_offset_rename);
+
+/**
+ * simple_offset_rename_exchange - exchange the offsets of two entries
+ * @old_dir: parent of dentry being moved
+ * @old_dentry: dentry being moved
+ * @new_dir: destination parent
+ * @new_dentry: destination dentry
+ *
+ * Both directories must implement ->get_offset_ctx. On failure the
+ * original offsets are restored.
+ *
+ * Returns zero on success, or a negative errno.
+ */
+int simple_offset_rename_exchange(struct inode *old_dir,
+				  struct dentry *old_dentry,
+				  struct inode *new_dir,
+				  struct dentry *new_dentry)
+{
+	struct offset_ctx *old_ctx = old_dir->i_op->get_offset_ctx(old_dir);
+	struct offset_ctx *new_ctx = new_dir->i_op->get_offset_ctx(new_dir);
+	u32 old_index = dentry2offset(old_dentry);
+	u32 new_index = dentry2offset(new_dentry);
+	int ret;
+
+	simple_offset_remove(old_ctx, old_dentry);
+	simple_offset_remove(new_ctx, new_dentry);
+
+	ret = simple_offset_replace(new_ctx, old_dentry, new_index);
+	if (ret)
+		goto out_restore;
+
+	ret = simple_offset_replace(old_ctx, new_dentry, old_index);
+	if (ret) {
+		simple_offset_remove(new_ctx, old_dentry);
+		goto out_restore;
+	}
+	return 0;
+
+out_restore:
+	simple_offset_replace(old_ctx, old_dentry, old_index);
+	simple_offset_replace(new_ctx, new_dentry, new_index);
+	return ret;
+}
+EXPORT_SYMBOL(simple_offset_rename_exchange);
+
+/**
+ * simple_offset_destroy - release the resources held by an offset map
+ * @octx: directory offset ctx that is about to be destroyed
+ */
+void simple_offset_destroy(struct offset_ctx *octx)
+{
+	xa_destroy(&octx->xa);
+}
+EXPORT_SYMBOL(simple_offset_destroy);
+
+static loff_t offset_dir_llseek(struct file *file, loff_t offset, int whence)
+{
+	switch (whence) {
+	case SEEK_CUR:
+		offset += file->f_pos;
+		/* fall through */
+	case SEEK_SET:
+		if (offset >= 0)
+			break;
+		/* fall through */
+	default:
+		return -EINVAL;
+	}
+
+	return vfs_setpos(file, offset, U32_MAX);
+}
+
+static struct dentry *offset_find_next(struct xa_state *xas)
+{
+	struct dentry *child, *found = NULL;
+
+	rcu_read_lock();
+	child = xas_next_entry(xas, U32_MAX);
+	if (!child)
+		goto out;
+	spin_lock(&child->d_lock);
+	if (simple_positive(child))
+		found = dget_dlock(child);
+	spin_unlock(&child->d_lock);
+out:
+	rcu_read_unlock();
+	return found;
+}
+
+static bool offset_dir_emit(struct dir_context *ctx, struct dentry *dentry)
+{
+	struct inode *inode = d_inode(dentry);
+
+	return ctx->actor(ctx, dentry->d_name.name, dentry->d_name.len,
+			  dentry2offset(dentry), inode->i_ino,
+			  dt_type(inode)) == 0;
+}
+
+/*
+ * Unlike dcache_readdir(), each entry is handed to the actor at its own
+ * offset and ->pos is left just past the last entry emitted, so a reader
+ * resumes with a single xarray lookup however far into the directory it
+ * is.
+ */
+static int offset_readdir(struct file *file, struct dir_context *ctx)
+{
+	XA_STATE(xas, NULL, 0);
+	struct dentry *dir = file->f_path.dentry;
+	struct dentry *dentry;
+
+	lockdep_assert_held(&d_inode(dir)->i_rwsem);
+
+	if (!dir_emit_dots(file, ctx))
+		return 0;
+
+	xas.xa = &d_inode(dir)->i_op->get_offset_ctx(d_inode(dir))->xa;
+	xas.xa_index = ctx->pos;
+	while (true) {
+		dentry = offset_find_next(&xas);
+		if (!dentry)
+			break;
+
+		if (!offset_dir_emit(ctx, dentry)) {
+			dput(dentry);
+			break;
+		}
+
+		dput(dentry);
+		ctx->pos = xas.xa_index + 1;
+		cond_resched();
+	}
+	return 0;
+}
+
+const struct file_operations simple_offset_dir_operations = {
+	.llseek		= offset_dir_llseek,
+	.iterate_shared	= offset_readdir,
+	.read		= generic_read_dir,
+	.fsync		= noop_fsync,
+};
+EXPORT_SYMBOL(simple_offset_dir_operations);
+
 const struct inode_operations simple_dir_inode_operations = {
 	.lookup		= simple_lookup,
 };
@@ -168,6 +168,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/hashtable.h>
 #include <linux/percpu.h>
+#include <linux/interval_tree_generic.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/filelock.h>
@@ -227,21 +228,51 @@ DEFINE_STATIC_PERCPU_RWSEM(file_rwsem);
 #define BLOCKED_HASH_BITS	7
 static DEFINE_HASHTABLE(blocked_hash, BLOCKED_HASH_BITS);
 
+/*
+ * Number of requests currently hashed in blocked_hash. Deadlock detection
+ * can only find a cycle if some lock owner is already waiting, so when this
+ * is zero the chain walk is skipped entirely.
+ */
+static unsigned int blocked_hash_count;
+
 /*
  * This lock protects the blocked_hash. Generally, if you're accessing it, you
  * want to be holding this lock.
  *
- * In addition, it also protects the fl->fl_blocked_requests list, and the
- * fl->fl_blocker pointer for file_lock structures that are acting as lock
- * requests (in contrast to those that are acting as records of acquired locks).
- *
- * Note that when we acquire this lock in order to change the above fields,
- * we often hold the flc_lock as well. In certain cases, when reading the fields
- * protected by this lock, we can skip acquiring it iff we already hold the
- * flc_lock.
+ * The fl->fl_blocked_requests list, and the fl->fl_blocker pointer for
+ * file_lock structures that are acting as lock requests (in contrast to those
+ * that are acting as records of acquired locks), are protected by the flc_lock
+ * of the inode: a request only ever waits on locks of its own inode. Deadlock
+ * detection follows fl_blocker from the requests in blocked_hash across inodes
+ * with just this lock held though, so while an inode has requests in
+ * blocked_hash (ctx->flc_blocked_hashed), changes to the waiters of that inode
+ * take this lock as well. Lock requests on other inodes, including all OFD,
+ * flock and lease waiters of such inodes, never touch it.
+ *
+ * Lock ordering: flc_lock, then blocked_lock_lock.
  */
 static DEFINE_SPINLOCK(blocked_lock_lock);
 
+/*
+ * Take blocked_lock_lock if deadlock detection may be looking at the waiters
+ * of ctx. Must be called with the flc_lock held, returns whether it was taken.
+ */
+static bool locks_lock_blocked(struct file_lock_context *ctx)
+{
+	lockdep_assert_held(&ctx->flc_lock);
+
+	if (!ctx->flc_blocked_hashed)
+		return false;
+	spin_lock(&blocked_lock_lock);
+	return true;
+}
+
+static void locks_unlock_blocked(bool locked)
+{
+	if (locked)
+		spin_unlock(&blocked_lock_lock);
+}
+
 static struct kmem_cache *flctx_cache __read_mostly;
 static struct kmem_cache *filelock_cache __read_mostly;
 
@@ -262,7 +293,9 @@ locks_get_lock_context(struct inode *inode, int type)
 	spin_lock_init(&ctx->flc_lock);
 	INIT_LIST_HEAD(&ctx->flc_flock);
 	INIT_LIST_HEAD(&ctx->flc_posix);
+	ctx->flc_posix_tree = RB_ROOT_CACHED;
 	INIT_LIST_HEAD(&ctx->flc_lease);
+	ctx->flc_blocked_hashed = 0;
 
 	/*
 	 * Assign the pointer if it's not already assigned. If it is, then
@@ -337,6 +370,7 @@ static void locks_init_lock_heads(struct file_lock *fl)
 	INIT_LIST_HEAD(&fl->fl_list);
 	INIT_LIST_HEAD(&fl->fl_blocked_requests);
 	INIT_LIST_HEAD(&fl->fl_blocked_member);
+	RB_CLEAR_NODE(&fl->fl_rb);
 	init_waitqueue_head(&fl->fl_wait);
 }
 
@@ -442,22 +476,20 @@ void locks_copy_lock(struct file_lock *new, struct file_lock *fl)
 }
 EXPORT_SYMBOL(locks_copy_lock);
 
-static void locks_move_blocks(struct file_lock *new, struct file_lock *fl)
+/* Must be called with the flc_lock held! */
+static void locks_move_blocks(struct file_lock_context *ctx,
+			      struct file_lock *new, struct file_lock *fl)
 {
 	struct file_lock *f;
+	bool locked;
 
-	/*
-	 * As ctx->flc_lock is held, new requests cannot be added to
-	 * ->fl_blocked_requests, so we don't need a lock to check if it
-	 * is empty.
-	 */
 	if (list_empty(&fl->fl_blocked_requests))
 		return;
-	spin_lock(&blocked_lock_lock);
+	locked = locks_lock_blocked(ctx);
 	list_splice_init(&fl->fl_blocked_requests, &new->fl_blocked_requests);
 	list_for_each_entry(f, &new->fl_blocked_requests, fl_blocked_member)
 		f->fl_blocker = new;
-	spin_unlock(&blocked_lock_lock);
+	locks_unlock_blocked(locked);
 }
 
 static inline int flock_translate_cmd(int cmd) {
@@ -662,6 +694,66 @@ static int posix_same_owner(struct file_lock *fl1, struct file_lock *fl2)
 	return fl1->fl_owner == fl2->fl_owner;
 }
 
+/*
+ * POSIX locks are additionally indexed by byte range in an interval tree
+ * hanging off the lock context, so that conflict checks and merging only
+ * look at the locks that overlap the request instead of every lock held
+ * on the inode. The tree is protected by the flc_lock.
+ *
+ * The range of a lock must never be changed while it is in the tree;
+ * take it out first and put it back once the new range is set.
+ */
+#define posix_lock_start(fl)	((fl)->fl_start)
+#define posix_lock_last(fl)	((fl)->fl_end)
+
+INTERVAL_TREE_DEFINE(struct file_lock, fl_rb, loff_t, fl_rb_subtree_last,
+		     posix_lock_start, posix_lock_last, static, posix_lock_tree)
+
+#define posix_lock_for_each_overlap(fl, ctx, start, end)		\
+	for (fl = posix_lock_tree_iter_first(&(ctx)->flc_posix_tree,	\
+					     start, end);		\
+	     fl; fl = posix_lock_tree_iter_next(fl, start, end))
+
+/* Must be called with the flc_lock held! */
+static void locks_insert_posix_tree(struct file_lock_context *ctx,
+				    struct file_lock *fl)
+{
+	lockdep_assert_held(&ctx->flc_lock);
+
+	posix_lock_tree_insert(fl, &ctx->flc_posix_tree);
+}
+
+/* Must be called with the flc_lock held! */
+static void locks_delete_posix_tree(struct file_lock_context *ctx,
+				    struct file_lock *fl)
+{
+	lockdep_assert_held(&ctx->flc_lock);
+
+	if (RB_EMPTY_NODE(&fl->fl_rb))
+		return;
+	posix_lock_tree_remove(fl, &ctx->flc_posix_tree);
+	RB_CLEAR_NODE(&fl->fl_rb);
+}
+
+/*
+ * Find the next lock after @fl (or the first one, if @fl is NULL) that has
+ * the same owner as @request and overlaps [@start, @end].
+ */
+static struct file_lock *
+posix_owner_next(struct file_lock_context *ctx, struct file_lock *request,
+		 struct file_lock *fl, loff_t start, loff_t end)
+{
+	if (!fl)
+		fl = posix_lock_tree_iter_first(&ctx->flc_posix_tree,
+						start, end);
+	else
+		fl = posix_lock_tree_iter_next(fl, start, end);
+
+	while (fl && !posix_same_owner(request, fl))
+		fl = posix_lock_tree_iter_next(fl, start, end);
+	return fl;
+}
+
 /* Must be called with the flc_lock held! */
 static void locks_insert_global_locks(struct file_lock *fl)
 {
@@ -702,24 +794,33 @@ posix_owner_key(struct file_lock *fl)
 	return (unsigned long)fl->fl_owner;
 }
 
-static void locks_insert_global_blocked(struct file_lock *waiter)
+static void locks_insert_global_blocked(struct file_lock_context *ctx,
+					struct file_lock *waiter)
 {
 	lockdep_assert_held(&blocked_lock_lock);
 
 	hash_add(blocked_hash, &waiter->fl_link, posix_owner_key(waiter));
+	blocked_hash_count++;
+	ctx->flc_blocked_hashed++;
 }
 
 static void locks_delete_global_blocked(struct file_lock *waiter)
 {
+	if (hlist_unhashed(&waiter->fl_link))
+		return;
 	lockdep_assert_held(&blocked_lock_lock);
 
 	hash_del(&waiter->fl_link);
+	blocked_hash_count--;
+	/* Only POSIX requests, which all have a file, are hashed */
+	locks_inode(waiter->fl_file)->i_flctx->flc_blocked_hashed--;
 }
 
 /* Remove waiter from blocker's block list.
  * When blocker ends up pointing to itself then the list is empty.
  *
- * Must be called with blocked_lock_lock held.
+ * Must be called with the flc_lock held, and blocked_lock_lock if the inode
+ * has requests in blocked_hash.
  */
 static void __locks_delete_block(struct file_lock *waiter)
 {
@@ -749,6 +850,28 @@ static void __locks_wake_up_blocks(struct file_lock *blocker)
 	}
 }
 
+/* Must be called with the flc_lock held! */
+static int __locks_delete_block_ctx(struct file_lock_context *ctx,
+				    struct file_lock *waiter)
+{
+	int status = -ENOENT;
+	bool locked;
+
+	locked = locks_lock_blocked(ctx);
+	if (waiter->fl_blocker)
+		status = 0;
+	__locks_wake_up_blocks(waiter);
+	__locks_delete_block(waiter);
+
+	/*
+	 * The setting of fl_blocker to NULL marks the "done" point in deleting
+	 * a block. Paired with acquire in locks_delete_block().
+	 */
+	smp_store_release(&waiter->fl_blocker, NULL);
+	locks_unlock_blocked(locked);
+	return status;
+}
+
 /**
  *	locks_delete_lock - stop waiting for a file lock
  *	@waiter: the lock which was waiting
@@ -757,14 +880,15 @@ static void __locks_wake_up_blocks(struct file_lock *blocker)
  */
 int locks_delete_block(struct file_lock *waiter)
 {
-	int status = -ENOENT;
+	struct file_lock_context *ctx;
+	int status;
 
 	/*
 	 * If fl_blocker is NULL, it won't be set again as this thread "owns"
 	 * the lock and is the only one that might try to claim the lock.
 	 *
 	 * We use acquire/release to manage fl_blocker so that we can
-	 * optimize away taking the blocked_lock_lock in many cases.
+	 * optimize away taking the flc_lock in many cases.
 	 *
 	 * The smp_load_acquire guarantees two things:
 	 *
@@ -782,20 +906,16 @@ int locks_delete_block(struct file_lock *waiter)
 	 */
 	if (!smp_load_acquire(&waiter->fl_blocker) &&
 	    list_empty(&waiter->fl_blocked_requests))
-		return status;
-
-	spin_lock(&blocked_lock_lock);
-	if (waiter->fl_blocker)
-		status = 0;
-	__locks_wake_up_blocks(waiter);
-	__locks_delete_block(waiter);
+		return -ENOENT;
 
 	/*
-	 * The setting of fl_blocker to NULL marks the "done" point in deleting
-	 * a block. Paired with acquire at the top of this function.
+	 * A request that has been queued was queued on locks of the inode of
+	 * its file, so the context exists.
 	 */
-	smp_store_release(&waiter->fl_blocker, NULL);
-	spin_unlock(&blocked_lock_lock);
+	ctx = smp_load_acquire(&locks_inode(waiter->fl_file)->i_flctx);
+	spin_lock(&ctx->flc_lock);
+	status = __locks_delete_block_ctx(ctx, waiter);
+	spin_unlock(&ctx->flc_lock);
 	return status;
 }
 EXPORT_SYMBOL(locks_delete_block);
@@ -805,20 +925,21 @@ EXPORT_SYMBOL(locks_delete_block);
  * the order they blocked. The documentation doesn't require this but
  * it seems like the reasonable thing to do.
  *
- * Must be called with both the flc_lock and blocked_lock_lock held. The
- * fl_blocked_requests list itself is protected by the blocked_lock_lock,
- * but by ensuring that the flc_lock is also held on insertions we can avoid
- * taking the blocked_lock_lock in some cases when we see that the
- * fl_blocked_requests list is empty.
+ * Must be called with the flc_lock held, and blocked_lock_lock if the inode
+ * has requests in blocked_hash, as returned by locks_lock_blocked() in
+ * *locked. If waiter has to go into blocked_hash, blocked_lock_lock is taken
+ * here and *locked set.
  *
  * Rather than just adding to the list, we check for conflicts with any existing
  * waiters, and add beneath any waiter that blocks the new waiter.
  * Thus wakeups don't happen until needed.
  */
-static void __locks_insert_block(struct file_lock *blocker,
+static void __locks_insert_block(struct file_lock_context *ctx,
+				 struct file_lock *blocker,
 				 struct file_lock *waiter,
 				 bool conflict(struct file_lock *,
-					       struct file_lock *))
+					       struct file_lock *),
+				 bool *locked)
 {
 	struct file_lock *fl;
 	BUG_ON(!list_empty(&waiter->fl_blocked_member));
@@ -831,8 +952,13 @@ static void __locks_insert_block(struct file_lock *blocker,
 		}
 	waiter->fl_blocker = blocker;
 	list_add_tail(&waiter->fl_blocked_member, &blocker->fl_blocked_requests);
-	if (IS_POSIX(blocker) && !IS_OFDLCK(blocker))
-		locks_insert_global_blocked(waiter);
+	if (IS_POSIX(blocker) && !IS_OFDLCK(blocker)) {
+		if (!*locked) {
+			spin_lock(&blocked_lock_lock);
+			*locked = true;
+		}
+		locks_insert_global_blocked(ctx, waiter);
+	}
 
 	/* The requests in waiter->fl_blocked are known to conflict with
 	 * waiter, but might not conflict with blocker, or the requests
@@ -842,14 +968,17 @@ static void __locks_insert_block(struct file_lock *blocker,
 }
 
 /* Must be called with flc_lock held. */
-static void locks_insert_block(struct file_lock *blocker,
+static void locks_insert_block(struct file_lock_context *ctx,
+			       struct file_lock *blocker,
 			       struct file_lock *waiter,
 			       bool conflict(struct file_lock *,
 					     struct file_lock *))
 {
-	spin_lock(&blocked_lock_lock);
-	__locks_insert_block(blocker, waiter, conflict);
-	spin_unlock(&blocked_lock_lock);
+	bool locked;
+
+	locked = locks_lock_blocked(ctx);
+	__locks_insert_block(ctx, blocker, waiter, conflict, &locked);
+	locks_unlock_blocked(locked);
 }
 
 /*
@@ -859,19 +988,15 @@ static void locks_insert_block(struct file_lock *blocker,
  */
 static void locks_wake_up_blocks(struct file_lock *blocker)
 {
-	/*
-	 * Avoid taking global lock if list is empty. This is safe since new
-	 * blocked requests are only added to the list under the flc_lock, and
-	 * the flc_lock is always held here. Note that removal from the
-	 * fl_blocked_requests list does not require the flc_lock, so we must
-	 * recheck list_empty() after acquiring the blocked_lock_lock.
-	 */
+	bool locked;
+
 	if (list_empty(&blocker->fl_blocked_requests))
 		return;
 
-	spin_lock(&blocked_lock_lock);
+	/* Blockers are granted locks, which all have a file */
+	locked = locks_lock_blocked(locks_inode(blocker->fl_file)->i_flctx);
 	__locks_wake_up_blocks(blocker);
-	spin_unlock(&blocked_lock_lock);
+	locks_unlock_blocked(locked);
 }
 
 static void
@@ -962,7 +1087,7 @@ posix_test_lock(struct file *filp, struct file_lock *fl)
 	}
 
 	spin_lock(&ctx->flc_lock);
-	list_for_each_entry(cfl, &ctx->flc_posix, fl_list) {
+	posix_lock_for_each_overlap(cfl, ctx, fl->fl_start, fl->fl_end) {
 		if (posix_locks_conflict(fl, cfl)) {
 			locks_copy_conflock(fl, cfl);
 			goto out;
@@ -1025,14 +1150,12 @@ static struct file_lock *what_owner_is_waiting_for(struct file_lock *block_fl)
 	return NULL;
 }
 
-/* Must be called with the blocked_lock_lock held! */
+/* Must be called with the blocked_lock_lock held, unless caller_fl is OFD! */
 static int posix_locks_deadlock(struct file_lock *caller_fl,
 				struct file_lock *block_fl)
 {
 	int i = 0;
 
-	lockdep_assert_held(&blocked_lock_lock);
-
 	/*
 	 * This deadlock detector can't reasonably detect deadlocks with
 	 * FL_OFDLCK locks, since they aren't owned by a process, per-se.
@@ -1040,6 +1163,12 @@ static int posix_locks_deadlock(struct file_lock *caller_fl,
 	if (IS_OFDLCK(caller_fl))
 		return 0;
 
+	lockdep_assert_held(&blocked_lock_lock);
+
+	/* Nobody is waiting, so there is no chain to follow. */
+	if (!blocked_hash_count)
+		return 0;
+
 	while ((block_fl = what_owner_is_waiting_for(block_fl))) {
 		if (i++ > MAX_DEADLK_ITERATIONS)
 			return 0;
@@ -1107,13 +1236,13 @@ static int flock_lock_inode(struct inode *inode, struct file_lock *request)
 		if (!(request->fl_flags & FL_SLEEP))
 			goto out;
 		error = FILE_LOCK_DEFERRED;
-		locks_insert_block(fl, request, flock_locks_conflict);
+		locks_insert_block(ctx, fl, request, flock_locks_conflict);
 		goto out;
 	}
 	if (request->fl_flags & FL_ACCESS)
 		goto out;
 	locks_copy_lock(new_fl, request);
-	locks_move_blocks(new_fl, request);
+	locks_move_blocks(ctx, new_fl, request);
 	locks_insert_lock_ctx(new_fl, &ctx->flc_flock);
 	new_fl = NULL;
 	error = 0;
@@ -1137,8 +1266,10 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 	struct file_lock *left = NULL;
 	struct file_lock *right = NULL;
 	struct file_lock_context *ctx;
+	loff_t start, end;
 	int error;
 	bool added = false;
+	bool locked;
 	LIST_HEAD(dispose);
 
 	ctx = locks_get_lock_context(inode, request->fl_type);
@@ -1166,7 +1297,8 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 	 * blocker's list of waiters and the global blocked_hash.
 	 */
 	if (request->fl_type != F_UNLCK) {
-		list_for_each_entry(fl, &ctx->flc_posix, fl_list) {
+		posix_lock_for_each_overlap(fl, ctx, request->fl_start,
+					    request->fl_end) {
 			if (!posix_locks_conflict(request, fl))
 				continue;
 			if (conflock)
@@ -1177,9 +1309,16 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 			/*
 			 * Deadlock detection and insertion into the blocked
 			 * locks list must be done while holding the same lock!
+			 * OFD requests skip deadlock detection, so they only
+			 * take it if the inode already needs it.
 			 */
 			error = -EDEADLK;
-			spin_lock(&blocked_lock_lock);
+			if (IS_OFDLCK(request)) {
+				locked = locks_lock_blocked(ctx);
+			} else {
+				spin_lock(&blocked_lock_lock);
+				locked = true;
+			}
 			/*
 			 * Ensure that we don't find any locks blocked on this
 			 * request during deadlock detection.
@@ -1187,10 +1326,11 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 			__locks_wake_up_blocks(request);
 			if (likely(!posix_locks_deadlock(request, fl))) {
 				error = FILE_LOCK_DEFERRED;
-				__locks_insert_block(fl, request,
-						     posix_locks_conflict);
+				__locks_insert_block(ctx, fl, request,
+						     posix_locks_conflict,
+						     &locked);
 			}
-			spin_unlock(&blocked_lock_lock);
+			locks_unlock_blocked(locked);
 			goto out;
 		}
 	}
@@ -1200,16 +1340,19 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 	if (request->fl_flags & FL_ACCESS)
 		goto out;
 
-	/* Find the first old lock with the same owner as the new lock */
-	list_for_each_entry(fl, &ctx->flc_posix, fl_list) {
-		if (posix_same_owner(request, fl))
-			break;
-	}
+	/*
+	 * Only locks of this owner that overlap or are adjacent to the
+	 * request can be merged, split or replaced. Merging never grows the
+	 * request far enough to reach a lock outside this range, since two
+	 * locks of the same owner and type are never adjacent.
+	 */
+	start = request->fl_start > 0 ? request->fl_start - 1 : 0;
+	end = request->fl_end < OFFSET_MAX ? request->fl_end + 1 : OFFSET_MAX;
 
-	/* Process locks with this owner. */
-	list_for_each_entry_safe_from(fl, tmp, &ctx->flc_posix, fl_list) {
-		if (!posix_same_owner(request, fl))
-			break;
+	/* Process locks with this owner, in order of their start offset. */
+	for (fl = posix_owner_next(ctx, request, NULL, start, end); fl;
+	     fl = tmp) {
+		tmp = posix_owner_next(ctx, request, fl, start, end);
 
 		/* Detect adjacent or overlapping regions (if same lock type) */
 		if (request->fl_type == fl->fl_type) {
@@ -1230,6 +1373,7 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 			 * lock yielding from the lower start address of both
 			 * locks to the higher end address.
 			 */
+			locks_delete_posix_tree(ctx, fl);
 			if (fl->fl_start > request->fl_start)
 				fl->fl_start = request->fl_start;
 			else
@@ -1268,6 +1412,7 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 				 * one (This may happen several times).
 				 */
 				if (added) {
+					locks_delete_posix_tree(ctx, fl);
 					locks_delete_lock_ctx(fl, &dispose);
 					continue;
 				}
@@ -1284,7 +1429,8 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 				locks_copy_lock(new_fl, request);
 				request = new_fl;
 				new_fl = NULL;
-				locks_insert_lock_ctx(request, &fl->fl_list);
+				locks_insert_lock_ctx(request, &ctx->flc_posix);
+				locks_delete_posix_tree(ctx, fl);
 				locks_delete_lock_ctx(fl, &dispose);
 				added = true;
 			}
@@ -1313,10 +1459,17 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 			goto out;
 		}
 		locks_copy_lock(new_fl, request);
-		locks_move_blocks(new_fl, request);
-		locks_insert_lock_ctx(new_fl, &fl->fl_list);
-		fl = new_fl;
+		locks_move_blocks(ctx, new_fl, request);
+		locks_insert_lock_ctx(new_fl, &ctx->flc_posix);
+		locks_insert_posix_tree(ctx, new_fl);
 		new_fl = NULL;
+	} else if (request->fl_type != F_UNLCK) {
+		/*
+		 * request is now a lock on the list that was merged with or
+		 * replaced older ones, and has been kept out of the tree
+		 * while its range was changing.
+		 */
+		locks_insert_posix_tree(ctx, request);
 	}
 	if (right) {
 		if (left == right) {
@@ -1326,13 +1479,17 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
 			left = new_fl2;
 			new_fl2 = NULL;
 			locks_copy_lock(left, right);
-			locks_insert_lock_ctx(left, &fl->fl_list);
+			locks_insert_lock_ctx(left, &ctx->flc_posix);
 		}
+		locks_delete_posix_tree(ctx, right);
 		right->fl_start = request->fl_end + 1;
+		locks_insert_posix_tree(ctx, right);
 		locks_wake_up_blocks(right);
 	}
 	if (left) {
+		locks_delete_posix_tree(ctx, left);
 		left->fl_end = request->fl_start - 1;
+		locks_insert_posix_tree(ctx, left);
 		locks_wake_up_blocks(left);
 	}
  out:
@@ -1359,7 +1516,7 @@ static int posix_lock_inode(struct inode *inode, struct file_lock *request,
  *
  * Add a POSIX style lock to a file.
  * We merge adjacent & overlapping locks whenever possible.
- * POSIX locks are sorted by owner task, then by starting address
+ * POSIX locks are indexed by byte range in the inode's flc_posix_tree.
  *
  * Note that if called with an FL_EXISTS argument, the caller may determine
  * whether or not a lock was successfully freed by testing the return
@@ -1670,7 +1827,7 @@ int __break_lease(struct inode *inode, unsigned int mode, unsigned int type)
 		break_time -= jiffies;
 	if (break_time == 0)
 		break_time++;
-	locks_insert_block(fl, new_fl, leases_conflict);
+	locks_insert_block(ctx, fl, new_fl, leases_conflict);
 	trace_break_lease_block(inode, new_fl);
 	spin_unlock(&ctx->flc_lock);
 	percpu_up_read(&file_rwsem);
@@ -1683,7 +1840,7 @@ int __break_lease(struct inode *inode, unsigned int mode, unsigned int type)
 	percpu_down_read(&file_rwsem);
 	spin_lock(&ctx->flc_lock);
 	trace_break_lease_unblock(inode, new_fl);
-	locks_delete_block(new_fl);
+	__locks_delete_block_ctx(ctx, new_fl);
 	if (error >= 0) {
 		/*
 		 * Wait for the next conflicting lease that has not been
@@ -2899,6 +3056,7 @@ static int locks_show(struct seq_file *f, void *v)
 {
 	struct locks_iterator *iter = f->private;
 	struct file_lock *fl, *bfl;
+	struct file_lock_context *ctx;
 	struct pid_namespace *proc_pidns = file_inode(f->file)->i_sb->s_fs_info;
 
 	fl = hlist_entry(v, struct file_lock, fl_link);
@@ -2908,8 +3066,12 @@ static int locks_show(struct seq_file *f, void *v)
 
 	lock_get_status(f, fl, iter->li_pos, "");
 
+	/* Waiters can leave without file_rwsem, but not without the flc_lock */
+	ctx = locks_inode(fl->fl_file)->i_flctx;
+	spin_lock(&ctx->flc_lock);
 	list_for_each_entry(bfl, &fl->fl_blocked_requests, fl_blocked_member)
 		lock_get_status(f, bfl, iter->li_pos, " ->");
+	spin_unlock(&ctx->flc_lock);
 
 	return 0;
 }
@@ -2953,13 +3115,11 @@ void show_fd_locks(struct seq_file *f,
 }
 
 static void *locks_start(struct seq_file *f, loff_t *pos)
-	__acquires(&blocked_lock_lock)
 {
 	struct locks_iterator *iter = f->private;
 
 	iter->li_pos = *pos + 1;
 	percpu_down_write(&file_rwsem);
-	spin_lock(&blocked_lock_lock);
 	return seq_hlist_start_percpu(&file_lock_list.hlist, &iter->li_cpu, *pos);
 }
 
@@ -2972,9 +3132,7 @@ static void *locks_next(struct seq_file *f, void *v, loff_t *pos)
 }
 
 static void locks_stop(struct seq_file *f, void *v)
-	__releases(&blocked_lock_lock)
 {
-	spin_unlock(&blocked_lock_lock);
 	percpu_up_write(&file_rwsem);
 }
 
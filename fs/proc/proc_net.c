@@ -77,6 +77,7 @@ static int seq_release_net(struct inode *ino, struct file *f)
 static const struct file_operations proc_net_seq_fops = {
 	.open		= seq_open_net,
 	.read		= seq_read,
+	.read_iter	= seq_read_iter,
 	.write		= proc_simple_write,
 	.llseek		= seq_lseek,
 	.release	= seq_release_net,
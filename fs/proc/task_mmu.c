@@ -635,14 +635,38 @@ static const struct seq_operations proc_pid_maps_op = {
 	.show	= show_map
 };
 
+/*
+ * Size the seq_file buffer for the whole map up front, so that a large
+ * read is answered in one go instead of one page at a time, each with a
+ * fresh vma lookup in m_start().
+ */
+#define MAPS_LINE_HINT		128
+#define MAPS_BUF_HINT_MAX	(128 * 1024)
+
 static int pid_maps_open(struct inode *inode, struct file *file)
 {
-	return do_maps_open(inode, file, &proc_pid_maps_op);
+	struct proc_maps_private *priv;
+	struct seq_file *m;
+	int ret;
+
+	ret = do_maps_open(inode, file, &proc_pid_maps_op);
+	if (ret)
+		return ret;
+
+	m = file->private_data;
+	priv = m->private;
+	if (priv->mm)
+		seq_size_hint(m, min_t(size_t, MAPS_BUF_HINT_MAX,
+				       (size_t)READ_ONCE(priv->mm->map_count) *
+				       MAPS_LINE_HINT));
+	return 0;
 }
 
 const struct file_operations proc_pid_maps_operations = {
 	.open		= pid_maps_open,
 	.read		= seq_read,
+	.read_iter	= seq_read_iter,
+	.splice_read	= generic_file_splice_read,
 	.llseek		= seq_lseek,
 	.release	= proc_map_release,
 };
@@ -1350,6 +1374,10 @@ static int clear_refs_pte_range(pmd_t *pmd, unsigned long addr,
 	if (pmd_trans_unstable(pmd))
 		return 0;
 
+	if (cp->type == CLEAR_REFS_SOFT_DIRTY &&
+	    pte_table_unshare(vma, pmd, addr))
+		return -ENOMEM;
+
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE) {
 		ptent = *pte;
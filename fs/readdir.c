@@ -305,18 +305,77 @@ SYSCALL_DEFINE3(getdents, unsigned int, fd,
 	return error;
 }
 
+/*
+ * Dirents are staged in a small on-stack buffer and copied out a batch at
+ * a time, instead of opening a user access window per entry. The most
+ * recent entry stays in the buffer until its successor (or the end
+ * of the call) supplies its d_off, so d_off rarely has to be patched in
+ * userspace. A 255 byte name needs 280 bytes, but some filesystems (FUSE)
+ * allow longer names: a dirent too big for the buffer is written straight
+ * to userspace after a flush, so it is never staged.
+ */
+#define GETDENTS_BATCH	512
+
 struct getdents_callback64 {
 	struct dir_context ctx;
 	struct linux_dirent64 __user * current_dir;
 	int prev_reclen;
 	int count;
 	int error;
+	int staged;
+	char batch[GETDENTS_BATCH] __aligned(sizeof(u64));
 };
 
+/* Copy the staged dirents, which end at ->current_dir, to userspace. */
+static int getdents64_flush(struct getdents_callback64 *buf)
+{
+	void __user *to = (void __user *)buf->current_dir - buf->staged;
+
+	if (buf->staged && copy_to_user(to, buf->batch, buf->staged))
+		return -EFAULT;
+	buf->staged = 0;
+	return 0;
+}
+
+/* Set d_off of the most recent dirent, staged unless it was too big. */
+static int getdents64_set_prev_off(struct getdents_callback64 *buf,
+				   loff_t offset)
+{
+	struct linux_dirent64 __user *uprev;
+	struct linux_dirent64 *prev;
+
+	if (buf->staged) {
+		prev = (void *)buf->batch + buf->staged - buf->prev_reclen;
+		prev->d_off = offset;
+		return 0;
+	}
+	uprev = (void __user *)buf->current_dir - buf->prev_reclen;
+	return put_user(offset, &uprev->d_off);
+}
+
+static int getdents64_put_large(struct linux_dirent64 __user *dirent,
+				const char *name, int namlen, u64 ino,
+				unsigned int d_type, int reclen)
+{
+	if (!user_access_begin(dirent, reclen))
+		return -EFAULT;
+	unsafe_put_user(ino, &dirent->d_ino, efault_end);
+	unsafe_put_user(0, &dirent->d_off, efault_end);
+	unsafe_put_user(reclen, &dirent->d_reclen, efault_end);
+	unsafe_put_user(d_type, &dirent->d_type, efault_end);
+	unsafe_copy_dirent_name(dirent->d_name, name, namlen, efault_end);
+	user_access_end();
+	return 0;
+
+efault_end:
+	user_access_end();
+	return -EFAULT;
+}
+
 static int filldir64(struct dir_context *ctx, const char *name, int namlen,
 		     loff_t offset, u64 ino, unsigned int d_type)
 {
-	struct linux_dirent64 __user *dirent, *prev;
+	struct linux_dirent64 *dirent;
 	struct getdents_callback64 *buf =
 		container_of(ctx, struct getdents_callback64, ctx);
 	int reclen = ALIGN(offsetof(struct linux_dirent64, d_name) + namlen + 1,
@@ -337,26 +396,37 @@ static int filldir64(struct dir_context *ctx, const char *name, int namlen,
 			return 0;
 		}
 #endif
-	dirent = buf->current_dir;
-	prev = (void __user *)dirent - prev_reclen;
-	if (!user_access_begin(prev, reclen + prev_reclen))
+	if (prev_reclen && getdents64_set_prev_off(buf, offset))
 		goto efault;
 
-	/* This might be 'dirent->d_off', but if so it will get overwritten */
-	unsafe_put_user(offset, &prev->d_off, efault_end);
-	unsafe_put_user(ino, &dirent->d_ino, efault_end);
-	unsafe_put_user(reclen, &dirent->d_reclen, efault_end);
-	unsafe_put_user(d_type, &dirent->d_type, efault_end);
-	unsafe_copy_dirent_name(dirent->d_name, name, namlen, efault_end);
-	user_access_end();
+	if (unlikely(reclen > GETDENTS_BATCH)) {
+		if (getdents64_flush(buf) ||
+		    getdents64_put_large(buf->current_dir, name, namlen, ino,
+					 d_type, reclen))
+			goto efault;
+		goto out;
+	}
+
+	if (buf->staged + reclen > GETDENTS_BATCH && getdents64_flush(buf))
+		goto efault;
 
+	dirent = (void *)buf->batch + buf->staged;
+	dirent->d_ino = ino;
+	dirent->d_off = 0;
+	dirent->d_reclen = reclen;
+	dirent->d_type = d_type;
+	memcpy(dirent->d_name, name, namlen);
+	/* NUL terminator plus padding: don't leak stack to userspace */
+	memset(dirent->d_name + namlen, 0,
+	       reclen - offsetof(struct linux_dirent64, d_name) - namlen);
+
+	buf->staged += reclen;
+out:
 	buf->prev_reclen = reclen;
-	buf->current_dir = (void __user *)dirent + reclen;
+	buf->current_dir = (void __user *)buf->current_dir + reclen;
 	buf->count -= reclen;
 	return 0;
 
-efault_end:
-	user_access_end();
 efault:
 	buf->error = -EFAULT;
 	return -EFAULT;
@@ -384,11 +454,8 @@ int ksys_getdents64(unsigned int fd, struct linux_dirent64 __user *dirent,
 	if (error >= 0)
 		error = buf.error;
 	if (buf.prev_reclen) {
-		struct linux_dirent64 __user * lastdirent;
-		typeof(lastdirent->d_off) d_off = buf.ctx.pos;
-
-		lastdirent = (void __user *) buf.current_dir - buf.prev_reclen;
-		if (__put_user(d_off, &lastdirent->d_off))
+		if (getdents64_set_prev_off(&buf, buf.ctx.pos) ||
+		    getdents64_flush(&buf))
 			error = -EFAULT;
 		else
 			error = count - buf.count;
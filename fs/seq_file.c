@@ -16,6 +16,7 @@
 #include <linux/mm.h>
 #include <linux/printk.h>
 #include <linux/string_helpers.h>
+#include <linux/uio.h>
 
 #include <linux/uaccess.h>
 #include <asm/page.h>
@@ -144,6 +145,41 @@ static int traverse(struct seq_file *m, loff_t offset)
 	return !m->buf ? -ENOMEM : -EAGAIN;
 }
 
+/**
+ *	seq_size_hint -	size the buffer of a sequential file up front
+ *	@m: the seq_file
+ *	@size: expected size of the output of one read
+ *
+ *	Producers whose output is known to be large can call this from their
+ *	->open() after seq_open(), so that reads do not have to start with a
+ *	PAGE_SIZE buffer and restart the iteration every time it overflows.
+ *	The buffer is kept across reads until the file is released. Failure
+ *	is not fatal: the buffer is then grown on demand as usual.
+ */
+void seq_size_hint(struct seq_file *m, size_t size)
+{
+	char *buf;
+
+	size = PAGE_ALIGN(size);
+	if (size <= PAGE_SIZE || (m->buf && m->size >= size))
+		return;
+
+	buf = seq_buf_alloc(size);
+	if (!buf)
+		return;
+
+	mutex_lock(&m->lock);
+	if (!m->count) {
+		kvfree(m->buf);
+		m->buf = buf;
+		m->size = size;
+		buf = NULL;
+	}
+	mutex_unlock(&m->lock);
+	kvfree(buf);
+}
+EXPORT_SYMBOL(seq_size_hint);
+
 /**
  *	seq_read -	->read() method for sequential files.
  *	@file: the file to read from
@@ -155,12 +191,43 @@ static int traverse(struct seq_file *m, loff_t offset)
  */
 ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 {
+	struct iovec iov = { .iov_base = buf, .iov_len = size };
+	struct kiocb kiocb;
+	struct iov_iter iter;
+	ssize_t ret;
+
+	init_sync_kiocb(&kiocb, file);
+	iov_iter_init(&iter, READ, &iov, 1, size);
+
+	kiocb.ki_pos = *ppos;
+	ret = seq_read_iter(&kiocb, &iter);
+	*ppos = kiocb.ki_pos;
+	return ret;
+}
+EXPORT_SYMBOL(seq_read);
+
+/**
+ *	seq_read_iter -	->read_iter() method for sequential files.
+ *	@iocb: the kiocb of the read, with the file and position
+ *	@iter: the destination of the read
+ *
+ *	Ready-made ->f_op->read_iter(). Together with
+ *	generic_file_splice_read() this lets seq_files be read through
+ *	readv(), splice() and io_uring without a bounce through userspace.
+ */
+ssize_t seq_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
 	struct seq_file *m = file->private_data;
+	size_t size = iov_iter_count(iter);
 	size_t copied = 0;
 	size_t n;
 	void *p;
 	int err = 0;
 
+	if (!size)
+		return 0;
+
 	mutex_lock(&m->lock);
 
 	/*
@@ -180,15 +247,15 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 	 * if request is to read from zero offset, reset iterator to first
 	 * record as it might have been already advanced by previous requests
 	 */
-	if (*ppos == 0) {
+	if (iocb->ki_pos == 0) {
 		m->index = 0;
 		m->version = 0;
 		m->count = 0;
 	}
 
-	/* Don't assume *ppos is where we left it */
-	if (unlikely(*ppos != m->read_pos)) {
-		while ((err = traverse(m, *ppos)) == -EAGAIN)
+	/* Don't assume ki_pos is where we left it */
+	if (unlikely(iocb->ki_pos != m->read_pos)) {
+		while ((err = traverse(m, iocb->ki_pos)) == -EAGAIN)
 			;
 		if (err) {
 			/* With prejudice... */
@@ -198,7 +265,7 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 			m->count = 0;
 			goto Done;
 		} else {
-			m->read_pos = *ppos;
+			m->read_pos = iocb->ki_pos;
 		}
 	}
 
@@ -210,16 +277,12 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 	}
 	/* if not empty - flush it first */
 	if (m->count) {
-		n = min(m->count, size);
-		err = copy_to_user(buf, m->buf + m->from, n);
-		if (err)
-			goto Efault;
+		n = copy_to_iter(m->buf + m->from, m->count, iter);
 		m->count -= n;
 		m->from += n;
 		size -= n;
-		buf += n;
 		copied += n;
-		if (!size)
+		if (m->count || !size)
 			goto Done;
 	}
 	/* we need at least one record in buffer */
@@ -276,18 +339,15 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 		}
 	}
 	m->op->stop(m, p);
-	n = min(m->count, size);
-	err = copy_to_user(buf, m->buf, n);
-	if (err)
-		goto Efault;
+	n = copy_to_iter(m->buf, m->count, iter);
 	copied += n;
 	m->count -= n;
 	m->from = n;
 Done:
 	if (!copied)
-		copied = err;
+		copied = m->count ? -EFAULT : err;
 	else {
-		*ppos += copied;
+		iocb->ki_pos += copied;
 		m->read_pos += copied;
 	}
 	file->f_version = m->version;
@@ -296,11 +356,8 @@ ssize_t seq_read(struct file *file, char __user *buf, size_t size, loff_t *ppos)
 Enomem:
 	err = -ENOMEM;
 	goto Done;
-Efault:
-	err = -EFAULT;
-	goto Done;
 }
-EXPORT_SYMBOL(seq_read);
+EXPORT_SYMBOL(seq_read_iter);
 
 /**
  *	seq_lseek -	->llseek() method for sequential files.
@@ -79,6 +79,8 @@ struct linux_binprm {
 #define BINPRM_FLAGS_PATH_INACCESSIBLE (1 << BINPRM_FLAGS_PATH_INACCESSIBLE_BIT)
 
 /* Function parameter for binfmt->coredump */
+struct core_stream;
+
 struct coredump_params {
 	const kernel_siginfo_t *siginfo;
 	struct pt_regs *regs;
@@ -87,6 +89,7 @@ struct coredump_params {
 	unsigned long mm_flags;
 	loff_t written;
 	loff_t pos;
+	struct core_stream *stream;
 };
 
 /*
@@ -127,6 +130,13 @@ extern void would_dump(struct linux_binprm *, struct file *);
 
 extern int suid_dumpable;
 
+/* Values for exec_prefetch (fs.exec_prefetch sysctl) */
+#define EXEC_PREFETCH_OFF	0	/* Leave text to demand paging */
+#define EXEC_PREFETCH_READAHEAD	1	/* Read ahead text and relro */
+#define EXEC_PREFETCH_POPULATE	2	/* ...and map recorded hot pages */
+
+extern int exec_prefetch;
+
 /* Stack area protections */
 #define EXSTACK_DEFAULT   0	/* Whatever the arch defaults to */
 #define EXSTACK_DISABLE_X 1	/* Disable executable stacks */
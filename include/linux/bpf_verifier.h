@@ -52,6 +52,9 @@ struct bpf_reg_state {
 		 */
 		struct bpf_map *map_ptr;
 
+		/* valid when type == PTR_TO_MEM | PTR_TO_MEM_OR_NULL */
+		u32 mem_size;
+
 		/* Max size from any of the above. */
 		unsigned long raw;
 	};
@@ -285,6 +288,8 @@ struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
 	struct bpf_verifier_state_list *next;
 	int miss_cnt, hit_cnt;
+	/* hash of what states_equal() compares exactly, see state_sig() */
+	u32 sig;
 };
 
 /* Possible states for alu_state member. */
@@ -402,6 +407,11 @@ struct bpf_verifier_env {
 	u32 peak_states;
 	/* longest register parentage chain walked for liveness marking */
 	u32 longest_mark_read_walk;
+	/* explored states looked at in is_state_visited(), and how many of
+	 * them were ruled out by their signature without a full comparison
+	 */
+	u32 states_compared;
+	u32 states_sig_skipped;
 };
 
 __printf(2, 0) void bpf_verifier_vlog(struct bpf_verifier_log *log,
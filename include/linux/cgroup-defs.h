@@ -33,6 +33,7 @@ struct kernfs_ops;
 struct kernfs_open_file;
 struct seq_file;
 struct poll_table_struct;
+struct eventfd_ctx;
 
 #define MAX_CGROUP_TYPE_NAMELEN 32
 #define MAX_CGROUP_ROOT_NAMELEN 64
@@ -344,8 +345,30 @@ struct cgroup_freezer_state {
 	/* Should the cgroup actually be frozen? */
 	int e_freeze;
 
+	/*
+	 * Bumped under css_set_lock whenever CGRP_FREEZE changes, read
+	 * locklessly by tasks to notice that, see cgroup_freezer_sync().
+	 */
+	unsigned int gen;
+
 	/* Fields below are protected by css_set_lock */
 
+	/* Signalled whenever CGRP_FROZEN changes, see cgroup.freeze.event */
+	struct eventfd_ctx *event;
+
+	/* When CGRP_FREEZE and CGRP_FROZEN were last set, in ns */
+	u64 freeze_start;
+	u64 frozen_start;
+
+	/* Time spent frozen, not counting the current stretch */
+	u64 frozen_time;
+
+	/* Time it took the last freeze to complete */
+	u64 freeze_latency;
+
+	/* Number of times the cgroup became frozen */
+	u64 nr_freezes;
+
 	/* Number of frozen descendant cgroups */
 	int nr_frozen_descendants;
 
@@ -762,6 +762,7 @@ void cgroup_rstat_updated(struct cgroup *cgrp, int cpu);
 void cgroup_rstat_flush(struct cgroup *cgrp);
 void cgroup_rstat_flush_irqsafe(struct cgroup *cgrp);
 void cgroup_rstat_flush_hold(struct cgroup *cgrp);
+void cgroup_rstat_flush_hold_ratelimited(struct cgroup *cgrp);
 void cgroup_rstat_flush_release(void);
 
 /*
@@ -912,6 +913,7 @@ static inline void put_cgroup_ns(struct cgroup_namespace *ns)
 void cgroup_enter_frozen(void);
 void cgroup_leave_frozen(bool always_leave);
 void cgroup_update_frozen(struct cgroup *cgrp);
+void cgroup_freezer_sync(void);
 void cgroup_freeze(struct cgroup *cgrp, bool freeze);
 void cgroup_freezer_migrate_task(struct task_struct *task, struct cgroup *src,
 				 struct cgroup *dst);
@@ -935,6 +937,27 @@ static inline bool cgroup_task_frozen(struct task_struct *task)
 	return task->frozen;
 }
 
+/*
+ * Has CGRP_FREEZE of the task's cgroup changed since the task last synced
+ * its JOBCTL_TRAP_FREEZE with it?  The freezer doesn't touch the jobctl of
+ * the tasks it freezes or thaws, it only bumps the cgroup's generation and
+ * kicks them into get_signal().
+ */
+static inline bool cgroup_task_freeze_changed(struct task_struct *task)
+{
+	bool ret;
+
+	if (task->flags & PF_KTHREAD)
+		return false;
+
+	rcu_read_lock();
+	ret = READ_ONCE(task_dfl_cgroup(task)->freezer.gen) !=
+		READ_ONCE(task->cgroup_freeze_gen);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 #else /* !CONFIG_CGROUPS */
 
 static inline void cgroup_enter_frozen(void) { }
@@ -947,6 +970,11 @@ static inline bool cgroup_task_frozen(struct task_struct *task)
 {
 	return false;
 }
+static inline bool cgroup_task_freeze_changed(struct task_struct *task)
+{
+	return false;
+}
+static inline void cgroup_freezer_sync(void) { }
 
 #endif /* !CONFIG_CGROUPS */
 
@@ -2,6 +2,7 @@
 #define KFRECESS_H
 
 #include <linux/sched.h>
+#include <linux/ioctl.h>
 
 #define KERNEL_ID_NETLINK      0x12341234
 #define UID_MIN_VALUE          10000
@@ -75,6 +76,35 @@ struct kfreecess_msg_data
 };
 
 
+/*
+ *  Shared memory report channel
+ *  Instead of one netlink message per report, the FW can open /dev/freecess,
+ *  bind the file to one mod with FREECESS_IOC_BIND and mmap it. The mapping
+ *  starts with a kfreecess_ring_hdr, followed by nr_slots kfreecess_msg_data
+ *  slots at slot_offset. The kernel fills slots[head % nr_slots] and bumps
+ *  head, the FW consumes slots[tail % nr_slots] and bumps tail; poll() says
+ *  POLLIN while head != tail. Reports that find the ring full are counted in
+ *  dropped, binder reports repeating the uid/code of one delivered within
+ *  the coalesce window are counted in coalesced. MSG_TO_USER reports for a
+ *  mod go to its ring while one is bound, and over netlink otherwise.
+ */
+#define FREECESS_RING_VERSION  1
+
+struct kfreecess_ring_hdr
+{
+	unsigned int version;
+	unsigned int nr_slots;		// power of 2
+	unsigned int slot_offset;	// from the start of the mapping
+	unsigned int slot_size;
+	unsigned int dropped;
+	unsigned int coalesced;
+	unsigned int head __attribute__((aligned(64)));	// written by the kernel
+	unsigned int tail __attribute__((aligned(64)));	// written by the FW
+};
+
+#define FREECESS_IOC_MAGIC     'F'
+#define FREECESS_IOC_BIND      _IOW(FREECESS_IOC_MAGIC, 1, int)
+
 extern int freecess_fw_version;    // record freecess framework version
 
 typedef void (*freecess_hook)(void* data, unsigned int len);
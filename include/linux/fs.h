@@ -48,6 +48,7 @@
 
 struct backing_dev_info;
 struct bdi_writeback;
+struct bpf_local_storage;
 struct bio;
 struct export_operations;
 struct hd_geometry;
@@ -763,6 +764,10 @@ struct inode {
 	struct fsverity_info	*i_verity_info;
 #endif
 
+#ifdef CONFIG_BPF_SYSCALL
+	struct bpf_local_storage __rcu	*i_bpf_storage;
+#endif
+
 	void			*i_private; /* fs or device private pointer */
 
 	ANDROID_KABI_RESERVE(1);
@@ -1136,6 +1141,8 @@ struct file_lock {
 	struct file *fl_file;
 	loff_t fl_start;
 	loff_t fl_end;
+	struct rb_node fl_rb;		/* node in ->flc_posix_tree */
+	loff_t fl_rb_subtree_last;	/* max fl_end in this subtree */
 
 	struct fasync_struct *	fl_fasync; /* for lease break notifications */
 	/* for lease breaks: */
@@ -1163,7 +1170,9 @@ struct file_lock_context {
 	spinlock_t		flc_lock;
 	struct list_head	flc_flock;
 	struct list_head	flc_posix;
+	struct rb_root_cached	flc_posix_tree;	/* posix locks by range */
 	struct list_head	flc_lease;
+	unsigned int		flc_blocked_hashed; /* waiters in blocked_hash */
 };
 
 /* The following constant reflects the upper bound of the file/locking space */
@@ -1955,6 +1964,7 @@ struct inode_operations {
 			   umode_t create_mode);
 	int (*tmpfile) (struct inode *, struct dentry *, umode_t);
 	int (*set_acl)(struct inode *, struct posix_acl *, int);
+	struct offset_ctx *(*get_offset_ctx)(struct inode *inode);
 
 	ANDROID_KABI_RESERVE(1);
 	ANDROID_KABI_RESERVE(2);
@@ -3417,6 +3427,28 @@ extern struct dentry *simple_lookup(struct inode *, struct dentry *, unsigned in
 extern ssize_t generic_read_dir(struct file *, char __user *, size_t, loff_t *);
 extern const struct file_operations simple_dir_operations;
 extern const struct inode_operations simple_dir_inode_operations;
+
+/*
+ * Per-directory offset map for filesystems that keep their whole namespace
+ * in the dcache: each entry gets a stable readdir offset when it is linked.
+ */
+struct offset_ctx {
+	struct xarray		xa;
+	u32			next_offset;
+};
+
+void simple_offset_init(struct offset_ctx *octx);
+int simple_offset_add(struct offset_ctx *octx, struct dentry *dentry);
+void simple_offset_remove(struct offset_ctx *octx, struct dentry *dentry);
+int simple_offset_rename(struct inode *old_dir, struct dentry *old_dentry,
+			 struct inode *new_dir);
+int simple_offset_rename_exchange(struct inode *old_dir,
+				  struct dentry *old_dentry,
+				  struct inode *new_dir,
+				  struct dentry *new_dentry);
+void simple_offset_destroy(struct offset_ctx *octx);
+extern const struct file_operations simple_offset_dir_operations;
+
 extern void make_empty_dir_inode(struct inode *inode);
 extern bool is_empty_dir_inode(struct inode *inode);
 struct tree_descr { const char *name; const struct file_operations *ops; int mode; };
@@ -77,6 +77,13 @@ void futex_exec_release(struct task_struct *tsk);
 
 long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	      u32 __user *uaddr2, u32 val2, u32 val3);
+
+extern unsigned int sysctl_futex_private_hash;
+
+void futex_mm_init(struct mm_struct *mm);
+void futex_hash_free(struct mm_struct *mm);
+void futex_hash_allocate_default(void);
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3);
 #else
 static inline void futex_init_task(struct task_struct *tsk) { }
 static inline void futex_exit_recursive(struct task_struct *tsk) { }
@@ -88,6 +95,13 @@ static inline long do_futex(u32 __user *uaddr, int op, u32 val,
 {
 	return -EINVAL;
 }
+static inline void futex_mm_init(struct mm_struct *mm) { }
+static inline void futex_hash_free(struct mm_struct *mm) { }
+static inline void futex_hash_allocate_default(void) { }
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	return -EINVAL;
+}
 #endif
 
 #endif
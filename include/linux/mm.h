@@ -2102,6 +2102,9 @@ static inline bool pgtable_pte_page_ctor(struct page *page)
 {
 	if (!ptlock_init(page))
 		return false;
+#ifdef CONFIG_FORK_SHARED_PTE
+	atomic_set(&page->pt_share_count, 0);
+#endif
 	__SetPageTable(page);
 	inc_zone_page_state(page, NR_PAGETABLE);
 	return true;
@@ -2141,6 +2144,59 @@ static inline void pgtable_pte_page_dtor(struct page *page)
 	((unlikely(pmd_none(*(pmd))) && __pte_alloc_kernel(pmd))? \
 		NULL: pte_offset_kernel(pmd, address))
 
+#ifdef CONFIG_FORK_SHARED_PTE
+/*
+ * Whether @pmd points to a pte table that fork shared between @mm and other
+ * mms.  Such a table must not be modified, see pte_table_unshare().
+ */
+static inline bool pte_table_shared(struct mm_struct *mm, pmd_t pmd)
+{
+	return test_bit(MMF_HAS_SHARED_PTE, &mm->flags) &&
+	       pmd_present(pmd) && !pmd_trans_huge(pmd) && !pmd_devmap(pmd) &&
+	       atomic_read(&pmd_page(pmd)->pt_share_count);
+}
+
+extern int __pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			       unsigned long addr);
+extern int __pte_table_unshare_range(struct vm_area_struct *vma,
+				     unsigned long start, unsigned long end);
+
+static inline int pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+				    unsigned long addr)
+{
+	if (!pte_table_shared(vma->vm_mm, READ_ONCE(*pmd)))
+		return 0;
+	return __pte_table_unshare(vma, pmd, addr);
+}
+
+static inline int pte_table_unshare_range(struct vm_area_struct *vma,
+					  unsigned long start,
+					  unsigned long end)
+{
+	if (!test_bit(MMF_HAS_SHARED_PTE, &vma->vm_mm->flags))
+		return 0;
+	return __pte_table_unshare_range(vma, start, end);
+}
+#else
+static inline bool pte_table_shared(struct mm_struct *mm, pmd_t pmd)
+{
+	return false;
+}
+
+static inline int pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+				    unsigned long addr)
+{
+	return 0;
+}
+
+static inline int pte_table_unshare_range(struct vm_area_struct *vma,
+					  unsigned long start,
+					  unsigned long end)
+{
+	return 0;
+}
+#endif
+
 #if USE_SPLIT_PMD_PTLOCKS
 
 static struct page *pmd_to_page(pmd_t *pmd)
@@ -150,6 +150,8 @@ struct page {
 			union {
 				struct mm_struct *pt_mm; /* x86 pgds only */
 				atomic_t pt_frag_refcount; /* powerpc */
+				/* extra mms mapping this pte table */
+				atomic_t pt_share_count;
 			};
 #if ALLOC_SPLIT_PTLOCKS
 			spinlock_t *ptl;
@@ -385,6 +387,7 @@ struct core_state {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct {
 		struct vm_area_struct *mmap;		/* list of VMAs */
@@ -489,6 +492,11 @@ struct mm_struct {
 
 		struct core_state *core_state; /* coredumping support */
 
+#ifdef CONFIG_FUTEX
+		/* private futex hash, NULL when using the global one */
+		struct futex_private_hash *futex_phash;
+#endif
+
 #ifdef CONFIG_AIO
 		spinlock_t			ioctx_lock;
 		struct kioctx_table __rcu	*ioctx_table;
@@ -14,6 +14,7 @@ enum {
 	FRAME_END,
 	FPS_NUM,
 	PROCESS_KILL,
+	BATCH,
 };
 
 struct fps_info {
@@ -23,18 +24,38 @@ struct fps_info {
 	int64_t duration;
 };
 
+/*
+ * PERF_MGR_BATCH runs cmd (TASK_ADD, FRAME_END or PROCESS_KILL) for each of
+ * the nr fps_info entries at infos, in order, and returns how many were
+ * handled.  PROCESS_KILL only looks at the tid of an entry.
+ */
+struct fps_info_batch {
+	__u64 infos;
+	__u32 nr;
+	__u32 cmd;
+};
+
+#define GPIS_BATCH_MAX 256
+
+struct gpis_group;
+
 struct task_fps_util_info{
 	struct fps_info orig_fps_info;
 	unsigned long updated_fps_util;
 	int running_cpu;
 	int last_update_frame;
 	struct list_head list;
+	struct hlist_node tid_node;
+	struct list_head group_list;
+	struct gpis_group *group;
+	struct rcu_head rcu;
 };
 
 #define PERF_MGR_FPS_CHANGE				_IOWR(PERF_MGR_MAGIC, FPS_NUM, int*)
 #define PERF_MGR_PROCESS_KILL			_IOWR(PERF_MGR_MAGIC, PROCESS_KILL, int*)
 #define PERF_MGR_TASK_ADD				_IOWR(PERF_MGR_MAGIC, TASK_ADD, int*)
 #define PERF_MGR_FRAME_END				_IOWR(PERF_MGR_MAGIC, FRAME_END, struct fps_info)
+#define PERF_MGR_BATCH					_IOWR(PERF_MGR_MAGIC, BATCH, struct fps_info_batch)
 
 #define perf_attr(_name) \
 static struct kobj_attribute _name##_attr = {	\
@@ -38,6 +38,7 @@
 struct audit_context;
 struct backing_dev_info;
 struct bio_list;
+struct bpf_local_storage;
 struct blk_plug;
 struct capture_control;
 struct cfs_rq;
@@ -1221,12 +1222,20 @@ struct task_struct {
 	seqcount_t			mems_allowed_seq;
 	int				cpuset_mem_spread_rotor;
 	int				cpuset_slab_spread_rotor;
+	/* Deferred cpuset cpumask update, bit 0 set while queued: */
+	unsigned long			cpuset_affinity_pending;
+	struct callback_head		cpuset_affinity_work;
+	/* Affinity changes, and their count when the update was queued: */
+	unsigned int			cpuset_affinity_seq;
+	unsigned int			cpuset_affinity_queued_seq;
 #endif
 #ifdef CONFIG_CGROUPS
 	/* Control Group info protected by css_set_lock: */
 	struct css_set __rcu		*cgroups;
 	/* cg_list protected by css_set_lock and tsk->alloc_lock: */
 	struct list_head		cg_list;
+	/* cgroup freezer generation last seen in get_signal(): */
+	unsigned int			cgroup_freeze_gen;
 #endif
 #ifdef CONFIG_X86_CPU_RESCTRL
 	u32				closid;
@@ -1455,6 +1464,10 @@ struct task_struct {
 	/* Used by LSM modules for access restriction: */
 	void				*security;
 #endif
+#ifdef CONFIG_BPF_SYSCALL
+	/* Used by BPF task local storage */
+	struct bpf_local_storage __rcu	*bpf_storage;
+#endif
 #ifdef CONFIG_SEC_PERF_MANAGER
 	int drawing_flag;
 	int drawing_mig_boost;
@@ -22,6 +22,7 @@ struct shmem_inode_info {
 	struct shared_policy	policy;		/* NUMA memory alloc policy */
 	struct simple_xattrs	xattrs;		/* list of xattrs */
 	atomic_t		stop_eviction;	/* hold when working on inode */
+	struct offset_ctx	dir_offsets;	/* stable directory offsets */
 	struct inode		vfs_inode;
 };
 
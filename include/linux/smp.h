@@ -111,6 +111,12 @@ int smp_call_function_any(const struct cpumask *mask,
 void kick_all_cpus_sync(void);
 void wake_up_all_idle_cpus(void);
 
+/*
+ * Batch the IPIs of several asynchronous calls
+ */
+void smp_call_function_plug(void);
+void smp_call_function_unplug(void);
+
 /*
  * Generic and arch helpers
  */
@@ -118,6 +124,7 @@ void __init call_function_init(void);
 void generic_smp_call_function_single_interrupt(void);
 #define generic_smp_call_function_interrupt \
 	generic_smp_call_function_single_interrupt
+bool arch_send_call_function_ipi_allbutself(void);
 
 /*
  * Mark the boot cpu "online" so that it can call console drivers in
@@ -186,6 +193,8 @@ smp_call_function_any(const struct cpumask *mask, smp_call_func_t func,
 
 static inline void kick_all_cpus_sync(void) {  }
 static inline void wake_up_all_idle_cpus(void) {  }
+static inline void smp_call_function_plug(void) { }
+static inline void smp_call_function_unplug(void) { }
 
 #ifdef CONFIG_UP_LATE_INIT
 extern void __init up_late_init(void);
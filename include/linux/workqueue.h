@@ -12,6 +12,7 @@
 #include <linux/lockdep.h>
 #include <linux/threads.h>
 #include <linux/atomic.h>
+#include <linux/llist.h>
 #include <linux/cpumask.h>
 #include <linux/rcupdate.h>
 #include <linux/android_kabi.h>
@@ -103,7 +104,14 @@ enum {
 
 struct work_struct {
 	atomic_long_t data;
-	struct list_head entry;
+	union {
+		struct list_head entry;
+		/* while staged on the pool's lockless pending list */
+		struct {
+			struct llist_node llnode;
+			void *staged_pwq;
+		};
+	};
 	work_func_t func;
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
@@ -136,6 +144,22 @@ struct rcu_work {
 	struct workqueue_struct *wq;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  CPUs which share the unit named
+ * by the scope form a pod and work items issued on a CPU are executed by
+ * the workers of its pod.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT */
+	WQ_AFFN_CACHE,			/* one pod per LLC / cluster */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -153,11 +177,40 @@ struct workqueue_attrs {
 	cpumask_var_t cpumask;
 
 	/**
-	 * @no_numa: disable NUMA affinity
+	 * @__pod_cpumask: internal attribute used to create per-pod pools
+	 *
+	 * Internal use only.  The CPUs of the pod a worker_pool serves.  Work
+	 * items are started on these CPUs; whether the workers may leave them
+	 * is controlled by @affn_strict.
+	 */
+	cpumask_var_t __pod_cpumask;
+
+	/**
+	 * @affn_strict: affinity scope is strict
+	 *
+	 * If clear, workers of a pod are started inside the pod but may be
+	 * moved by the scheduler anywhere in @cpumask.  If set, they are
+	 * confined to @__pod_cpumask.
+	 */
+	bool affn_strict;
+
+	/*
+	 * Below fields aren't properties of a worker_pool.  They only modify
+	 * how :c:func:`apply_workqueue_attrs` select pools and thus don't
+	 * participate in pool hash calculations or equality comparisons.
+	 */
+
+	/**
+	 * @affn_scope: unbound CPU affinity scope
 	 *
-	 * Unlike other fields, ``no_numa`` isn't a property of a worker_pool. It
-	 * only modifies how :c:func:`apply_workqueue_attrs` select pools and thus
-	 * doesn't participate in pool hash calculations or equality comparisons.
+	 * CPU pods are used to improve execution locality of unbound work
+	 * items.  There are multiple pod types, one for each wq_affn_scope,
+	 * and every CPU in the system belongs to one pod in every pod type.
+	 */
+	enum wq_affn_scope affn_scope;
+
+	/**
+	 * @no_numa: disable pod affinity, use one pool for all CPUs
 	 */
 	bool no_numa;
 };
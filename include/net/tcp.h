@@ -1958,6 +1958,10 @@ struct tcp_iter_state {
 	struct sock		*syn_wait_sk;
 	int			bucket, offset, sbucket, num;
 	loff_t			last_pos;
+#ifdef CONFIG_BPF_SYSCALL
+	/* set by the BPF iterator, which has no proc entry */
+	struct tcp_seq_afinfo	*bpf_seq_afinfo;
+#endif
 };
 
 extern struct request_sock_ops tcp_request_sock_ops;
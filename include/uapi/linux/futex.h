@@ -21,6 +21,7 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_WAITV		31
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -41,6 +42,27 @@
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 
+/*
+ * FUTEX_WAITV: wait on up to FUTEX_WAITV_MAX futexes at once.
+ *
+ *   futex(waiters, FUTEX_WAITV [| FUTEX_CLOCK_REALTIME], nr_waiters,
+ *         abs_timeout, NULL, 0)
+ *
+ * Returns the index of a futex that was woken. The timeout is absolute,
+ * measured on CLOCK_MONOTONIC unless FUTEX_CLOCK_REALTIME is given. Each
+ * entry must have FUTEX_32 set in @flags, plus FUTEX_PRIVATE_FLAG for a
+ * process private futex.
+ */
+#define FUTEX_32		2
+#define FUTEX_WAITV_MAX		128
+
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
  * thread exit time.
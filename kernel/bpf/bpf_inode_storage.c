@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF local storage hung off struct inode.
+ *
+ * The storage of an inode is freed when the inode is destroyed, so it
+ * can't outlive the object it describes the way an inode number keyed
+ * hash entry does.
+ */
+#include <linux/rculist.h>
+#include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/bpf.h>
+#include <linux/bpf_local_storage.h>
+#include <linux/fdtable.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <uapi/linux/btf.h>
+
+DEFINE_BPF_STORAGE_CACHE(inode_cache);
+
+static DEFINE_PER_CPU(int, bpf_inode_storage_busy);
+
+static struct bpf_local_storage __rcu **inode_storage_ptr(void *owner)
+{
+	struct inode *inode = owner;
+
+	return &inode->i_bpf_storage;
+}
+
+static struct bpf_local_storage_data *
+inode_storage_lookup(struct inode *inode, struct bpf_map *map,
+		     bool cacheit_lockit)
+{
+	struct bpf_local_storage *inode_storage;
+	struct bpf_local_storage_map *smap;
+
+	inode_storage = rcu_dereference(inode->i_bpf_storage);
+	if (!inode_storage)
+		return NULL;
+
+	smap = (struct bpf_local_storage_map *)map;
+	return bpf_local_storage_lookup(inode_storage, smap, cacheit_lockit);
+}
+
+static int inode_storage_delete(struct inode *inode, struct bpf_map *map)
+{
+	struct bpf_local_storage_data *sdata;
+
+	sdata = inode_storage_lookup(inode, map, false);
+	if (!sdata)
+		return -ENOENT;
+
+	bpf_selem_unlink(SELEM(sdata));
+
+	return 0;
+}
+
+/* Called by __destroy_inode() */
+void bpf_inode_storage_free(struct inode *inode)
+{
+	struct bpf_local_storage *local_storage;
+
+	if (!rcu_access_pointer(inode->i_bpf_storage))
+		return;
+
+	rcu_read_lock();
+	local_storage = rcu_dereference(inode->i_bpf_storage);
+	if (local_storage) {
+		bpf_local_storage_busy_lock(&bpf_inode_storage_busy);
+		bpf_local_storage_destroy(local_storage);
+		bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+	}
+	rcu_read_unlock();
+}
+
+static void *bpf_fd_inode_storage_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_local_storage_data *sdata;
+	struct file *f;
+
+	f = fget_raw(*(int *)key);
+	if (!f)
+		return ERR_PTR(-EBADF);
+
+	bpf_local_storage_busy_lock(&bpf_inode_storage_busy);
+	sdata = inode_storage_lookup(file_inode(f), map, true);
+	bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+	fput(f);
+	return sdata ? sdata->data : NULL;
+}
+
+static int bpf_fd_inode_storage_update_elem(struct bpf_map *map, void *key,
+					    void *value, u64 map_flags)
+{
+	struct bpf_local_storage_data *sdata;
+	struct file *f;
+
+	f = fget_raw(*(int *)key);
+	if (!f)
+		return -EBADF;
+
+	bpf_local_storage_busy_lock(&bpf_inode_storage_busy);
+	sdata = bpf_local_storage_update(file_inode(f),
+					 (struct bpf_local_storage_map *)map,
+					 value, map_flags);
+	bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+	fput(f);
+	return PTR_ERR_OR_ZERO(sdata);
+}
+
+static int bpf_fd_inode_storage_delete_elem(struct bpf_map *map, void *key)
+{
+	struct file *f;
+	int err;
+
+	f = fget_raw(*(int *)key);
+	if (!f)
+		return -EBADF;
+
+	bpf_local_storage_busy_lock(&bpf_inode_storage_busy);
+	err = inode_storage_delete(file_inode(f), map);
+	bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+	fput(f);
+	return err;
+}
+
+static int notsupp_get_next_key(struct bpf_map *map, void *key,
+				void *next_key)
+{
+	return -ENOTSUPP;
+}
+
+static struct bpf_map *inode_storage_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = bpf_local_storage_map_alloc(attr);
+	if (IS_ERR(smap))
+		return ERR_CAST(smap);
+
+	smap->cache_idx = bpf_local_storage_cache_idx_get(&inode_cache);
+	return &smap->map;
+}
+
+static void inode_storage_map_free(struct bpf_map *map)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = (struct bpf_local_storage_map *)map;
+	bpf_local_storage_cache_idx_free(&inode_cache, smap->cache_idx);
+	bpf_local_storage_map_free(smap, &bpf_inode_storage_busy);
+}
+
+/* Programs name the inode by a file descriptor of the current task.
+ * Files and inodes are freed after an RCU grace period and programs
+ * run under rcu_read_lock(), so the inode can be looked at without a
+ * reference.  Adding storage to it needs one though: the inode must
+ * not get past bpf_inode_storage_free() before the new elem is linked.
+ */
+static struct file *inode_storage_fcheck(int fd)
+{
+	struct files_struct *files = current->files;
+
+	if (!files || fd < 0)
+		return NULL;
+
+	return fcheck_files(files, fd);
+}
+
+BPF_CALL_4(bpf_inode_storage_get, struct bpf_map *, map, int, fd,
+	   void *, value, u64, flags)
+{
+	struct bpf_local_storage_data *sdata;
+	struct file *file;
+
+	if (flags & ~BPF_LOCAL_STORAGE_GET_F_CREATE)
+		return (unsigned long)NULL;
+
+	file = inode_storage_fcheck(fd);
+	if (!file)
+		return (unsigned long)NULL;
+
+	if (!bpf_local_storage_busy_trylock(&bpf_inode_storage_busy))
+		return (unsigned long)NULL;
+
+	sdata = inode_storage_lookup(file_inode(file), map, !in_nmi());
+	if (sdata)
+		goto unlock;
+
+	if ((flags & BPF_LOCAL_STORAGE_GET_F_CREATE) && !in_nmi() &&
+	    get_file_rcu(file)) {
+		sdata = bpf_local_storage_update(
+			file_inode(file), (struct bpf_local_storage_map *)map,
+			value, BPF_NOEXIST);
+		if (IS_ERR(sdata))
+			sdata = NULL;
+		/* Dropping the last reference frees the inode's storage */
+		bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+		fput(file);
+		goto out;
+	}
+
+unlock:
+	bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+out:
+	return sdata ? (unsigned long)sdata->data : (unsigned long)NULL;
+}
+
+BPF_CALL_2(bpf_inode_storage_delete, struct bpf_map *, map, int, fd)
+{
+	struct file *file;
+	int err;
+
+	if (in_nmi())
+		return -EBUSY;
+
+	file = inode_storage_fcheck(fd);
+	if (!file)
+		return -EBADF;
+
+	if (!bpf_local_storage_busy_trylock(&bpf_inode_storage_busy))
+		return -EBUSY;
+
+	err = inode_storage_delete(file_inode(file), map);
+	bpf_local_storage_busy_unlock(&bpf_inode_storage_busy);
+	return err;
+}
+
+const struct bpf_map_ops inode_storage_map_ops = {
+	.map_alloc_check = bpf_local_storage_map_alloc_check,
+	.map_alloc = inode_storage_map_alloc,
+	.map_free = inode_storage_map_free,
+	.map_get_next_key = notsupp_get_next_key,
+	.map_lookup_elem = bpf_fd_inode_storage_lookup_elem,
+	.map_update_elem = bpf_fd_inode_storage_update_elem,
+	.map_delete_elem = bpf_fd_inode_storage_delete_elem,
+	.map_check_btf = bpf_local_storage_map_check_btf,
+	.map_owner_storage_ptr = inode_storage_ptr,
+};
+
+const struct bpf_func_proto bpf_inode_storage_get_proto = {
+	.func		= bpf_inode_storage_get,
+	.gpl_only	= false,
+	.ret_type	= RET_PTR_TO_MAP_VALUE_OR_NULL,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_MAP_VALUE_OR_NULL,
+	.arg4_type	= ARG_ANYTHING,
+};
+
+const struct bpf_func_proto bpf_inode_storage_delete_proto = {
+	.func		= bpf_inode_storage_delete,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+};
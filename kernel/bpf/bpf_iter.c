@@ -0,0 +1,275 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterators.
+ *
+ * A target walks a set of kernel objects (tasks, maps, sockets, ...) with
+ * a seq_operations of its own, and for every object runs the
+ * BPF_PROG_TYPE_ITER program of the iterator on a record describing it.
+ * What the program writes with bpf_seq_write() is what user space reads
+ * from the iterator fd, so one read() can dump thousands of objects in
+ * whatever format the program picks.
+ *
+ * The program is attached to the target with BPF_LINK_CREATE, and every
+ * BPF_ITER_CREATE on the link opens a new walk.
+ */
+#include <linux/anon_inodes.h>
+#include <linux/bpf.h>
+#include <linux/file.h>
+#include <linux/filter.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+struct bpf_iter_link {
+	struct bpf_link link;
+	const struct bpf_iter_reg *reg_info;
+};
+
+struct bpf_iter_priv_data {
+	const struct bpf_iter_reg *reg_info;
+	struct bpf_link *link;
+	u64 seq_num;
+	u8 target_private[] __aligned(8);
+};
+
+static DEFINE_MUTEX(targets_mutex);
+static const struct bpf_iter_reg *bpf_iter_targets[MAX_BPF_ATTACH_TYPE];
+
+int bpf_iter_reg_target(const struct bpf_iter_reg *reg_info)
+{
+	enum bpf_attach_type type = reg_info->attach_type;
+	int err = 0;
+
+	if (WARN_ON_ONCE(type >= MAX_BPF_ATTACH_TYPE))
+		return -EINVAL;
+
+	mutex_lock(&targets_mutex);
+	if (bpf_iter_targets[type])
+		err = -EBUSY;
+	else
+		WRITE_ONCE(bpf_iter_targets[type], reg_info);
+	mutex_unlock(&targets_mutex);
+
+	return err;
+}
+
+const struct bpf_iter_reg *bpf_iter_target(enum bpf_attach_type type)
+{
+	if ((u32)type >= MAX_BPF_ATTACH_TYPE)
+		return NULL;
+
+	return READ_ONCE(bpf_iter_targets[type]);
+}
+
+static struct bpf_iter_priv_data *bpf_iter_priv(struct seq_file *seq)
+{
+	return container_of(seq->private, struct bpf_iter_priv_data,
+			    target_private);
+}
+
+/* Called by the targets' ->show() for every object */
+void bpf_iter_run_prog(struct seq_file *seq, struct bpf_iter_meta *meta)
+{
+	struct bpf_iter_priv_data *priv = bpf_iter_priv(seq);
+	/* every record starts with seq_num */
+	u64 *ctx = (u64 *)(meta + 1);
+
+	meta->seq = seq;
+	*ctx = priv->seq_num;
+
+	rcu_read_lock();
+	preempt_disable();
+	BPF_PROG_RUN(priv->link->prog, ctx);
+	preempt_enable();
+	rcu_read_unlock();
+
+	/* seq_read() shows the object again if its record didn't fit */
+	if (!seq_has_overflowed(seq))
+		priv->seq_num++;
+}
+
+static int iter_release(struct inode *inode, struct file *file)
+{
+	struct bpf_iter_priv_data *priv;
+	struct seq_file *seq;
+
+	seq = file->private_data;
+	/* bpf_iter_new_fd() failed half way */
+	if (!seq)
+		return 0;
+
+	priv = bpf_iter_priv(seq);
+	if (priv->reg_info->fini_seq_private)
+		priv->reg_info->fini_seq_private(priv->target_private);
+	bpf_link_put(priv->link);
+
+	/* give seq_release_private() back what __seq_open_private() got */
+	seq->private = priv;
+	return seq_release_private(inode, file);
+}
+
+static const struct file_operations bpf_iter_fops = {
+	.read		= seq_read,
+	.release	= iter_release,
+};
+
+static void bpf_iter_link_dealloc(struct bpf_link *link)
+{
+	kfree(container_of(link, struct bpf_iter_link, link));
+}
+
+static const struct bpf_link_ops bpf_iter_link_lops = {
+	.dealloc	= bpf_iter_link_dealloc,
+};
+
+int bpf_iter_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	const struct bpf_iter_reg *reg_info;
+	struct bpf_iter_link *link;
+	int fd;
+
+	if (attr->link_create.target_fd)
+		return -EINVAL;
+
+	reg_info = bpf_iter_target(prog->expected_attach_type);
+	if (!reg_info)
+		return -ENOENT;
+
+	link = kzalloc(sizeof(*link), GFP_USER | __GFP_NOWARN);
+	if (!link)
+		return -ENOMEM;
+
+	bpf_link_init(&link->link, &bpf_iter_link_lops, prog);
+	link->reg_info = reg_info;
+
+	fd = bpf_link_new_fd(&link->link);
+	if (fd < 0)
+		kfree(link);
+
+	return fd;
+}
+
+int bpf_iter_new_fd(struct bpf_link *link)
+{
+	const struct bpf_iter_reg *reg_info;
+	struct bpf_iter_priv_data *priv;
+	struct seq_file *seq;
+	struct file *file;
+	int fd, err;
+
+	if (link->ops != &bpf_iter_link_lops)
+		return -EINVAL;
+	reg_info = container_of(link, struct bpf_iter_link, link)->reg_info;
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0)
+		return fd;
+
+	file = anon_inode_getfile("bpf_iter", &bpf_iter_fops, NULL, O_CLOEXEC);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		goto free_fd;
+	}
+
+	priv = __seq_open_private(file, reg_info->seq_ops,
+				  sizeof(*priv) + reg_info->seq_priv_size);
+	if (!priv) {
+		err = -ENOMEM;
+		goto free_file;
+	}
+
+	if (reg_info->init_seq_private) {
+		err = reg_info->init_seq_private(priv->target_private);
+		if (err) {
+			seq_release_private(file_inode(file), file);
+			file->private_data = NULL;
+			goto free_file;
+		}
+	}
+
+	priv->reg_info = reg_info;
+	bpf_link_inc(link);
+	priv->link = link;
+
+	/* the target's seq_ops only get to see their own part */
+	seq = file->private_data;
+	seq->private = priv->target_private;
+
+	fd_install(fd, file);
+	return fd;
+
+free_file:
+	fput(file);
+free_fd:
+	put_unused_fd(fd);
+	return err;
+}
+
+BPF_CALL_3(bpf_seq_write, void *, ctx, const void *, data, u32, len)
+{
+	struct bpf_iter_meta *meta = (struct bpf_iter_meta *)ctx - 1;
+
+	return seq_write(meta->seq, data, len) ? -EOVERFLOW : 0;
+}
+
+const struct bpf_func_proto bpf_seq_write_proto = {
+	.func		= bpf_seq_write,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_MEM,
+	.arg3_type	= ARG_CONST_SIZE_OR_ZERO,
+};
+
+static const struct bpf_func_proto *
+bpf_iter_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	switch (func_id) {
+	case BPF_FUNC_seq_write:
+		return &bpf_seq_write_proto;
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_spin_lock:
+		return &bpf_spin_lock_proto;
+	case BPF_FUNC_spin_unlock:
+		return &bpf_spin_unlock_proto;
+	case BPF_FUNC_get_prandom_u32:
+		return &bpf_get_prandom_u32_proto;
+	case BPF_FUNC_ktime_get_ns:
+		return &bpf_ktime_get_ns_proto;
+	case BPF_FUNC_task_storage_get:
+		return &bpf_task_storage_get_proto;
+	case BPF_FUNC_task_storage_delete:
+		return &bpf_task_storage_delete_proto;
+	default:
+		return NULL;
+	}
+}
+
+static bool bpf_iter_is_valid_access(int off, int size,
+				     enum bpf_access_type type,
+				     const struct bpf_prog *prog,
+				     struct bpf_insn_access_aux *info)
+{
+	const struct bpf_iter_reg *reg_info;
+
+	reg_info = bpf_iter_target(prog->expected_attach_type);
+	if (!reg_info || type != BPF_READ)
+		return false;
+	if (off < 0 || off + size > reg_info->ctx_size)
+		return false;
+	/* the records only have naturally aligned fields */
+	return off % size == 0;
+}
+
+const struct bpf_verifier_ops bpf_iter_verifier_ops = {
+	.get_func_proto		= bpf_iter_func_proto,
+	.is_valid_access	= bpf_iter_is_valid_access,
+};
+
+const struct bpf_prog_ops bpf_iter_prog_ops = {
+};
@@ -320,10 +320,17 @@ static void bpf_lru_list_push_free(struct bpf_lru_list *l,
 	raw_spin_unlock_irqrestore(&l->lock, flags);
 }
 
+/* Refill the local free list with up to target_free nodes from the global
+ * free list.  Only if that runs short are the active and inactive lists
+ * rotated and shrunk, so that the rotation is paid once per batch of
+ * evictions rather than on every refill of a map that still has free
+ * nodes, and the global lock is held for less time.
+ */
 static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
 					   struct bpf_lru_locallist *loc_l)
 {
 	struct bpf_lru_list *l = &lru->common_lru.lru_list;
+	unsigned int target = lru->common_lru.target_free;
 	struct bpf_lru_node *node, *tmp_node;
 	unsigned int nfree = 0;
 
@@ -331,20 +338,20 @@ static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
 
 	__local_list_flush(l, loc_l);
 
-	__bpf_lru_list_rotate(lru, l);
-
 	list_for_each_entry_safe(node, tmp_node, &l->lists[BPF_LRU_LIST_T_FREE],
 				 list) {
 		__bpf_lru_node_move_to_free(l, node, local_free_list(loc_l),
 					    BPF_LRU_LOCAL_LIST_T_FREE);
-		if (++nfree == LOCAL_FREE_TARGET)
+		if (++nfree == target)
 			break;
 	}
 
-	if (nfree < LOCAL_FREE_TARGET)
-		__bpf_lru_list_shrink(lru, l, LOCAL_FREE_TARGET - nfree,
+	if (nfree < target) {
+		__bpf_lru_list_rotate(lru, l);
+		__bpf_lru_list_shrink(lru, l, target - nfree,
 				      local_free_list(loc_l),
 				      BPF_LRU_LOCAL_LIST_T_FREE);
+	}
 
 	raw_spin_unlock(&l->lock);
 }
@@ -474,6 +481,13 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	do {
 		steal_loc_l = per_cpu_ptr(clru->local_list, steal);
 
+		/* Don't bounce the lock of a CPU with nothing to steal. */
+		if (list_empty(local_free_list(steal_loc_l)) &&
+		    list_empty(local_pending_list(steal_loc_l))) {
+			steal = get_next_cpu(steal);
+			continue;
+		}
+
 		raw_spin_lock_irqsave(&steal_loc_l->lock, flags);
 
 		node = __local_list_pop_free(steal_loc_l);
@@ -568,6 +582,13 @@ static void bpf_common_lru_populate(struct bpf_lru *lru, void *buf,
 	struct bpf_lru_list *l = &lru->common_lru.lru_list;
 	u32 i;
 
+	/* Don't let the local free lists hoard more than half of a small
+	 * map, which leaves the other CPUs stealing from each other.
+	 */
+	lru->common_lru.target_free =
+		clamp_t(u32, nr_elems / num_possible_cpus() / 2, 1,
+			LOCAL_FREE_TARGET);
+
 	for (i = 0; i < nr_elems; i++) {
 		struct bpf_lru_node *node;
 
@@ -680,6 +701,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 		}
 
 		bpf_lru_list_init(&clru->lru_list);
+		clru->target_free = LOCAL_FREE_TARGET;
 		lru->nr_scans = LOCAL_NR_SCANS;
 	}
 
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF local storage hung off task_struct.
+ *
+ * The storage of a task is freed together with the task, so programs
+ * tracking per-task state neither need a hash lookup keyed by pid nor
+ * have to clean up after exited tasks.
+ */
+#include <linux/rculist.h>
+#include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/bpf.h>
+#include <linux/bpf_local_storage.h>
+#include <linux/filter.h>
+#include <linux/pid.h>
+#include <linux/sched.h>
+#include <uapi/linux/btf.h>
+
+DEFINE_BPF_STORAGE_CACHE(task_cache);
+
+static DEFINE_PER_CPU(int, bpf_task_storage_busy);
+
+static struct bpf_local_storage __rcu **task_storage_ptr(void *owner)
+{
+	struct task_struct *task = owner;
+
+	return &task->bpf_storage;
+}
+
+static struct bpf_local_storage_data *
+task_storage_lookup(struct task_struct *task, struct bpf_map *map,
+		    bool cacheit_lockit)
+{
+	struct bpf_local_storage *task_storage;
+	struct bpf_local_storage_map *smap;
+
+	task_storage = rcu_dereference(task->bpf_storage);
+	if (!task_storage)
+		return NULL;
+
+	smap = (struct bpf_local_storage_map *)map;
+	return bpf_local_storage_lookup(task_storage, smap, cacheit_lockit);
+}
+
+static int task_storage_delete(struct task_struct *task, struct bpf_map *map)
+{
+	struct bpf_local_storage_data *sdata;
+
+	sdata = task_storage_lookup(task, map, false);
+	if (!sdata)
+		return -ENOENT;
+
+	bpf_selem_unlink(SELEM(sdata));
+
+	return 0;
+}
+
+/* Called by free_task() */
+void bpf_task_storage_free(struct task_struct *task)
+{
+	struct bpf_local_storage *local_storage;
+
+	/* Most tasks never had any storage attached */
+	if (!rcu_access_pointer(task->bpf_storage))
+		return;
+
+	rcu_read_lock();
+	local_storage = rcu_dereference(task->bpf_storage);
+	if (local_storage) {
+		bpf_local_storage_busy_lock(&bpf_task_storage_busy);
+		bpf_local_storage_destroy(local_storage);
+		bpf_local_storage_busy_unlock(&bpf_task_storage_busy);
+	}
+	rcu_read_unlock();
+}
+
+/* The syscall side is keyed by a pidfd, which pins the task's pid. */
+static struct task_struct *task_storage_get_task(void *key, struct pid **pidp)
+{
+	struct task_struct *task;
+	struct pid *pid;
+
+	pid = pidfd_get_pid(*(int *)key);
+	if (IS_ERR(pid))
+		return ERR_CAST(pid);
+
+	task = pid_task(pid, PIDTYPE_PID);
+	if (!task) {
+		put_pid(pid);
+		return ERR_PTR(-ENOENT);
+	}
+
+	*pidp = pid;
+	return task;
+}
+
+static void *bpf_pid_task_storage_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_local_storage_data *sdata;
+	struct task_struct *task;
+	struct pid *pid;
+
+	task = task_storage_get_task(key, &pid);
+	if (IS_ERR(task))
+		return task;
+
+	bpf_local_storage_busy_lock(&bpf_task_storage_busy);
+	sdata = task_storage_lookup(task, map, true);
+	bpf_local_storage_busy_unlock(&bpf_task_storage_busy);
+	put_pid(pid);
+	return sdata ? sdata->data : NULL;
+}
+
+static int bpf_pid_task_storage_update_elem(struct bpf_map *map, void *key,
+					    void *value, u64 map_flags)
+{
+	struct bpf_local_storage_data *sdata;
+	struct task_struct *task;
+	struct pid *pid;
+
+	task = task_storage_get_task(key, &pid);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	bpf_local_storage_busy_lock(&bpf_task_storage_busy);
+	sdata = bpf_local_storage_update(
+		task, (struct bpf_local_storage_map *)map, value, map_flags);
+	bpf_local_storage_busy_unlock(&bpf_task_storage_busy);
+	put_pid(pid);
+	return PTR_ERR_OR_ZERO(sdata);
+}
+
+static int bpf_pid_task_storage_delete_elem(struct bpf_map *map, void *key)
+{
+	struct task_struct *task;
+	struct pid *pid;
+	int err;
+
+	task = task_storage_get_task(key, &pid);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	bpf_local_storage_busy_lock(&bpf_task_storage_busy);
+	err = task_storage_delete(task, map);
+	bpf_local_storage_busy_unlock(&bpf_task_storage_busy);
+	put_pid(pid);
+	return err;
+}
+
+static int notsupp_get_next_key(struct bpf_map *map, void *key,
+				void *next_key)
+{
+	return -ENOTSUPP;
+}
+
+static struct bpf_map *task_storage_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = bpf_local_storage_map_alloc(attr);
+	if (IS_ERR(smap))
+		return ERR_CAST(smap);
+
+	smap->cache_idx = bpf_local_storage_cache_idx_get(&task_cache);
+	return &smap->map;
+}
+
+static void task_storage_map_free(struct bpf_map *map)
+{
+	struct bpf_local_storage_map *smap;
+
+	smap = (struct bpf_local_storage_map *)map;
+	bpf_local_storage_cache_idx_free(&task_cache, smap->cache_idx);
+	bpf_local_storage_map_free(smap, &bpf_task_storage_busy);
+}
+
+/* A pid of 0 is the current task.  Any other pid is looked up in the
+ * init pid namespace.  Programs run under rcu_read_lock(), and the
+ * task_struct found here can't be freed before a grace period has
+ * passed after it was unhashed, so no reference needs to be taken.
+ */
+static struct task_struct *task_storage_find_task(u32 pid)
+{
+	if (!pid)
+		return current;
+
+	return find_task_by_pid_ns(pid, &init_pid_ns);
+}
+
+BPF_CALL_4(bpf_task_storage_get, struct bpf_map *, map, u32, pid,
+	   void *, value, u64, flags)
+{
+	struct bpf_local_storage_data *sdata;
+	struct task_struct *task;
+
+	if (flags & ~BPF_LOCAL_STORAGE_GET_F_CREATE)
+		return (unsigned long)NULL;
+
+	task = task_storage_find_task(pid);
+	if (!task)
+		return (unsigned long)NULL;
+
+	if (!bpf_local_storage_busy_trylock(&bpf_task_storage_busy))
+		return (unsigned long)NULL;
+
+	/* Publishing to the cache takes the storage lock, which an NMI
+	 * may have interrupted.
+	 */
+	sdata = task_storage_lookup(task, map, !in_nmi());
+	if (sdata)
+		goto unlock;
+
+	/* Only allocate new storage while the task is still refcounted,
+	 * bpf_task_storage_free() would not see it otherwise.
+	 */
+	if ((flags & BPF_LOCAL_STORAGE_GET_F_CREATE) && !in_nmi() &&
+	    refcount_read(&task->usage)) {
+		sdata = bpf_local_storage_update(
+			task, (struct bpf_local_storage_map *)map, value,
+			BPF_NOEXIST);
+		if (IS_ERR(sdata))
+			sdata = NULL;
+	}
+
+unlock:
+	bpf_local_storage_busy_unlock(&bpf_task_storage_busy);
+	return sdata ? (unsigned long)sdata->data : (unsigned long)NULL;
+}
+
+BPF_CALL_2(bpf_task_storage_delete, struct bpf_map *, map, u32, pid)
+{
+	struct task_struct *task;
+	int err;
+
+	if (in_nmi())
+		return -EBUSY;
+
+	task = task_storage_find_task(pid);
+	if (!task)
+		return -ENOENT;
+
+	if (!bpf_local_storage_busy_trylock(&bpf_task_storage_busy))
+		return -EBUSY;
+
+	err = task_storage_delete(task, map);
+	bpf_local_storage_busy_unlock(&bpf_task_storage_busy);
+	return err;
+}
+
+const struct bpf_map_ops task_storage_map_ops = {
+	.map_alloc_check = bpf_local_storage_map_alloc_check,
+	.map_alloc = task_storage_map_alloc,
+	.map_free = task_storage_map_free,
+	.map_get_next_key = notsupp_get_next_key,
+	.map_lookup_elem = bpf_pid_task_storage_lookup_elem,
+	.map_update_elem = bpf_pid_task_storage_update_elem,
+	.map_delete_elem = bpf_pid_task_storage_delete_elem,
+	.map_check_btf = bpf_local_storage_map_check_btf,
+	.map_owner_storage_ptr = task_storage_ptr,
+};
+
+const struct bpf_func_proto bpf_task_storage_get_proto = {
+	.func		= bpf_task_storage_get,
+	.gpl_only	= false,
+	.ret_type	= RET_PTR_TO_MAP_VALUE_OR_NULL,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_MAP_VALUE_OR_NULL,
+	.arg4_type	= ARG_ANYTHING,
+};
+
+const struct bpf_func_proto bpf_task_storage_delete_proto = {
+	.func		= bpf_task_storage_delete,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+};
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterator target walking all BPF maps (BPF_ITER_BPF_MAP), in the
+ * order of their ids.
+ */
+#include <linux/bpf.h>
+#include <linux/init.h>
+#include <linux/seq_file.h>
+
+struct bpf_iter_seq_map_info {
+	u32 mid;
+};
+
+static void *bpf_map_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_seq_map_info *info = seq->private;
+	struct bpf_map *map;
+
+	map = bpf_map_get_curr_or_next(&info->mid);
+	if (!map)
+		return NULL;
+
+	if (*pos == 0)
+		++*pos;
+	return map;
+}
+
+static void *bpf_map_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_seq_map_info *info = seq->private;
+
+	++*pos;
+	++info->mid;
+	bpf_map_put((struct bpf_map *)v);
+	return bpf_map_get_curr_or_next(&info->mid);
+}
+
+static int bpf_map_seq_show(struct seq_file *seq, void *v)
+{
+	BPF_ITER_CTX(bpf_iter_bpf_map) kctx = {};
+	struct bpf_iter_bpf_map *ctx = &kctx.ctx;
+	struct bpf_map *map = v;
+
+	ctx->id = map->id;
+	ctx->type = map->map_type;
+	ctx->key_size = map->key_size;
+	ctx->value_size = map->value_size;
+	ctx->max_entries = map->max_entries;
+	ctx->map_flags = map->map_flags;
+	ctx->memlock = (u64)map->memory.pages << PAGE_SHIFT;
+	memcpy(ctx->name, map->name, sizeof(ctx->name));
+
+	bpf_iter_run_prog(seq, &kctx.meta);
+	return 0;
+}
+
+static void bpf_map_seq_stop(struct seq_file *seq, void *v)
+{
+	if (v)
+		bpf_map_put((struct bpf_map *)v);
+}
+
+static const struct seq_operations bpf_map_seq_ops = {
+	.start	= bpf_map_seq_start,
+	.next	= bpf_map_seq_next,
+	.stop	= bpf_map_seq_stop,
+	.show	= bpf_map_seq_show,
+};
+
+static const struct bpf_iter_reg bpf_map_reg_info = {
+	.attach_type		= BPF_ITER_BPF_MAP,
+	.seq_ops		= &bpf_map_seq_ops,
+	.seq_priv_size		= sizeof(struct bpf_iter_seq_map_info),
+	.ctx_size		= sizeof(struct bpf_iter_bpf_map),
+};
+
+static int __init bpf_map_iter_init(void)
+{
+	return bpf_iter_reg_target(&bpf_map_reg_info);
+}
+late_initcall(bpf_map_iter_init);
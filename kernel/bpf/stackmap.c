@@ -13,7 +13,7 @@
 
 #define STACK_CREATE_FLAG_MASK					\
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY |	\
-	 BPF_F_STACK_BUILD_ID)
+	 BPF_F_STACK_BUILD_ID | BPF_F_STACK_DEDUP)
 
 struct stack_map_bucket {
 	struct pcpu_freelist_node fnode;
@@ -22,9 +22,45 @@ struct stack_map_bucket {
 	u64 data[];
 };
 
+/* With BPF_F_STACK_DEDUP a stack is a chain of nodes, one per frame, from
+ * the outermost caller down to the innermost ip, and its id is the index of
+ * the innermost node.  Stacks with a common prefix share those nodes.
+ *
+ * All nodes live in one open addressed table, hashed on the path from the
+ * root, so finding a known stack takes no writes and no locks.  New nodes
+ * claim an empty slot with cmpxchg; a node is freed when the last child and
+ * the stack id using it are gone.  The generation in ->state tells readers
+ * that a slot was reused while they looked at it.  When there is no free
+ * slot within STACK_NODE_MAX_PROBE, the stack is not recorded and -ENOMEM
+ * returned, just like when the bucket freelist runs out.
+ *
+ * A slot another cpu is filling may be getting the very node we look for,
+ * so adding one waits for it, up to STACK_NODE_MAX_SPIN times, rather than
+ * adding a duplicate further on.  The cpu filling it may be the one we
+ * interrupted, so past that, -EBUSY is returned.
+ */
+struct stack_map_node {
+	u64 ip;
+	u32 parent;		/* index of the caller, or STACK_NODE_ROOT */
+	u32 hash;		/* of the path from the root down to here */
+	u32 state;		/* STACK_NODE_* and generation */
+	atomic_t refcnt;	/* children, plus one while it's a stack id */
+};
+
+#define STACK_NODE_EMPTY	0
+#define STACK_NODE_BUSY		1
+#define STACK_NODE_READY	2
+#define STACK_NODE_STATE_MASK	3
+#define STACK_NODE_ID		4	/* the node ends a stack */
+#define STACK_NODE_GEN_INC	8
+#define STACK_NODE_ROOT		U32_MAX
+#define STACK_NODE_MAX_PROBE	16
+#define STACK_NODE_MAX_SPIN	128
+
 struct bpf_stack_map {
 	struct bpf_map map;
 	void *elems;
+	struct stack_map_node *nodes;
 	struct pcpu_freelist freelist;
 	u32 n_buckets;
 	struct stack_map_bucket *buckets[];
@@ -52,6 +88,11 @@ static inline bool stack_map_use_build_id(struct bpf_map *map)
 	return (map->map_flags & BPF_F_STACK_BUILD_ID);
 }
 
+static inline bool stack_map_use_dedup(struct bpf_map *map)
+{
+	return (map->map_flags & BPF_F_STACK_DEDUP);
+}
+
 static inline int stack_map_data_size(struct bpf_map *map)
 {
 	return stack_map_use_build_id(map) ?
@@ -82,13 +123,22 @@ static int prealloc_elems_and_freelist(struct bpf_stack_map *smap)
 	return err;
 }
 
+static int alloc_nodes(struct bpf_stack_map *smap)
+{
+	smap->nodes = bpf_map_area_alloc(sizeof(struct stack_map_node) *
+					 (u64)smap->n_buckets,
+					 smap->map.numa_node);
+	return smap->nodes ? 0 : -ENOMEM;
+}
+
 /* Called from syscall */
 static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 {
+	bool dedup = attr->map_flags & BPF_F_STACK_DEDUP;
 	u32 value_size = attr->value_size;
 	struct bpf_stack_map *smap;
 	struct bpf_map_memory mem;
-	u64 cost, n_buckets;
+	u64 cost, n_buckets, data;
 	int err;
 
 	if (!capable(CAP_SYS_ADMIN))
@@ -104,6 +154,9 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 
 	BUILD_BUG_ON(sizeof(struct bpf_stack_build_id) % sizeof(u64));
 	if (attr->map_flags & BPF_F_STACK_BUILD_ID) {
+		/* build_id+offset entries are too big to share */
+		if (dedup)
+			return ERR_PTR(-EINVAL);
 		if (value_size % sizeof(struct bpf_stack_build_id) ||
 		    value_size / sizeof(struct bpf_stack_build_id)
 		    > sysctl_perf_event_max_stack)
@@ -119,9 +172,16 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 
 	n_buckets = roundup_pow_of_two(attr->max_entries);
 
-	cost = n_buckets * sizeof(struct stack_map_bucket *) + sizeof(*smap);
-	err = bpf_map_charge_init(&mem, cost + attr->max_entries *
-			   (sizeof(struct stack_map_bucket) + (u64)value_size));
+	if (dedup) {
+		cost = sizeof(*smap);
+		data = n_buckets * sizeof(struct stack_map_node);
+	} else {
+		cost = n_buckets * sizeof(struct stack_map_bucket *) +
+		       sizeof(*smap);
+		data = attr->max_entries *
+		       (sizeof(struct stack_map_bucket) + (u64)value_size);
+	}
+	err = bpf_map_charge_init(&mem, cost + data);
 	if (err)
 		return ERR_PTR(err);
 
@@ -139,7 +199,10 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto free_charge;
 
-	err = prealloc_elems_and_freelist(smap);
+	if (dedup)
+		err = alloc_nodes(smap);
+	else
+		err = prealloc_elems_and_freelist(smap);
 	if (err)
 		goto put_buffers;
 
@@ -349,6 +412,187 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	}
 }
 
+static u32 stack_node_hash(u64 ip, u32 parent_hash)
+{
+	return jhash_2words((u32)ip, (u32)(ip >> 32), parent_hash);
+}
+
+static bool stack_node_is_id(u32 state)
+{
+	return (state & (STACK_NODE_STATE_MASK | STACK_NODE_ID)) ==
+	       (STACK_NODE_READY | STACK_NODE_ID);
+}
+
+/* Drop a reference, and free the node and then its callers for as long as
+ * that was the last one.
+ */
+static void stack_node_put(struct bpf_stack_map *smap, u32 idx)
+{
+	struct stack_map_node *node;
+	u32 state;
+
+	while (idx != STACK_NODE_ROOT) {
+		node = &smap->nodes[idx];
+		if (!atomic_dec_and_test(&node->refcnt))
+			return;
+		idx = node->parent;
+		/* nobody can change the state of a node without a reference */
+		state = READ_ONCE(node->state);
+		state &= ~(STACK_NODE_STATE_MASK | STACK_NODE_ID);
+		smp_store_release(&node->state, state + STACK_NODE_GEN_INC);
+	}
+}
+
+/* Look up the child of parent for ip, or add it.  On success the caller
+ * owns a reference on the returned node.  When the node is new, the
+ * caller's reference on parent went into the node's parent link, otherwise
+ * the caller still has to drop it.
+ */
+static int stack_node_get(struct bpf_stack_map *smap, u32 parent, u64 ip,
+			  u32 hash, bool *created)
+{
+	u32 mask = smap->n_buckets - 1;
+	u32 empty_state = 0, state;
+	struct stack_map_node *node;
+	int i, retry = 0, spin = 0, empty;
+	u32 idx;
+
+again:
+	empty = -1;
+	for (i = 0; i < STACK_NODE_MAX_PROBE; i++) {
+		idx = (hash + i) & mask;
+		node = &smap->nodes[idx];
+		state = smp_load_acquire(&node->state);
+
+		if ((state & STACK_NODE_STATE_MASK) == STACK_NODE_EMPTY) {
+			/* no tombstones, the node may still be further on */
+			if (empty < 0) {
+				empty = idx;
+				empty_state = state;
+			}
+			continue;
+		}
+		if ((state & STACK_NODE_STATE_MASK) == STACK_NODE_BUSY) {
+			if (++spin > STACK_NODE_MAX_SPIN)
+				return -EBUSY;
+			cpu_relax();
+			/* look at the same slot again */
+			i--;
+			continue;
+		}
+		if ((state & STACK_NODE_STATE_MASK) != STACK_NODE_READY ||
+		    node->hash != hash || node->parent != parent ||
+		    node->ip != ip)
+			continue;
+		if (!atomic_inc_not_zero(&node->refcnt))
+			/* on its way out */
+			continue;
+		if ((READ_ONCE(node->state) ^ state) & ~STACK_NODE_ID) {
+			/* freed and reused since we compared it */
+			stack_node_put(smap, idx);
+			continue;
+		}
+		*created = false;
+		return idx;
+	}
+
+	if (empty < 0)
+		return -ENOMEM;
+
+	node = &smap->nodes[empty];
+	if (cmpxchg(&node->state, empty_state,
+		    empty_state | STACK_NODE_BUSY) != empty_state) {
+		/* most likely the same frame, the rescan waits for it */
+		if (retry++)
+			return -EBUSY;
+		goto again;
+	}
+	node->ip = ip;
+	node->parent = parent;
+	node->hash = hash;
+	atomic_set(&node->refcnt, 1);
+	smp_store_release(&node->state, empty_state | STACK_NODE_READY);
+	*created = true;
+	return empty;
+}
+
+/* Find the id of a stack that is already in the map, without writing to it. */
+static int stack_map_find_dedup(struct bpf_stack_map *smap, u64 *ips,
+				u32 trace_nr, u32 hash, bool fast_cmp)
+{
+	u32 mask = smap->n_buckets - 1;
+	struct stack_map_node *node;
+	u32 i, j, idx, p, state;
+
+	for (i = 0; i < STACK_NODE_MAX_PROBE; i++) {
+		idx = (hash + i) & mask;
+		node = &smap->nodes[idx];
+		state = smp_load_acquire(&node->state);
+		if (!stack_node_is_id(state) || node->hash != hash ||
+		    node->ip != ips[0])
+			continue;
+		if (fast_cmp)
+			return idx;
+
+		/* the callers can't go away while the node is an id */
+		p = node->parent;
+		for (j = 1; j < trace_nr; j++) {
+			if (p >= smap->n_buckets ||
+			    smap->nodes[p].ip != ips[j])
+				break;
+			p = smap->nodes[p].parent;
+		}
+		if (j == trace_nr && p == STACK_NODE_ROOT &&
+		    READ_ONCE(node->state) == state)
+			return idx;
+	}
+	return -ENOENT;
+}
+
+static int stack_map_get_dedup_id(struct bpf_stack_map *smap, u64 *ips,
+				  u32 trace_nr, u64 flags)
+{
+	u32 hash = 0, parent = STACK_NODE_ROOT, state;
+	struct stack_map_node *node;
+	bool created;
+	int i, idx;
+
+	for (i = trace_nr - 1; i >= 0; i--)
+		hash = stack_node_hash(ips[i], hash);
+
+	idx = stack_map_find_dedup(smap, ips, trace_nr, hash,
+				   flags & BPF_F_FAST_STACK_CMP);
+	if (idx >= 0)
+		return idx;
+
+	/* Slow path: walk down from the outermost caller, holding a reference
+	 * on the current node, and add the frames that are missing.
+	 */
+	hash = 0;
+	for (i = trace_nr - 1; i >= 0; i--) {
+		hash = stack_node_hash(ips[i], hash);
+		idx = stack_node_get(smap, parent, ips[i], hash, &created);
+		if (idx < 0) {
+			stack_node_put(smap, parent);
+			return idx;
+		}
+		if (!created)
+			stack_node_put(smap, parent);
+		parent = idx;
+	}
+
+	/* our reference becomes the one of the stack id, unless it has one */
+	node = &smap->nodes[idx];
+	do {
+		state = READ_ONCE(node->state);
+		if (state & STACK_NODE_ID) {
+			stack_node_put(smap, idx);
+			break;
+		}
+	} while (cmpxchg(&node->state, state, state | STACK_NODE_ID) != state);
+	return idx;
+}
+
 BPF_CALL_3(bpf_get_stackid, struct pt_regs *, regs, struct bpf_map *, map,
 	   u64, flags)
 {
@@ -388,6 +632,9 @@ BPF_CALL_3(bpf_get_stackid, struct pt_regs *, regs, struct bpf_map *, map,
 	trace_nr -= skip;
 	trace_len = trace_nr * sizeof(u64);
 	ips = trace->ip + skip + init_nr;
+	if (stack_map_use_dedup(map))
+		return stack_map_get_dedup_id(smap, ips, trace_nr, flags);
+
 	hash = jhash2((u32 *)ips, trace_len / sizeof(u32), 0);
 	id = hash & (smap->n_buckets - 1);
 	bucket = READ_ONCE(smap->buckets[id]);
@@ -522,6 +769,29 @@ static void *stack_map_lookup_elem(struct bpf_map *map, void *key)
 	return ERR_PTR(-EOPNOTSUPP);
 }
 
+static int stack_map_copy_dedup(struct bpf_stack_map *smap, u32 id,
+				u64 *value)
+{
+	u32 max_depth = smap->map.value_size / sizeof(u64);
+	struct stack_map_node *node = &smap->nodes[id];
+	u32 i, p, state;
+
+	state = smp_load_acquire(&node->state);
+	if (!stack_node_is_id(state))
+		return -ENOENT;
+
+	for (i = 0, p = id; i < max_depth && p < smap->n_buckets; i++) {
+		value[i] = smap->nodes[p].ip;
+		p = smap->nodes[p].parent;
+	}
+	memset(value + i, 0, (max_depth - i) * sizeof(u64));
+
+	/* deleted while we copied it, what we have may be garbage */
+	if (READ_ONCE(node->state) != state)
+		return -ENOENT;
+	return 0;
+}
+
 /* Called from syscall */
 int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 {
@@ -532,6 +802,9 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	if (unlikely(id >= smap->n_buckets))
 		return -ENOENT;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_copy_dedup(smap, id, value);
+
 	bucket = xchg(&smap->buckets[id], NULL);
 	if (!bucket)
 		return -ENOENT;
@@ -546,6 +819,13 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	return 0;
 }
 
+static bool stack_map_id_used(struct bpf_stack_map *smap, u32 id)
+{
+	if (stack_map_use_dedup(&smap->map))
+		return stack_node_is_id(READ_ONCE(smap->nodes[id].state));
+	return READ_ONCE(smap->buckets[id]);
+}
+
 static int stack_map_get_next_key(struct bpf_map *map, void *key,
 				  void *next_key)
 {
@@ -559,13 +839,13 @@ static int stack_map_get_next_key(struct bpf_map *map, void *key,
 		id = 0;
 	} else {
 		id = *(u32 *)key;
-		if (id >= smap->n_buckets || !smap->buckets[id])
+		if (id >= smap->n_buckets || !stack_map_id_used(smap, id))
 			id = 0;
 		else
 			id++;
 	}
 
-	while (id < smap->n_buckets && !smap->buckets[id])
+	while (id < smap->n_buckets && !stack_map_id_used(smap, id))
 		id++;
 
 	if (id >= smap->n_buckets)
@@ -581,6 +861,21 @@ static int stack_map_update_elem(struct bpf_map *map, void *key, void *value,
 	return -EINVAL;
 }
 
+static int stack_map_delete_dedup(struct bpf_stack_map *smap, u32 id)
+{
+	struct stack_map_node *node = &smap->nodes[id];
+	u32 state;
+
+	do {
+		state = READ_ONCE(node->state);
+		if (!stack_node_is_id(state))
+			return -ENOENT;
+	} while (cmpxchg(&node->state, state, state & ~STACK_NODE_ID) != state);
+
+	stack_node_put(smap, id);
+	return 0;
+}
+
 /* Called from syscall or from eBPF program */
 static int stack_map_delete_elem(struct bpf_map *map, void *key)
 {
@@ -591,6 +886,9 @@ static int stack_map_delete_elem(struct bpf_map *map, void *key)
 	if (unlikely(id >= smap->n_buckets))
 		return -E2BIG;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_delete_dedup(smap, id);
+
 	old_bucket = xchg(&smap->buckets[id], NULL);
 	if (old_bucket) {
 		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
@@ -608,8 +906,12 @@ static void stack_map_free(struct bpf_map *map)
 	/* wait for bpf programs to complete before freeing stack map */
 	synchronize_rcu();
 
-	bpf_map_area_free(smap->elems);
-	pcpu_freelist_destroy(&smap->freelist);
+	if (stack_map_use_dedup(map)) {
+		bpf_map_area_free(smap->nodes);
+	} else {
+		bpf_map_area_free(smap->elems);
+		pcpu_freelist_destroy(&smap->freelist);
+	}
 	bpf_map_area_free(smap);
 	put_callchain_buffers();
 }
@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF iterator targets walking tasks (BPF_ITER_TASK) and the open files
+ * of processes (BPF_ITER_TASK_FILE), in the pid namespace of the task
+ * that created the iterator.
+ */
+#include <linux/bpf.h>
+#include <linux/cred.h>
+#include <linux/fdtable.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/kdev_t.h>
+#include <linux/pid_namespace.h>
+#include <linux/sched.h>
+#include <linux/sched/cputime.h>
+#include <linux/seq_file.h>
+
+struct bpf_iter_seq_task_common {
+	struct pid_namespace *ns;
+};
+
+struct bpf_iter_seq_task_info {
+	/* must come first, for init_seq_pidns() and fini_seq_pidns() */
+	struct bpf_iter_seq_task_common common;
+	u32 tid;
+};
+
+/* Returns the task with the lowest pid not below *tid, with a reference
+ * held, and moves *tid to it.
+ */
+static struct task_struct *task_seq_get_next(struct pid_namespace *ns,
+					     u32 *tid)
+{
+	struct task_struct *task = NULL;
+	int next_tid = *tid;
+	struct pid *pid;
+
+	rcu_read_lock();
+retry:
+	pid = idr_get_next(&ns->idr, &next_tid);
+	if (pid) {
+		task = get_pid_task(pid, PIDTYPE_PID);
+		if (!task) {
+			next_tid++;
+			goto retry;
+		}
+	}
+	rcu_read_unlock();
+
+	*tid = next_tid;
+	return task;
+}
+
+static void *task_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_seq_task_info *info = seq->private;
+	struct task_struct *task;
+
+	task = task_seq_get_next(info->common.ns, &info->tid);
+	if (!task)
+		return NULL;
+
+	if (*pos == 0)
+		++*pos;
+	return task;
+}
+
+static void *task_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_seq_task_info *info = seq->private;
+
+	++*pos;
+	++info->tid;
+	put_task_struct((struct task_struct *)v);
+	return task_seq_get_next(info->common.ns, &info->tid);
+}
+
+static int task_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_seq_task_info *info = seq->private;
+	struct pid_namespace *ns = info->common.ns;
+	BPF_ITER_CTX(bpf_iter_task) kctx = {};
+	struct bpf_iter_task *ctx = &kctx.ctx;
+	struct task_struct *task = v;
+	u64 utime, stime;
+
+	ctx->pid = task_pid_nr_ns(task, ns);
+	ctx->tgid = task_tgid_nr_ns(task, ns);
+	ctx->ppid = task_ppid_nr_ns(task, ns);
+	ctx->uid = from_kuid_munged(seq_user_ns(seq), task_uid(task));
+	ctx->state = task_state_index(task);
+	ctx->flags = task->flags;
+	task_cputime_adjusted(task, &utime, &stime);
+	ctx->utime = utime;
+	ctx->stime = stime;
+	ctx->start_time = task->real_start_time;
+	__get_task_comm(ctx->comm, sizeof(ctx->comm), task);
+
+	bpf_iter_run_prog(seq, &kctx.meta);
+	return 0;
+}
+
+static void task_seq_stop(struct seq_file *seq, void *v)
+{
+	if (v)
+		put_task_struct((struct task_struct *)v);
+}
+
+static const struct seq_operations task_seq_ops = {
+	.start	= task_seq_start,
+	.next	= task_seq_next,
+	.stop	= task_seq_stop,
+	.show	= task_seq_show,
+};
+
+struct bpf_iter_seq_task_file_info {
+	/* must come first, for init_seq_pidns() and fini_seq_pidns() */
+	struct bpf_iter_seq_task_common common;
+	struct task_struct *task;
+	struct files_struct *files;
+	u32 tid;
+	u32 fd;
+};
+
+/* Returns the next open file, starting at info->fd of the process at
+ * info->tid.  With a file returned, references on it, on info->task and
+ * on info->files are held.  Otherwise, none are.
+ */
+static struct file *
+task_file_seq_get_next(struct bpf_iter_seq_task_file_info *info)
+{
+	struct pid_namespace *ns = info->common.ns;
+	struct files_struct *curr_files;
+	struct task_struct *curr_task;
+	u32 curr_tid = info->tid;
+	unsigned int max_fds;
+	unsigned int curr_fd;
+
+again:
+	if (info->task) {
+		curr_task = info->task;
+		curr_files = info->files;
+		curr_fd = info->fd;
+	} else {
+		curr_task = task_seq_get_next(ns, &curr_tid);
+		if (!curr_task)
+			return NULL;
+
+		/* threads normally share the table of their leader */
+		if (!thread_group_leader(curr_task)) {
+			put_task_struct(curr_task);
+			curr_tid++;
+			info->fd = 0;
+			goto again;
+		}
+
+		curr_files = get_files_struct(curr_task);
+		if (!curr_files) {
+			put_task_struct(curr_task);
+			curr_tid++;
+			info->fd = 0;
+			goto again;
+		}
+
+		info->task = curr_task;
+		info->files = curr_files;
+		if (curr_tid == info->tid) {
+			curr_fd = info->fd;
+		} else {
+			info->tid = curr_tid;
+			curr_fd = 0;
+		}
+	}
+
+	rcu_read_lock();
+	max_fds = files_fdtable(curr_files)->max_fds;
+	for (; curr_fd < max_fds; curr_fd++) {
+		struct file *f;
+
+		f = fcheck_files(curr_files, curr_fd);
+		if (!f || !get_file_rcu(f))
+			continue;
+
+		info->fd = curr_fd;
+		rcu_read_unlock();
+		return f;
+	}
+
+	/* the current process is done, go to the next one */
+	rcu_read_unlock();
+	put_files_struct(curr_files);
+	put_task_struct(curr_task);
+	info->task = NULL;
+	info->files = NULL;
+	info->fd = 0;
+	curr_tid = ++info->tid;
+	goto again;
+}
+
+static void *task_file_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+	struct file *file;
+
+	info->task = NULL;
+	info->files = NULL;
+	file = task_file_seq_get_next(info);
+	if (file && *pos == 0)
+		++*pos;
+
+	return file;
+}
+
+static void *task_file_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+
+	++*pos;
+	++info->fd;
+	fput((struct file *)v);
+	return task_file_seq_get_next(info);
+}
+
+static int task_file_seq_show(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+	BPF_ITER_CTX(bpf_iter_task_file) kctx = {};
+	struct bpf_iter_task_file *ctx = &kctx.ctx;
+	struct file *file = v;
+	struct inode *inode = file_inode(file);
+
+	ctx->pid = task_tgid_nr_ns(info->task, info->common.ns);
+	ctx->fd = info->fd;
+	ctx->ino = inode->i_ino;
+	ctx->dev = new_encode_dev(inode->i_sb->s_dev);
+	ctx->mode = inode->i_mode;
+	ctx->pos = file->f_pos;
+	ctx->f_flags = file->f_flags;
+	ctx->f_mode = (__force u32)file->f_mode;
+
+	bpf_iter_run_prog(seq, &kctx.meta);
+	return 0;
+}
+
+static void task_file_seq_stop(struct seq_file *seq, void *v)
+{
+	struct bpf_iter_seq_task_file_info *info = seq->private;
+
+	if (v) {
+		fput((struct file *)v);
+		put_files_struct(info->files);
+		put_task_struct(info->task);
+		info->files = NULL;
+		info->task = NULL;
+	}
+}
+
+static const struct seq_operations task_file_seq_ops = {
+	.start	= task_file_seq_start,
+	.next	= task_file_seq_next,
+	.stop	= task_file_seq_stop,
+	.show	= task_file_seq_show,
+};
+
+static int init_seq_pidns(void *priv_data)
+{
+	struct bpf_iter_seq_task_common *common = priv_data;
+
+	common->ns = get_pid_ns(task_active_pid_ns(current));
+	return 0;
+}
+
+static void fini_seq_pidns(void *priv_data)
+{
+	struct bpf_iter_seq_task_common *common = priv_data;
+
+	put_pid_ns(common->ns);
+}
+
+static const struct bpf_iter_reg task_reg_info = {
+	.attach_type		= BPF_ITER_TASK,
+	.seq_ops		= &task_seq_ops,
+	.init_seq_private	= init_seq_pidns,
+	.fini_seq_private	= fini_seq_pidns,
+	.seq_priv_size		= sizeof(struct bpf_iter_seq_task_info),
+	.ctx_size		= sizeof(struct bpf_iter_task),
+};
+
+static const struct bpf_iter_reg task_file_reg_info = {
+	.attach_type		= BPF_ITER_TASK_FILE,
+	.seq_ops		= &task_file_seq_ops,
+	.init_seq_private	= init_seq_pidns,
+	.fini_seq_private	= fini_seq_pidns,
+	.seq_priv_size		= sizeof(struct bpf_iter_seq_task_file_info),
+	.ctx_size		= sizeof(struct bpf_iter_task_file),
+};
+
+static int __init task_iter_init(void)
+{
+	int ret;
+
+	ret = bpf_iter_reg_target(&task_reg_info);
+	if (ret)
+		return ret;
+
+	return bpf_iter_reg_target(&task_file_reg_info);
+}
+late_initcall(task_iter_init);
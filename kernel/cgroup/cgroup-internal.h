@@ -273,6 +273,13 @@ void cgroup_rstat_exit(struct cgroup *cgrp);
 void cgroup_rstat_boot(void);
 void cgroup_base_stat_cputime_show(struct seq_file *seq);
 
+/*
+ * freezer.c
+ */
+int cgroup_freezer_set_event(struct cgroup *cgrp, int fd);
+void cgroup_freezer_stat_show(struct seq_file *seq, struct cgroup *cgrp);
+void cgroup_freezer_exit(struct cgroup *cgrp);
+
 /*
  * namespace.c
  */
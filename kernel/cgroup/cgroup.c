@@ -3697,6 +3697,7 @@ static int cgroup_stat_show(struct seq_file *seq, void *v)
 		   cgroup->nr_descendants);
 	seq_printf(seq, "nr_dying_descendants %d\n",
 		   cgroup->nr_dying_descendants);
+	cgroup_freezer_stat_show(seq, cgroup);
 
 	return 0;
 }
@@ -3871,6 +3872,28 @@ static ssize_t cgroup_freeze_write(struct kernfs_open_file *of,
 	return nbytes;
 }
 
+static ssize_t cgroup_freeze_event_write(struct kernfs_open_file *of,
+					 char *buf, size_t nbytes, loff_t off)
+{
+	struct cgroup *cgrp;
+	ssize_t ret;
+	int fd;
+
+	ret = kstrtoint(strstrip(buf), 0, &fd);
+	if (ret)
+		return ret;
+
+	cgrp = cgroup_kn_lock_live(of->kn, false);
+	if (!cgrp)
+		return -ENOENT;
+
+	ret = cgroup_freezer_set_event(cgrp, fd);
+
+	cgroup_kn_unlock(of->kn);
+
+	return ret ?: nbytes;
+}
+
 static int cgroup_file_open(struct kernfs_open_file *of)
 {
 	struct cftype *cft = of->kn->priv;
@@ -5109,6 +5132,11 @@ static struct cftype cgroup_base_files[] = {
 		.seq_show = cgroup_freeze_show,
 		.write = cgroup_freeze_write,
 	},
+	{
+		.name = "cgroup.freeze.event",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.write = cgroup_freeze_event_write,
+	},
 	{
 		.name = "cpu.stat",
 		.flags = CFTYPE_NOT_ON_ROOT,
@@ -5203,6 +5231,7 @@ static void css_free_rwork_fn(struct work_struct *work)
 			psi_cgroup_free(cgrp);
 			if (cgroup_on_dfl(cgrp))
 				cgroup_rstat_exit(cgrp);
+			cgroup_freezer_exit(cgrp);
 			kfree(cgrp);
 		} else {
 			/*
@@ -5480,6 +5509,8 @@ static struct cgroup *cgroup_create(struct cgroup *parent)
 		 */
 		set_bit(CGRP_FREEZE, &cgrp->flags);
 		set_bit(CGRP_FROZEN, &cgrp->flags);
+		cgrp->freezer.freeze_start = ktime_get_ns();
+		cgrp->freezer.frozen_start = cgrp->freezer.freeze_start;
 	}
 
 	spin_lock_irq(&css_set_lock);
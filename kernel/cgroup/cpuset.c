@@ -39,6 +39,7 @@
 #include <linux/mm.h>
 #include <linux/memory.h>
 #include <linux/export.h>
+#include <linux/moduleparam.h>
 #include <linux/mount.h>
 #include <linux/fs_context.h>
 #include <linux/namei.h>
@@ -55,6 +56,7 @@
 #include <linux/spinlock.h>
 #include <linux/stat.h>
 #include <linux/string.h>
+#include <linux/task_work.h>
 #include <linux/time.h>
 #include <linux/time64.h>
 #include <linux/backing-dev.h>
@@ -348,6 +350,17 @@ static DECLARE_WORK(cpuset_hotplug_work, cpuset_hotplug_workfn);
 
 static DECLARE_WAIT_QUEUE_HEAD(cpuset_attach_wq);
 
+/*
+ * Apply the cpumask of a cpuset to the user tasks that are moved into it,
+ * or whose cpuset's cpus change, on their next return to userspace rather
+ * than from the cgroup write with cpuset_rwsem and the hotplug lock held.
+ * Until then a sleeping task keeps, and sched_getaffinity() reports, its
+ * old mask.  Partition and hotplug updates are always synchronous.
+ * See cpuset_defer_affinity().
+ */
+static bool defer_affinity;
+module_param(defer_affinity, bool, 0644);
+
 /*
  * Cgroup v2 behavior is used when on default hierarchy or the
  * cgroup_v2_mode flag is set.
@@ -966,6 +979,71 @@ partition_and_rebuild_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 	mutex_unlock(&sched_domains_mutex);
 }
 
+/*
+ * Copy of the sched domains last handed to the scheduler by
+ * rebuild_sched_domains_locked(), to skip repartitioning, and walking every
+ * task for the deadline root domain accounting, when a cpuset update
+ * doesn't change the domains.  This is the common case: on the legacy
+ * hierarchy, rewriting the cpus of any load balanced cpuset ends up here.
+ * The scheduler doesn't tell when the domains change behind our back, so
+ * rebuild_sched_domains(), which hotplug and the arch code go through,
+ * invalidates the copy.
+ */
+static cpumask_var_t *last_doms;
+static struct sched_domain_attr *last_dattr;
+static int last_ndoms;
+static bool last_doms_valid;
+
+static bool sched_domains_unchanged(int ndoms, cpumask_var_t doms[],
+				    struct sched_domain_attr *dattr)
+{
+	int i;
+
+	if (!last_doms_valid || !doms || ndoms != last_ndoms)
+		return false;
+
+	for (i = 0; i < ndoms; i++) {
+		if (!cpumask_equal(doms[i], last_doms[i]))
+			return false;
+	}
+
+	if (!dattr || !last_dattr)
+		return !dattr && !last_dattr;
+
+	return !memcmp(dattr, last_dattr, ndoms * sizeof(*dattr));
+}
+
+static void sched_domains_remember(int ndoms, cpumask_var_t doms[],
+				   struct sched_domain_attr *dattr)
+{
+	int i;
+
+	free_sched_domains(last_doms, last_ndoms);
+	kfree(last_dattr);
+	last_doms = NULL;
+	last_dattr = NULL;
+	last_ndoms = 0;
+	last_doms_valid = false;
+
+	if (!doms)
+		return;
+
+	last_doms = alloc_sched_domains(ndoms);
+	if (!last_doms)
+		return;
+	last_ndoms = ndoms;
+
+	if (dattr) {
+		last_dattr = kmemdup(dattr, ndoms * sizeof(*dattr), GFP_KERNEL);
+		if (!last_dattr)
+			return;
+	}
+
+	for (i = 0; i < ndoms; i++)
+		cpumask_copy(last_doms[i], doms[i]);
+	last_doms_valid = true;
+}
+
 /*
  * Rebuild scheduler domains.
  *
@@ -1025,19 +1103,37 @@ static void rebuild_sched_domains_locked(void)
 	/* Generate domain masks and attrs */
 	ndoms = generate_sched_domains(&doms, &attr);
 
+	/* Nothing to do if the domains are the same as last time */
+	if (sched_domains_unchanged(ndoms, doms, attr)) {
+		free_sched_domains(doms, ndoms);
+		kfree(attr);
+		return;
+	}
+	sched_domains_remember(ndoms, doms, attr);
+
 	/* Have scheduler rebuild the domains */
 	partition_and_rebuild_sched_domains(ndoms, doms, attr);
 }
+
+static void invalidate_sched_domains(void)
+{
+	last_doms_valid = false;
+}
 #else /* !CONFIG_SMP */
 static void rebuild_sched_domains_locked(void)
 {
 }
+
+static void invalidate_sched_domains(void)
+{
+}
 #endif /* CONFIG_SMP */
 
 void rebuild_sched_domains(void)
 {
 	get_online_cpus();
 	percpu_down_write(&cpuset_rwsem);
+	invalidate_sched_domains();
 	rebuild_sched_domains_locked();
 	percpu_up_write(&cpuset_rwsem);
 	put_online_cpus();
@@ -1059,15 +1155,86 @@ static int update_cpus_allowed(struct cpuset *cs, struct task_struct *p,
 	return set_cpus_allowed_ptr(p, new_mask);
 }
 
+static void cpuset_affinity_workfn(struct callback_head *head)
+{
+	struct task_struct *p = current;
+	cpumask_var_t new_cpus;
+	struct cpuset *cs;
+
+	/* Let a cpuset change from here on queue another update. */
+	clear_bit(0, &p->cpuset_affinity_pending);
+	smp_mb__after_atomic();
+
+	/* sched_setaffinity() since the cpuset change has the last word */
+	if (READ_ONCE(p->cpuset_affinity_seq) !=
+	    READ_ONCE(p->cpuset_affinity_queued_seq))
+		return;
+
+	if (!alloc_cpumask_var(&new_cpus, GFP_KERNEL))
+		return;
+
+	percpu_down_read(&cpuset_rwsem);
+	rcu_read_lock();
+	cs = task_cs(p);
+	if (cs == &top_cpuset)
+		cpumask_copy(new_cpus, cpu_possible_mask);
+	else
+		guarantee_online_cpus(cs, new_cpus);
+	rcu_read_unlock();
+
+	/* Stable, cpuset changes take cpuset_rwsem for writing. */
+	update_cpus_allowed(cs, p, new_cpus);
+	percpu_up_read(&cpuset_rwsem);
+
+	free_cpumask_var(new_cpus);
+}
+
+/**
+ * cpuset_defer_affinity - update the cpumask of a task on its way to userspace
+ * @p: the task
+ *
+ * Queue a task_work that makes @p apply the cpumask of whatever cpuset it
+ * is in at the time to itself.  Only a task that is about to run user code
+ * needs its affinity updated right away, and most tasks being moved, e.g.
+ * the threads of an app going to the background, are asleep; they pick up
+ * the change when they wake up and return to userspace.  The task_work of
+ * a task that is running is run right away, as the notification kicks it.
+ * If the affinity of @p is set in the meantime, the update is dropped.
+ *
+ * Returns %false if the update has to be done synchronously.
+ */
+static bool cpuset_defer_affinity(struct task_struct *p)
+{
+	if (!defer_affinity || (p->flags & PF_KTHREAD))
+		return false;
+
+	/* Ordered before the pending bit by test_and_set_bit() */
+	WRITE_ONCE(p->cpuset_affinity_queued_seq,
+		   READ_ONCE(p->cpuset_affinity_seq));
+
+	/* Already queued, and it looks the cpuset up when it runs. */
+	if (test_and_set_bit(0, &p->cpuset_affinity_pending))
+		return true;
+
+	init_task_work(&p->cpuset_affinity_work, cpuset_affinity_workfn);
+	if (task_work_add(p, &p->cpuset_affinity_work, true)) {
+		/* Exiting, whatever is done now won't matter for long. */
+		clear_bit(0, &p->cpuset_affinity_pending);
+		return false;
+	}
+	return true;
+}
+
 /**
  * update_tasks_cpumask - Update the cpumasks of tasks in the cpuset.
  * @cs: the cpuset in which each task's cpus_allowed mask needs to be changed
+ * @defer: whether user tasks may pick the new mask up on their own
  *
  * Iterate through each task of @cs updating its cpus_allowed to the
  * effective cpuset's.  As this function is called with cpuset_mutex held,
  * cpuset membership stays stable.
  */
-static void update_tasks_cpumask(struct cpuset *cs)
+static void update_tasks_cpumask(struct cpuset *cs, bool defer)
 {
 	struct css_task_iter it;
 	struct task_struct *task;
@@ -1081,6 +1248,8 @@ static void update_tasks_cpumask(struct cpuset *cs)
 		if (top_cs && (task->flags & PF_KTHREAD) &&
 		    kthread_is_per_cpu(task))
 			continue;
+		if (defer && cpuset_defer_affinity(task))
+			continue;
 		update_cpus_allowed(cs, task, cs->effective_cpus);
 	}
 	css_task_iter_end(&it);
@@ -1328,6 +1497,7 @@ static int update_parent_subparts_cpumask(struct cpuset *cpuset, int cmd,
  * update_cpumasks_hier - Update effective cpumasks and tasks in the subtree
  * @cs:  the cpuset to consider
  * @tmp: temp variables for calculating effective_cpus & partition setup
+ * @defer: whether user tasks may pick the new masks up on their own
  *
  * When congifured cpumask is changed, the effective cpumasks of this cpuset
  * and all its descendants need to be updated.
@@ -1336,7 +1506,8 @@ static int update_parent_subparts_cpumask(struct cpuset *cpuset, int cmd,
  *
  * Called with cpuset_mutex held
  */
-static void update_cpumasks_hier(struct cpuset *cs, struct tmpmasks *tmp)
+static void update_cpumasks_hier(struct cpuset *cs, struct tmpmasks *tmp,
+				 bool defer)
 {
 	struct cpuset *cp;
 	struct cgroup_subsys_state *pos_css;
@@ -1404,7 +1575,7 @@ static void update_cpumasks_hier(struct cpuset *cs, struct tmpmasks *tmp)
 
 			case PRS_ENABLED:
 				if (update_parent_subparts_cpumask(cp, partcmd_update, NULL, tmp))
-					update_tasks_cpumask(parent);
+					update_tasks_cpumask(parent, false);
 				break;
 
 			case PRS_ERROR:
@@ -1460,7 +1631,8 @@ static void update_cpumasks_hier(struct cpuset *cs, struct tmpmasks *tmp)
 		WARN_ON(!is_in_v2_mode() &&
 			!cpumask_equal(cp->cpus_allowed, cp->effective_cpus));
 
-		update_tasks_cpumask(cp);
+		/* CPUs moving in or out of a partition are exclusive */
+		update_tasks_cpumask(cp, defer && !cp->partition_root_state);
 
 		/*
 		 * On legacy hierarchy, if the effective cpumask of any non-
@@ -1515,7 +1687,7 @@ static void update_sibling_cpumasks(struct cpuset *parent, struct cpuset *cs,
 			continue;
 
 		rcu_read_unlock();
-		update_cpumasks_hier(sibling, tmp);
+		update_cpumasks_hier(sibling, tmp, false);
 		rcu_read_lock();
 		css_put(&sibling->css);
 	}
@@ -1597,7 +1769,7 @@ static int update_cpumask(struct cpuset *cs, struct cpuset *trialcs,
 	}
 	spin_unlock_irq(&callback_lock);
 
-	update_cpumasks_hier(cs, &tmp);
+	update_cpumasks_hier(cs, &tmp, !cs->partition_root_state);
 
 	if (cs->partition_root_state) {
 		struct cpuset *parent = parent_cs(cs);
@@ -2038,7 +2210,7 @@ static int update_prstate(struct cpuset *cs, int val)
 		update_flag(CS_CPU_EXCLUSIVE, cs, 0);
 	}
 
-	update_tasks_cpumask(parent);
+	update_tasks_cpumask(parent, false);
 
 	if (parent->child_ecpus_count)
 		update_sibling_cpumasks(parent, cs, &tmp);
@@ -2243,7 +2415,8 @@ static void cpuset_attach(struct cgroup_taskset *tset)
 		 * can_attach beforehand should guarantee that this doesn't
 		 * fail.  TODO: have a better way to handle failure here
 		 */
-		WARN_ON_ONCE(update_cpus_allowed(cs, task, cpus_attach));
+		if (!cpuset_defer_affinity(task))
+			WARN_ON_ONCE(update_cpus_allowed(cs, task, cpus_attach));
 
 		cpuset_change_task_nodemask(task, &cpuset_attach_nodemask_to);
 		cpuset_update_task_spread_flag(cs, task);
@@ -2916,6 +3089,17 @@ static void cpuset_bind(struct cgroup_subsys_state *root_css)
  */
 static void cpuset_fork(struct task_struct *task)
 {
+	/*
+	 * The parent may not have applied its own cpuset's mask yet, in
+	 * which case neither can the child inherit it.
+	 */
+	task->cpuset_affinity_pending = 0;
+	if (test_bit(0, &current->cpuset_affinity_pending) &&
+	    cpuset_defer_affinity(task)) {
+		task->mems_allowed = current->mems_allowed;
+		return;
+	}
+
 	if (task_css_is_root(task, cpuset_cgrp_id))
 		return;
 
@@ -3016,7 +3200,7 @@ hotplug_update_tasks_legacy(struct cpuset *cs,
 	 * as the tasks will be migratecd to an ancestor.
 	 */
 	if (cpus_updated && !cpumask_empty(cs->cpus_allowed))
-		update_tasks_cpumask(cs);
+		update_tasks_cpumask(cs, false);
 	if (mems_updated && !nodes_empty(cs->mems_allowed))
 		update_tasks_nodemask(cs);
 
@@ -3052,7 +3236,7 @@ hotplug_update_tasks(struct cpuset *cs,
 	spin_unlock_irq(&callback_lock);
 
 	if (cpus_updated)
-		update_tasks_cpumask(cs);
+		update_tasks_cpumask(cs, false);
 	if (mems_updated)
 		update_tasks_nodemask(cs);
 }
@@ -3345,6 +3529,12 @@ void cpuset_cpus_allowed(struct task_struct *tsk, struct cpumask *pmask)
 {
 	unsigned long flags;
 
+	/*
+	 * Only sched_setaffinity() asks, right before setting the affinity
+	 * of @tsk: a deferred cpuset update mustn't overwrite it.
+	 */
+	WRITE_ONCE(tsk->cpuset_affinity_seq, tsk->cpuset_affinity_seq + 1);
+
 	spin_lock_irqsave(&callback_lock, flags);
 	rcu_read_lock();
 	guarantee_online_cpus(task_cs(tsk), pmask);
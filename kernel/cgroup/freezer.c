@@ -3,11 +3,39 @@
 #include <linux/sched.h>
 #include <linux/sched/task.h>
 #include <linux/sched/signal.h>
+#include <linux/eventfd.h>
+#include <linux/ktime.h>
 
 #include "cgroup-internal.h"
 
 #include <trace/events/cgroup.h>
 
+/*
+ * Switch CGRP_FROZEN, account the time spent frozen and notify userspace.
+ */
+static void cgroup_set_frozen(struct cgroup *cgrp, bool frozen)
+{
+	struct cgroup_freezer_state *freezer = &cgrp->freezer;
+	u64 now = ktime_get_ns();
+
+	lockdep_assert_held(&css_set_lock);
+
+	if (frozen) {
+		set_bit(CGRP_FROZEN, &cgrp->flags);
+		freezer->frozen_start = now;
+		freezer->freeze_latency = now - freezer->freeze_start;
+		freezer->nr_freezes++;
+	} else {
+		clear_bit(CGRP_FROZEN, &cgrp->flags);
+		freezer->frozen_time += now - freezer->frozen_start;
+	}
+
+	cgroup_file_notify(&cgrp->events_file);
+	if (freezer->event)
+		eventfd_signal(freezer->event, 1);
+	TRACE_CGROUP_PATH(notify_frozen, cgrp, frozen);
+}
+
 /*
  * Propagate the cgroup frozen state upwards by the cgroup tree.
  */
@@ -28,17 +56,13 @@ static void cgroup_propagate_frozen(struct cgroup *cgrp, bool frozen)
 			    test_bit(CGRP_FREEZE, &cgrp->flags) &&
 			    cgrp->freezer.nr_frozen_descendants ==
 			    cgrp->nr_descendants) {
-				set_bit(CGRP_FROZEN, &cgrp->flags);
-				cgroup_file_notify(&cgrp->events_file);
-				TRACE_CGROUP_PATH(notify_frozen, cgrp, 1);
+				cgroup_set_frozen(cgrp, true);
 				desc++;
 			}
 		} else {
 			cgrp->freezer.nr_frozen_descendants -= desc;
 			if (test_bit(CGRP_FROZEN, &cgrp->flags)) {
-				clear_bit(CGRP_FROZEN, &cgrp->flags);
-				cgroup_file_notify(&cgrp->events_file);
-				TRACE_CGROUP_PATH(notify_frozen, cgrp, 0);
+				cgroup_set_frozen(cgrp, false);
 				desc++;
 			}
 		}
@@ -63,21 +87,11 @@ void cgroup_update_frozen(struct cgroup *cgrp)
 	frozen = test_bit(CGRP_FREEZE, &cgrp->flags) &&
 		cgrp->freezer.nr_frozen_tasks == __cgroup_task_count(cgrp);
 
-	if (frozen) {
-		/* Already there? */
-		if (test_bit(CGRP_FROZEN, &cgrp->flags))
-			return;
-
-		set_bit(CGRP_FROZEN, &cgrp->flags);
-	} else {
-		/* Already there? */
-		if (!test_bit(CGRP_FROZEN, &cgrp->flags))
-			return;
+	/* Already there? */
+	if (frozen == test_bit(CGRP_FROZEN, &cgrp->flags))
+		return;
 
-		clear_bit(CGRP_FROZEN, &cgrp->flags);
-	}
-	cgroup_file_notify(&cgrp->events_file);
-	TRACE_CGROUP_PATH(notify_frozen, cgrp, frozen);
+	cgroup_set_frozen(cgrp, frozen);
 
 	/* Update the state of ancestor cgroups. */
 	cgroup_propagate_frozen(cgrp, frozen);
@@ -148,6 +162,30 @@ void cgroup_leave_frozen(bool always_leave)
 	spin_unlock_irq(&css_set_lock);
 }
 
+/*
+ * Catch up with the freezer state of the task's cgroup: set or clear
+ * JOBCTL_TRAP_FREEZE according to CGRP_FREEZE, and remember the generation
+ * that was seen.  Called from get_signal() with siglock held, whenever
+ * cgroup_task_freeze_changed() says that the generation has moved on.
+ */
+void cgroup_freezer_sync(void)
+{
+	struct cgroup *cgrp;
+
+	lockdep_assert_held(&current->sighand->siglock);
+
+	rcu_read_lock();
+	cgrp = task_dfl_cgroup(current);
+	current->cgroup_freeze_gen = READ_ONCE(cgrp->freezer.gen);
+	/* Pairs with the smp_wmb() in cgroup_do_freeze() */
+	smp_rmb();
+	if (test_bit(CGRP_FREEZE, &cgrp->flags))
+		current->jobctl |= JOBCTL_TRAP_FREEZE;
+	else
+		current->jobctl &= ~JOBCTL_TRAP_FREEZE;
+	rcu_read_unlock();
+}
+
 /*
  * Freeze or unfreeze the task by setting or clearing the JOBCTL_TRAP_FREEZE
  * jobctl bit.
@@ -171,6 +209,20 @@ static void cgroup_freeze_task(struct task_struct *task, bool freeze)
 	unlock_task_sighand(task, &flags);
 }
 
+/*
+ * Make the task notice the new freezer generation of its cgroup.  The task
+ * syncs its JOBCTL_TRAP_FREEZE in get_signal() itself, so unlike
+ * cgroup_freeze_task() this doesn't need the task's sighand lock: a freeze
+ * only has to get it there, a thaw to wake it up from the freezer trap.
+ */
+static void cgroup_kick_task(struct task_struct *task, bool freeze)
+{
+	if (freeze)
+		signal_wake_up(task, false);
+	else
+		wake_up_process(task);
+}
+
 /*
  * Freeze or unfreeze all tasks in the given cgroup.
  */
@@ -182,12 +234,24 @@ static void cgroup_do_freeze(struct cgroup *cgrp, bool freeze)
 	lockdep_assert_held(&cgroup_mutex);
 
 	spin_lock_irq(&css_set_lock);
-	if (freeze)
+	if (freeze) {
 		set_bit(CGRP_FREEZE, &cgrp->flags);
-	else
+		cgrp->freezer.freeze_start = ktime_get_ns();
+	} else {
 		clear_bit(CGRP_FREEZE, &cgrp->flags);
+	}
+	/* Pairs with the smp_rmb() in cgroup_freezer_sync() */
+	smp_wmb();
+	WRITE_ONCE(cgrp->freezer.gen, cgrp->freezer.gen + 1);
 	spin_unlock_irq(&css_set_lock);
 
+	/*
+	 * Order the generation bump before setting TIF_SIGPENDING below,
+	 * pairs with the barrier in recalc_sigpending() and the one in
+	 * set_current_state() in do_freezer_trap().
+	 */
+	smp_mb();
+
 	if (freeze)
 		TRACE_CGROUP_PATH(freeze, cgrp);
 	else
@@ -201,7 +265,7 @@ static void cgroup_do_freeze(struct cgroup *cgrp, bool freeze)
 		 */
 		if (task->flags & PF_KTHREAD)
 			continue;
-		cgroup_freeze_task(task, freeze);
+		cgroup_kick_task(task, freeze);
 	}
 	css_task_iter_end(&it);
 
@@ -321,3 +385,52 @@ void cgroup_freeze(struct cgroup *cgrp, bool freeze)
 		cgroup_file_notify(&cgrp->events_file);
 	}
 }
+
+/*
+ * Signal the eventfd @fd whenever the frozen state of @cgrp changes, or
+ * stop signalling any if @fd is negative.
+ */
+int cgroup_freezer_set_event(struct cgroup *cgrp, int fd)
+{
+	struct eventfd_ctx *event = NULL, *old;
+
+	if (fd >= 0) {
+		event = eventfd_ctx_fdget(fd);
+		if (IS_ERR(event))
+			return PTR_ERR(event);
+	}
+
+	spin_lock_irq(&css_set_lock);
+	old = cgrp->freezer.event;
+	cgrp->freezer.event = event;
+	spin_unlock_irq(&css_set_lock);
+
+	if (old)
+		eventfd_ctx_put(old);
+	return 0;
+}
+
+void cgroup_freezer_stat_show(struct seq_file *seq, struct cgroup *cgrp)
+{
+	struct cgroup_freezer_state *freezer = &cgrp->freezer;
+	u64 frozen_time, freeze_latency, nr_freezes;
+
+	spin_lock_irq(&css_set_lock);
+	frozen_time = freezer->frozen_time;
+	if (test_bit(CGRP_FROZEN, &cgrp->flags))
+		frozen_time += ktime_get_ns() - freezer->frozen_start;
+	freeze_latency = freezer->freeze_latency;
+	nr_freezes = freezer->nr_freezes;
+	spin_unlock_irq(&css_set_lock);
+
+	seq_printf(seq, "frozen_usec %llu\n", div_u64(frozen_time, NSEC_PER_USEC));
+	seq_printf(seq, "freeze_latency_usec %llu\n",
+		   div_u64(freeze_latency, NSEC_PER_USEC));
+	seq_printf(seq, "nr_freezes %llu\n", nr_freezes);
+}
+
+void cgroup_freezer_exit(struct cgroup *cgrp)
+{
+	if (cgrp->freezer.event)
+		eventfd_ctx_put(cgrp->freezer.event);
+}
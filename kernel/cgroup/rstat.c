@@ -6,6 +6,32 @@
 static DEFINE_SPINLOCK(cgroup_rstat_lock);
 static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
 
+/*
+ * Readers that can live with slightly stale stats go through
+ * cgroup_rstat_flush_hold_ratelimited(), which only flushes once enough
+ * cgroups have been queued on the updated trees since the last full
+ * flush, or the stats are older than CGROUP_RSTAT_FLUSH_PERIOD.  A
+ * deferrable work item flushes everything at that period anyway, so the
+ * trees can't grow without bound on a system nobody reads stats on.
+ *
+ * Queueings are counted per cpu and folded into cgroup_rstat_pending in
+ * batches of CGROUP_RSTAT_UPDATE_BATCH to keep the update path cheap.
+ */
+#define CGROUP_RSTAT_FLUSH_PERIOD	(2UL * HZ)
+#define CGROUP_RSTAT_UPDATE_BATCH	32
+
+static DEFINE_PER_CPU(unsigned int, cgroup_rstat_cpu_pending);
+static atomic_t cgroup_rstat_pending = ATOMIC_INIT(0);
+static atomic_t cgroup_rstat_flushing = ATOMIC_INIT(0);
+static unsigned long cgroup_rstat_last_flush;
+
+static void cgroup_rstat_flush_workfn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(cgroup_rstat_flush_work,
+			       cgroup_rstat_flush_workfn);
+
+/* max number of cgroups flushed between checks for lock contention */
+#define CGROUP_RSTAT_FLUSH_BATCH	32
+
 static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu);
 
 static struct cgroup_rstat_cpu *cgroup_rstat_cpu(struct cgroup *cgrp, int cpu)
@@ -62,6 +88,12 @@ void cgroup_rstat_updated(struct cgroup *cgrp, int cpu)
 		prstatc->updated_children = cgrp;
 	}
 
+	if (++*per_cpu_ptr(&cgroup_rstat_cpu_pending, cpu) >=
+	    CGROUP_RSTAT_UPDATE_BATCH) {
+		atomic_add(CGROUP_RSTAT_UPDATE_BATCH, &cgroup_rstat_pending);
+		*per_cpu_ptr(&cgroup_rstat_cpu_pending, cpu) = 0;
+	}
+
 	raw_spin_unlock_irqrestore(cpu_lock, flags);
 }
 EXPORT_SYMBOL_GPL(cgroup_rstat_updated);
@@ -146,10 +178,17 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
 
 	lockdep_assert_held(&cgroup_rstat_lock);
 
+	/* a full flush leaves nothing pending */
+	if (!cgroup_parent(cgrp)) {
+		atomic_set(&cgroup_rstat_pending, 0);
+		WRITE_ONCE(cgroup_rstat_last_flush, jiffies);
+	}
+
 	for_each_possible_cpu(cpu) {
 		raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock,
 						       cpu);
 		struct cgroup *pos = NULL;
+		int nr = 0;
 
 		raw_spin_lock(cpu_lock);
 		while ((pos = cgroup_rstat_cpu_pop_updated(pos, cgrp, cpu))) {
@@ -162,6 +201,25 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
 						rstat_css_node)
 				css->ss->css_rstat_flush(css, cpu);
 			rcu_read_unlock();
+
+			/*
+			 * With hundreds of cgroups on one cpu's tree, don't
+			 * sit on the locks for the whole of it.  Flushed
+			 * cgroups are off the tree already and parents stay
+			 * on it until their children are gone, so the walk
+			 * can simply start over from @cgrp.
+			 */
+			if (may_sleep && ++nr >= CGROUP_RSTAT_FLUSH_BATCH &&
+			    (need_resched() ||
+			     spin_needbreak(&cgroup_rstat_lock))) {
+				raw_spin_unlock(cpu_lock);
+				spin_unlock_irq(&cgroup_rstat_lock);
+				cond_resched();
+				spin_lock_irq(&cgroup_rstat_lock);
+				raw_spin_lock(cpu_lock);
+				pos = NULL;
+				nr = 0;
+			}
 		}
 		raw_spin_unlock(cpu_lock);
 
@@ -230,6 +288,54 @@ void cgroup_rstat_flush_hold(struct cgroup *cgrp)
 	cgroup_rstat_flush_locked(cgrp, true);
 }
 
+static bool cgroup_rstat_flush_needed(void)
+{
+	return atomic_read(&cgroup_rstat_pending) >
+		CGROUP_RSTAT_UPDATE_BATCH * num_online_cpus() ||
+	       time_after(jiffies, READ_ONCE(cgroup_rstat_last_flush) +
+				   CGROUP_RSTAT_FLUSH_PERIOD);
+}
+
+/**
+ * cgroup_rstat_flush_hold_ratelimited - cheap cgroup_rstat_flush_hold()
+ * @cgrp: target cgroup
+ *
+ * Like cgroup_rstat_flush_hold(), but the stats of @cgrp's subtree may be
+ * up to CGROUP_RSTAT_FLUSH_PERIOD old.  Only a reader that finds enough
+ * updates pending flushes, and it flushes the whole hierarchy so that the
+ * readers after it don't have to; readers that come along while that
+ * flush is running don't queue up behind it to flush again.  Must be
+ * paired with cgroup_rstat_flush_release().
+ *
+ * This function may block.
+ */
+void cgroup_rstat_flush_hold_ratelimited(struct cgroup *cgrp)
+	__acquires(&cgroup_rstat_lock)
+{
+	might_sleep();
+
+	if (cgroup_rstat_flush_needed() &&
+	    !atomic_xchg(&cgroup_rstat_flushing, 1)) {
+		spin_lock_irq(&cgroup_rstat_lock);
+		cgroup_rstat_flush_locked(&cgrp_dfl_root.cgrp, true);
+		atomic_set(&cgroup_rstat_flushing, 0);
+		return;
+	}
+
+	spin_lock_irq(&cgroup_rstat_lock);
+}
+
+static void cgroup_rstat_flush_workfn(struct work_struct *work)
+{
+	if (!atomic_xchg(&cgroup_rstat_flushing, 1)) {
+		cgroup_rstat_flush(&cgrp_dfl_root.cgrp);
+		atomic_set(&cgroup_rstat_flushing, 0);
+	}
+
+	queue_delayed_work(system_unbound_wq, &cgroup_rstat_flush_work,
+			   CGROUP_RSTAT_FLUSH_PERIOD);
+}
+
 /**
  * cgroup_rstat_flush_release - release cgroup_rstat_flush_hold()
  */
@@ -290,6 +396,14 @@ void __init cgroup_rstat_boot(void)
 	BUG_ON(cgroup_rstat_init(&cgrp_dfl_root.cgrp));
 }
 
+static int __init cgroup_rstat_flush_init(void)
+{
+	queue_delayed_work(system_unbound_wq, &cgroup_rstat_flush_work,
+			   CGROUP_RSTAT_FLUSH_PERIOD);
+	return 0;
+}
+subsys_initcall(cgroup_rstat_flush_init);
+
 /*
  * Functions for cgroup basic resource statistics implemented on top of
  * rstat.
@@ -393,7 +507,7 @@ void cgroup_base_stat_cputime_show(struct seq_file *seq)
 	if (!cgroup_parent(cgrp))
 		return;
 
-	cgroup_rstat_flush_hold(cgrp);
+	cgroup_rstat_flush_hold_ratelimited(cgrp);
 	usage = cgrp->bstat.cputime.sum_exec_runtime;
 	cputime_adjust(&cgrp->bstat.cputime, &cgrp->prev_cputime, &utime, &stime);
 	cgroup_rstat_flush_release();
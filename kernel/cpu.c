@@ -35,6 +35,7 @@
 #include <uapi/linux/sched/types.h>
 #include <linux/cpuset.h>
 #include <linux/random.h>
+#include <linux/math64.h>
 
 #include <trace/events/power.h>
 #define CREATE_TRACE_POINTS
@@ -113,6 +114,11 @@ static inline void cpuhp_lock_release(bool bringup) { }
  * @startup:	Startup function of the step
  * @teardown:	Teardown function of the step
  * @cant_stop:	Bringup/teardown can't be stopped at this step
+ * @parallel:	The callbacks may run on several CPUs at the same time
+ * @startup_ns:	Time spent in the startup callbacks, summed over all CPUs
+ * @teardown_ns: Time spent in the teardown callbacks, summed over all CPUs
+ * @startup_calls: Number of startup callback invocations
+ * @teardown_calls: Number of teardown callback invocations
  */
 struct cpuhp_step {
 	const char		*name;
@@ -129,6 +135,11 @@ struct cpuhp_step {
 	struct hlist_head	list;
 	bool			cant_stop;
 	bool			multi_instance;
+	bool			parallel;
+	atomic64_t		startup_ns;
+	atomic64_t		teardown_ns;
+	atomic_t		startup_calls;
+	atomic_t		teardown_calls;
 };
 
 static DEFINE_MUTEX(cpuhp_state_mutex);
@@ -149,9 +160,9 @@ static struct cpuhp_step *cpuhp_get_step(enum cpuhp_state state)
  *
  * Called from cpu hotplug and from the state register machinery.
  */
-static int cpuhp_invoke_callback(unsigned int cpu, enum cpuhp_state state,
-				 bool bringup, struct hlist_node *node,
-				 struct hlist_node **lastp)
+static int __cpuhp_invoke_callback(unsigned int cpu, enum cpuhp_state state,
+				   bool bringup, struct hlist_node *node,
+				   struct hlist_node **lastp)
 {
 	struct cpuhp_cpu_state *st = per_cpu_ptr(&cpuhp_state, cpu);
 	struct cpuhp_step *step = cpuhp_get_step(state);
@@ -233,6 +244,32 @@ static int cpuhp_invoke_callback(unsigned int cpu, enum cpuhp_state state,
 	return ret;
 }
 
+static int cpuhp_invoke_callback(unsigned int cpu, enum cpuhp_state state,
+				 bool bringup, struct hlist_node *node,
+				 struct hlist_node **lastp)
+{
+	struct cpuhp_step *step = cpuhp_get_step(state);
+	u64 start;
+	int ret;
+
+	/* Only time state transitions, not instance add/remove. */
+	if (node || !(bringup ? step->startup.single : step->teardown.single))
+		return __cpuhp_invoke_callback(cpu, state, bringup, node, lastp);
+
+	start = local_clock();
+	ret = __cpuhp_invoke_callback(cpu, state, bringup, node, lastp);
+	start = local_clock() - start;
+
+	if (bringup) {
+		atomic64_add(start, &step->startup_ns);
+		atomic_inc(&step->startup_calls);
+	} else {
+		atomic64_add(start, &step->teardown_ns);
+		atomic_inc(&step->teardown_calls);
+	}
+	return ret;
+}
+
 #ifdef CONFIG_SMP
 static bool cpuhp_is_ap_state(enum cpuhp_state state)
 {
@@ -489,11 +526,11 @@ cpuhp_reset_state(struct cpuhp_cpu_state *st, enum cpuhp_state prev_state)
 	st->bringup = !st->bringup;
 }
 
-/* Regular hotplug invocation of the AP hotplug thread */
-static void __cpuhp_kick_ap(struct cpuhp_cpu_state *st)
+/* Start the AP hotplug thread, returns false if there is nothing to do */
+static bool __cpuhp_kick_ap_start(struct cpuhp_cpu_state *st)
 {
 	if (!st->single && st->state == st->target)
-		return;
+		return false;
 
 	st->result = 0;
 	/*
@@ -503,7 +540,14 @@ static void __cpuhp_kick_ap(struct cpuhp_cpu_state *st)
 	smp_mb();
 	st->should_run = true;
 	wake_up_process(st->thread);
-	wait_for_ap_thread(st, st->bringup);
+	return true;
+}
+
+/* Regular hotplug invocation of the AP hotplug thread */
+static void __cpuhp_kick_ap(struct cpuhp_cpu_state *st)
+{
+	if (__cpuhp_kick_ap_start(st))
+		wait_for_ap_thread(st, st->bringup);
 }
 
 static int cpuhp_kick_ap(struct cpuhp_cpu_state *st, enum cpuhp_state target)
@@ -803,6 +847,118 @@ static int cpuhp_kick_ap_work(unsigned int cpu)
 	return ret;
 }
 
+/*
+ * Parallel hotplug: the AP thread states of several CPUs are walked in
+ * lockstep.  Runs of states marked parallel (or without a callback in the
+ * direction at hand) are done on all CPUs at once, every other state on
+ * one CPU after the other, so that its callbacks still never run
+ * concurrently.  Off unless enabled with cpuhp_parallel=1 or through
+ * /sys/devices/system/cpu/hotplug/parallel.
+ */
+static bool cpuhp_parallel;
+
+static int __init cpuhp_parallel_setup(char *str)
+{
+	return kstrtobool(str, &cpuhp_parallel);
+}
+early_param("cpuhp_parallel", cpuhp_parallel_setup);
+
+/* Wall clock time of the last multi-CPU bringup and teardown */
+static unsigned int cpuhp_last_up_cpus, cpuhp_last_down_cpus;
+static u64 cpuhp_last_up_ns, cpuhp_last_down_ns;
+
+/*
+ * Find how far the AP threads can get from @state towards @target in one
+ * kick: over a run of states that can go in parallel, or else over a
+ * single state that can't.
+ */
+static enum cpuhp_state cpuhp_next_segment(enum cpuhp_state state,
+					   enum cpuhp_state target,
+					   bool *parallel)
+{
+	bool bringup = state < target;
+	enum cpuhp_state next = state;
+
+	*parallel = true;
+	while (next != target) {
+		/* Going down, the AP thread tears down its current state */
+		struct cpuhp_step *step = cpuhp_get_step(bringup ? next + 1 :
+								   next);
+
+		if (!step->parallel && (bringup ? step->startup.single :
+						  step->teardown.single)) {
+			if (next == state) {
+				*parallel = false;
+				next = bringup ? next + 1 : next - 1;
+			}
+			break;
+		}
+		next = bringup ? next + 1 : next - 1;
+	}
+	return next;
+}
+
+/*
+ * Move the AP threads of the CPUs in @mask to @target, all at once if
+ * @parallel, else one after the other.  A CPU that fails is rolled back to
+ * @rollback and dropped from @mask; the first error is returned.
+ */
+static int cpuhp_kick_ap_mask(struct cpumask *mask, enum cpuhp_state target,
+			      enum cpuhp_state rollback, bool parallel)
+{
+	struct cpuhp_cpu_state *st;
+	int cpu, ret = 0;
+
+	for_each_cpu(cpu, mask) {
+		st = per_cpu_ptr(&cpuhp_state, cpu);
+		cpuhp_set_state(st, target);
+		if (__cpuhp_kick_ap_start(st) && !parallel)
+			wait_for_ap_thread(st, st->bringup);
+	}
+
+	for_each_cpu(cpu, mask) {
+		st = per_cpu_ptr(&cpuhp_state, cpu);
+		if (parallel)
+			wait_for_ap_thread(st, st->bringup);
+		if (!st->result)
+			continue;
+
+		if (!ret)
+			ret = st->result;
+		cpuhp_reset_state(st, rollback);
+		__cpuhp_kick_ap(st);
+		cpumask_clear_cpu(cpu, mask);
+	}
+	return ret;
+}
+
+/*
+ * Walk the AP threads of all CPUs in @mask, which must all be at @from,
+ * to @target in lockstep.  On return @mask holds the CPUs that made it;
+ * the others are back at @from.  Requires cpus_write_lock().
+ */
+static int cpuhp_kick_ap_lockstep(struct cpumask *mask, enum cpuhp_state from,
+				  enum cpuhp_state target)
+{
+	enum cpuhp_state state = from;
+	bool parallel;
+	int err, ret = 0;
+
+	cpuhp_lock_acquire(false);
+	cpuhp_lock_release(false);
+
+	cpuhp_lock_acquire(true);
+	cpuhp_lock_release(true);
+
+	while (state != target && !cpumask_empty(mask)) {
+		state = cpuhp_next_segment(state, target, &parallel);
+		err = cpuhp_kick_ap_mask(mask, state, from, parallel);
+		if (err && !ret)
+			ret = err;
+	}
+	return ret;
+}
+
 static struct smp_hotplug_thread cpuhp_threads = {
 	.store			= &cpuhp_state.thread,
 	.create			= &cpuhp_create,
@@ -1348,11 +1504,196 @@ int cpu_up(unsigned int cpu)
 }
 EXPORT_SYMBOL_GPL(cpu_up);
 
+/*
+ * Bring the CPUs in @mask up.  In parallel mode every CPU is first booted
+ * into its AP hotplug thread one by one, then the AP thread states of all
+ * of them are walked in lockstep.  On return @mask holds the CPUs that came
+ * up.  Requires cpu_add_remove_lock to be held.
+ */
+static int cpuhp_bringup_mask(struct cpumask *mask, int tasks_frozen)
+{
+	struct cpuhp_cpu_state *st;
+	cpumask_var_t lockstep;
+	u64 start = local_clock();
+	int cpu, err, ret = 0;
+
+	if (!cpuhp_parallel || cpumask_weight(mask) < 2 ||
+	    !zalloc_cpumask_var(&lockstep, GFP_KERNEL)) {
+		for_each_cpu(cpu, mask) {
+			err = _cpu_up(cpu, tasks_frozen, CPUHP_ONLINE);
+			if (err) {
+				cpumask_clear_cpu(cpu, mask);
+				ret = ret ?: err;
+			}
+		}
+		return ret;
+	}
+
+	for_each_cpu(cpu, mask) {
+		err = _cpu_up(cpu, tasks_frozen, CPUHP_AP_ONLINE_IDLE);
+		st = per_cpu_ptr(&cpuhp_state, cpu);
+		if (err) {
+			cpumask_clear_cpu(cpu, mask);
+			ret = ret ?: err;
+		} else if (st->state == CPUHP_AP_ONLINE_IDLE) {
+			cpumask_set_cpu(cpu, lockstep);
+		}
+	}
+
+	cpus_write_lock();
+	cpuhp_tasks_frozen = tasks_frozen;
+	err = cpuhp_kick_ap_lockstep(lockstep, CPUHP_AP_ONLINE_IDLE,
+				     CPUHP_ONLINE);
+	cpus_write_unlock();
+	arch_smt_update();
+	cpu_up_down_serialize_trainwrecks(tasks_frozen);
+	ret = ret ?: err;
+
+	/* Finish those that were further up already, drop the failures */
+	for_each_cpu(cpu, mask) {
+		if (cpumask_test_cpu(cpu, lockstep))
+			continue;
+		st = per_cpu_ptr(&cpuhp_state, cpu);
+		if (st->state == CPUHP_AP_ONLINE_IDLE) {
+			cpumask_clear_cpu(cpu, mask);
+#ifdef CONFIG_HOTPLUG_CPU
+			_cpu_down(cpu, tasks_frozen, CPUHP_OFFLINE);
+#endif
+			continue;
+		}
+		err = _cpu_up(cpu, tasks_frozen, CPUHP_ONLINE);
+		if (err) {
+			cpumask_clear_cpu(cpu, mask);
+			ret = ret ?: err;
+		}
+	}
+
+	cpuhp_last_up_cpus = cpumask_weight(mask);
+	cpuhp_last_up_ns = local_clock() - start;
+	free_cpumask_var(lockstep);
+	return ret;
+}
+
+/**
+ * cpu_up_mask - Bring a set of CPUs online
+ * @mask:	The CPUs to bring up, left holding those that came up
+ *
+ * Like cpu_up() for each CPU in @mask, but with cpuhp_parallel=1 the
+ * hotplug states that allow it run on all of them at the same time.
+ * Returns the first error.
+ */
+int cpu_up_mask(struct cpumask *mask)
+{
+	int cpu, err = 0;
+	int switch_err;
+
+	cpuset_wait_for_hotplug();
+
+	switch_err = switch_to_rt_policy();
+	if (switch_err < 0)
+		return switch_err;
+
+	for_each_cpu(cpu, mask) {
+		if (!cpu_possible(cpu) || try_online_node(cpu_to_node(cpu)))
+			cpumask_clear_cpu(cpu, mask);
+	}
+
+	cpu_maps_update_begin();
+
+	if (cpu_hotplug_disabled) {
+		cpumask_clear(mask);
+		err = -EBUSY;
+		goto out;
+	}
+	for_each_cpu(cpu, mask) {
+		if (!cpu_smt_allowed(cpu))
+			cpumask_clear_cpu(cpu, mask);
+	}
+
+	err = cpuhp_bringup_mask(mask, 0);
+out:
+	cpu_maps_update_done();
+
+	if (!switch_err) {
+		switch_err = switch_to_fair_policy();
+		if (switch_err)
+			pr_err("Hotplug policy switch err=%d Task %s pid=%d\n",
+				switch_err, current->comm, current->pid);
+	}
+
+	return err;
+}
+
 #ifdef CONFIG_PM_SLEEP_SMP
 static cpumask_var_t frozen_cpus;
 
+/*
+ * Take the non-boot CPUs down with their AP thread states torn down in
+ * lockstep, and the rest one CPU at a time.  @lockstep is scratch space.
+ */
+static int freeze_secondary_cpus_parallel(int primary, bool suspend,
+					  struct cpumask *lockstep)
+{
+	u64 start = local_clock();
+	int cpu, err, error = 0;
+
+	for_each_online_cpu(cpu) {
+		if (cpu != primary &&
+		    per_cpu(cpuhp_state, cpu).state == CPUHP_ONLINE)
+			cpumask_set_cpu(cpu, lockstep);
+	}
+
+	if (suspend && pm_wakeup_pending()) {
+		pr_info("Wakeup pending. Abort CPU freeze\n");
+		return -EBUSY;
+	}
+
+	cpus_write_lock();
+	cpuhp_tasks_frozen = 1;
+	error = cpuhp_kick_ap_lockstep(lockstep, CPUHP_ONLINE,
+				       CPUHP_TEARDOWN_CPU);
+	cpus_write_unlock();
+	if (error)
+		pr_err("Error taking CPUs down: %d\n", error);
+
+	/*
+	 * Finish off the CPUs the lockstep walk took half way down even on
+	 * error, so that enable_nonboot_cpus() brings them back.
+	 */
+	for_each_online_cpu(cpu) {
+		bool half_down = cpumask_test_cpu(cpu, lockstep);
+
+		if (cpu == primary)
+			continue;
+		if (!half_down && error)
+			continue;
+		if (!half_down && suspend && pm_wakeup_pending()) {
+			pr_info("Wakeup pending. Abort CPU freeze\n");
+			error = -EBUSY;
+			continue;
+		}
+
+		trace_suspend_resume(TPS("CPU_OFF"), cpu, true);
+		err = _cpu_down(cpu, 1, CPUHP_OFFLINE);
+		trace_suspend_resume(TPS("CPU_OFF"), cpu, false);
+		if (!err) {
+			cpumask_set_cpu(cpu, frozen_cpus);
+			continue;
+		}
+		pr_err("Error taking CPU%d down: %d\n", cpu, err);
+		error = error ?: err;
+		if (half_down)
+			_cpu_up(cpu, 1, CPUHP_ONLINE);
+	}
+
+	cpuhp_last_down_cpus = cpumask_weight(frozen_cpus);
+	cpuhp_last_down_ns = local_clock() - start;
+	return error;
+}
+
 int __freeze_secondary_cpus(int primary, bool suspend)
 {
+	cpumask_var_t lockstep;
 	int cpu, error = 0;
 
 	cpu_maps_update_begin();
@@ -1372,6 +1713,13 @@ int __freeze_secondary_cpus(int primary, bool suspend)
 	cpumask_clear(frozen_cpus);
 
 	pr_info("Disabling non-boot CPUs ...\n");
+	if (cpuhp_parallel && zalloc_cpumask_var(&lockstep, GFP_KERNEL)) {
+		error = freeze_secondary_cpus_parallel(primary, suspend,
+						       lockstep);
+		free_cpumask_var(lockstep);
+		goto done;
+	}
+
 	for_each_online_cpu(cpu) {
 		if (cpu == primary)
 			continue;
@@ -1393,6 +1741,7 @@ int __freeze_secondary_cpus(int primary, bool suspend)
 		}
 	}
 
+done:
 	if (!error)
 		BUG_ON(num_online_cpus() > 1);
 	else
@@ -1417,10 +1766,22 @@ void __weak arch_enable_nonboot_cpus_end(void)
 {
 }
 
+static void cpuhp_report_up(unsigned int cpu)
+{
+	struct device *cpu_device;
+
+	pr_info("CPU%d is up\n", cpu);
+	cpu_device = get_cpu_device(cpu);
+	if (!cpu_device)
+		pr_err("%s: failed to get cpu%d device\n", __func__, cpu);
+	else
+		kobject_uevent(&cpu_device->kobj, KOBJ_ONLINE);
+}
+
 void enable_nonboot_cpus(void)
 {
+	unsigned int nr_frozen;
 	int cpu, error;
-	struct device *cpu_device;
 
 	/* Allow everyone to use the CPU hotplug again */
 	cpu_maps_update_begin();
@@ -1432,23 +1793,28 @@ void enable_nonboot_cpus(void)
 
 	arch_enable_nonboot_cpus_begin();
 
+	if (cpuhp_parallel) {
+		nr_frozen = cpumask_weight(frozen_cpus);
+		error = cpuhp_bringup_mask(frozen_cpus, 1);
+		if (error)
+			pr_warn("Error taking %u CPUs up: %d\n",
+				nr_frozen - cpumask_weight(frozen_cpus), error);
+		for_each_cpu(cpu, frozen_cpus)
+			cpuhp_report_up(cpu);
+		goto done;
+	}
+
 	for_each_cpu(cpu, frozen_cpus) {
 		trace_suspend_resume(TPS("CPU_ON"), cpu, true);
 		error = _cpu_up(cpu, 1, CPUHP_ONLINE);
 		trace_suspend_resume(TPS("CPU_ON"), cpu, false);
 		if (!error) {
-			pr_info("CPU%d is up\n", cpu);
-			cpu_device = get_cpu_device(cpu);
-			if (!cpu_device)
-				pr_err("%s: failed to get cpu%d device\n",
-				       __func__, cpu);
-			else
-				kobject_uevent(&cpu_device->kobj, KOBJ_ONLINE);
+			cpuhp_report_up(cpu);
 			continue;
 		}
 		pr_warn("Error taking CPU%d up: %d\n", cpu, error);
 	}
-
+done:
 	arch_enable_nonboot_cpus_end();
 
 	cpumask_clear(frozen_cpus);
@@ -1647,31 +2013,37 @@ static struct cpuhp_step cpuhp_hp_states[] = {
 		.name			= "smpboot/threads:online",
 		.startup.single		= smpboot_unpark_threads,
 		.teardown.single	= smpboot_park_threads,
+		.parallel		= true,
 	},
 	[CPUHP_AP_IRQ_AFFINITY_ONLINE] = {
 		.name			= "irq/affinity:online",
 		.startup.single		= irq_affinity_online_cpu,
 		.teardown.single	= NULL,
+		.parallel		= true,
 	},
 	[CPUHP_AP_PERF_ONLINE] = {
 		.name			= "perf:online",
 		.startup.single		= perf_event_init_cpu,
 		.teardown.single	= perf_event_exit_cpu,
+		.parallel		= true,
 	},
 	[CPUHP_AP_WATCHDOG_ONLINE] = {
 		.name			= "lockup_detector:online",
 		.startup.single		= lockup_detector_online_cpu,
 		.teardown.single	= lockup_detector_offline_cpu,
+		.parallel		= true,
 	},
 	[CPUHP_AP_WORKQUEUE_ONLINE] = {
 		.name			= "workqueue:online",
 		.startup.single		= random_and_workqueue_online_fusion,
 		.teardown.single	= workqueue_offline_cpu,
+		.parallel		= true,
 	},
 	[CPUHP_AP_RCUTREE_ONLINE] = {
 		.name			= "RCU/tree:online",
 		.startup.single		= rcutree_online_cpu,
 		.teardown.single	= rcutree_offline_cpu,
+		.parallel		= true,
 	},
 #endif
 	/*
@@ -2289,8 +2661,93 @@ static ssize_t show_cpuhp_states(struct device *dev,
 }
 static DEVICE_ATTR(states, 0444, show_cpuhp_states, NULL);
 
+/*
+ * Time spent in each state's callbacks in microseconds, summed over all
+ * CPUs, and the number of calls.  States marked parallel are flagged with
+ * a 'P'.  Any write resets the numbers.
+ */
+static ssize_t show_cpuhp_timing(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	ssize_t res;
+	int i;
+
+	res = scnprintf(buf, PAGE_SIZE,
+			"last bringup: %u CPUs in %llu us, last teardown: %u CPUs in %llu us\n",
+			cpuhp_last_up_cpus,
+			div_u64(cpuhp_last_up_ns, NSEC_PER_USEC),
+			cpuhp_last_down_cpus,
+			div_u64(cpuhp_last_down_ns, NSEC_PER_USEC));
+
+	mutex_lock(&cpuhp_state_mutex);
+	for (i = CPUHP_OFFLINE; i <= CPUHP_ONLINE; i++) {
+		struct cpuhp_step *sp = cpuhp_get_step(i);
+		unsigned int up = atomic_read(&sp->startup_calls);
+		unsigned int down = atomic_read(&sp->teardown_calls);
+
+		if (!sp->name || (!up && !down))
+			continue;
+		res += scnprintf(buf + res, PAGE_SIZE - res,
+				 "%3d: %-32s %c up %u %llu down %u %llu\n",
+				 i, sp->name, sp->parallel ? 'P' : '-', up,
+				 div_u64(atomic64_read(&sp->startup_ns),
+					 NSEC_PER_USEC),
+				 down,
+				 div_u64(atomic64_read(&sp->teardown_ns),
+					 NSEC_PER_USEC));
+	}
+	mutex_unlock(&cpuhp_state_mutex);
+	return res;
+}
+
+static ssize_t write_cpuhp_timing(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	int i;
+
+	mutex_lock(&cpuhp_state_mutex);
+	for (i = CPUHP_OFFLINE; i <= CPUHP_ONLINE; i++) {
+		struct cpuhp_step *sp = cpuhp_get_step(i);
+
+		atomic64_set(&sp->startup_ns, 0);
+		atomic64_set(&sp->teardown_ns, 0);
+		atomic_set(&sp->startup_calls, 0);
+		atomic_set(&sp->teardown_calls, 0);
+	}
+	mutex_unlock(&cpuhp_state_mutex);
+	return count;
+}
+static DEVICE_ATTR(timing, 0644, show_cpuhp_timing, write_cpuhp_timing);
+
+static ssize_t show_cpuhp_parallel(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", cpuhp_parallel);
+}
+
+static ssize_t write_cpuhp_parallel(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	cpu_maps_update_begin();
+	cpuhp_parallel = val;
+	cpu_maps_update_done();
+	return count;
+}
+static DEVICE_ATTR(parallel, 0644, show_cpuhp_parallel, write_cpuhp_parallel);
+
 static struct attribute *cpuhp_cpu_root_attrs[] = {
 	&dev_attr_states.attr,
+	&dev_attr_timing.attr,
+	&dev_attr_parallel.attr,
 	NULL
 };
 
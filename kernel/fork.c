@@ -96,6 +96,7 @@
 #include <linux/cpufreq_times.h>
 #include <linux/stackleak.h>
 #include <linux/scs.h>
+#include <linux/bpf.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -475,6 +476,7 @@ void free_task(struct task_struct *tsk)
 	rt_mutex_debug_task_free(tsk);
 	ftrace_graph_exit_task(tsk);
 	put_seccomp_filter(tsk);
+	bpf_task_storage_free(tsk);
 	arch_release_task_struct(tsk);
 	if (tsk->flags & PF_KTHREAD)
 		free_kthread_struct(tsk);
@@ -733,6 +735,7 @@ void __mmdrop(struct mm_struct *mm)
 	destroy_context(mm);
 	mmu_notifier_mm_destroy(mm);
 	check_mm(mm);
+	futex_hash_free(mm);
 	put_user_ns(mm->user_ns);
 	free_mm(mm);
 }
@@ -969,6 +972,10 @@ static struct task_struct *dup_task_struct(struct task_struct *orig, int node)
 	 */
 	tsk->seccomp.filter = NULL;
 #endif
+#ifdef CONFIG_BPF_SYSCALL
+	/* Storage is per task, and free_task() on the error path frees it */
+	RCU_INIT_POINTER(tsk->bpf_storage, NULL);
+#endif
 
 	setup_thread_stack(tsk, orig);
 	clear_user_return_notifier(tsk);
@@ -1099,6 +1106,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 #endif
 	mm_init_uprobes_state(mm);
 	hugetlb_count_init(mm);
+	futex_mm_init(mm);
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -2102,6 +2110,9 @@ static __latent_entropy struct task_struct *copy_process(
 	retval = copy_signal(clone_flags, p);
 	if (retval)
 		goto bad_fork_cleanup_sighand;
+	/* Last chance to switch hashes while nothing else uses our mm */
+	if (clone_flags & CLONE_THREAD)
+		futex_hash_allocate_default();
 	retval = copy_mm(clone_flags, p);
 	if (retval)
 		goto bad_fork_cleanup_signal;
@@ -56,6 +56,7 @@
 #include <linux/memblock.h>
 #include <linux/fault-inject.h>
 #include <linux/refcount.h>
+#include <linux/prctl.h>
 
 #include <asm/futex.h>
 
@@ -377,21 +378,149 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+/*
+ * Per-process private futex hash.
+ *
+ * All futexes normally hash into the one global table, so unrelated
+ * processes collide on bucket locks and a heavily threaded process keeps
+ * bouncing buckets that everybody else uses too. A process can instead
+ * get a table of its own, allocated on its local node, for its private
+ * futexes: those keyed on (mm, address) with no FUT_OFF_* bits set. It is
+ * set up either with prctl(PR_FUTEX_HASH) or, when the futex_private_hash
+ * sysctl is set, automatically as the process creates its first thread.
+ *
+ * Queued waiters are never moved between tables, so the table can only be
+ * installed or replaced while the mm has a single user and nothing can be
+ * waiting on one of its private futexes. It then lives as long as the mm.
+ */
+struct futex_private_hash {
+	unsigned int			hashmask;
+	struct futex_hash_bucket	queues[];
+};
+
+unsigned int sysctl_futex_private_hash;
+
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
+
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket for a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the process private hash for private keys of
+ * a process that has one, and in the global hash otherwise.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
 			  key->both.offset);
 
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))) {
+		struct futex_private_hash *fph;
+
+		fph = READ_ONCE(key->private.mm->futex_phash);
+		if (fph)
+			return &fph->queues[hash & fph->hashmask];
+	}
+
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+/*
+ * Install a private hash of @slots buckets for current's mm, or go back to
+ * the global hash if @slots is 0.
+ */
+static int futex_hash_install(struct mm_struct *mm, unsigned int slots)
+{
+	struct futex_private_hash *fph = NULL, *old;
+	unsigned int i;
+
+	if (slots) {
+		fph = kvzalloc_node(struct_size(fph, queues, slots),
+				    GFP_KERNEL_ACCOUNT, numa_node_id());
+		if (!fph)
+			return -ENOMEM;
+		fph->hashmask = slots - 1;
+		for (i = 0; i < slots; i++)
+			futex_hash_bucket_init(&fph->queues[i]);
+	}
+
+	/*
+	 * Only current can add users to its mm from here on, so with no
+	 * other user there is no waiter that could be stranded in the old
+	 * table.
+	 */
+	if (atomic_read(&mm->mm_users) != 1) {
+		kvfree(fph);
+		return -EBUSY;
+	}
+
+	old = mm->futex_phash;
+	WRITE_ONCE(mm->futex_phash, fph);
+	kvfree(old);
+	return 0;
+}
+
+/*
+ * The table is fixed for the life of the mm, so it cannot follow the
+ * thread count; size it for the most threads that can contend at once.
+ */
+static unsigned int futex_hash_default_slots(void)
+{
+	unsigned int slots = roundup_pow_of_two(4 * num_online_cpus());
+
+	return clamp_t(unsigned int, slots, 16, futex_hashsize);
+}
+
+void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_phash = NULL;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_phash);
+}
+
+/*
+ * Called by a process about to create its first thread: give it a private
+ * hash if the sysctl asks for one. On failure it stays on the global hash.
+ */
+void futex_hash_allocate_default(void)
+{
+	struct mm_struct *mm = current->mm;
+
+	if (!sysctl_futex_private_hash || !mm || mm->futex_phash ||
+	    atomic_read(&mm->mm_users) != 1)
+		return;
+
+	futex_hash_install(mm, futex_hash_default_slots());
+}
+
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	struct futex_private_hash *fph;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (arg3 && (arg3 < 2 || arg3 > futex_hashsize ||
+			     !is_power_of_2(arg3)))
+			return -EINVAL;
+		return futex_hash_install(current->mm, arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		fph = READ_ONCE(current->mm->futex_phash);
+		return fph ? fph->hashmask + 1 : 0;
+	}
+	return -EINVAL;
+}
+
 
 /**
  * match_futex - Check whether two futex keys are equal
@@ -2901,6 +3030,229 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/**
+ * struct futex_vector - One entry of a FUTEX_WAITV wait
+ * @w:	the entry as passed by userspace
+ * @q:	the futex_q queued for it
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	struct futex_q q;
+};
+
+static int futex_parse_waitv(struct futex_vector *vs,
+			     struct futex_waitv __user *uwaitv,
+			     unsigned int count)
+{
+	struct futex_waitv aux;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
+			return -EFAULT;
+
+		if ((aux.flags & ~(FUTEX_32 | FUTEX_PRIVATE_FLAG)) ||
+		    !(aux.flags & FUTEX_32) || aux.__reserved)
+			return -EINVAL;
+
+		if (aux.val > U32_MAX ||
+		    aux.uaddr != (unsigned long)aux.uaddr)
+			return -EINVAL;
+
+		vs[i].w = aux;
+		vs[i].q = futex_q_init;
+	}
+
+	return 0;
+}
+
+/*
+ * Unqueue the first @count entries and drop their key references. Returns
+ * the index of the last one that had already been woken, or -1 if none.
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q))
+			ret = i;
+	}
+
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait and enqueue several futexes
+ * @vs:		the futexes to wait on
+ * @count:	number of entries in @vs
+ * @woken:	index of the last woken futex, if any
+ *
+ * Like futex_wait_setup(), but for each entry in turn. Only one hash bucket
+ * lock can be held at a time, so each futex is queued as soon as its value
+ * has been checked, with the task already in TASK_INTERRUPTIBLE so that a
+ * wakeup on an earlier entry is not lost while later ones are set up. The
+ * keys are all looked up first, because that may sleep.
+ *
+ * Return:
+ *  -  1 - a futex was woken during setup, its index is in @woken;
+ *  -  0 - all futexes are queued and current is ready to sleep;
+ *  - <0 - -EFAULT, -EWOULDBLOCK or another error; nothing is queued
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	int ret, i, j;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr),
+				    !(vs[i].w.flags & FUTEX_PRIVATE_FLAG),
+				    &vs[i].q.key, FUTEX_READ);
+		if (unlikely(ret)) {
+			for (j = 0; j < i; j++)
+				put_futex_key(&vs[j].q.key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		u32 __user *uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		struct futex_q *q = &vs[i].q;
+		u32 val = vs[i].w.val;
+
+		hb = queue_lock(q);
+		ret = get_futex_value_locked(&uval, uaddr);
+
+		if (!ret && uval == val) {
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/* Entries from i on were never queued, so still hold refs */
+		for (j = i; j < count; j++)
+			put_futex_key(&vs[j].q.key);
+
+		/*
+		 * A wakeup that raced with the setup wins over the error, and
+		 * is reported to userspace.
+		 */
+		*woken = unqueue_multiple(vs, i);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			/*
+			 * Fault the page in with nothing queued and no lock
+			 * held, so that no wakeup can be lost, then redo the
+			 * whole setup.
+			 */
+			if (get_user(uval, uaddr))
+				return -EFAULT;
+			goto retry;
+		}
+
+		return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+static void futex_sleep_multiple(struct futex_vector *vs, int count,
+				 struct hrtimer_sleeper *to)
+{
+	int i;
+
+	if (to && !to->task)
+		return;
+
+	/* Skip the sleep if any futex was woken in the meantime */
+	for (i = 0; i < count; i++) {
+		if (!READ_ONCE(vs[i].q.lock_ptr))
+			return;
+	}
+
+	freezable_schedule();
+}
+
+static int futex_wait_multiple(struct futex_vector *vs, int count,
+			       struct hrtimer_sleeper *to)
+{
+	int ret, hint = 0;
+
+	if (to)
+		hrtimer_sleeper_start_expires(to, HRTIMER_MODE_ABS);
+
+	while (1) {
+		ret = futex_wait_multiple_setup(vs, count, &hint);
+		if (ret)
+			return ret > 0 ? hint : ret;
+
+		futex_sleep_multiple(vs, count, to);
+
+		__set_current_state(TASK_RUNNING);
+
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			return ret;
+
+		if (to && !to->task)
+			return -ETIMEDOUT;
+		/* The timeout is absolute, so the syscall simply restarts */
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		/* A spurious wakeup: go round again */
+	}
+}
+
+/**
+ * futex_waitv() - Wait on a vector of futexes
+ * @uwaitv:	array of struct futex_waitv in userspace
+ * @count:	number of entries, at most FUTEX_WAITV_MAX
+ * @flags:	futex flags (FLAGS_CLOCKRT selects the timeout clock)
+ * @abs_time:	absolute timeout, or NULL to wait forever
+ *
+ * Sleep until one of the futexes is woken, as if by FUTEX_WAIT on each.
+ *
+ * Return: the index of a woken futex, or a negative error code
+ */
+static int futex_waitv(struct futex_waitv __user *uwaitv, unsigned int count,
+		       unsigned int flags, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to;
+	struct futex_vector *vs;
+	int ret;
+
+	if (!uwaitv || !count || count > FUTEX_WAITV_MAX)
+		return -EINVAL;
+
+	vs = kcalloc(count, sizeof(*vs), GFP_KERNEL);
+	if (!vs)
+		return -ENOMEM;
+
+	ret = futex_parse_waitv(vs, uwaitv, count);
+	if (ret)
+		goto out;
+
+	to = futex_setup_timer(abs_time, &timeout, flags,
+			       current->timer_slack_ns);
+	ret = futex_wait_multiple(vs, count, to);
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out:
+	kfree(vs);
+	return ret;
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -3866,7 +4218,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 
 	if (op & FUTEX_CLOCK_REALTIME) {
 		flags |= FLAGS_CLOCKRT;
-		if (cmd != FUTEX_WAIT_BITSET &&	cmd != FUTEX_WAIT_REQUEUE_PI)
+		if (cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_WAIT_REQUEUE_PI &&
+		    cmd != FUTEX_WAITV)
 			return -ENOSYS;
 	}
 
@@ -3909,6 +4262,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAITV:
+		return futex_waitv((struct futex_waitv __user *)uaddr, val,
+				   flags, timeout);
 	}
 	return -ENOSYS;
 }
@@ -3925,7 +4281,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI || cmd == FUTEX_WAITV)) {
 		if (unlikely(should_fail_futex(!(op & FUTEX_PRIVATE_FLAG))))
 			return -EFAULT;
 		if (get_timespec64(&ts, utime))
@@ -4119,7 +4475,7 @@ SYSCALL_DEFINE6(futex_time32, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI || cmd == FUTEX_WAITV)) {
 		if (get_old_timespec32(&ts, utime))
 			return -EFAULT;
 		if (!timespec64_valid(&ts))
@@ -4178,11 +4534,8 @@ static int __init futex_init(void)
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i]);
 
 	return 0;
 }
@@ -25,6 +25,11 @@
 #include <linux/filter.h>
 #include <linux/ftrace.h>
 #include <linux/compiler.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
+#include <linux/stringhash.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 /*
  * These will be re-linked against their real values
@@ -180,17 +185,113 @@ static inline char *cleanup_symbol_name(char *s)
 static inline char *cleanup_symbol_name(char *s) { return NULL; }
 #endif
 
+/*
+ * Name lookups go through an index of symbol numbers sorted by the hash
+ * of the name, built once from a work item at boot so that it doesn't
+ * hold up the initcalls.  Until it's there, lookups scan all the names.
+ * Names are hashed with the ThinLTO suffix stripped, so that lookups
+ * with and without it land on the same entries.
+ */
+struct kallsyms_name_entry {
+	u32 hash;
+	u32 seq;
+};
+
+static const struct kallsyms_name_entry *kallsyms_name_index;
+
+static u32 kallsyms_name_hash(const char *name)
+{
+	char namebuf[KSYM_NAME_LEN];
+
+	strlcpy(namebuf, name, sizeof(namebuf));
+	cleanup_symbol_name(namebuf);
+	return full_name_hash(NULL, namebuf, strlen(namebuf));
+}
+
+static int kallsyms_name_cmp(const void *a, const void *b)
+{
+	const struct kallsyms_name_entry *x = a, *y = b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	/* Keep aliases in kallsyms order, the first one wins. */
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void kallsyms_build_name_index(struct work_struct *work)
+{
+	char namebuf[KSYM_NAME_LEN];
+	struct kallsyms_name_entry *index;
+	unsigned int i, off;
+
+	index = vmalloc(array_size(kallsyms_num_syms, sizeof(*index)));
+	if (!index)
+		return;
+
+	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
+		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
+		index[i].hash = kallsyms_name_hash(namebuf);
+		index[i].seq = i;
+		if (!(i & 1023))
+			cond_resched();
+	}
+	sort(index, kallsyms_num_syms, sizeof(*index), kallsyms_name_cmp,
+	     NULL);
+
+	smp_store_release(&kallsyms_name_index, index);
+}
+static DECLARE_WORK(kallsyms_name_index_work, kallsyms_build_name_index);
+
+static unsigned long
+kallsyms_lookup_name_index(const struct kallsyms_name_entry *index,
+			   const char *name)
+{
+	char namebuf[KSYM_NAME_LEN];
+	u32 hash = kallsyms_name_hash(name);
+	unsigned int low = 0, high = kallsyms_num_syms, mid;
+
+	/* Find the first entry with this hash. */
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (index[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	for (; low < kallsyms_num_syms && index[low].hash == hash; low++) {
+		unsigned int seq = index[low].seq;
+
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf,
+				       ARRAY_SIZE(namebuf));
+
+		if (strcmp(namebuf, name) == 0)
+			return kallsyms_sym_address(seq);
+
+		if (cleanup_symbol_name(namebuf) && strcmp(namebuf, name) == 0)
+			return kallsyms_sym_address(seq);
+	}
+	return 0;
+}
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
+	const struct kallsyms_name_entry *index;
 	char namebuf[KSYM_NAME_LEN];
-	unsigned long i;
+	unsigned long i, addr;
 	unsigned int off;
 
 	/* Skip the search for empty string. */
 	if (!*name)
 		return 0;
 
+	index = smp_load_acquire(&kallsyms_name_index);
+	if (index) {
+		addr = kallsyms_lookup_name_index(index, name);
+		return addr ?: module_kallsyms_lookup_name(name);
+	}
+
 	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
 		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
 
@@ -281,6 +382,49 @@ static unsigned long get_symbol_pos(unsigned long addr,
 	return low;
 }
 
+/*
+ * Stack dumps and profilers resolve the same few hundred addresses over
+ * and over, so the expanded names of recently looked up symbols are kept
+ * in a small direct-mapped cache.  Each slot is guarded by a sequence
+ * count: a writer that loses the race for a slot just doesn't fill it and
+ * a reader that sees the slot change under it expands the name itself,
+ * which keeps this usable from any context.
+ */
+#define KALLSYMS_CACHE_BITS 7
+
+static struct kallsyms_cache_slot {
+	unsigned int seq;
+	unsigned int pos;
+	char name[KSYM_NAME_LEN];
+} kallsyms_cache[1 << KALLSYMS_CACHE_BITS];
+
+/* Expand the name of symbol @pos into @namebuf (KSYM_NAME_LEN bytes). */
+static void kallsyms_expand_symbol_cached(unsigned long pos, char *namebuf)
+{
+	struct kallsyms_cache_slot *slot;
+	unsigned int seq;
+
+	slot = &kallsyms_cache[hash_32(pos, KALLSYMS_CACHE_BITS)];
+	seq = smp_load_acquire(&slot->seq);
+
+	/* seq is zero until the slot is first filled */
+	if (seq && !(seq & 1) && READ_ONCE(slot->pos) == pos) {
+		memcpy(namebuf, slot->name, KSYM_NAME_LEN);
+		smp_rmb();
+		if (READ_ONCE(slot->seq) == seq)
+			return;
+	}
+
+	kallsyms_expand_symbol(get_symbol_offset(pos), namebuf,
+			       KSYM_NAME_LEN);
+
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	WRITE_ONCE(slot->pos, pos);
+	memcpy(slot->name, namebuf, KSYM_NAME_LEN);
+	smp_store_release(&slot->seq, seq + 2);
+}
+
 /*
  * Lookup an address but don't bother to find any names.
  */
@@ -319,8 +463,7 @@ const char *kallsyms_lookup(unsigned long addr,
 
 		pos = get_symbol_pos(addr, symbolsize, offset);
 		/* Grab name */
-		kallsyms_expand_symbol(get_symbol_offset(pos),
-				       namebuf, KSYM_NAME_LEN);
+		kallsyms_expand_symbol_cached(pos, namebuf);
 		if (modname)
 			*modname = NULL;
 
@@ -356,8 +499,7 @@ int lookup_symbol_name(unsigned long addr, char *symname)
 
 		pos = get_symbol_pos(addr, NULL, NULL);
 		/* Grab name */
-		kallsyms_expand_symbol(get_symbol_offset(pos),
-				       symname, KSYM_NAME_LEN);
+		kallsyms_expand_symbol_cached(pos, symname);
 		goto found;
 	}
 	/* See if it's in a module. */
@@ -383,8 +525,7 @@ int lookup_symbol_attrs(unsigned long addr, unsigned long *size,
 
 		pos = get_symbol_pos(addr, size, offset);
 		/* Grab name */
-		kallsyms_expand_symbol(get_symbol_offset(pos),
-				       name, KSYM_NAME_LEN);
+		kallsyms_expand_symbol_cached(pos, name);
 		modname[0] = '\0';
 		goto found;
 	}
@@ -760,6 +901,7 @@ static const struct file_operations kallsyms_operations = {
 static int __init kallsyms_init(void)
 {
 	proc_create("kallsyms", 0444, NULL, &kallsyms_operations);
+	schedule_work(&kallsyms_name_index_work);
 	return 0;
 }
 device_initcall(kallsyms_init);
@@ -6,6 +6,7 @@
  */
 
 #include <linux/elf.h>
+#include <linux/workqueue.h>
 #include <asm/module.h>
 
 struct load_info {
@@ -20,6 +21,12 @@ struct load_info {
 	struct _ddebug *debug;
 	unsigned int num_debug;
 	bool sig_ok;
+	/* signature split off by mod_split_sig(), checked by sig_work */
+	const void *sig;
+	size_t sig_len;
+	bool sig_pending;
+	int sig_err;
+	struct work_struct sig_work;
 #ifdef CONFIG_KALLSYMS
 	unsigned long mod_kallsyms_init_off;
 #endif
@@ -28,4 +35,5 @@ struct load_info {
 	} index;
 };
 
-extern int mod_verify_sig(const void *mod, struct load_info *info);
+extern int mod_split_sig(const void *mod, struct load_info *info);
+extern int mod_verify_split_sig(const void *mod, struct load_info *info);
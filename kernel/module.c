@@ -51,6 +51,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
 #include <linux/dynamic_debug.h>
 #include <linux/audit.h>
 #include <uapi/linux/module.h>
@@ -423,68 +425,55 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
-/* Returns true as soon as fn returns true, otherwise false. */
-static bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
-				    struct module *owner,
-				    void *data),
-			 void *data)
-{
-	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
+/* vmlinux's export tables, sorted at build time. */
+static const struct symsearch vmlinux_symsearch[] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
 #ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
 #endif
-	};
-
-	module_assert_mutex_or_preempt();
-
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
-		return true;
+};
 
-	list_for_each_entry_rcu(mod, &modules, list,
-				lockdep_is_held(&module_mutex)) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY, false },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY, false },
-			{ mod->gpl_future_syms,
-			  mod->gpl_future_syms + mod->num_gpl_future_syms,
-			  mod->gpl_future_crcs,
-			  WILL_BE_GPL_ONLY, false },
 #ifdef CONFIG_UNUSED_SYMBOLS
-			{ mod->unused_syms,
-			  mod->unused_syms + mod->num_unused_syms,
-			  mod->unused_crcs,
-			  NOT_GPL_ONLY, true },
-			{ mod->unused_gpl_syms,
-			  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
-			  mod->unused_gpl_crcs,
-			  GPL_ONLY, true },
+#define NR_MODULE_SYMSEARCH 5
+#else
+#define NR_MODULE_SYMSEARCH 3
 #endif
-		};
-
-		if (mod->state == MODULE_STATE_UNFORMED)
-			continue;
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
-			return true;
-	}
-	return false;
+/* Fill in the export tables of a module, in the same order as vmlinux's. */
+static void module_symsearch(struct module *mod,
+			     struct symsearch arr[NR_MODULE_SYMSEARCH])
+{
+	arr[0] = (struct symsearch){ mod->syms, mod->syms + mod->num_syms,
+				     mod->crcs, NOT_GPL_ONLY, false };
+	arr[1] = (struct symsearch){ mod->gpl_syms,
+				     mod->gpl_syms + mod->num_gpl_syms,
+				     mod->gpl_crcs, GPL_ONLY, false };
+	arr[2] = (struct symsearch){ mod->gpl_future_syms,
+				     mod->gpl_future_syms +
+				     mod->num_gpl_future_syms,
+				     mod->gpl_future_crcs,
+				     WILL_BE_GPL_ONLY, false };
+#ifdef CONFIG_UNUSED_SYMBOLS
+	arr[3] = (struct symsearch){ mod->unused_syms,
+				     mod->unused_syms + mod->num_unused_syms,
+				     mod->unused_crcs, NOT_GPL_ONLY, true };
+	arr[4] = (struct symsearch){ mod->unused_gpl_syms,
+				     mod->unused_gpl_syms +
+				     mod->num_unused_gpl_syms,
+				     mod->unused_gpl_crcs, GPL_ONLY, true };
+#endif
 }
 
 struct find_symbol_arg {
@@ -586,6 +575,134 @@ static bool find_exported_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * The symbols exported by loaded modules, hashed by name.  Resolving a
+ * module's imports used to bsearch the export tables of every other
+ * module in turn, which adds up when a vendor boot loads hundreds of
+ * modules.  A module's exports go in when it is fully formed and come out
+ * before it leaves the modules list; the entries live in a per-module
+ * block so struct module stays as it is.  Changes are made under
+ * module_mutex, lookups need module_mutex or preemption disabled.
+ */
+#define MODULE_SYMS_HASH_BITS 12
+
+struct module_syms;
+
+struct module_sym {
+	struct hlist_node node;
+	struct module_syms *syms;
+	unsigned int table;
+	unsigned int symnum;
+};
+
+struct module_syms {
+	struct list_head list;
+	struct module *owner;
+	struct symsearch tables[NR_MODULE_SYMSEARCH];
+	unsigned int num;
+	struct module_sym entries[];
+};
+
+static DEFINE_HASHTABLE(module_syms_hash, MODULE_SYMS_HASH_BITS);
+static LIST_HEAD(module_syms_list);
+
+static struct hlist_head *module_syms_bucket(const char *name)
+{
+	unsigned int hash = full_name_hash(NULL, name, strlen(name));
+
+	return &module_syms_hash[hash_min(hash, MODULE_SYMS_HASH_BITS)];
+}
+
+/*
+ * Set up the hash entries for a module's exports, ahead of taking
+ * module_mutex.  Returns NULL if the module exports nothing.
+ */
+static struct module_syms *module_syms_alloc(struct module *mod)
+{
+	struct module_syms *syms;
+	unsigned int i, j, num = 0;
+	struct symsearch arr[NR_MODULE_SYMSEARCH];
+
+	module_symsearch(mod, arr);
+	for (i = 0; i < ARRAY_SIZE(arr); i++)
+		num += arr[i].stop - arr[i].start;
+	if (!num)
+		return NULL;
+
+	syms = kvmalloc(struct_size(syms, entries, num), GFP_KERNEL);
+	if (!syms)
+		return ERR_PTR(-ENOMEM);
+
+	syms->owner = mod;
+	syms->num = num;
+	memcpy(syms->tables, arr, sizeof(arr));
+	for (i = 0, num = 0; i < ARRAY_SIZE(arr); i++) {
+		for (j = 0; j < arr[i].stop - arr[i].start; j++, num++) {
+			syms->entries[num].syms = syms;
+			syms->entries[num].table = i;
+			syms->entries[num].symnum = j;
+		}
+	}
+	return syms;
+}
+
+static void module_syms_add(struct module_syms *syms)
+{
+	struct module_sym *e;
+
+	lockdep_assert_held(&module_mutex);
+
+	for (e = syms->entries; e < syms->entries + syms->num; e++) {
+		const struct symsearch *table = &syms->tables[e->table];
+
+		hlist_add_head_rcu(&e->node, module_syms_bucket(
+			kernel_symbol_name(&table->start[e->symnum])));
+	}
+	list_add(&syms->list, &module_syms_list);
+}
+
+/*
+ * Unhash a module's exports.  The caller frees the result with kvfree()
+ * once an RCU grace period has passed.
+ */
+static struct module_syms *module_syms_del(struct module *mod)
+{
+	struct module_syms *syms;
+	unsigned int i;
+
+	lockdep_assert_held(&module_mutex);
+
+	list_for_each_entry(syms, &module_syms_list, list) {
+		if (syms->owner != mod)
+			continue;
+		for (i = 0; i < syms->num; i++)
+			hlist_del_rcu(&syms->entries[i].node);
+		list_del(&syms->list);
+		return syms;
+	}
+	return NULL;
+}
+
+static bool find_exported_symbol_in_modules(struct find_symbol_arg *fsa)
+{
+	struct module_sym *e;
+
+	hlist_for_each_entry_rcu(e, module_syms_bucket(fsa->name), node,
+				 lockdep_is_held(&module_mutex)) {
+		const struct symsearch *table = &e->syms->tables[e->table];
+		struct module *owner = e->syms->owner;
+
+		if (owner->state == MODULE_STATE_UNFORMED)
+			continue;
+		if (strcmp(fsa->name,
+			   kernel_symbol_name(&table->start[e->symnum])))
+			continue;
+		if (check_exported_symbol(table, owner, e->symnum, fsa))
+			return true;
+	}
+	return false;
+}
+
 /* Find an exported symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 static const struct kernel_symbol *find_symbol(const char *name,
@@ -601,7 +718,12 @@ static const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_exported_symbol_in_section, &fsa)) {
+	module_assert_mutex_or_preempt();
+
+	if (each_symbol_in_section(vmlinux_symsearch,
+				   ARRAY_SIZE(vmlinux_symsearch), NULL,
+				   find_exported_symbol_in_section, &fsa) ||
+	    find_exported_symbol_in_modules(&fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -2240,6 +2362,8 @@ static void cfi_cleanup(struct module *mod);
 /* Free a module, remove from lists, etc. */
 static void free_module(struct module *mod)
 {
+	struct module_syms *syms;
+
 	trace_module_free(mod);
 
 	mod_sysfs_teardown(mod);
@@ -2270,11 +2394,13 @@ static void free_module(struct module *mod)
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	syms = module_syms_del(mod);
 	/* Remove this module from bug list, this uses list_del_rcu */
 	module_bug_cleanup(mod);
 	/* Wait for RCU-sched synchronizing before releasing mod->list and buglist. */
 	synchronize_rcu();
 	mutex_unlock(&module_mutex);
+	kvfree(syms);
 
 	/* Clean up CFI for the module. */
 	cfi_cleanup(mod);
@@ -2918,24 +3044,17 @@ static inline void kmemleak_load_module(const struct module *mod,
 #endif
 
 #ifdef CONFIG_MODULE_SIG
-static int module_sig_check(struct load_info *info, int flags)
+/*
+ * Check the PKCS#7 signature on a background worker while load_module()
+ * gets on with parsing the ELF headers.  Off by default: it only pays
+ * when there are more CPUs than modules being loaded at a time.
+ */
+static bool sig_async;
+module_param(sig_async, bool, 0644);
+
+static int module_sig_result(struct load_info *info, int err)
 {
-	int err = -ENODATA;
-	const unsigned long markerlen = sizeof(MODULE_SIG_STRING) - 1;
 	const char *reason;
-	const void *mod = info->hdr;
-
-	/*
-	 * Require flags == 0, as a module with version information
-	 * removed is no longer the module that was signed
-	 */
-	if (flags == 0 &&
-	    info->len > markerlen &&
-	    memcmp(mod + info->len - markerlen, MODULE_SIG_STRING, markerlen) == 0) {
-		/* We truncate the module to discard the signature */
-		info->len -= markerlen;
-		err = mod_verify_sig(mod, info);
-	}
 
 	switch (err) {
 	case 0:
@@ -2971,11 +3090,67 @@ static int module_sig_check(struct load_info *info, int flags)
 
 	return security_locked_down(LOCKDOWN_MODULE_SIGNATURE);
 }
+
+static void module_sig_work(struct work_struct *work)
+{
+	struct load_info *info = container_of(work, struct load_info,
+					      sig_work);
+
+	info->sig_err = mod_verify_split_sig(info->hdr, info);
+}
+
+static int module_sig_check(struct load_info *info, int flags)
+{
+	int err = -ENODATA;
+	const unsigned long markerlen = sizeof(MODULE_SIG_STRING) - 1;
+	const void *mod = info->hdr;
+
+	/*
+	 * Require flags == 0, as a module with version information
+	 * removed is no longer the module that was signed
+	 */
+	if (flags == 0 &&
+	    info->len > markerlen &&
+	    memcmp(mod + info->len - markerlen, MODULE_SIG_STRING, markerlen) == 0) {
+		/* We truncate the module to discard the signature */
+		info->len -= markerlen;
+		err = mod_split_sig(mod, info);
+		if (!err && sig_async) {
+			INIT_WORK(&info->sig_work, module_sig_work);
+			info->sig_pending = true;
+			queue_work(system_unbound_wq, &info->sig_work);
+			return 0;
+		}
+		if (!err)
+			err = mod_verify_split_sig(mod, info);
+	}
+
+	return module_sig_result(info, err);
+}
+
+/*
+ * Collect the result of a signature check that module_sig_check() left
+ * running.  Nothing may act on what the module says before this.
+ */
+static int module_sig_wait(struct load_info *info)
+{
+	if (!info->sig_pending)
+		return 0;
+
+	flush_work(&info->sig_work);
+	info->sig_pending = false;
+	return module_sig_result(info, info->sig_err);
+}
 #else /* !CONFIG_MODULE_SIG */
 static int module_sig_check(struct load_info *info, int flags)
 {
 	return 0;
 }
+
+static int module_sig_wait(struct load_info *info)
+{
+	return 0;
+}
 #endif /* !CONFIG_MODULE_SIG */
 
 static int validate_section_offset(struct load_info *info, Elf_Shdr *shdr)
@@ -3170,6 +3345,8 @@ static int copy_module_from_user(const void __user *umod, unsigned long len,
 
 static void free_copy(struct load_info *info)
 {
+	/* A signature check may still be reading the copy. */
+	module_sig_wait(info);
 	vfree(info->hdr);
 }
 
@@ -3877,8 +4054,13 @@ static int add_unformed_module(struct module *mod)
 
 static int complete_formation(struct module *mod, struct load_info *info)
 {
+	struct module_syms *syms;
 	int err;
 
+	syms = module_syms_alloc(mod);
+	if (IS_ERR(syms))
+		return PTR_ERR(syms);
+
 	mutex_lock(&module_mutex);
 
 	/* Find duplicate symbols (must be called under lock). */
@@ -3886,6 +4068,9 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err < 0)
 		goto out;
 
+	if (syms)
+		module_syms_add(syms);
+
 	/* This relies on module_mutex for list integrity. */
 	module_bug_finalize(info->hdr, info->sechdrs, mod);
 
@@ -3902,6 +4087,7 @@ static int complete_formation(struct module *mod, struct load_info *info)
 
 out:
 	mutex_unlock(&module_mutex);
+	kvfree(syms);
 	return err;
 }
 
@@ -3943,6 +4129,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 		       int flags)
 {
 	struct module *mod;
+	struct module_syms *syms;
 	long err = 0;
 	char *after_dashes;
 
@@ -3957,6 +4144,11 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	 * The check will also adjust info->len by stripping
 	 * off the sig length at the end of the module, making
 	 * checks against info->len more correct.
+	 *
+	 * With module.sig_async the crypto part runs in the
+	 * background until module_sig_wait() below; the steps
+	 * in between only read the image, which is still being
+	 * hashed.
 	 */
 	err = module_sig_check(info, flags);
 	if (err)
@@ -3989,6 +4181,15 @@ static int load_module(struct load_info *info, const char __user *uargs,
 		goto free_copy;
 	}
 
+	/*
+	 * rewrite_section_headers() writes to the signed image, and
+	 * nothing may act on what the module says before its
+	 * signature is settled.
+	 */
+	err = module_sig_wait(info);
+	if (err)
+		goto free_copy;
+
 	err = rewrite_section_headers(info, flags);
 	if (err)
 		goto free_copy;
@@ -4148,10 +4349,12 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	syms = module_syms_del(mod);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_rcu();
 	mutex_unlock(&module_mutex);
+	kvfree(syms);
  free_module:
 	/* Free lock-classes; relies on the preceding sync_rcu() */
 	lockdep_free_key_range(mod->core_layout.base, mod->core_layout.size);
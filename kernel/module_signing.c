@@ -15,9 +15,10 @@
 #include "module-internal.h"
 
 /*
- * Verify the signature on a module.
+ * Parse the signature trailer of a module and strip it off: info->len is
+ * left covering the signed data and info->sig/sig_len the signature.
  */
-int mod_verify_sig(const void *mod, struct load_info *info)
+int mod_split_sig(const void *mod, struct load_info *info)
 {
 	struct module_signature ms;
 	size_t sig_len, modlen = info->len;
@@ -37,8 +38,19 @@ int mod_verify_sig(const void *mod, struct load_info *info)
 	sig_len = be32_to_cpu(ms.sig_len);
 	modlen -= sig_len + sizeof(ms);
 	info->len = modlen;
+	info->sig = mod + modlen;
+	info->sig_len = sig_len;
+	return 0;
+}
 
-	return verify_pkcs7_signature(mod, modlen, mod + modlen, sig_len,
+/*
+ * Check the signature split off by mod_split_sig().  This is the expensive
+ * part, and only reads the module image, so it may run concurrently with
+ * the loader looking at the ELF headers.
+ */
+int mod_verify_split_sig(const void *mod, struct load_info *info)
+{
+	return verify_pkcs7_signature(mod, info->len, info->sig, info->sig_len,
 				      VERIFY_USE_SECONDARY_KEYRING,
 				      VERIFYING_MODULE_SIGNATURE,
 				      NULL, NULL);
@@ -21,6 +21,7 @@
  * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/completion.h>
 #include <linux/export.h>
 #include <linux/cpumask.h>
 #include <linux/err.h>
@@ -35,6 +36,9 @@
 
 #define MAX_OBJ_NUM 1000
 
+/* Chunks per helper thread, so early finishers can steal from slow ones. */
+#define PADATA_MT_LOAD_BALANCE_FACTOR	4
+
 static void padata_free_pd(struct parallel_data *pd);
 
 static int padata_index_to_cpu(struct parallel_data *pd, int cpu_index)
@@ -350,6 +354,129 @@ void padata_do_serial(struct padata_priv *padata)
 }
 EXPORT_SYMBOL(padata_do_serial);
 
+struct padata_mt_job_state {
+	spinlock_t		lock;
+	struct completion	completion;
+	struct padata_mt_job	*job;
+	int			nworks;
+	int			nworks_fini;
+	unsigned long		chunk_size;
+};
+
+struct padata_mt_work {
+	struct work_struct		work;
+	struct padata_mt_job_state	*ps;
+};
+
+static void __init padata_mt_helper(struct work_struct *w)
+{
+	struct padata_mt_work *pw = container_of(w, struct padata_mt_work, work);
+	struct padata_mt_job_state *ps = pw->ps;
+	struct padata_mt_job *job = ps->job;
+	bool done;
+
+	spin_lock(&ps->lock);
+
+	while (job->size > 0) {
+		unsigned long start, size, end;
+
+		start = job->start;
+		/* So end is chunk size aligned if enough work remains. */
+		size = roundup(start + 1, ps->chunk_size) - start;
+		size = min(size, job->size);
+		end = start + size;
+
+		job->start = end;
+		job->size -= size;
+
+		spin_unlock(&ps->lock);
+		job->thread_fn(start, end, job->fn_arg);
+		spin_lock(&ps->lock);
+	}
+
+	++ps->nworks_fini;
+	done = (ps->nworks_fini == ps->nworks);
+	spin_unlock(&ps->lock);
+
+	if (done)
+		complete(&ps->completion);
+}
+
+/**
+ * padata_do_multithreaded - run a multithreaded job
+ * @job: Description of the job.
+ *
+ * The range [@job->start, @job->start + @job->size) is cut into chunks of
+ * at least @job->min_chunk units that the calling thread and up to
+ * @job->max_threads - 1 helpers on system_unbound_wq claim one at a time
+ * until none are left, so a thread that gets through its chunks quickly
+ * takes over work that would otherwise have waited on a slower one.
+ *
+ * @job->align must be at least 1.
+ *
+ * Returns once the whole range has been processed.  Only usable at boot,
+ * where falling back to running the job single threaded if the helpers
+ * can't be allocated is fine.
+ */
+void __init padata_do_multithreaded(struct padata_mt_job *job)
+{
+	struct padata_mt_job_state ps;
+	struct padata_mt_work my_work, *works;
+	unsigned long nworks;
+	int i;
+
+	if (job->size == 0)
+		return;
+
+	/* Ensure at least one thread when size < min_chunk. */
+	nworks = max(job->size / max(job->min_chunk, job->align), 1ul);
+	nworks = min_t(unsigned long, nworks, job->max_threads);
+	nworks = min_t(unsigned long, nworks, num_online_cpus());
+
+	if (nworks <= 1) {
+		/* Single thread, no coordination needed, cut to the chase. */
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+		return;
+	}
+
+	spin_lock_init(&ps.lock);
+	init_completion(&ps.completion);
+	ps.job	       = job;
+	ps.nworks      = nworks;
+	ps.nworks_fini = 0;
+
+	/*
+	 * Chunk size is the amount of work a helper does per call to the
+	 * thread function.  Load balance large jobs between threads by
+	 * increasing the number of chunks, guarantee at least the minimum
+	 * chunk size from the caller, and honor the caller's alignment.
+	 */
+	ps.chunk_size = job->size / (ps.nworks * PADATA_MT_LOAD_BALANCE_FACTOR);
+	ps.chunk_size = max3(ps.chunk_size, job->min_chunk, 1ul);
+	ps.chunk_size = roundup(ps.chunk_size, job->align);
+
+	works = kcalloc(nworks - 1, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		ps.nworks = 1;
+
+	for (i = 0; i < ps.nworks - 1; i++) {
+		works[i].ps = &ps;
+		INIT_WORK(&works[i].work, padata_mt_helper);
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+
+	/* Use the current thread, which saves starting a workqueue worker. */
+	my_work.ps = &ps;
+	INIT_WORK_ONSTACK(&my_work.work, padata_mt_helper);
+	padata_mt_helper(&my_work.work);
+
+	/* Wait for all the helpers to finish. */
+	wait_for_completion(&ps.completion);
+
+	destroy_work_on_stack(&my_work.work);
+	kfree(works);
+}
+
 static int padata_setup_cpumasks(struct padata_instance *pinst)
 {
 	struct workqueue_attrs *attrs;
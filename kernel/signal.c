@@ -157,7 +157,7 @@ static bool recalc_sigpending_tsk(struct task_struct *t)
 	if ((t->jobctl & (JOBCTL_PENDING_MASK | JOBCTL_TRAP_FREEZE)) ||
 	    PENDING(&t->pending, &t->blocked) ||
 	    PENDING(&t->signal->shared_pending, &t->blocked) ||
-	    cgroup_task_frozen(t)) {
+	    cgroup_task_frozen(t) || cgroup_task_freeze_changed(t)) {
 		set_tsk_thread_flag(t, TIF_SIGPENDING);
 		return true;
 	}
@@ -183,8 +183,18 @@ void recalc_sigpending_and_wake(struct task_struct *t)
 void recalc_sigpending(void)
 {
 	if (!recalc_sigpending_tsk(current) && !freezing(current) &&
-	    !klp_patch_pending(current))
+	    !klp_patch_pending(current)) {
 		clear_thread_flag(TIF_SIGPENDING);
+		/*
+		 * The cgroup freezer sets TIF_SIGPENDING without siglock
+		 * after bumping the generation, don't lose a freeze that
+		 * raced with the check above.  Pairs with the smp_mb() in
+		 * cgroup_do_freeze().
+		 */
+		smp_mb__after_atomic();
+		if (unlikely(cgroup_task_freeze_changed(current)))
+			set_thread_flag(TIF_SIGPENDING);
+	}
 
 }
 EXPORT_SYMBOL(recalc_sigpending);
@@ -2471,7 +2481,18 @@ static void do_freezer_trap(void)
 	 * immediately (if there is a non-fatal signal pending), and
 	 * put the task into sleep.
 	 */
-	__set_current_state(TASK_INTERRUPTIBLE);
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	/*
+	 * A thaw only bumps the cgroup's freezer generation and wakes us
+	 * up, recheck it now that we're TASK_INTERRUPTIBLE.
+	 */
+	if (unlikely(cgroup_task_freeze_changed(current))) {
+		__set_current_state(TASK_RUNNING);
+		spin_unlock_irq(&current->sighand->siglock);
+		return;
+	}
+
 	clear_thread_flag(TIF_SIGPENDING);
 	spin_unlock_irq(&current->sighand->siglock);
 	cgroup_enter_frozen();
@@ -2600,6 +2621,13 @@ bool get_signal(struct ksignal *ksig)
 		    do_signal_stop(0))
 			goto relock;
 
+		/*
+		 * The cgroup freezer only bumps the generation of the
+		 * cgroup, pick up the new state.
+		 */
+		if (unlikely(cgroup_task_freeze_changed(current)))
+			cgroup_freezer_sync();
+
 		if (unlikely(current->jobctl &
 			     (JOBCTL_TRAP_MASK | JOBCTL_TRAP_FREEZE))) {
 			if (current->jobctl & JOBCTL_TRAP_MASK) {
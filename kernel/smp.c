@@ -21,6 +21,11 @@
 #include <linux/sched/idle.h>
 #include <linux/hypervisor.h>
 #include <linux/suspend.h>
+#include <linux/jump_label.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>
 
 #include "smpboot.h"
 
@@ -33,6 +38,8 @@ struct call_function_data {
 	call_single_data_t	__percpu *csd;
 	cpumask_var_t		cpumask;
 	cpumask_var_t		cpumask_ipi;
+	cpumask_var_t		cpumask_plug;	/* IPIs held back while plugged */
+	int			plugged;
 };
 
 static DEFINE_PER_CPU_ALIGNED(struct call_function_data, cfd_data);
@@ -52,18 +59,24 @@ int smpcfd_prepare_cpu(unsigned int cpu)
 				     cpu_to_node(cpu)))
 		return -ENOMEM;
 	if (!zalloc_cpumask_var_node(&cfd->cpumask_ipi, GFP_KERNEL,
-				     cpu_to_node(cpu))) {
-		free_cpumask_var(cfd->cpumask);
-		return -ENOMEM;
-	}
+				     cpu_to_node(cpu)))
+		goto free_cpumask;
+	if (!zalloc_cpumask_var_node(&cfd->cpumask_plug, GFP_KERNEL,
+				     cpu_to_node(cpu)))
+		goto free_cpumask_ipi;
 	cfd->csd = alloc_percpu(call_single_data_t);
-	if (!cfd->csd) {
-		free_cpumask_var(cfd->cpumask);
-		free_cpumask_var(cfd->cpumask_ipi);
-		return -ENOMEM;
-	}
+	if (!cfd->csd)
+		goto free_cpumask_plug;
 
 	return 0;
+
+free_cpumask_plug:
+	free_cpumask_var(cfd->cpumask_plug);
+free_cpumask_ipi:
+	free_cpumask_var(cfd->cpumask_ipi);
+free_cpumask:
+	free_cpumask_var(cfd->cpumask);
+	return -ENOMEM;
 }
 
 int smpcfd_dead_cpu(unsigned int cpu)
@@ -72,6 +85,7 @@ int smpcfd_dead_cpu(unsigned int cpu)
 
 	free_cpumask_var(cfd->cpumask);
 	free_cpumask_var(cfd->cpumask_ipi);
+	free_cpumask_var(cfd->cpumask_plug);
 	free_percpu(cfd->csd);
 	return 0;
 }
@@ -101,6 +115,189 @@ void __init call_function_init(void)
 	smpcfd_prepare_cpu(smp_processor_id());
 }
 
+/*
+ * IPI statistics, off until enabled through debugfs.  Every CPU counts the
+ * calls it queues and the IPIs it sends, as well as the IPIs it takes and
+ * the functions it runs.  The CPU that raises an IPI also stamps the target
+ * with the time, so that the target can account the delivery latency.
+ */
+struct smp_ipi_stats {
+	u64	sent;		/* IPIs sent by this CPU, one per target */
+	u64	broadcasts;	/* of which as one all-but-self broadcast */
+	u64	queued;		/* functions queued on other CPUs */
+	u64	coalesced;	/* of which found an IPI already pending */
+	u64	received;	/* IPIs handled */
+	u64	run;		/* functions run */
+	u64	lat_sum;	/* ns from IPI send to running the queue */
+	u64	lat_nr;
+	u64	lat_max;
+};
+
+static DEFINE_STATIC_KEY_FALSE(ipi_stats_enabled);
+static DEFINE_PER_CPU(struct smp_ipi_stats, ipi_stats);
+static DEFINE_PER_CPU(unsigned long, ipi_sent_ns);
+
+#define ipi_stat_inc(field)						\
+do {									\
+	if (static_branch_unlikely(&ipi_stats_enabled))			\
+		this_cpu_inc(ipi_stats.field);				\
+} while (0)
+
+static void ipi_stats_sent(int cpu)
+{
+	this_cpu_inc(ipi_stats.sent);
+	WRITE_ONCE(per_cpu(ipi_sent_ns, cpu),
+		   (unsigned long)ktime_get_mono_fast_ns() ?: 1);
+}
+
+/* Must be called with interrupts disabled. */
+static void ipi_stats_account_latency(void)
+{
+	struct smp_ipi_stats *st = this_cpu_ptr(&ipi_stats);
+	unsigned long sent, lat;
+
+	sent = xchg(this_cpu_ptr(&ipi_sent_ns), 0);
+	if (!sent)
+		return;
+
+	lat = (unsigned long)ktime_get_mono_fast_ns() - sent;
+	st->lat_sum += lat;
+	st->lat_nr++;
+	if (lat > st->lat_max)
+		st->lat_max = lat;
+}
+
+extern void send_call_function_single_ipi(int cpu);
+
+/**
+ * arch_send_call_function_ipi_allbutself - Broadcast the call-function IPI
+ *
+ * Raise the call-function IPI on all online CPUs but this one with a single
+ * interrupt controller operation, where the irqchip has one.  Returns false
+ * if the IPI has to be sent to each CPU instead.
+ */
+bool __weak arch_send_call_function_ipi_allbutself(void)
+{
+	return false;
+}
+
+static void smp_send_ipi_mask(struct cpumask *mask)
+{
+	int this_cpu = smp_processor_id();
+	int cpu;
+
+	if (static_branch_unlikely(&ipi_stats_enabled)) {
+		for_each_cpu(cpu, mask)
+			ipi_stats_sent(cpu);
+	}
+
+	/*
+	 * @mask only ever holds online CPUs other than this one, so if it
+	 * is as large as that it covers all of them.
+	 */
+	if (cpu_online(this_cpu) &&
+	    cpumask_weight(mask) == num_online_cpus() - 1 &&
+	    arch_send_call_function_ipi_allbutself()) {
+		ipi_stat_inc(broadcasts);
+		return;
+	}
+
+	arch_send_call_function_ipi_mask(mask);
+}
+
+/*
+ * Raise the call-function IPI on @cpu, or on the CPUs in @mask, unless this
+ * CPU is plugged; then the targets are only noted down for the unplug.
+ */
+static void smp_send_ipi_single(int cpu)
+{
+	struct call_function_data *cfd = this_cpu_ptr(&cfd_data);
+
+	if (cfd->plugged) {
+		cpumask_set_cpu(cpu, cfd->cpumask_plug);
+		return;
+	}
+
+	if (static_branch_unlikely(&ipi_stats_enabled))
+		ipi_stats_sent(cpu);
+	send_call_function_single_ipi(cpu);
+}
+
+static void smp_send_ipi_many(struct call_function_data *cfd,
+			      struct cpumask *mask)
+{
+	unsigned long flags;
+
+	if (cfd->plugged) {
+		local_irq_save(flags);
+		cpumask_or(cfd->cpumask_plug, cfd->cpumask_plug, mask);
+		local_irq_restore(flags);
+		return;
+	}
+
+	smp_send_ipi_mask(mask);
+}
+
+static void smp_call_function_flush_plug(struct call_function_data *cfd)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	if (!cpumask_empty(cfd->cpumask_plug)) {
+		smp_send_ipi_mask(cfd->cpumask_plug);
+		cpumask_clear(cfd->cpumask_plug);
+	}
+	local_irq_restore(flags);
+}
+
+/*
+ * Whoever waits for a csd while plugged must send the IPIs held back so far,
+ * the one that completes the csd may well be among them.
+ */
+static __always_inline void smp_call_function_flush_plug_wait(void)
+{
+	struct call_function_data *cfd = this_cpu_ptr(&cfd_data);
+
+	if (unlikely(cfd->plugged))
+		smp_call_function_flush_plug(cfd);
+}
+
+/**
+ * smp_call_function_plug - Hold back call-function IPIs from this CPU
+ *
+ * Functions queued on other CPUs from here on don't raise an IPI each
+ * until the matching smp_call_function_unplug().  The target CPUs are
+ * collected instead, and unplugging raises one IPI on each of them with a
+ * single mask send, or broadcast, however many functions it was given.
+ * This is meant for bursts of asynchronous calls such as a run of
+ * smp_call_function_single_async() or smp_call_function_many() without
+ * @wait.
+ *
+ * Waiting for a call, or for a csd still in flight, sends the held back
+ * IPIs first, so a plug never delays a call past the caller's own wait.
+ * Interrupts on this CPU have their calls held back as well meanwhile.
+ * Plugs nest; preemption must stay disabled until the outermost unplug.
+ */
+void smp_call_function_plug(void)
+{
+	this_cpu_ptr(&cfd_data)->plugged++;
+}
+EXPORT_SYMBOL_GPL(smp_call_function_plug);
+
+/**
+ * smp_call_function_unplug - Send the IPIs held back since the plug
+ */
+void smp_call_function_unplug(void)
+{
+	struct call_function_data *cfd = this_cpu_ptr(&cfd_data);
+
+	if (WARN_ON_ONCE(!cfd->plugged))
+		return;
+	if (!--cfd->plugged)
+		smp_call_function_flush_plug(cfd);
+}
+EXPORT_SYMBOL_GPL(smp_call_function_unplug);
+
 /*
  * csd_lock/csd_unlock used to serialize access to per-cpu csd resources
  *
@@ -115,6 +312,8 @@ static __always_inline void csd_lock_wait(struct __call_single_data *csd)
 
 static __always_inline void csd_lock(struct __call_single_data *csd)
 {
+	if (READ_ONCE(csd->flags) & CSD_FLAG_LOCK)
+		smp_call_function_flush_plug_wait();
 	csd_lock_wait(csd);
 	csd->flags |= CSD_FLAG_LOCK;
 
@@ -138,8 +337,6 @@ static __always_inline void csd_unlock(struct __call_single_data *csd)
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(call_single_data_t, csd_data);
 
-extern void send_call_function_single_ipi(int cpu);
-
 /*
  * Insert a previously allocated call_single_data_t element
  * for execution on the given CPU. data must already have
@@ -182,8 +379,11 @@ static int generic_exec_single(int cpu, struct __call_single_data *csd,
 	 * locking and barrier primitives. Generic code isn't really
 	 * equipped to do the right thing...
 	 */
+	ipi_stat_inc(queued);
 	if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu)))
-		send_call_function_single_ipi(cpu);
+		smp_send_ipi_single(cpu);
+	else
+		ipi_stat_inc(coalesced);
 
 	return 0;
 }
@@ -196,6 +396,7 @@ static int generic_exec_single(int cpu, struct __call_single_data *csd,
  */
 void generic_smp_call_function_single_interrupt(void)
 {
+	ipi_stat_inc(received);
 	flush_smp_call_function_queue(true);
 }
 
@@ -226,6 +427,9 @@ static void flush_smp_call_function_queue(bool warn_cpu_offline)
 	entry = llist_del_all(head);
 	entry = llist_reverse_order(entry);
 
+	if (static_branch_unlikely(&ipi_stats_enabled) && entry)
+		ipi_stats_account_latency();
+
 	/* There shouldn't be any pending callbacks on an offline CPU. */
 	if (unlikely(warn_cpu_offline && !cpu_online(smp_processor_id()) &&
 		     !warned && entry != NULL)) {
@@ -245,6 +449,8 @@ static void flush_smp_call_function_queue(bool warn_cpu_offline)
 		smp_call_func_t func = csd->func;
 		void *info = csd->info;
 
+		ipi_stat_inc(run);
+
 		/* Do we wait until *after* callback? */
 		if (csd->flags & CSD_FLAG_SYNCHRONOUS) {
 			func(info);
@@ -325,8 +531,10 @@ int smp_call_function_single(int cpu, smp_call_func_t func, void *info,
 
 	err = generic_exec_single(cpu, csd, func, info);
 
-	if (wait)
+	if (wait) {
+		smp_call_function_flush_plug_wait();
 		csd_lock_wait(csd);
+	}
 
 	put_cpu();
 
@@ -357,8 +565,10 @@ int smp_call_function_single_async(int cpu, call_single_data_t *csd)
 	preempt_disable();
 
 	/* We could deadlock if we have to wait here with interrupts disabled! */
-	if (WARN_ON_ONCE(csd->flags & CSD_FLAG_LOCK))
+	if (WARN_ON_ONCE(csd->flags & CSD_FLAG_LOCK)) {
+		smp_call_function_flush_plug_wait();
 		csd_lock_wait(csd);
+	}
 
 	csd->flags = CSD_FLAG_LOCK;
 	smp_wmb();
@@ -488,14 +698,18 @@ void smp_call_function_many(const struct cpumask *mask,
 			csd->flags |= CSD_FLAG_SYNCHRONOUS;
 		csd->func = func;
 		csd->info = info;
+		ipi_stat_inc(queued);
 		if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu)))
 			__cpumask_set_cpu(cpu, cfd->cpumask_ipi);
+		else
+			ipi_stat_inc(coalesced);
 	}
 
 	/* Send a message to all CPUs in the map */
-	arch_send_call_function_ipi_mask(cfd->cpumask_ipi);
+	smp_send_ipi_many(cfd, cfd->cpumask_ipi);
 
 	if (wait) {
+		smp_call_function_flush_plug_wait();
 		for_each_cpu(cpu, cfd->cpumask) {
 			call_single_data_t *csd;
 
@@ -629,6 +843,7 @@ static inline void free_boot_cpu_mask(void)
 void __init smp_init(void)
 {
 	int num_nodes, num_cpus;
+	cpumask_var_t bringup;
 	unsigned int cpu;
 
 	idle_threads_init();
@@ -636,12 +851,27 @@ void __init smp_init(void)
 
 	pr_info("Bringing up secondary CPUs ...\n");
 
-	/* FIXME: This should be done in userspace --RR */
-	for_each_present_cpu(cpu) {
-		if (num_online_cpus() >= setup_max_cpus)
-			break;
-		if (!cpu_online(cpu) && boot_cpu(cpu))
-			cpu_up(cpu);
+	/* Hand them over as one set, so that the states can go in parallel */
+	if (zalloc_cpumask_var(&bringup, GFP_KERNEL)) {
+		num_cpus = num_online_cpus();
+		for_each_present_cpu(cpu) {
+			if (num_cpus >= setup_max_cpus)
+				break;
+			if (!cpu_online(cpu) && boot_cpu(cpu)) {
+				cpumask_set_cpu(cpu, bringup);
+				num_cpus++;
+			}
+		}
+		cpu_up_mask(bringup);
+		free_cpumask_var(bringup);
+	} else {
+		/* FIXME: This should be done in userspace --RR */
+		for_each_present_cpu(cpu) {
+			if (num_online_cpus() >= setup_max_cpus)
+				break;
+			if (!cpu_online(cpu) && boot_cpu(cpu))
+				cpu_up(cpu);
+		}
 	}
 	free_boot_cpu_mask();
 
@@ -870,3 +1100,71 @@ int smp_call_on_cpu(unsigned int cpu, int (*func)(void *), void *par, bool phys)
 	return sscs.ret;
 }
 EXPORT_SYMBOL_GPL(smp_call_on_cpu);
+
+#ifdef CONFIG_DEBUG_FS
+static int ipi_stats_show(struct seq_file *m, void *v)
+{
+	int cpu;
+
+	seq_printf(m, "enabled: %d\n",
+		   static_key_enabled(&ipi_stats_enabled) ? 1 : 0);
+	seq_puts(m, "cpu         sent  broadcasts      queued   coalesced    received         run  lat_avg_ns  lat_max_ns\n");
+	for_each_online_cpu(cpu) {
+		struct smp_ipi_stats *st = per_cpu_ptr(&ipi_stats, cpu);
+
+		seq_printf(m, "%-4d %11llu %11llu %11llu %11llu %11llu %11llu %11llu %11llu\n",
+			   cpu, st->sent, st->broadcasts, st->queued,
+			   st->coalesced, st->received, st->run,
+			   st->lat_nr ? div64_u64(st->lat_sum, st->lat_nr) : 0,
+			   st->lat_max);
+	}
+	return 0;
+}
+
+static int ipi_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ipi_stats_show, NULL);
+}
+
+/* Writing 1 resets the counters and starts counting, 0 stops counting. */
+static ssize_t ipi_stats_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	bool enable;
+	int cpu, ret;
+
+	ret = kstrtobool_from_user(ubuf, count, &enable);
+	if (ret)
+		return ret;
+
+	if (!enable) {
+		static_branch_disable(&ipi_stats_enabled);
+		return count;
+	}
+
+	for_each_possible_cpu(cpu) {
+		memset(per_cpu_ptr(&ipi_stats, cpu), 0,
+		       sizeof(struct smp_ipi_stats));
+		per_cpu(ipi_sent_ns, cpu) = 0;
+	}
+	static_branch_enable(&ipi_stats_enabled);
+	return count;
+}
+
+static const struct file_operations ipi_stats_fops = {
+	.open		= ipi_stats_open,
+	.read		= seq_read,
+	.write		= ipi_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init smp_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("smp", NULL);
+
+	debugfs_create_file("ipi_stats", 0644, dir, NULL, &ipi_stats_fops);
+	return 0;
+}
+late_initcall(smp_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
@@ -51,6 +51,7 @@
 #include <linux/kprobes.h>
 #include <linux/user_namespace.h>
 #include <linux/binfmts.h>
+#include <linux/futex.h>
 
 #include <linux/sched.h>
 #include <linux/sched/autogroup.h>
@@ -2695,6 +2696,26 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			return -EINVAL;
 		error = GET_TAGGED_ADDR_CTRL();
 		break;
+	case PR_FUTEX_HASH:
+		if (arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_prctl(arg2, arg3);
+		break;
+	case PR_GET_FORK_SHARE_PTE:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = !!test_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+		break;
+	case PR_SET_FORK_SHARE_PTE:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (!IS_ENABLED(CONFIG_FORK_SHARED_PTE))
+			return -EINVAL;
+		if (arg2)
+			set_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+		else
+			clear_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+		break;
 	default:
 		error = -EINVAL;
 		break;
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Boot time benchmark of kallsyms name and address lookups.
+ *
+ * Every (kallsyms_num_syms / nr_syms)th symbol is sampled, then
+ * kallsyms_lookup_name() is timed over the sampled names and
+ * kallsyms_lookup() over their addresses, nr_lookups calls each.  The
+ * address pass can be limited to the first nr_hot samples, to see what a
+ * profiler that keeps hitting the same functions gets out of the name
+ * cache.
+ *
+ * This needs kallsyms interfaces that aren't exported to modules, so it
+ * is built in and runs once at boot; pass e.g. "test_kallsyms.nr_hot=64"
+ * on the command line to change the parameters.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kallsyms.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+
+#define __param(type, name, init, msg)		\
+	static type name = init;			\
+	module_param(name, type, 0444);			\
+	MODULE_PARM_DESC(name, msg)			\
+
+__param(int, nr_syms, 1024,
+	"Number of symbols sampled");
+
+__param(int, nr_lookups, 100000,
+	"Number of lookups timed per pass");
+
+__param(int, nr_hot, 0,
+	"Only look up the addresses of the first nr_hot samples, 0 for all");
+
+struct test_sym {
+	char name[KSYM_NAME_LEN];
+	unsigned long addr;
+};
+
+static struct test_sym *test_syms;
+static int test_nr_syms;
+static unsigned long test_nr_seen;
+static unsigned long test_stride;
+
+/* Core kernel symbols only, they come first. */
+static int test_count_sym(void *data, const char *name, struct module *mod,
+			  unsigned long addr)
+{
+	if (mod)
+		return 1;
+
+	test_nr_seen++;
+	return 0;
+}
+
+static int test_sample_sym(void *data, const char *name, struct module *mod,
+			   unsigned long addr)
+{
+	struct test_sym *sym;
+
+	if (mod)
+		return 1;
+
+	if (test_nr_seen++ % test_stride)
+		return 0;
+
+	sym = &test_syms[test_nr_syms++];
+	strlcpy(sym->name, name, sizeof(sym->name));
+	sym->addr = addr;
+	return test_nr_syms == nr_syms;
+}
+
+static u64 test_rate(int n, u64 ns)
+{
+	return ns ? div64_u64((u64)n * NSEC_PER_SEC, ns) : 0;
+}
+
+static void test_name_lookups(void)
+{
+	int i, misses = 0;
+	u64 start, ns;
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr_lookups; i++) {
+		if (!kallsyms_lookup_name(test_syms[i % test_nr_syms].name))
+			misses++;
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ktime_get_ns() - start;
+
+	pr_info("name lookups: %d in %llu usec (%llu lookups/sec, %llu nsec each), %d not found\n",
+		nr_lookups, div_u64(ns, NSEC_PER_USEC), test_rate(nr_lookups, ns),
+		div_u64(ns, nr_lookups), misses);
+}
+
+static void test_addr_lookups(void)
+{
+	char namebuf[KSYM_NAME_LEN];
+	unsigned long size, offset;
+	int i, n, misses = 0;
+	char *modname;
+	u64 start, ns;
+
+	n = nr_hot > 0 ? min(nr_hot, test_nr_syms) : test_nr_syms;
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr_lookups; i++) {
+		if (!kallsyms_lookup(test_syms[i % n].addr, &size, &offset,
+				     &modname, namebuf))
+			misses++;
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ktime_get_ns() - start;
+
+	pr_info("address lookups over %d symbols: %d in %llu usec (%llu lookups/sec, %llu nsec each), %d not found\n",
+		n, nr_lookups, div_u64(ns, NSEC_PER_USEC),
+		test_rate(nr_lookups, ns), div_u64(ns, nr_lookups), misses);
+}
+
+static int __init kallsyms_test_init(void)
+{
+	unsigned long total;
+
+	if (nr_syms <= 0 || nr_lookups <= 0)
+		return -EINVAL;
+
+	/* The name index is built from a work item queued at boot. */
+	flush_scheduled_work();
+
+	test_syms = kvcalloc(nr_syms, sizeof(*test_syms), GFP_KERNEL);
+	if (!test_syms)
+		return -ENOMEM;
+
+	/* Count the symbols first, to spread the samples. */
+	kallsyms_on_each_symbol(test_count_sym, NULL);
+	total = test_nr_seen;
+	test_stride = max(total / nr_syms, 1UL);
+	test_nr_seen = 0;
+	kallsyms_on_each_symbol(test_sample_sym, NULL);
+
+	if (test_nr_syms) {
+		pr_info("sampled %d of %lu symbols\n", test_nr_syms, total);
+		test_name_lookups();
+		test_addr_lookups();
+	}
+
+	kvfree(test_syms);
+	return 0;
+}
+late_initcall(kallsyms_test_init);
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Test module for stress and performance analysis of cross-CPU function
+ * calls.
+ *
+ * One kthread per online CPU fires nr_bursts bursts of burst_size
+ * asynchronous calls at the other CPUs and spins until all of them have
+ * run.  Depending on mode, a burst is made of smp_call_function_single_async()
+ * calls going round-robin over the other CPUs, of smp_call_function_many()
+ * calls to all of them, or of a mix of both.  With plug=1 every burst is
+ * wrapped in smp_call_function_plug()/unplug(), so that it costs one IPI
+ * per target.  Call throughput and the time from the start of a burst to
+ * its last call having run are reported.
+ *
+ * For the IPI counts and the per-CPU delivery latency behind the numbers,
+ * write 1 to /sys/kernel/debug/smp/ipi_stats before loading and read it
+ * back afterwards.  Under QEMU, vary "-smp" between 8 and 64 vCPUs.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/smp.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+
+static int nr_bursts = 100000;
+module_param(nr_bursts, int, 0444);
+MODULE_PARM_DESC(nr_bursts, "Number of bursts fired by each CPU");
+
+static int burst_size = 16;
+module_param(burst_size, int, 0444);
+MODULE_PARM_DESC(burst_size, "Number of calls per burst");
+
+static int mode;
+module_param(mode, int, 0444);
+MODULE_PARM_DESC(mode, "0: every fourth call to all other CPUs, the rest as in 1; 1: each call to one other CPU, round-robin; 2: all to all other CPUs");
+
+static bool plug;
+module_param(plug, bool, 0444);
+MODULE_PARM_DESC(plug, "Plug the call-function IPIs for the duration of a burst");
+
+struct test_thread {
+	struct task_struct *task;
+	call_single_data_t *csd;
+	cpumask_var_t others;
+	int *targets;
+	int nr_targets;
+	atomic_t pending;
+	u64 nr_calls;
+	u64 lat_sum;
+	u64 lat_max;
+	u64 nsec;
+};
+
+static atomic_t nr_running;
+static DECLARE_COMPLETION(all_done);
+
+static void test_smp_fn(void *info)
+{
+	atomic_dec(info);
+}
+
+static void test_call(struct test_thread *t, int i)
+{
+	bool many = mode == 2 || (mode == 0 && (i & 3) == 3);
+	int cpu;
+
+	if (many) {
+		atomic_add(t->nr_targets, &t->pending);
+		smp_call_function_many(t->others, test_smp_fn, &t->pending,
+				       false);
+		t->nr_calls += t->nr_targets;
+		return;
+	}
+
+	cpu = t->targets[i % t->nr_targets];
+	atomic_inc(&t->pending);
+	if (smp_call_function_single_async(cpu, &t->csd[i]))
+		atomic_dec(&t->pending);
+	t->nr_calls++;
+}
+
+static int test_func(void *private)
+{
+	struct test_thread *t = private;
+	u64 start, lat;
+	int i, j;
+
+	t->nsec = ktime_get_ns();
+	for (i = 0; i < nr_bursts; i++) {
+		preempt_disable();
+		start = ktime_get_ns();
+
+		if (plug)
+			smp_call_function_plug();
+		for (j = 0; j < burst_size; j++)
+			test_call(t, j);
+		if (plug)
+			smp_call_function_unplug();
+
+		while (atomic_read(&t->pending))
+			cpu_relax();
+
+		lat = ktime_get_ns() - start;
+		preempt_enable();
+
+		t->lat_sum += lat;
+		t->lat_max = max(t->lat_max, lat);
+
+		if (!(i & 63))
+			cond_resched();
+	}
+	t->nsec = ktime_get_ns() - t->nsec;
+
+	if (atomic_dec_and_test(&nr_running))
+		complete(&all_done);
+	return 0;
+}
+
+static int init_test_thread(struct test_thread *t, int cpu)
+{
+	int i, other;
+
+	t->csd = kcalloc(burst_size, sizeof(*t->csd), GFP_KERNEL);
+	t->targets = kcalloc(nr_cpu_ids, sizeof(*t->targets), GFP_KERNEL);
+	if (!t->csd || !t->targets || !zalloc_cpumask_var(&t->others,
+							 GFP_KERNEL))
+		return -ENOMEM;
+
+	for (i = 0; i < burst_size; i++) {
+		t->csd[i].func = test_smp_fn;
+		t->csd[i].info = &t->pending;
+	}
+
+	/* Start right after ourselves so that the CPUs spread the load. */
+	cpumask_copy(t->others, cpu_online_mask);
+	cpumask_clear_cpu(cpu, t->others);
+	for_each_cpu_wrap(other, t->others, cpu + 1)
+		t->targets[t->nr_targets++] = other;
+
+	return 0;
+}
+
+static void run_test(struct test_thread *threads)
+{
+	u64 calls = 0, bursts = 0, lat_sum = 0, lat_max = 0, elapsed = 0;
+	int cpu;
+
+	/* Create everybody first, so that they all start together. */
+	for_each_online_cpu(cpu) {
+		struct test_thread *t = &threads[cpu];
+
+		if (init_test_thread(t, cpu)) {
+			pr_err("Failed to allocate calls for CPU%d\n", cpu);
+			continue;
+		}
+		t->task = kthread_create_on_cpu(test_func, t, cpu,
+						"smp_call_test/%u");
+		if (IS_ERR(t->task)) {
+			pr_err("Failed to start kthread for %d CPU\n", cpu);
+			t->task = NULL;
+		}
+	}
+
+	/* Our own reference, so that early finishers can't complete */
+	atomic_set(&nr_running, 1);
+	for_each_online_cpu(cpu) {
+		if (!threads[cpu].task)
+			continue;
+		atomic_inc(&nr_running);
+		wake_up_process(threads[cpu].task);
+	}
+	if (!atomic_dec_and_test(&nr_running)) {
+		/* 1 second at a time, so the hung task detector stays quiet */
+		while (!wait_for_completion_timeout(&all_done, HZ))
+			;
+	}
+
+	for_each_online_cpu(cpu) {
+		struct test_thread *t = &threads[cpu];
+
+		if (t->task) {
+			elapsed = max(elapsed, t->nsec);
+			calls += t->nr_calls;
+			bursts += nr_bursts;
+			lat_sum += t->lat_sum;
+			lat_max = max(lat_max, t->lat_max);
+			pr_info("CPU%d: %llu calls in %llu usec, burst latency avg: %llu nsec max: %llu nsec\n",
+				cpu, t->nr_calls, div_u64(t->nsec, NSEC_PER_USEC),
+				div_u64(t->lat_sum, nr_bursts), t->lat_max);
+		}
+		kfree(t->csd);
+		kfree(t->targets);
+		free_cpumask_var(t->others);
+	}
+
+	if (!calls || !elapsed)
+		return;
+
+	pr_info("Summary: mode %d %s: %llu calls in %llu usec (%llu calls/sec) burst latency avg: %llu nsec max: %llu nsec\n",
+		mode, plug ? "plugged" : "unplugged", calls,
+		div_u64(elapsed, NSEC_PER_USEC),
+		div64_u64(calls * NSEC_PER_SEC, elapsed),
+		div64_u64(lat_sum, bursts), lat_max);
+}
+
+static int smp_call_test_init(void)
+{
+	struct test_thread *threads;
+
+	if (nr_bursts <= 0 || burst_size <= 0 || mode < 0 || mode > 2)
+		return -EINVAL;
+
+	if (num_online_cpus() < 2) {
+		pr_err("Needs at least two online CPUs\n");
+		return -EINVAL;
+	}
+
+	threads = kcalloc(nr_cpu_ids, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	/* The target sets are fixed for the whole run. */
+	get_online_cpus();
+	run_test(threads);
+	put_online_cpus();
+	kfree(threads);
+
+	return -EAGAIN; /* Fail will directly unload the module */
+}
+
+module_init(smp_call_test_init)
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("cross-CPU function call test module");
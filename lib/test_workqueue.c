@@ -0,0 +1,346 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Test module for stress and performance analysis of work item queueing.
+ *
+ * One kthread per online CPU queues nr_items work items onto a shared
+ * workqueue, recycling a small pool of nr_inflight items so that queueing,
+ * execution and flush_work() on still pending items all race with each
+ * other.  Aggregate throughput and the queue-to-execution latency are
+ * reported once every thread is done.
+ *
+ * With pipeline=1 each kthread instead acts like a dm-crypt submitter: it
+ * fills a buf_size buffer, hands it to an unbound workqueue which reads and
+ * rewrites all of it, and waits for the result.  The end-to-end latency,
+ * the share of requests executed outside the submitter's cluster
+ * (topology_core_cpumask(), which also bounds the "cache" affinity pods)
+ * and, if the PMU allows, cache misses per request are reported.  Set
+ * /sys/module/workqueue/parameters/default_affinity_scope before loading
+ * to compare affinity scopes.  To get a synthetic two-cluster topology
+ * under QEMU, boot with e.g. "-smp 8,sockets=2,cores=4,threads=1".
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/topology.h>
+#include <linux/perf_event.h>
+
+static int nr_items = 1000000;
+module_param(nr_items, int, 0444);
+MODULE_PARM_DESC(nr_items, "Number of work items queued by each CPU");
+
+static int nr_inflight = 256;
+module_param(nr_inflight, int, 0444);
+MODULE_PARM_DESC(nr_inflight, "Number of distinct work items each CPU recycles");
+
+static bool unbound;
+module_param(unbound, bool, 0444);
+MODULE_PARM_DESC(unbound, "Use a WQ_UNBOUND workqueue instead of a per-cpu one");
+
+static bool pipeline;
+module_param(pipeline, bool, 0444);
+MODULE_PARM_DESC(pipeline, "Run the producer/consumer test on an unbound workqueue");
+
+static int buf_size = 65536;
+module_param(buf_size, int, 0444);
+MODULE_PARM_DESC(buf_size, "Size of the buffer handed over per request in pipeline mode");
+
+struct test_item {
+	struct work_struct work;
+	u64 queued;
+};
+
+/* a pipeline mode request, one in flight per submitter */
+struct test_crypt_req {
+	struct work_struct work;
+	struct completion done;
+	u64 *buf;
+	int exec_cpu;
+};
+
+struct test_thread {
+	struct task_struct *task;
+	struct test_item *items;
+	struct test_crypt_req req;
+	int cpu;
+	u64 remote;
+	u64 nsec;
+};
+
+static struct workqueue_struct *test_wq;
+
+static atomic64_t lat_sum = ATOMIC64_INIT(0);
+static atomic64_t lat_max = ATOMIC64_INIT(0);
+static atomic64_t nr_executed = ATOMIC64_INIT(0);
+
+static atomic_t nr_running;
+static DECLARE_COMPLETION(all_done);
+
+static void account_latency(s64 lat)
+{
+	s64 max = atomic64_read(&lat_max);
+
+	atomic64_add(lat, &lat_sum);
+	atomic64_inc(&nr_executed);
+
+	while (lat > max) {
+		s64 old = atomic64_cmpxchg(&lat_max, max, lat);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+static void test_work_fn(struct work_struct *work)
+{
+	struct test_item *item = container_of(work, struct test_item, work);
+
+	account_latency(ktime_get_ns() - item->queued);
+}
+
+/* Stand-in for the cipher: read and rewrite every word of the buffer. */
+static void test_crypt_fn(struct work_struct *work)
+{
+	struct test_crypt_req *req =
+		container_of(work, struct test_crypt_req, work);
+	u64 sum = 0;
+	int i;
+
+	for (i = 0; i < buf_size / sizeof(u64); i++) {
+		sum += req->buf[i];
+		req->buf[i] ^= sum;
+	}
+
+	req->exec_cpu = raw_smp_processor_id();
+	complete(&req->done);
+}
+
+static void test_pipeline(struct test_thread *t)
+{
+	struct test_crypt_req *req = &t->req;
+	u64 queued;
+	int i;
+
+	for (i = 0; i < nr_items; i++) {
+		/* the submitter produces the data, like filling a bio */
+		memset(req->buf, i, buf_size);
+		reinit_completion(&req->done);
+
+		queued = ktime_get_ns();
+		queue_work(test_wq, &req->work);
+		wait_for_completion(&req->done);
+		account_latency(ktime_get_ns() - queued);
+
+		if (!cpumask_test_cpu(req->exec_cpu,
+				      topology_core_cpumask(t->cpu)))
+			t->remote++;
+	}
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static struct perf_event *miss_events[NR_CPUS];
+
+static struct perf_event_attr miss_attr = {
+	.type		= PERF_TYPE_HARDWARE,
+	.config		= PERF_COUNT_HW_CACHE_MISSES,
+	.size		= sizeof(struct perf_event_attr),
+	.pinned		= 1,
+};
+
+static void start_miss_counters(void)
+{
+	struct perf_event *event;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		event = perf_event_create_kernel_counter(&miss_attr, cpu,
+							 NULL, NULL, NULL);
+		miss_events[cpu] = IS_ERR(event) ? NULL : event;
+	}
+}
+
+/* Return the total number of cache misses, or -1 if there's no PMU. */
+static s64 stop_miss_counters(void)
+{
+	u64 enabled, running;
+	s64 total = -1;
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!miss_events[cpu])
+			continue;
+		if (total < 0)
+			total = 0;
+		total += perf_event_read_value(miss_events[cpu],
+					       &enabled, &running);
+		perf_event_release_kernel(miss_events[cpu]);
+		miss_events[cpu] = NULL;
+	}
+	return total;
+}
+#else
+static void start_miss_counters(void) { }
+static s64 stop_miss_counters(void) { return -1; }
+#endif
+
+static int test_func(void *private)
+{
+	struct test_thread *t = private;
+	u64 start;
+	int i;
+
+	start = ktime_get_ns();
+	if (pipeline) {
+		test_pipeline(t);
+		goto done;
+	}
+
+	for (i = 0; i < nr_items; i++) {
+		struct test_item *item = &t->items[i % nr_inflight];
+
+		/* Still queued from the previous round?  Wait for it. */
+		if (work_pending(&item->work))
+			flush_work(&item->work);
+
+		item->queued = ktime_get_ns();
+		queue_work_on(t->cpu, test_wq, &item->work);
+
+		if (!(i & 1023))
+			cond_resched();
+	}
+	for (i = 0; i < nr_inflight; i++)
+		flush_work(&t->items[i].work);
+done:
+	t->nsec = ktime_get_ns() - start;
+
+	if (atomic_dec_and_test(&nr_running))
+		complete(&all_done);
+	return 0;
+}
+
+static int init_test_thread(struct test_thread *t)
+{
+	int i;
+
+	if (pipeline) {
+		t->req.buf = kvmalloc(buf_size, GFP_KERNEL);
+		if (!t->req.buf)
+			return -ENOMEM;
+		INIT_WORK(&t->req.work, test_crypt_fn);
+		init_completion(&t->req.done);
+		return 0;
+	}
+
+	t->items = kcalloc(nr_inflight, sizeof(*t->items), GFP_KERNEL);
+	if (!t->items)
+		return -ENOMEM;
+	for (i = 0; i < nr_inflight; i++)
+		INIT_WORK(&t->items[i].work, test_work_fn);
+	return 0;
+}
+
+static void run_test(struct test_thread *threads)
+{
+	u64 executed, remote = 0, elapsed = 0;
+	s64 misses;
+	int cpu;
+
+	/* Create everybody first, so that they all start together. */
+	for_each_online_cpu(cpu) {
+		struct test_thread *t = &threads[cpu];
+
+		t->cpu = cpu;
+		if (init_test_thread(t)) {
+			pr_err("Failed to allocate work items for CPU%d\n", cpu);
+			continue;
+		}
+		t->task = kthread_create_on_cpu(test_func, t, cpu, "wq_test/%u");
+		if (IS_ERR(t->task)) {
+			pr_err("Failed to start kthread for %d CPU\n", cpu);
+			t->task = NULL;
+		}
+	}
+
+	start_miss_counters();
+	/* Our own reference, so that early finishers can't complete */
+	atomic_set(&nr_running, 1);
+	for_each_online_cpu(cpu) {
+		if (!threads[cpu].task)
+			continue;
+		atomic_inc(&nr_running);
+		wake_up_process(threads[cpu].task);
+	}
+	if (!atomic_dec_and_test(&nr_running)) {
+		/* 1 second at a time, so the hung task detector stays quiet */
+		while (!wait_for_completion_timeout(&all_done, HZ))
+			;
+	}
+	misses = stop_miss_counters();
+
+	for_each_online_cpu(cpu) {
+		struct test_thread *t = &threads[cpu];
+
+		if (t->task) {
+			elapsed = max(elapsed, t->nsec);
+			remote += t->remote;
+			pr_info("CPU%d: %d items in %llu usec\n", cpu, nr_items,
+				div_u64(t->nsec, NSEC_PER_USEC));
+		}
+		kfree(t->items);
+		kvfree(t->req.buf);
+	}
+
+	executed = atomic64_read(&nr_executed);
+	if (!executed || !elapsed)
+		return;
+
+	pr_info("Summary: %s wq executed: %llu in %llu usec (%llu items/sec) latency avg: %llu nsec max: %llu nsec\n",
+		unbound || pipeline ? "unbound" : "per-cpu", executed,
+		div_u64(elapsed, NSEC_PER_USEC),
+		div64_u64(executed * NSEC_PER_SEC, elapsed),
+		div64_u64(atomic64_read(&lat_sum), executed),
+		(u64)atomic64_read(&lat_max));
+
+	if (pipeline)
+		pr_info("Summary: pipeline %d bytes: %llu%% executed off-cluster, cache misses/request: %lld\n",
+			buf_size, div64_u64(remote * 100, executed),
+			misses < 0 ? -1LL : (s64)div64_u64(misses, executed));
+}
+
+static int workqueue_test_init(void)
+{
+	struct test_thread *threads;
+
+	if (nr_items <= 0 || nr_inflight <= 0 || buf_size < sizeof(u64))
+		return -EINVAL;
+
+	threads = kcalloc(nr_cpu_ids, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	test_wq = alloc_workqueue("test_wq",
+				  unbound || pipeline ? WQ_UNBOUND : 0, 0);
+	if (!test_wq) {
+		kfree(threads);
+		return -ENOMEM;
+	}
+
+	run_test(threads);
+	destroy_workqueue(test_wq);
+	kfree(threads);
+
+	return -EAGAIN; /* Fail will directly unload the module */
+}
+
+module_init(workqueue_test_init)
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("workqueue queueing test module");
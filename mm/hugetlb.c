@@ -28,6 +28,7 @@
 #include <linux/jhash.h>
 #include <linux/numa.h>
 #include <linux/llist.h>
+#include <linux/padata.h>
 
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -2328,10 +2329,87 @@ static void __init gather_bootmem_prealloc(void)
 	}
 }
 
+struct hugetlb_boot_alloc {
+	struct hstate *h;
+	nodemask_t *node_alloc_noretry;
+	atomic_long_t allocated;
+};
+
+/* Spread page @i of the boot allocation round-robin across memory nodes. */
+static int __init hugetlb_boot_alloc_nid(unsigned long i)
+{
+	int nid, n = i % num_node_state(N_MEMORY);
+
+	for_each_node_state(nid, N_MEMORY)
+		if (!n--)
+			break;
+	return nid;
+}
+
+static void __init hugetlb_boot_alloc_fn(unsigned long start,
+					 unsigned long end, void *arg)
+{
+	struct hugetlb_boot_alloc *ba = arg;
+	struct hstate *h = ba->h;
+	gfp_t gfp_mask = htlb_alloc_mask(h) | __GFP_THISNODE;
+	struct page *page = NULL;
+	unsigned long i, nr = 0;
+	int nr_nodes, node;
+
+	for (i = start; i < end; i++) {
+		node = hugetlb_boot_alloc_nid(i);
+		for (nr_nodes = num_node_state(N_MEMORY); nr_nodes > 0;
+		     nr_nodes--) {
+			page = alloc_fresh_huge_page(h, gfp_mask, node,
+						     &node_states[N_MEMORY],
+						     ba->node_alloc_noretry);
+			if (page)
+				break;
+			node = next_node_in(node, node_states[N_MEMORY]);
+		}
+		if (!page)
+			break;
+		put_page(page); /* free it into the hugepage allocator */
+		nr++;
+		cond_resched();
+	}
+	atomic_long_add(nr, &ba->allocated);
+}
+
+/*
+ * Fill the pool with non-gigantic pages from several threads at once, which
+ * matters once the pool is tens of GB: most of the time goes into preparing
+ * the struct pages of each compound page, and that scales with CPUs.
+ */
+static unsigned long __init hugetlb_alloc_boot_pages(struct hstate *h,
+					nodemask_t *node_alloc_noretry)
+{
+	struct hugetlb_boot_alloc ba = {
+		.h			= h,
+		.node_alloc_noretry	= node_alloc_noretry,
+		.allocated		= ATOMIC_LONG_INIT(0),
+	};
+	struct padata_mt_job job = {
+		.thread_fn	= hugetlb_boot_alloc_fn,
+		.fn_arg		= &ba,
+		.start		= 0,
+		.size		= h->max_huge_pages,
+		.align		= 1,
+		/* enough pages per chunk to amortize claiming it */
+		.min_chunk	= 64,
+		.max_threads	= num_online_cpus(),
+	};
+
+	padata_do_multithreaded(&job);
+	return atomic_long_read(&ba.allocated);
+}
+
 static void __init hugetlb_hstate_alloc_pages(struct hstate *h)
 {
 	unsigned long i;
+	unsigned long start_jiffies = jiffies;
 	nodemask_t *node_alloc_noretry;
+	char buf[32];
 
 	if (!hstate_is_gigantic(h)) {
 		/*
@@ -2351,24 +2429,26 @@ static void __init hugetlb_hstate_alloc_pages(struct hstate *h)
 	if (node_alloc_noretry)
 		nodes_clear(*node_alloc_noretry);
 
-	for (i = 0; i < h->max_huge_pages; ++i) {
-		if (hstate_is_gigantic(h)) {
+	if (hstate_is_gigantic(h)) {
+		/* memblock allocations, long before any helper can run */
+		for (i = 0; i < h->max_huge_pages; ++i) {
 			if (!alloc_bootmem_huge_page(h))
 				break;
-		} else if (!alloc_pool_huge_page(h,
-					 &node_states[N_MEMORY],
-					 node_alloc_noretry))
-			break;
-		cond_resched();
+			cond_resched();
+		}
+	} else {
+		i = hugetlb_alloc_boot_pages(h, node_alloc_noretry);
 	}
-	if (i < h->max_huge_pages) {
-		char buf[32];
 
-		string_get_size(huge_page_size(h), 1, STRING_UNITS_2, buf, 32);
+	string_get_size(huge_page_size(h), 1, STRING_UNITS_2, buf, 32);
+	if (i < h->max_huge_pages) {
 		pr_warn("HugeTLB: allocating %lu of page size %s failed.  Only allocated %lu hugepages.\n",
 			h->max_huge_pages, buf, i);
 		h->max_huge_pages = i;
 	}
+	if (i && !hstate_is_gigantic(h))
+		pr_info("HugeTLB: allocating %lu pages of size %s took %ums\n",
+			i, buf, jiffies_to_msecs(jiffies - start_jiffies));
 
 	kfree(node_alloc_noretry);
 }
@@ -1042,6 +1042,9 @@ static void collapse_huge_page(struct mm_struct *mm,
 	/* check if the pmd is still valid */
 	if (mm_find_pmd(mm, address) != pmd)
 		goto out;
+	/* fork may have shared the table while we dropped mmap_sem */
+	if (pte_table_shared(mm, *pmd))
+		goto out;
 
 	vm_write_begin(vma);
 	anon_vma_lock_write(vma->anon_vma);
@@ -1154,6 +1157,11 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		result = SCAN_PMD_NULL;
 		goto out;
 	}
+	/* collapsing would free a table other mms still map */
+	if (pte_table_shared(mm, *pmd)) {
+		result = SCAN_FAIL;
+		goto out;
+	}
 
 	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
@@ -1057,6 +1057,9 @@ static int write_protect_page(struct vm_area_struct *vma, struct page *page,
 		goto out_mn;
 	if (WARN_ONCE(!pvmw.pte, "Unexpected PMD mapping?"))
 		goto out_unlock;
+	/* see try_to_unmap_one() */
+	if (pte_table_shared(mm, *pvmw.pmd))
+		goto out_unlock;
 
 	if (pte_write(*pvmw.pte) || pte_dirty(*pvmw.pte) ||
 	    (pte_protnone(*pvmw.pte) && pte_savedwrite(*pvmw.pte)) ||
@@ -885,6 +885,221 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	return 0;
 }
 
+#ifdef CONFIG_FORK_SHARED_PTE
+/*
+ * With MMF_FORK_SHARE_PTE set, fork hands the child the parent's pte tables
+ * for private anonymous memory instead of copying them: every pte is write
+ * protected, the table's pt_share_count is raised and the child's pmd simply
+ * points at the same table.  The page references and mapcounts held by the
+ * ptes belong to the table and are not duplicated, only the child's rss is.
+ *
+ * A shared table is never modified.  Whatever would change one of its ptes
+ * first gives the mm a private copy with pte_table_unshare(), taking page
+ * references for the copy, and rmap walkers that can't do that back off.
+ * Only none and present ptes are ever found in a shared table.  All sharers
+ * lock the split ptlock embedded in the table, which serializes sharing,
+ * unsharing and dropping a table across mms.
+ */
+static bool pte_table_share(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+			    pmd_t *dst_pmd, pmd_t *src_pmd,
+			    struct vm_area_struct *vma, unsigned long addr,
+			    unsigned long end)
+{
+	int rss[NR_MM_COUNTERS];
+	pte_t *orig_pte, *pte;
+	struct page *page;
+	spinlock_t *ptl;
+
+	if (!USE_SPLIT_PTE_PTLOCKS ||
+	    !test_bit(MMF_FORK_SHARE_PTE, &src_mm->flags))
+		return false;
+	if (!vma_is_anonymous(vma) || !is_cow_mapping(vma->vm_flags) ||
+	    userfaultfd_armed(vma))
+		return false;
+	/* The child must map the whole table, or it'd see pages it shouldn't */
+	if ((addr & ~PMD_MASK) || end - addr != PMD_SIZE)
+		return false;
+
+	/* Before the table can be seen shared, see pte_table_shared() */
+	set_bit(MMF_HAS_SHARED_PTE, &src_mm->flags);
+	set_bit(MMF_HAS_SHARED_PTE, &dst_mm->flags);
+
+	init_rss_vec(rss);
+	orig_pte = pte = pte_offset_map_lock(src_mm, src_pmd, addr, &ptl);
+	do {
+		pte_t entry = *pte;
+
+		if (pte_none(entry))
+			continue;
+		/* swap and migration entries would need their own counts */
+		if (!pte_present(entry) || pte_devmap(entry))
+			goto fail;
+		page = vm_normal_page(vma, addr, entry);
+		if (page)
+			rss[mm_counter(page)]++;
+		if (pte_write(entry))
+			ptep_set_wrprotect(src_mm, addr, pte);
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+
+	atomic_inc(&pmd_page(*src_pmd)->pt_share_count);
+	pte_unmap_unlock(orig_pte, ptl);
+
+	mm_inc_nr_ptes(dst_mm);
+	pmd_populate(dst_mm, dst_pmd, pmd_pgtable(*src_pmd));
+	add_mm_rss_vec(dst_mm, rss);
+	return true;
+
+fail:
+	pte_unmap_unlock(orig_pte, ptl);
+	return false;
+}
+
+/*
+ * Replace the shared pte table at @pmd with a private copy for this mm.
+ * The copy keeps the ptes write protected, so the fault that follows still
+ * goes through COW.
+ */
+int __pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = addr & PMD_MASK;
+	pmd_t pmdval = READ_ONCE(*pmd);
+	pte_t *src, *dst;
+	spinlock_t *ptl;
+	pgtable_t new;
+	int i;
+
+	new = pte_alloc_one(mm);
+	if (!new)
+		return -ENOMEM;
+
+	ptl = pte_lockptr(mm, &pmdval);
+	spin_lock(ptl);
+	/*
+	 * Another thread of ours may have unshared or dropped the table, or
+	 * every other mm let go of it and it is ours alone again.
+	 */
+	if (!pmd_same(*pmd, pmdval) || !pte_table_shared(mm, pmdval)) {
+		spin_unlock(ptl);
+		pte_free(mm, new);
+		return 0;
+	}
+
+	src = pte_offset_map(&pmdval, start);
+	dst = (pte_t *)page_address(new);
+	for (i = 0, addr = start; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		pte_t entry = src[i];
+		struct page *page;
+
+		if (pte_none(entry))
+			continue;
+		page = vm_normal_page(vma, addr, entry);
+		if (page) {
+			get_page(page);
+			page_dup_rmap(page, false);
+		}
+		set_pte_at(mm, addr, dst + i, entry);
+	}
+	pte_unmap(src);
+	atomic_dec(&pmd_page(pmdval)->pt_share_count);
+
+	smp_wmb(); /* See comment in __pte_alloc() */
+	pmd_populate(mm, pmd, new);
+	spin_unlock(ptl);
+
+	/* Nothing of ours may keep walking the table another mm now owns */
+	flush_tlb_range(vma, start, start + PMD_SIZE);
+	return 0;
+}
+
+int __pte_table_unshare_range(struct vm_area_struct *vma,
+			      unsigned long start, unsigned long end)
+{
+	unsigned long addr = start, next;
+	pmd_t *pmd;
+	int err;
+
+	do {
+		next = pmd_addr_end(addr, end);
+		pmd = mm_find_pmd(vma->vm_mm, addr);
+		if (pmd) {
+			err = pte_table_unshare(vma, pmd, addr);
+			if (err)
+				return err;
+		}
+		cond_resched();
+	} while (addr = next, addr != end);
+
+	return 0;
+}
+
+/*
+ * Unmapping a whole shared table only drops this mm's use of it: the pages
+ * stay mapped for the other sharers, which hold the references.  Returns
+ * false if [@addr, @end) doesn't cover the table or it is no longer shared.
+ */
+static bool pte_table_drop(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			   pmd_t *pmd, unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = tlb->mm;
+	pmd_t pmdval = READ_ONCE(*pmd);
+	unsigned long start = addr;
+	int rss[NR_MM_COUNTERS];
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int i;
+
+	if ((start & ~PMD_MASK) || end - start != PMD_SIZE)
+		return false;
+
+	ptl = pte_lockptr(mm, &pmdval);
+	spin_lock(ptl);
+	if (!pmd_same(*pmd, pmdval) ||
+	    !atomic_add_unless(&pmd_page(pmdval)->pt_share_count, -1, 0)) {
+		spin_unlock(ptl);
+		return false;
+	}
+
+	init_rss_vec(rss);
+	pte = pte_offset_map(&pmdval, addr);
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		if (!pte_present(pte[i]))
+			continue;
+		page = vm_normal_page(vma, addr, pte[i]);
+		if (page)
+			rss[mm_counter(page)]--;
+	}
+	pte_unmap(pte);
+	pmd_clear(pmd);
+	spin_unlock(ptl);
+
+	add_mm_rss_vec(mm, rss);
+	mm_dec_nr_ptes(mm);
+	/* as for a freed table: no walk of ours may find it anymore */
+	tlb_flush_pmd_range(tlb, start, PMD_SIZE);
+	tlb->freed_tables = 1;
+	return true;
+}
+#else
+static inline bool pte_table_share(struct mm_struct *dst_mm,
+				   struct mm_struct *src_mm,
+				   pmd_t *dst_pmd, pmd_t *src_pmd,
+				   struct vm_area_struct *vma,
+				   unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline bool pte_table_drop(struct mmu_gather *tlb,
+				  struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long addr, unsigned long end)
+{
+	return false;
+}
+#endif
+
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -912,6 +1127,9 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (pte_table_share(dst_mm, src_mm, dst_pmd, src_pmd,
+				    vma, addr, next))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1226,6 +1444,17 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 * because MADV_DONTNEED holds the mmap_sem in read
 		 * mode.
 		 */
+		if (unlikely(pte_table_shared(tlb->mm, READ_ONCE(*pmd)))) {
+			if (pte_table_drop(tlb, vma, pmd, addr, next))
+				goto next;
+			/*
+			 * Partial unmap: zap a private copy.  The unmap can't
+			 * fail, so keep retrying the order-0 allocation the
+			 * way __GFP_NOFAIL would.
+			 */
+			while (pte_table_unshare(vma, pmd, addr))
+				cond_resched();
+		}
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
@@ -4373,6 +4602,10 @@ static vm_fault_t __handle_mm_fault(struct vm_area_struct *vma,
 		}
 	}
 
+	/* Any fault may change a pte, so it needs a table of its own */
+	if (unlikely(pte_table_unshare(vma, vmf.pmd, address)))
+		return VM_FAULT_OOM;
+
 	return handle_pte_fault(&vmf);
 }
 
@@ -4526,6 +4759,10 @@ int __handle_speculative_fault(struct mm_struct *mm, unsigned long address,
 		     is_swap_pmd(vmf.orig_pmd)))
 		goto out_walk;
 
+	/* Unsharing a pte table needs the mmap_sem */
+	if (unlikely(pte_table_shared(mm, vmf.orig_pmd)))
+		goto out_walk;
+
 	/*
 	 * The above does not allocate/instantiate page-tables because doing so
 	 * would lead to the possibility of instantiating page-tables after
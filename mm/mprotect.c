@@ -244,6 +244,12 @@ static inline unsigned long change_pmd_range(struct vm_area_struct *vma,
 			}
 			/* fall through, the trans huge pmd just split */
 		}
+		/*
+		 * NUMA hinting leaves pte tables shared by fork alone,
+		 * mprotect_fixup() unshared them before we got here.
+		 */
+		if (prot_numa && pte_table_shared(vma->vm_mm, *pmd))
+			goto next;
 		this_pages = change_pte_range(vma, pmd, addr, next, newprot,
 				 dirty_accountable, prot_numa);
 		pages += this_pages;
@@ -387,6 +393,10 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 		return 0;
 	}
 
+	error = pte_table_unshare_range(vma, start, end);
+	if (error)
+		return error;
+
 	/*
 	 * Do PROT_NONE PFN permission checks here when we can still
 	 * bail out without undoing a lot of state. This is a rather
@@ -1445,6 +1445,17 @@ static bool try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		/* Unexpected PMD-mapped THP? */
 		VM_BUG_ON_PAGE(!pvmw.pte, page);
 
+		/*
+		 * Clearing a pte in a table shared by fork would unmap the
+		 * page from every sharer, but only flush this mm's TLB.
+		 * The page stays until the table is unshared.
+		 */
+		if (pte_table_shared(mm, *pvmw.pmd)) {
+			ret = false;
+			page_vma_mapped_walk_done(&pvmw);
+			break;
+		}
+
 		subpage = page - page_to_pfn(page) + pte_pfn(*pvmw.pte);
 		address = pvmw.address;
 
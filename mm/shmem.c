@@ -258,6 +258,11 @@ bool vma_is_shmem(struct vm_area_struct *vma)
 	return vma->vm_ops == &shmem_vm_ops;
 }
 
+static struct offset_ctx *shmem_get_offset_ctx(struct inode *inode)
+{
+	return &SHMEM_I(inode)->dir_offsets;
+}
+
 static LIST_HEAD(shmem_swaplist);
 static DEFINE_MUTEX(shmem_swaplist_mutex);
 
@@ -2274,7 +2279,8 @@ static struct inode *shmem_get_inode(struct super_block *sb, const struct inode
 			/* Some things misbehave if size == 0 on a directory */
 			inode->i_size = 2 * BOGO_DIRENT_SIZE;
 			inode->i_op = &shmem_dir_inode_operations;
-			inode->i_fop = &simple_dir_operations;
+			inode->i_fop = &simple_offset_dir_operations;
+			simple_offset_init(&info->dir_offsets);
 			break;
 		case S_IFLNK:
 			/*
@@ -2896,7 +2902,10 @@ shmem_mknod(struct inode *dir, struct dentry *dentry, umode_t mode, dev_t dev)
 		if (error && error != -EOPNOTSUPP)
 			goto out_iput;
 
-		error = 0;
+		error = simple_offset_add(shmem_get_offset_ctx(dir), dentry);
+		if (error)
+			goto out_iput;
+
 		dir->i_size += BOGO_DIRENT_SIZE;
 		dir->i_ctime = dir->i_mtime = current_time(dir);
 		d_instantiate(dentry, inode);
@@ -2969,6 +2978,13 @@ static int shmem_link(struct dentry *old_dentry, struct inode *dir, struct dentr
 			goto out;
 	}
 
+	ret = simple_offset_add(shmem_get_offset_ctx(dir), dentry);
+	if (ret) {
+		if (inode->i_nlink)
+			shmem_free_inode(inode->i_sb);
+		goto out;
+	}
+
 	dir->i_size += BOGO_DIRENT_SIZE;
 	inode->i_ctime = dir->i_ctime = dir->i_mtime = current_time(inode);
 	inc_nlink(inode);
@@ -2986,6 +3002,8 @@ static int shmem_unlink(struct inode *dir, struct dentry *dentry)
 	if (inode->i_nlink > 1 && !S_ISDIR(inode->i_mode))
 		shmem_free_inode(inode->i_sb);
 
+	simple_offset_remove(shmem_get_offset_ctx(dir), dentry);
+
 	dir->i_size -= BOGO_DIRENT_SIZE;
 	inode->i_ctime = dir->i_ctime = dir->i_mtime = current_time(inode);
 	drop_nlink(inode);
@@ -3061,22 +3079,33 @@ static int shmem_rename2(struct inode *old_dir, struct dentry *old_dentry, struc
 {
 	struct inode *inode = d_inode(old_dentry);
 	int they_are_dirs = S_ISDIR(inode->i_mode);
+	int error;
 
 	if (flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE | RENAME_WHITEOUT))
 		return -EINVAL;
 
-	if (flags & RENAME_EXCHANGE)
+	if (flags & RENAME_EXCHANGE) {
+		error = simple_offset_rename_exchange(old_dir, old_dentry,
+						      new_dir, new_dentry);
+		if (error)
+			return error;
 		return shmem_exchange(old_dir, old_dentry, new_dir, new_dentry);
+	}
 
 	if (!simple_empty(new_dentry))
 		return -ENOTEMPTY;
 
-	if (flags & RENAME_WHITEOUT) {
-		int error;
+	error = simple_offset_rename(old_dir, old_dentry, new_dir);
+	if (error)
+		return error;
 
+	if (flags & RENAME_WHITEOUT) {
 		error = shmem_whiteout(old_dir, old_dentry);
-		if (error)
+		if (error) {
+			/* The rename doesn't happen, move the offset back. */
+			simple_offset_rename(new_dir, old_dentry, old_dir);
 			return error;
+		}
 	}
 
 	if (d_really_is_positive(new_dentry)) {
@@ -3147,6 +3176,11 @@ static int shmem_symlink(struct inode *dir, struct dentry *dentry, const char *s
 		unlock_page(page);
 		put_page(page);
 	}
+	error = simple_offset_add(shmem_get_offset_ctx(dir), dentry);
+	if (error) {
+		iput(inode);
+		return error;
+	}
 	dir->i_size += BOGO_DIRENT_SIZE;
 	dir->i_ctime = dir->i_mtime = current_time(dir);
 	d_instantiate(dentry, inode);
@@ -3777,6 +3811,8 @@ static void shmem_destroy_inode(struct inode *inode)
 {
 	if (S_ISREG(inode->i_mode))
 		mpol_free_shared_policy(&SHMEM_I(inode)->policy);
+	if (S_ISDIR(inode->i_mode))
+		simple_offset_destroy(&SHMEM_I(inode)->dir_offsets);
 }
 
 static void shmem_init_inode(void *foo)
@@ -3846,6 +3882,7 @@ static const struct inode_operations shmem_dir_inode_operations = {
 	.rename		= shmem_rename2,
 	.tmpfile	= shmem_tmpfile,
 #endif
+	.get_offset_ctx	= shmem_get_offset_ctx,
 #ifdef CONFIG_TMPFS_XATTR
 	.listxattr	= shmem_listxattr,
 #endif
@@ -563,6 +563,10 @@ static __always_inline ssize_t __mcopy_atomic(struct mm_struct *dst_mm,
 			err = -EFAULT;
 			break;
 		}
+		if (unlikely(pte_table_unshare(dst_vma, dst_pmd, dst_addr))) {
+			err = -ENOMEM;
+			break;
+		}
 
 		BUG_ON(pmd_none(*dst_pmd));
 		BUG_ON(pmd_trans_huge(*dst_pmd));
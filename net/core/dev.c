@@ -5956,6 +5956,8 @@ EXPORT_SYMBOL(__skb_gro_checksum_complete);
 static void net_rps_send_ipi(struct softnet_data *remsd)
 {
 #ifdef CONFIG_RPS
+	/* One mask IPI for all the remote CPUs rather than one each */
+	smp_call_function_plug();
 	while (remsd) {
 		struct softnet_data *next = remsd->rps_ipi_next;
 
@@ -5963,6 +5965,7 @@ static void net_rps_send_ipi(struct softnet_data *remsd)
 			smp_call_function_single_async(remsd->cpu, &remsd->csd);
 		remsd = next;
 	}
+	smp_call_function_unplug();
 #endif
 }
 
@@ -76,6 +76,8 @@
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <linux/inetdevice.h>
+#include <linux/bpf.h>
+#include <linux/nsproxy.h>
 
 #include <crypto/hash.h>
 #include <linux/scatterlist.h>
@@ -2180,6 +2182,24 @@ EXPORT_SYMBOL(tcp_v4_destroy_sock);
 #ifdef CONFIG_PROC_FS
 /* Proc filesystem TCP sock list dumping. */
 
+static struct tcp_seq_afinfo *tcp_seq_get_afinfo(struct seq_file *seq)
+{
+#ifdef CONFIG_BPF_SYSCALL
+	struct tcp_iter_state *st = seq->private;
+
+	if (st->bpf_seq_afinfo)
+		return st->bpf_seq_afinfo;
+#endif
+	return PDE_DATA(file_inode(seq->file));
+}
+
+/* AF_UNSPEC walks the sockets of both families */
+static bool tcp_seq_family_match(const struct tcp_seq_afinfo *afinfo,
+				 const struct sock *sk)
+{
+	return afinfo->family == AF_UNSPEC || sk->sk_family == afinfo->family;
+}
+
 /*
  * Get next listener socket follow cur.  If cur is NULL, get first socket
  * starting from bucket given in st->bucket; when st->bucket is zero the
@@ -2187,7 +2207,7 @@ EXPORT_SYMBOL(tcp_v4_destroy_sock);
  */
 static void *listening_get_next(struct seq_file *seq, void *cur)
 {
-	struct tcp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	struct tcp_seq_afinfo *afinfo = tcp_seq_get_afinfo(seq);
 	struct tcp_iter_state *st = seq->private;
 	struct net *net = seq_file_net(seq);
 	struct inet_listen_hashbucket *ilb;
@@ -2211,7 +2231,7 @@ static void *listening_get_next(struct seq_file *seq, void *cur)
 	sk_nulls_for_each_from(sk, node) {
 		if (!net_eq(sock_net(sk), net))
 			continue;
-		if (sk->sk_family == afinfo->family)
+		if (tcp_seq_family_match(afinfo, sk))
 			return sk;
 	}
 	spin_unlock(&ilb->lock);
@@ -2248,7 +2268,7 @@ static inline bool empty_bucket(const struct tcp_iter_state *st)
  */
 static void *established_get_first(struct seq_file *seq)
 {
-	struct tcp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	struct tcp_seq_afinfo *afinfo = tcp_seq_get_afinfo(seq);
 	struct tcp_iter_state *st = seq->private;
 	struct net *net = seq_file_net(seq);
 	void *rc = NULL;
@@ -2265,7 +2285,7 @@ static void *established_get_first(struct seq_file *seq)
 
 		spin_lock_bh(lock);
 		sk_nulls_for_each(sk, node, &tcp_hashinfo.ehash[st->bucket].chain) {
-			if (sk->sk_family != afinfo->family ||
+			if (!tcp_seq_family_match(afinfo, sk) ||
 			    !net_eq(sock_net(sk), net)) {
 				continue;
 			}
@@ -2280,7 +2300,7 @@ static void *established_get_first(struct seq_file *seq)
 
 static void *established_get_next(struct seq_file *seq, void *cur)
 {
-	struct tcp_seq_afinfo *afinfo = PDE_DATA(file_inode(seq->file));
+	struct tcp_seq_afinfo *afinfo = tcp_seq_get_afinfo(seq);
 	struct sock *sk = cur;
 	struct hlist_nulls_node *node;
 	struct tcp_iter_state *st = seq->private;
@@ -2292,7 +2312,7 @@ static void *established_get_next(struct seq_file *seq, void *cur)
 	sk = sk_nulls_next(sk);
 
 	sk_nulls_for_each_from(sk, node) {
-		if (sk->sk_family == afinfo->family &&
+		if (tcp_seq_family_match(afinfo, sk) &&
 		    net_eq(sock_net(sk), net))
 			return sk;
 	}
@@ -2614,6 +2634,113 @@ void tcp4_proc_exit(void)
 {
 	unregister_pernet_subsys(&tcp4_net_ops);
 }
+
+#ifdef CONFIG_BPF_SYSCALL
+static void bpf_iter_tcp_fill_sock(struct seq_file *seq, struct sock *sk,
+				   struct bpf_iter_tcp *ctx)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	int state = inet_sk_state_load(sk);
+
+	ctx->state = state;
+	ctx->uid = from_kuid_munged(seq_user_ns(seq), sock_i_uid(sk));
+	ctx->ino = sock_i_ino(sk);
+	ctx->tx_queue = READ_ONCE(tp->write_seq) - tp->snd_una;
+	/* same as get_tcp4_sock() */
+	if (state == TCP_LISTEN)
+		ctx->rx_queue = sk->sk_ack_backlog;
+	else
+		ctx->rx_queue = max_t(int, READ_ONCE(tp->rcv_nxt) -
+					   READ_ONCE(tp->copied_seq), 0);
+	ctx->snd_cwnd = tp->snd_cwnd;
+}
+
+static int bpf_iter_tcp_seq_show(struct seq_file *seq, void *v)
+{
+	BPF_ITER_CTX(bpf_iter_tcp) kctx = {};
+	struct bpf_iter_tcp *ctx = &kctx.ctx;
+	struct sock_common *skc = v;
+	struct sock *sk = v;
+
+	if (v == SEQ_START_TOKEN)
+		return 0;
+
+	ctx->family = skc->skc_family;
+	ctx->src_port = skc->skc_num;
+	ctx->dst_port = ntohs(skc->skc_dport);
+	if (skc->skc_family == AF_INET) {
+		ctx->src_ip4 = skc->skc_rcv_saddr;
+		ctx->dst_ip4 = skc->skc_daddr;
+	}
+#if IS_ENABLED(CONFIG_IPV6)
+	else {
+		memcpy(ctx->src_ip6, &skc->skc_v6_rcv_saddr,
+		       sizeof(ctx->src_ip6));
+		memcpy(ctx->dst_ip6, &skc->skc_v6_daddr, sizeof(ctx->dst_ip6));
+	}
+#endif
+
+	if (skc->skc_state == TCP_TIME_WAIT) {
+		ctx->state = inet_twsk(sk)->tw_substate;
+	} else if (skc->skc_state == TCP_NEW_SYN_RECV) {
+		ctx->state = TCP_SYN_RECV;
+		ctx->uid = from_kuid_munged(seq_user_ns(seq),
+				sock_i_uid(inet_reqsk(sk)->rsk_listener));
+	} else {
+		bpf_iter_tcp_fill_sock(seq, sk, ctx);
+	}
+
+	bpf_iter_run_prog(seq, &kctx.meta);
+	return 0;
+}
+
+static const struct seq_operations bpf_iter_tcp_seq_ops = {
+	.show		= bpf_iter_tcp_seq_show,
+	.start		= tcp_seq_start,
+	.next		= tcp_seq_next,
+	.stop		= tcp_seq_stop,
+};
+
+static struct tcp_seq_afinfo bpf_iter_tcp_seq_afinfo = {
+	.family		= AF_UNSPEC,
+};
+
+/* The sockets of the netns of the task creating the iterator */
+static int bpf_iter_tcp_init(void *priv_data)
+{
+	struct tcp_iter_state *st = priv_data;
+
+#ifdef CONFIG_NET_NS
+	st->p.net = get_net(current->nsproxy->net_ns);
+#endif
+	st->bpf_seq_afinfo = &bpf_iter_tcp_seq_afinfo;
+	return 0;
+}
+
+static void bpf_iter_tcp_fini(void *priv_data)
+{
+#ifdef CONFIG_NET_NS
+	struct tcp_iter_state *st = priv_data;
+
+	put_net(st->p.net);
+#endif
+}
+
+static const struct bpf_iter_reg bpf_iter_tcp_reg_info = {
+	.attach_type		= BPF_ITER_TCP,
+	.seq_ops		= &bpf_iter_tcp_seq_ops,
+	.init_seq_private	= bpf_iter_tcp_init,
+	.fini_seq_private	= bpf_iter_tcp_fini,
+	.seq_priv_size		= sizeof(struct tcp_iter_state),
+	.ctx_size		= sizeof(struct bpf_iter_tcp),
+};
+
+static void __init bpf_iter_tcp_register(void)
+{
+	if (bpf_iter_reg_target(&bpf_iter_tcp_reg_info))
+		pr_warn("Warning: could not register the tcp bpf iterator\n");
+}
+#endif /* CONFIG_BPF_SYSCALL */
 #endif /* CONFIG_PROC_FS */
 
 struct proto tcp_prot = {
@@ -2811,4 +2938,8 @@ void __init tcp_v4_init(void)
 {
 	if (register_pernet_subsys(&tcp_sk_ops))
 		panic("Failed to create the TCP control socket.\n");
+
+#if defined(CONFIG_PROC_FS) && defined(CONFIG_BPF_SYSCALL)
+	bpf_iter_tcp_register();
+#endif
 }
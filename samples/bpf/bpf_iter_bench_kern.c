@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/version.h>
+#include <linux/socket.h>
+#include <uapi/linux/bpf.h>
+#include "bpf_helpers.h"
+
+/* Not in bpf_helpers.h yet. */
+static int (*bpf_seq_write)(void *ctx, const void *data, __u32 len) =
+	(void *) BPF_FUNC_seq_write;
+
+/* Keep in sync with bpf_iter_bench_user.c */
+struct task_rec {
+	__u32 pid;
+	__u32 tgid;
+	__u32 ppid;
+	__u32 uid;
+	__u32 state;
+	__u32 pad;
+	__u64 utime;
+	__u64 stime;
+	char comm[16];
+};
+
+struct tcp_rec {
+	__u32 family;
+	__u32 state;
+	__u32 src_port;
+	__u32 dst_port;
+	__u32 uid;
+	__u32 tx_queue;
+	__u32 rx_queue;
+	__u32 pad;
+	__u64 ino;
+	__u32 src[4];
+	__u32 dst[4];
+};
+
+SEC("iter/task")
+int dump_task(struct bpf_iter_task *ctx)
+{
+	struct task_rec rec = {
+		.pid	= ctx->pid,
+		.tgid	= ctx->tgid,
+		.ppid	= ctx->ppid,
+		.uid	= ctx->uid,
+		.state	= ctx->state,
+		.utime	= ctx->utime,
+		.stime	= ctx->stime,
+	};
+
+	__builtin_memcpy(rec.comm, ctx->comm, sizeof(rec.comm));
+	bpf_seq_write(ctx, &rec, sizeof(rec));
+	return 0;
+}
+
+SEC("iter/tcp")
+int dump_tcp(struct bpf_iter_tcp *ctx)
+{
+	struct tcp_rec rec = {
+		.family		= ctx->family,
+		.state		= ctx->state,
+		.src_port	= ctx->src_port,
+		.dst_port	= ctx->dst_port,
+		.uid		= ctx->uid,
+		.tx_queue	= ctx->tx_queue,
+		.rx_queue	= ctx->rx_queue,
+		.ino		= ctx->ino,
+	};
+	int i;
+
+	if (ctx->family == AF_INET) {
+		rec.src[0] = ctx->src_ip4;
+		rec.dst[0] = ctx->dst_ip4;
+	} else {
+#pragma unroll
+		for (i = 0; i < 4; i++) {
+			rec.src[i] = ctx->src_ip6[i];
+			rec.dst[i] = ctx->dst_ip6[i];
+		}
+	}
+
+	bpf_seq_write(ctx, &rec, sizeof(rec));
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
+u32 _version SEC("version") = LINUX_VERSION_CODE;
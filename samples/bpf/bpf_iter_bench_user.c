@@ -0,0 +1,324 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Cost of dumping all tasks and all TCP sockets with BPF iterators vs.
+ * walking /proc the way ps and netstat do.
+ *
+ * The iterator programs write a compact binary record per object, which
+ * is read back in large chunks from the iterator fd.  The /proc side opens
+ * and parses /proc/<pid>/task/<tid>/stat for every thread, and
+ * /proc/net/tcp and /proc/net/tcp6 for the sockets, to get the same
+ * fields.  Each dump is repeated and the average time per dump reported,
+ * with the number of objects each side saw.
+ *
+ * Usage: bpf_iter_bench [-r repeats]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include "libbpf.h"
+
+/* Keep in sync with bpf_iter_bench_kern.c */
+struct task_rec {
+	__u32 pid;
+	__u32 tgid;
+	__u32 ppid;
+	__u32 uid;
+	__u32 state;
+	__u32 pad;
+	__u64 utime;
+	__u64 stime;
+	char comm[16];
+};
+
+struct tcp_rec {
+	__u32 family;
+	__u32 state;
+	__u32 src_port;
+	__u32 dst_port;
+	__u32 uid;
+	__u32 tx_queue;
+	__u32 rx_queue;
+	__u32 pad;
+	__u64 ino;
+	__u32 src[4];
+	__u32 dst[4];
+};
+
+static char buf[1 << 16];
+static int repeats = 100;
+
+static __u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* libbpf doesn't know about BPF_LINK_CREATE and BPF_ITER_CREATE yet. */
+static int attach_prog(struct bpf_program *prog, enum bpf_attach_type type)
+{
+	union bpf_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = bpf_program__fd(prog);
+	attr.link_create.attach_type = type;
+	fd = syscall(__NR_bpf, BPF_LINK_CREATE, &attr, sizeof(attr));
+	if (fd < 0) {
+		perror("BPF_LINK_CREATE");
+		exit(1);
+	}
+	return fd;
+}
+
+static int iter_create(int link_fd)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.iter_create.link_fd = link_fd;
+	return syscall(__NR_bpf, BPF_ITER_CREATE, &attr, sizeof(attr));
+}
+
+/* Returns the number of records read, or -1 on failure. */
+static long iter_dump(int link_fd, size_t rec_size)
+{
+	long bytes = 0;
+	ssize_t len;
+	int fd;
+
+	fd = iter_create(link_fd);
+	if (fd < 0)
+		return -1;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		bytes += len;
+	close(fd);
+
+	return len < 0 ? -1 : bytes / (long)rec_size;
+}
+
+static int proc_parse_task(int pid, const char *tid)
+{
+	unsigned long utime, stime;
+	struct task_rec rec;
+	char path[64], *p;
+	struct stat st;
+	int fd, ppid;
+	ssize_t len;
+	char state;
+
+	snprintf(path, sizeof(path), "/proc/%d/task/%s", pid, tid);
+	if (stat(path, &st))
+		return 0;
+
+	strcat(path, "/stat");
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+
+	/* the comm may have spaces and parentheses of its own */
+	p = strrchr(buf, ')');
+	if (!p || sscanf(p + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+			 "%lu %lu", &state, &ppid, &utime, &stime) != 4)
+		return 0;
+
+	rec.pid = atoi(tid);
+	rec.tgid = pid;
+	rec.ppid = ppid;
+	rec.uid = st.st_uid;
+	rec.state = state;
+	rec.utime = utime;
+	rec.stime = stime;
+	return rec.pid != 0;
+}
+
+static long proc_dump_tasks(void)
+{
+	struct dirent *pde, *tde;
+	DIR *proc, *task;
+	char path[64];
+	long nr = 0;
+	int pid;
+
+	proc = opendir("/proc");
+	if (!proc)
+		return -1;
+
+	while ((pde = readdir(proc))) {
+		pid = atoi(pde->d_name);
+		if (pid <= 0)
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%d/task", pid);
+		task = opendir(path);
+		if (!task)
+			continue;
+		while ((tde = readdir(task)))
+			if (tde->d_name[0] != '.')
+				nr += proc_parse_task(pid, tde->d_name);
+		closedir(task);
+	}
+	closedir(proc);
+	return nr;
+}
+
+static long proc_parse_tcp(const char *path)
+{
+	char line[256], src[33], dst[33];
+	struct tcp_rec rec;
+	unsigned long ino;
+	long nr = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	/* skip the header */
+	if (!fgets(line, sizeof(line), f))
+		goto out;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%*d: %32[0-9A-F]:%X %32[0-9A-F]:%X %X %X:%X "
+			   "%*X:%*X %*X %u %*d %lu", src, &rec.src_port, dst,
+			   &rec.dst_port, &rec.state, &rec.tx_queue,
+			   &rec.rx_queue, &rec.uid, &ino) != 9)
+			continue;
+		rec.ino = ino;
+		nr++;
+	}
+out:
+	fclose(f);
+	return nr;
+}
+
+static long proc_dump_tcp(void)
+{
+	return proc_parse_tcp("/proc/net/tcp") +
+	       proc_parse_tcp("/proc/net/tcp6");
+}
+
+static void report(const char *what, __u64 ns, long nr)
+{
+	if (nr < 0) {
+		printf("%-16s: failed\n", what);
+		return;
+	}
+	printf("%-16s: %10.1f us/dump, %6ld objects", what,
+	       (double)ns / repeats / 1000, nr);
+	if (nr)
+		printf(", %7.1f ns/object", (double)ns / repeats / nr);
+	printf("\n");
+}
+
+static void bench_iter(const char *what, int link_fd, size_t rec_size)
+{
+	__u64 start;
+	long nr = 0;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < repeats && nr >= 0; i++)
+		nr = iter_dump(link_fd, rec_size);
+	report(what, now_ns() - start, nr);
+}
+
+static void bench_proc(const char *what, long (*dump)(void))
+{
+	__u64 start;
+	long nr = 0;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < repeats && nr >= 0; i++)
+		nr = dump();
+	report(what, now_ns() - start, nr);
+}
+
+static struct bpf_program *find_prog(struct bpf_object *obj,
+				     const char *title,
+				     enum bpf_attach_type type)
+{
+	struct bpf_program *prog;
+
+	prog = bpf_object__find_program_by_title(obj, title);
+	if (!prog) {
+		fprintf(stderr, "finding %s failed\n", title);
+		exit(1);
+	}
+	bpf_program__set_type(prog, BPF_PROG_TYPE_ITER);
+	bpf_program__set_expected_attach_type(prog, type);
+	return prog;
+}
+
+int main(int argc, char **argv)
+{
+	struct rlimit r = {RLIM_INFINITY, RLIM_INFINITY};
+	struct bpf_program *task_prog, *tcp_prog;
+	int opt, task_link, tcp_link;
+	struct bpf_object *obj;
+	char filename[256];
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r repeats]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (repeats <= 0)
+		return 1;
+
+	if (setrlimit(RLIMIT_MEMLOCK, &r)) {
+		perror("setrlimit(RLIMIT_MEMLOCK)");
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+	obj = bpf_object__open(filename);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "opening %s failed\n", filename);
+		return 1;
+	}
+
+	task_prog = find_prog(obj, "iter/task", BPF_ITER_TASK);
+	tcp_prog = find_prog(obj, "iter/tcp", BPF_ITER_TCP);
+	if (bpf_object__load(obj)) {
+		fprintf(stderr, "loading %s failed\n", filename);
+		return 1;
+	}
+
+	task_link = attach_prog(task_prog, BPF_ITER_TASK);
+	tcp_link = attach_prog(tcp_prog, BPF_ITER_TCP);
+
+	printf("%d dumps each\n", repeats);
+	bench_iter("tasks, iterator", task_link, sizeof(struct task_rec));
+	bench_proc("tasks, /proc", proc_dump_tasks);
+	bench_iter("tcp, iterator", tcp_link, sizeof(struct tcp_rec));
+	bench_proc("tcp, /proc", proc_dump_tcp);
+
+	close(tcp_link);
+	close(task_link);
+	bpf_object__close(obj);
+	return 0;
+}
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/version.h>
+#include <linux/sched.h>
+#include <linux/fdtable.h>
+#include <linux/fs.h>
+#include <uapi/linux/bpf.h>
+#include "bpf_helpers.h"
+
+/* Not in bpf_helpers.h yet. */
+static void *(*bpf_task_storage_get)(void *map, __u32 pid, void *value,
+				     __u64 flags) =
+	(void *) BPF_FUNC_task_storage_get;
+static void *(*bpf_inode_storage_get)(void *map, int fd, void *value,
+				      __u64 flags) =
+	(void *) BPF_FUNC_inode_storage_get;
+
+#define _(P) ({typeof(P) val = 0; bpf_probe_read(&val, sizeof(val), &P); val; })
+
+/* Keep in sync with local_storage_bench_user.c */
+enum {
+	MODE_NONE,
+	MODE_TASK_STORAGE,
+	MODE_TASK_HASH,
+	MODE_INODE_STORAGE,
+	MODE_INODE_HASH,
+	NR_MODES,
+};
+
+struct bench_config {
+	__u32 mode;
+	__u32 cookie;
+};
+
+struct syscalls_enter_lseek_args {
+	unsigned long long unused;
+	long syscall_nr;
+	long fd;
+	long offset;
+	long whence;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, struct bench_config);
+	__uint(max_entries, 1);
+} config SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, __u64);
+} task_store SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, __u32);
+	__type(value, __u64);
+	__uint(max_entries, 65536);
+} task_hash SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_INODE_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, __u64);
+} inode_store SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, __u64);
+	__type(value, __u64);
+	__uint(max_entries, 65536);
+} inode_hash SEC(".maps");
+
+static __always_inline void hash_inc(void *map, void *key)
+{
+	__u64 *value, init_val = 1;
+
+	value = bpf_map_lookup_elem(map, key);
+	if (value)
+		__sync_fetch_and_add(value, 1);
+	else
+		bpf_map_update_elem(map, key, &init_val, BPF_NOEXIST);
+}
+
+/* What a program keying a hash by inode number has to go through to
+ * get from an fd to the inode.
+ */
+static __always_inline __u64 fd_to_ino(int fd)
+{
+	struct task_struct *task = (void *)bpf_get_current_task();
+	struct files_struct *files = _(task->files);
+	struct fdtable *fdt = _(files->fdt);
+	struct file **fds = _(fdt->fd);
+	struct file *file = _(fds[fd]);
+	struct inode *inode = _(file->f_inode);
+
+	return _(inode->i_ino);
+}
+
+SEC("tracepoint/syscalls/sys_enter_lseek")
+int bench_lseek(struct syscalls_enter_lseek_args *ctx)
+{
+	struct bench_config *cfg;
+	__u32 key = 0;
+	__u64 *value;
+	__u64 ino;
+	__u32 tid;
+
+	cfg = bpf_map_lookup_elem(&config, &key);
+	/* only the benchmark's own calls */
+	if (!cfg || ctx->offset != cfg->cookie)
+		return 0;
+
+	switch (cfg->mode) {
+	case MODE_TASK_STORAGE:
+		value = bpf_task_storage_get(&task_store, 0, NULL,
+					     BPF_LOCAL_STORAGE_GET_F_CREATE);
+		if (value)
+			__sync_fetch_and_add(value, 1);
+		break;
+	case MODE_TASK_HASH:
+		tid = (__u32)bpf_get_current_pid_tgid();
+		hash_inc(&task_hash, &tid);
+		break;
+	case MODE_INODE_STORAGE:
+		value = bpf_inode_storage_get(&inode_store, ctx->fd, NULL,
+					      BPF_LOCAL_STORAGE_GET_F_CREATE);
+		if (value)
+			__sync_fetch_and_add(value, 1);
+		break;
+	case MODE_INODE_HASH:
+		ino = fd_to_ino(ctx->fd);
+		hash_inc(&inode_hash, &ino);
+		break;
+	}
+
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
+u32 _version SEC("version") = LINUX_VERSION_CODE;
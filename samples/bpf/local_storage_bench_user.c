@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per-event cost of keeping per-task and per-inode state in task and
+ * inode local storage vs. in hash maps keyed by tid and inode number.
+ *
+ * A program on the lseek() syscall tracepoint bumps a counter in the
+ * storage picked by the mode.  For each mode, a number of processes call
+ * lseek() on a file of their own in a loop and report the time per call,
+ * which is compared against the same loop with the program doing nothing.
+ * Once the processes have exited, the hash map entries they left behind
+ * are counted; the local storage went away with the tasks and inodes.
+ *
+ * Usage: local_storage_bench [-n iterations] [-p processes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include "libbpf.h"
+
+/* Keep in sync with local_storage_bench_kern.c */
+enum {
+	MODE_NONE,
+	MODE_TASK_STORAGE,
+	MODE_TASK_HASH,
+	MODE_INODE_STORAGE,
+	MODE_INODE_HASH,
+	NR_MODES,
+};
+
+struct bench_config {
+	__u32 mode;
+	__u32 cookie;
+};
+
+#define COOKIE	0x1ca1
+
+static const char * const mode_names[NR_MODES] = {
+	[MODE_NONE] = "none",
+	[MODE_TASK_STORAGE] = "task storage",
+	[MODE_TASK_HASH] = "tid hash",
+	[MODE_INODE_STORAGE] = "inode storage",
+	[MODE_INODE_HASH] = "inode hash",
+};
+
+static long iterations = 1000000;
+static int nr_procs = 1;
+
+static int config_fd, task_store_fd, task_hash_fd;
+static int inode_store_fd, inode_hash_fd;
+
+static __u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Check that the storage saw every call of this process. */
+static int check_storage(int mode, int fd)
+{
+	__u64 value = 0;
+	int key = fd;
+
+	switch (mode) {
+	case MODE_TASK_STORAGE:
+#ifdef __NR_pidfd_open
+		key = syscall(__NR_pidfd_open, getpid(), 0);
+		if (key < 0)
+			return 0;
+		if (bpf_map_lookup_elem(task_store_fd, &key, &value))
+			value = 0;
+		close(key);
+		break;
+#else
+		return 0;
+#endif
+	case MODE_INODE_STORAGE:
+		if (bpf_map_lookup_elem(inode_store_fd, &key, &value))
+			value = 0;
+		break;
+	default:
+		return 0;
+	}
+
+	if (value != iterations) {
+		fprintf(stderr, "%s: pid %d counted %llu of %ld calls\n",
+			mode_names[mode], getpid(), value, iterations);
+		return 1;
+	}
+	return 0;
+}
+
+static void run_child(int mode, int out)
+{
+	__u64 start, ns;
+	FILE *file;
+	long i;
+	int fd;
+
+	/* a file of its own, so that every process adds an inode */
+	file = tmpfile();
+	if (!file)
+		exit(1);
+	fd = fileno(file);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		lseek(fd, COOKIE, SEEK_SET);
+	ns = now_ns() - start;
+
+	if (write(out, &ns, sizeof(ns)) != sizeof(ns))
+		exit(1);
+	exit(check_storage(mode, fd));
+}
+
+/* Returns the average ns per call, or 0 on failure. */
+static double run_mode(int mode)
+{
+	struct bench_config cfg = { .mode = mode, .cookie = COOKIE };
+	__u64 ns, total = 0;
+	int pipefd[2];
+	int i, status, failed = 0;
+	__u32 key = 0;
+
+	if (bpf_map_update_elem(config_fd, &key, &cfg, BPF_ANY)) {
+		perror("bpf_map_update_elem");
+		return 0;
+	}
+	if (pipe(pipefd)) {
+		perror("pipe");
+		return 0;
+	}
+
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (!pid) {
+			close(pipefd[0]);
+			run_child(mode, pipefd[1]);
+		}
+	}
+	close(pipefd[1]);
+
+	for (i = 0; i < nr_procs; i++) {
+		if (read(pipefd[0], &ns, sizeof(ns)) != sizeof(ns))
+			failed = 1;
+		else
+			total += ns;
+	}
+	close(pipefd[0]);
+
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+
+	return failed ? 0 : (double)total / nr_procs / iterations;
+}
+
+static long count_entries(int fd, size_t key_size)
+{
+	char key[8], next_key[8];
+	void *prev_key = NULL;
+	long nr = 0;
+
+	while (bpf_map_get_next_key(fd, prev_key, next_key) == 0) {
+		memcpy(key, next_key, key_size);
+		prev_key = key;
+		nr++;
+	}
+	return nr;
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_prog_load_attr prog_load_attr = {
+		.prog_type = BPF_PROG_TYPE_TRACEPOINT,
+	};
+	struct rlimit r = {RLIM_INFINITY, RLIM_INFINITY};
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	struct bpf_link *link;
+	double ns[NR_MODES];
+	char filename[256];
+	int opt, prog_fd, i;
+
+	while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		case 'p':
+			nr_procs = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-p processes]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (iterations <= 0 || nr_procs <= 0)
+		return 1;
+
+	if (setrlimit(RLIMIT_MEMLOCK, &r)) {
+		perror("setrlimit(RLIMIT_MEMLOCK)");
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+	prog_load_attr.file = filename;
+	if (bpf_prog_load_xattr(&prog_load_attr, &obj, &prog_fd))
+		return 1;
+
+	config_fd = bpf_object__find_map_fd_by_name(obj, "config");
+	task_store_fd = bpf_object__find_map_fd_by_name(obj, "task_store");
+	task_hash_fd = bpf_object__find_map_fd_by_name(obj, "task_hash");
+	inode_store_fd = bpf_object__find_map_fd_by_name(obj, "inode_store");
+	inode_hash_fd = bpf_object__find_map_fd_by_name(obj, "inode_hash");
+	if (config_fd < 0 || task_store_fd < 0 || task_hash_fd < 0 ||
+	    inode_store_fd < 0 || inode_hash_fd < 0) {
+		fprintf(stderr, "bpf_object__find_map_fd_by_name failed\n");
+		return 1;
+	}
+
+	prog = bpf_object__find_program_by_title(obj,
+			"tracepoint/syscalls/sys_enter_lseek");
+	if (!prog) {
+		fprintf(stderr, "finding the program failed\n");
+		return 1;
+	}
+	link = bpf_program__attach_tracepoint(prog, "syscalls",
+					      "sys_enter_lseek");
+	if (libbpf_get_error(link)) {
+		fprintf(stderr, "attaching to sys_enter_lseek failed\n");
+		return 1;
+	}
+
+	printf("%d process(es), %ld lseek() calls each\n", nr_procs,
+	       iterations);
+
+	for (i = 0; i < NR_MODES; i++) {
+		ns[i] = run_mode(i);
+		if (!ns[i]) {
+			printf("%-14s: failed\n", mode_names[i]);
+			continue;
+		}
+		printf("%-14s: %8.1f ns/call", mode_names[i], ns[i]);
+		if (i != MODE_NONE && ns[MODE_NONE])
+			printf(", %+7.1f ns over none", ns[i] - ns[MODE_NONE]);
+		printf("\n");
+	}
+
+	printf("stale entries after exit: tid hash %ld, inode hash %ld\n",
+	       count_entries(task_hash_fd, sizeof(__u32)),
+	       count_entries(inode_hash_fd, sizeof(__u64)));
+
+	bpf_link__destroy(link);
+	bpf_object__close(obj);
+	return 0;
+}
@@ -95,6 +95,24 @@ struct bpf_map_def SEC("maps") lru_hash_lookup_map = {
 	.max_entries = MAX_ENTRIES,
 };
 
+/* Updated and deleted from every CPU, so that the LRU keeps evicting and
+ * freeing nodes of the common list.
+ */
+struct bpf_map_def SEC("maps") lru_hash_contention_map = {
+	.type = BPF_MAP_TYPE_LRU_HASH,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(long),
+	.max_entries = MAX_ENTRIES,
+};
+
+/* Only dumped from user space */
+struct bpf_map_def SEC("maps") hash_batch_dump_map = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(long),
+	.max_entries = 10000,
+};
+
 SEC("kprobe/sys_getuid")
 int stress_hmap(struct pt_regs *ctx)
 {
@@ -220,6 +238,12 @@ int stress_lru_hmap_alloc(struct pt_regs *ctx)
 			bpf_map_lookup_elem(&lru_hash_lookup_map, &key);
 			key++;
 		}
+	} else if (test_case == 4) {
+		key %= 2 * MAX_ENTRIES;
+		ret = bpf_map_update_elem(&lru_hash_contention_map, &key, &val,
+					  BPF_ANY);
+		key = bpf_get_prandom_u32() % (2 * MAX_ENTRIES);
+		bpf_map_delete_elem(&lru_hash_contention_map, &key);
 	} else {
 		ret = -EINVAL;
 	}
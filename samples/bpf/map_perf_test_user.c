@@ -44,6 +44,8 @@ enum test_type {
 	ARRAY_LOOKUP,
 	INNER_LRU_HASH_PREALLOC,
 	LRU_HASH_LOOKUP,
+	LRU_HASH_CONTENTION,
+	HASH_BATCH_DUMP,
 	NR_TESTS,
 };
 
@@ -59,6 +61,8 @@ const char *test_map_names[NR_TESTS] = {
 	[ARRAY_LOOKUP] = "array_map",
 	[INNER_LRU_HASH_PREALLOC] = "inner_lru_hash_map",
 	[LRU_HASH_LOOKUP] = "lru_hash_lookup_map",
+	[LRU_HASH_CONTENTION] = "lru_hash_contention_map",
+	[HASH_BATCH_DUMP] = "hash_batch_dump_map",
 };
 
 static int test_flags = ~0;
@@ -68,6 +72,8 @@ static int inner_lru_hash_idx = -1;
 static int array_of_lru_hashs_idx = -1;
 static int lru_hash_lookup_idx = -1;
 static int lru_hash_lookup_test_entries = 32;
+static int hash_batch_dump_idx = -1;
+static uint32_t hash_batch_dump_entries;
 static uint32_t max_cnt = 1000000;
 
 static int check_test_flags(enum test_type t)
@@ -113,6 +119,22 @@ static int pre_test_lru_hash_lookup(int tasks)
 	return 0;
 }
 
+static int pre_test_hash_batch_dump(int tasks)
+{
+	int fd = map_fd[hash_batch_dump_idx];
+	uint32_t key;
+	long val = 1;
+	int ret;
+
+	for (key = 0; key < hash_batch_dump_entries; key++) {
+		ret = bpf_map_update_elem(fd, &key, &val, BPF_NOEXIST);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 static void do_test_lru(enum test_type test, int cpu)
 {
 	static int inner_lru_map_fds[MAX_NR_CPUS];
@@ -174,6 +196,9 @@ static void do_test_lru(enum test_type test, int cpu)
 		test_name = "lru_hash_lookup_perf";
 		in6.sin6_addr.s6_addr16[2] = 3;
 		in6.sin6_addr.s6_addr32[3] = 0;
+	} else if (test == LRU_HASH_CONTENTION) {
+		test_name = "lru_hash_contention_perf";
+		in6.sin6_addr.s6_addr16[2] = 4;
 	} else {
 		assert(0);
 	}
@@ -213,6 +238,85 @@ static void test_lru_hash_lookup(int cpu)
 	do_test_lru(LRU_HASH_LOOKUP, cpu);
 }
 
+static void test_lru_hash_contention(int cpu)
+{
+	do_test_lru(LRU_HASH_CONTENTION, cpu);
+}
+
+/* The samples are built against the installed uapi headers, but not
+ * necessarily against a libbpf that knows the batch commands.
+ */
+static int map_lookup_batch(int fd, __u32 *in_batch, __u32 *out_batch,
+			    void *keys, void *values, __u32 *count)
+{
+	union bpf_attr attr;
+	int ret;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.batch.map_fd = fd;
+	attr.batch.in_batch = (unsigned long)in_batch;
+	attr.batch.out_batch = (unsigned long)out_batch;
+	attr.batch.keys = (unsigned long)keys;
+	attr.batch.values = (unsigned long)values;
+	attr.batch.count = *count;
+
+	ret = syscall(__NR_bpf, BPF_MAP_LOOKUP_BATCH, &attr, sizeof(attr));
+	*count = attr.batch.count;
+	return ret;
+}
+
+#define DUMP_BATCH_SIZE 1024
+
+/* Dump the whole map, first with two syscalls per key, then in batches */
+static void test_hash_batch_dump(int cpu)
+{
+	int fd = map_fd[hash_batch_dump_idx];
+	uint32_t keys[DUMP_BATCH_SIZE], key, next_key, batch, count;
+	long values[DUMP_BATCH_SIZE], value;
+	__u64 start_time, single_ns, batch_ns;
+	long long n, nr_single = 0, nr_batch = 0;
+	int i, rounds, ret;
+
+	rounds = hash_batch_dump_entries ?
+		 max_cnt / hash_batch_dump_entries : 0;
+	if (rounds < 1)
+		rounds = 1;
+
+	start_time = time_get_ns();
+	for (i = 0; i < rounds; i++) {
+		ret = bpf_map_get_next_key(fd, NULL, &key);
+		while (!ret) {
+			if (!bpf_map_lookup_elem(fd, &key, &value))
+				nr_single++;
+			ret = bpf_map_get_next_key(fd, &key, &next_key);
+			key = next_key;
+		}
+	}
+	single_ns = time_get_ns() - start_time;
+
+	start_time = time_get_ns();
+	for (i = 0; i < rounds; i++) {
+		n = 0;
+		do {
+			count = DUMP_BATCH_SIZE;
+			ret = map_lookup_batch(fd, n ? &batch : NULL, &batch,
+					       keys, values, &count);
+			n += count;
+		} while (!ret);
+		if (errno != ENOENT) {
+			printf("BPF_MAP_LOOKUP_BATCH failed: %s(%d)\n",
+			       strerror(errno), errno);
+			exit(1);
+		}
+		nr_batch += n;
+	}
+	batch_ns = time_get_ns() - start_time;
+
+	printf("%d:hash_map_dump %lld entries per sec per key, %lld entries per sec batched\n",
+	       cpu, nr_single * 1000000000ll / single_ns,
+	       nr_batch * 1000000000ll / batch_ns);
+}
+
 static void test_percpu_hash_prealloc(int cpu)
 {
 	__u64 start_time;
@@ -288,6 +392,7 @@ static void test_array_lookup(int cpu)
 typedef int (*pre_test_func)(int tasks);
 const pre_test_func pre_test_funcs[] = {
 	[LRU_HASH_LOOKUP] = pre_test_lru_hash_lookup,
+	[HASH_BATCH_DUMP] = pre_test_hash_batch_dump,
 };
 
 typedef void (*test_func)(int cpu);
@@ -303,6 +408,8 @@ const test_func test_funcs[] = {
 	[ARRAY_LOOKUP] = test_array_lookup,
 	[INNER_LRU_HASH_PREALLOC] = test_inner_lru_hash_prealloc,
 	[LRU_HASH_LOOKUP] = test_lru_hash_lookup,
+	[LRU_HASH_CONTENTION] = test_lru_hash_contention,
+	[HASH_BATCH_DUMP] = test_hash_batch_dump,
 };
 
 static int pre_test(int tasks)
@@ -413,6 +520,13 @@ static void fixup_map(struct bpf_map_data *map, int idx)
 	if (!strcmp("lru_hash_lookup_map", map->name))
 		lru_hash_lookup_idx = idx;
 
+	if (!strcmp("hash_batch_dump_map", map->name)) {
+		hash_batch_dump_idx = idx;
+		hash_batch_dump_entries = map->def.max_entries;
+		if (num_map_entries > 0 && check_test_flags(HASH_BATCH_DUMP))
+			hash_batch_dump_entries = num_map_entries;
+	}
+
 	if (num_map_entries <= 0)
 		return;
 
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/ptrace.h>
+#include <linux/version.h>
+#include <uapi/linux/bpf.h>
+#include "bpf_helpers.h"
+
+#define MAX_CPUS 128
+
+/* Not in bpf_helpers.h yet. */
+static int (*bpf_ringbuf_output)(void *ringbuf, void *data, __u64 size,
+				 __u64 flags) =
+	(void *) BPF_FUNC_ringbuf_output;
+static void *(*bpf_ringbuf_reserve)(void *ringbuf, __u64 size, __u64 flags) =
+	(void *) BPF_FUNC_ringbuf_reserve;
+static void (*bpf_ringbuf_submit)(void *data, __u64 flags) =
+	(void *) BPF_FUNC_ringbuf_submit;
+
+/* Keep in sync with ringbuf_perf_user.c */
+struct event {
+	__u64 ts;
+	__u32 cpu;
+	__u32 pid;
+	__u64 payload[6];
+};
+
+enum {
+	DROP_RINGBUF_RESERVE,
+	DROP_RINGBUF_OUTPUT,
+	DROP_PERF_OUTPUT,
+	NR_DROPS,
+};
+
+/* max_entries is the ring size, ringbuf_perf_user.c may resize it */
+struct bpf_map_def SEC("maps") ringbuf = {
+	.type = BPF_MAP_TYPE_RINGBUF,
+	.max_entries = 1 << 22,
+};
+
+struct bpf_map_def SEC("maps") perfbuf = {
+	.type = BPF_MAP_TYPE_PERF_EVENT_ARRAY,
+	.key_size = sizeof(int),
+	.value_size = sizeof(__u32),
+	.max_entries = MAX_CPUS,
+};
+
+struct bpf_map_def SEC("maps") drops = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = NR_DROPS,
+};
+
+/* [0]: flags passed to bpf_ringbuf_submit() and bpf_ringbuf_output() */
+struct bpf_map_def SEC("maps") config = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(__u64),
+	.max_entries = 1,
+};
+
+static __always_inline void count_drop(__u32 key)
+{
+	__u64 *value = bpf_map_lookup_elem(&drops, &key);
+
+	if (value)
+		__sync_fetch_and_add(value, 1);
+}
+
+static __always_inline __u64 wakeup_flags(void)
+{
+	__u32 key = 0;
+	__u64 *value = bpf_map_lookup_elem(&config, &key);
+
+	return value ? *value : 0;
+}
+
+static __always_inline void fill_event(struct event *e)
+{
+	e->ts = bpf_ktime_get_ns();
+	e->cpu = bpf_get_smp_processor_id();
+	e->pid = bpf_get_current_pid_tgid() >> 32;
+	e->payload[0] = e->ts;
+}
+
+/* zero copy: the event is built in place in the ring */
+SEC("kprobe/sys_getpgid")
+int ringbuf_reserve_prog(struct pt_regs *ctx)
+{
+	__u64 flags = wakeup_flags();
+	struct event *e;
+
+	e = bpf_ringbuf_reserve(&ringbuf, sizeof(*e), 0);
+	if (!e) {
+		count_drop(DROP_RINGBUF_RESERVE);
+		return 0;
+	}
+	fill_event(e);
+	bpf_ringbuf_submit(e, flags);
+	return 0;
+}
+
+/* one copy from the stack, like perf_event_output */
+SEC("kprobe/sys_getppid")
+int ringbuf_output_prog(struct pt_regs *ctx)
+{
+	struct event e = {};
+
+	fill_event(&e);
+	if (bpf_ringbuf_output(&ringbuf, &e, sizeof(e), wakeup_flags()))
+		count_drop(DROP_RINGBUF_OUTPUT);
+	return 0;
+}
+
+SEC("kprobe/sys_gettid")
+int perf_output_prog(struct pt_regs *ctx)
+{
+	struct event e = {};
+
+	fill_event(&e);
+	if (bpf_perf_event_output(ctx, &perfbuf, BPF_F_CURRENT_CPU, &e,
+				  sizeof(e)))
+		count_drop(DROP_PERF_OUTPUT);
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
+u32 _version SEC("version") = LINUX_VERSION_CODE;
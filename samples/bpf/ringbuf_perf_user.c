@@ -0,0 +1,407 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF ring buffer vs perf buffer throughput.
+ *
+ * One producer process per CPU keeps calling a syscall that a kprobe
+ * program turns into a 64 byte event, sent either through a
+ * BPF_MAP_TYPE_RINGBUF (reserve/submit or output) or through a
+ * BPF_MAP_TYPE_PERF_EVENT_ARRAY.  A single consumer drains the buffer
+ * with epoll and reports events/sec, the drop rate and how many events
+ * arrived with an older timestamp than the one before, i.e. out of order
+ * across CPUs.
+ *
+ * Both buffers get the same total memory: the ring buffer all of it, the
+ * perf buffer an equal share per possible CPU.
+ *
+ * Usage: ringbuf_perf [-c cpus] [-n events] [-m MB] [-t tests] [-w]
+ */
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <libbpf.h>
+#include "bpf_load.h"
+
+#define MAX_CPUS 128
+
+/* Keep in sync with ringbuf_perf_kern.c */
+struct event {
+	__u64 ts;
+	__u32 cpu;
+	__u32 pid;
+	__u64 payload[6];
+};
+
+enum {
+	DROP_RINGBUF_RESERVE,
+	DROP_RINGBUF_OUTPUT,
+	DROP_PERF_OUTPUT,
+	NR_DROPS,
+};
+
+enum test_type {
+	RINGBUF_RESERVE,
+	RINGBUF_OUTPUT,
+	PERF_OUTPUT,
+	NR_TESTS,
+};
+
+static const struct {
+	const char *name;
+	int nr;
+	int drop;
+} tests[NR_TESTS] = {
+	[RINGBUF_RESERVE] = { "ringbuf reserve", __NR_getpgid,
+			      DROP_RINGBUF_RESERVE },
+	[RINGBUF_OUTPUT] = { "ringbuf output", __NR_getppid,
+			     DROP_RINGBUF_OUTPUT },
+	[PERF_OUTPUT] = { "perf output", __NR_gettid, DROP_PERF_OUTPUT },
+};
+
+static int nr_producers;
+static long nr_events = 1000000;
+static size_t mem_mb = 4;
+static int test_flags = ~0;
+static int force_wakeup;
+
+static int ringbuf_fd, perfbuf_fd, drops_fd, config_fd;
+static size_t ring_size;
+
+static __u64 received, reordered, lost, last_ts;
+
+static __u64 time_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void handle_event(const struct event *e)
+{
+	received++;
+	if (e->ts < last_ts)
+		reordered++;
+	last_ts = e->ts;
+}
+
+/* Minimal BPF_MAP_TYPE_RINGBUF consumer. */
+struct ring {
+	unsigned long *consumer_pos;
+	unsigned long *producer_pos;
+	void *data;
+	unsigned long mask;
+	int epoll_fd;
+};
+
+static int ring_init(struct ring *r, int map_fd, size_t size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct epoll_event ev = { .events = EPOLLIN };
+	void *tmp;
+
+	r->mask = size - 1;
+
+	/* the consumer page is the only one user space can write */
+	tmp = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   map_fd, 0);
+	if (tmp == MAP_FAILED)
+		return -errno;
+	r->consumer_pos = tmp;
+
+	/* producer page, then the data pages mapped twice */
+	tmp = mmap(NULL, page_size + 2 * size, PROT_READ, MAP_SHARED,
+		   map_fd, page_size);
+	if (tmp == MAP_FAILED)
+		return -errno;
+	r->producer_pos = tmp;
+	r->data = tmp + page_size;
+
+	r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (r->epoll_fd < 0)
+		return -errno;
+	if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, map_fd, &ev) < 0)
+		return -errno;
+	return 0;
+}
+
+static void ring_consume(struct ring *r)
+{
+	unsigned long cons, prod;
+	__u32 *len_ptr, len;
+	bool got;
+
+	cons = __atomic_load_n(r->consumer_pos, __ATOMIC_ACQUIRE);
+	do {
+		got = false;
+		prod = __atomic_load_n(r->producer_pos, __ATOMIC_ACQUIRE);
+		while (cons < prod) {
+			len_ptr = r->data + (cons & r->mask);
+			len = __atomic_load_n(len_ptr, __ATOMIC_ACQUIRE);
+
+			/* the next record is still being written */
+			if (len & BPF_RINGBUF_BUSY_BIT)
+				return;
+
+			got = true;
+			cons += (len & ~BPF_RINGBUF_DISCARD_BIT) +
+				BPF_RINGBUF_HDR_SZ;
+			cons = (cons + 7) & ~7UL;
+			if (!(len & BPF_RINGBUF_DISCARD_BIT))
+				handle_event((void *)len_ptr +
+					     BPF_RINGBUF_HDR_SZ);
+			__atomic_store_n(r->consumer_pos, cons,
+					 __ATOMIC_RELEASE);
+		}
+	} while (got);
+}
+
+static void ring_free(struct ring *r)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	munmap(r->consumer_pos, page_size);
+	munmap(r->producer_pos, page_size + 2 * (r->mask + 1));
+	close(r->epoll_fd);
+}
+
+static void perf_sample(void *ctx, int cpu, void *data, __u32 size)
+{
+	handle_event(data);
+}
+
+static void perf_lost(void *ctx, int cpu, __u64 cnt)
+{
+	lost += cnt;
+}
+
+static void producer(int cpu, int nr)
+{
+	cpu_set_t cpuset;
+	long i;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	if (sched_setaffinity(0, sizeof(cpuset), &cpuset))
+		printf("couldn't pin producer to cpu %d\n", cpu);
+
+	for (i = 0; i < nr_events; i++)
+		syscall(nr, 0);
+	exit(0);
+}
+
+static int start_producers(int nr)
+{
+	int i;
+
+	for (i = 0; i < nr_producers; i++) {
+		pid_t pid = fork();
+
+		if (pid == 0)
+			producer(i, nr);
+		if (pid < 0) {
+			perror("fork");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static bool producers_done(int *running)
+{
+	while (*running && waitpid(-1, NULL, WNOHANG) > 0)
+		(*running)--;
+	return !*running;
+}
+
+static void reset_counters(void)
+{
+	__u64 zero = 0;
+	__u32 key;
+
+	for (key = 0; key < NR_DROPS; key++)
+		bpf_map_update_elem(drops_fd, &key, &zero, BPF_ANY);
+	received = reordered = lost = last_ts = 0;
+}
+
+static __u64 read_drops(int drop)
+{
+	__u32 key = drop;
+	__u64 value = 0;
+
+	bpf_map_lookup_elem(drops_fd, &key, &value);
+	return value;
+}
+
+static void report(enum test_type t, __u64 ns)
+{
+	__u64 produced = (__u64)nr_producers * nr_events;
+	__u64 dropped = read_drops(tests[t].drop);
+
+	printf("%-16s: %d cpus, %llu events/sec, dropped %llu of %llu (%.3f%%), lost %llu, reordered %llu\n",
+	       tests[t].name, nr_producers,
+	       ns ? received * 1000000000ull / ns : 0,
+	       dropped, produced, produced ? 100.0 * dropped / produced : 0,
+	       lost, reordered);
+}
+
+static int run_ringbuf(enum test_type t)
+{
+	struct epoll_event ev;
+	int running = nr_producers;
+	struct ring r;
+	__u64 start;
+	int err;
+
+	err = ring_init(&r, ringbuf_fd, ring_size);
+	if (err) {
+		printf("failed to map ring buffer: %s\n", strerror(-err));
+		return err;
+	}
+
+	reset_counters();
+	start = time_get_ns();
+	if (start_producers(tests[t].nr))
+		return -1;
+
+	while (!producers_done(&running)) {
+		if (epoll_wait(r.epoll_fd, &ev, 1, 100) > 0)
+			ring_consume(&r);
+	}
+	ring_consume(&r);
+
+	report(t, time_get_ns() - start);
+	ring_free(&r);
+	return 0;
+}
+
+static int run_perfbuf(enum test_type t)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct perf_buffer_opts pb_opts = {};
+	int running = nr_producers;
+	size_t page_cnt = 1;
+	struct perf_buffer *pb;
+	__u64 start;
+	int ncpus;
+
+	/* an equal share of the ring buffer's memory for every CPU */
+	ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	while (page_cnt * 2 * page_size * ncpus <= ring_size)
+		page_cnt *= 2;
+
+	pb_opts.sample_cb = perf_sample;
+	pb_opts.lost_cb = perf_lost;
+	pb = perf_buffer__new(perfbuf_fd, page_cnt, &pb_opts);
+	if (libbpf_get_error(pb)) {
+		printf("failed to setup perf_buffer\n");
+		return -1;
+	}
+
+	reset_counters();
+	start = time_get_ns();
+	if (start_producers(tests[t].nr))
+		return -1;
+
+	while (!producers_done(&running))
+		perf_buffer__poll(pb, 100);
+	perf_buffer__poll(pb, 0);
+
+	report(t, time_get_ns() - start);
+	perf_buffer__free(pb);
+	return 0;
+}
+
+static void fixup_map(struct bpf_map_data *map, int idx)
+{
+	if (!strcmp("ringbuf", map->name))
+		map->def.max_entries = ring_size;
+}
+
+int main(int argc, char **argv)
+{
+	__u64 flags;
+	__u32 key = 0;
+	char filename[256];
+	int opt, i;
+
+	nr_producers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "c:n:m:t:w")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_producers = atoi(optarg);
+			break;
+		case 'n':
+			nr_events = atol(optarg);
+			break;
+		case 'm':
+			mem_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			test_flags = strtol(optarg, NULL, 0);
+			break;
+		case 'w':
+			force_wakeup = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-c cpus] [-n events] [-m MB] [-t tests] [-w]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_producers <= 0 || nr_producers > MAX_CPUS || nr_events <= 0 ||
+	    !mem_mb)
+		return 1;
+
+	/* the ring size must be a power of 2 */
+	for (ring_size = 1; ring_size < (mem_mb << 20); ring_size <<= 1)
+		;
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+	if (load_bpf_file_fixup_map(filename, fixup_map)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	for (i = 0; i < map_data_count; i++) {
+		if (!strcmp(map_data[i].name, "ringbuf"))
+			ringbuf_fd = map_fd[i];
+		else if (!strcmp(map_data[i].name, "perfbuf"))
+			perfbuf_fd = map_fd[i];
+		else if (!strcmp(map_data[i].name, "drops"))
+			drops_fd = map_fd[i];
+		else if (!strcmp(map_data[i].name, "config"))
+			config_fd = map_fd[i];
+	}
+
+	flags = force_wakeup ? BPF_RB_FORCE_WAKEUP : 0;
+	bpf_map_update_elem(config_fd, &key, &flags, BPF_ANY);
+
+	printf("%zu KB ring buffer, %s wakeup, %ld events per cpu\n",
+	       ring_size >> 10, force_wakeup ? "forced" : "adaptive",
+	       nr_events);
+
+	for (i = 0; i < NR_TESTS; i++) {
+		if (!(test_flags & (1U << i)))
+			continue;
+		if (i == PERF_OUTPUT)
+			run_perfbuf(i);
+		else
+			run_ringbuf(i);
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/ptrace.h>
+#include <linux/version.h>
+#include <uapi/linux/bpf.h>
+#include <uapi/linux/bpf_perf_event.h>
+#include <uapi/linux/perf_event.h>
+#include "bpf_helpers.h"
+
+#define E_NOMEM	12
+#define E_EXIST	17
+
+/* Keep in sync with stackmap_dedup_user.c */
+enum {
+	MAP_BUCKETS,
+	MAP_DEDUP,
+	NR_MAPS,
+};
+
+enum {
+	RES_OK,
+	RES_EXIST,
+	RES_NOMEM,
+	RES_OTHER,
+	NR_RESULTS,
+};
+
+/* max_entries of both stack maps is set by stackmap_dedup_user.c */
+struct bpf_map_def SEC("maps") stacks = {
+	.type = BPF_MAP_TYPE_STACK_TRACE,
+	.key_size = sizeof(u32),
+	.value_size = PERF_MAX_STACK_DEPTH * sizeof(u64),
+	.max_entries = 1024,
+};
+
+struct bpf_map_def SEC("maps") dedup_stacks = {
+	.type = BPF_MAP_TYPE_STACK_TRACE,
+	.key_size = sizeof(u32),
+	.value_size = PERF_MAX_STACK_DEPTH * sizeof(u64),
+	.max_entries = 32768,
+	.map_flags = BPF_F_STACK_DEDUP,
+};
+
+struct bpf_map_def SEC("maps") results = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u64),
+	.max_entries = NR_MAPS * NR_RESULTS,
+};
+
+static __always_inline void count(u32 map, long id)
+{
+	u32 key = map * NR_RESULTS;
+	u64 *value;
+
+	if (id >= 0)
+		key += RES_OK;
+	else if (id == -E_EXIST)
+		key += RES_EXIST;
+	else if (id == -E_NOMEM)
+		key += RES_NOMEM;
+	else
+		key += RES_OTHER;
+
+	value = bpf_map_lookup_elem(&results, &key);
+	if (value)
+		__sync_fetch_and_add(value, 1);
+}
+
+SEC("perf_event")
+int sample_stacks(struct bpf_perf_event_data *ctx)
+{
+	count(MAP_BUCKETS, bpf_get_stackid(ctx, &stacks, 0));
+	count(MAP_DEDUP, bpf_get_stackid(ctx, &dedup_stacks, 0));
+	count(MAP_BUCKETS, bpf_get_stackid(ctx, &stacks, BPF_F_USER_STACK));
+	count(MAP_DEDUP, bpf_get_stackid(ctx, &dedup_stacks,
+					 BPF_F_USER_STACK));
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
+u32 _version SEC("version") = LINUX_VERSION_CODE;
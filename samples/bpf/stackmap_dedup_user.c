@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stack capture rate and memory use of a plain stack trace map vs. one
+ * created with BPF_F_STACK_DEDUP.
+ *
+ * A perf_event program samples the kernel and user stack on every CPU and
+ * records them in both maps, which get the same memory budget.  At the end
+ * the number of samples each map managed to store, the reasons it didn't,
+ * and how much of its memory the stored stacks take up are reported.
+ *
+ * Usage: stackmap_dedup [-F freq] [-d secs] [-m KB] [command]
+ *
+ * The command, if any, is run as load while sampling, otherwise the tool
+ * just samples whatever the system is doing for the given time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include "libbpf.h"
+#include "bpf_load.h"
+#include "perf-sys.h"
+
+#define MAX_DEPTH	127	/* PERF_MAX_STACK_DEPTH */
+
+/* Keep in sync with stackmap_dedup_kern.c */
+enum {
+	MAP_BUCKETS,
+	MAP_DEDUP,
+	NR_MAPS,
+};
+
+enum {
+	RES_OK,
+	RES_EXIST,
+	RES_NOMEM,
+	RES_OTHER,
+	NR_RESULTS,
+};
+
+/* sizes of the kernel side structures, for the memory budget */
+#define BUCKET_SIZE	(16 + MAX_DEPTH * sizeof(__u64))
+#define NODE_SIZE	24
+
+static const char * const map_names[NR_MAPS] = {
+	[MAP_BUCKETS] = "stacks",
+	[MAP_DEDUP] = "dedup_stacks",
+};
+
+static int sample_freq = 999;
+static int duration = 10;
+static size_t budget_kb = 1024;
+
+static int stack_fd[NR_MAPS], results_fd;
+static __u32 max_entries[NR_MAPS];
+
+static __u32 roundup_pow2(__u32 n)
+{
+	__u32 r = 1;
+
+	while (r < n)
+		r <<= 1;
+	return r;
+}
+
+/* Give both maps about the same amount of memory. */
+static void size_maps(void)
+{
+	size_t budget = budget_kb << 10;
+	__u32 n;
+
+	n = budget / (BUCKET_SIZE + sizeof(void *));
+	while (n > 1 && n * BUCKET_SIZE + roundup_pow2(n) * sizeof(void *) >
+			budget)
+		n--;
+	max_entries[MAP_BUCKETS] = n;
+
+	for (n = 1; (n << 1) * NODE_SIZE <= budget; n <<= 1)
+		;
+	max_entries[MAP_DEDUP] = n;
+}
+
+static void fixup_map(struct bpf_map_data *map, int idx)
+{
+	int i;
+
+	for (i = 0; i < NR_MAPS; i++)
+		if (!strcmp(map->name, map_names[i]))
+			map->def.max_entries = max_entries[i];
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a, y = *(const __u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Read back all stacks of a map.  Returns the number of stacks, and in
+ * frames the number of frames in them and in prefixes the number of
+ * distinct caller prefixes, i.e. what the dedup map needs a node for.
+ */
+static long read_stacks(int fd, long *frames, long *prefixes)
+{
+	__u64 ips[MAX_DEPTH], *paths = NULL, hash;
+	long nr = 0, nr_paths = 0, size = 0, i;
+	__u32 key, next_key;
+	void *prev_key = NULL;
+	int depth, j;
+
+	*frames = 0;
+	while (bpf_map_get_next_key(fd, prev_key, &next_key) == 0) {
+		key = next_key;
+		prev_key = &key;
+		if (bpf_map_lookup_elem(fd, &key, ips))
+			continue;
+		for (depth = 0; depth < MAX_DEPTH && ips[depth]; depth++)
+			;
+		nr++;
+		*frames += depth;
+
+		if (nr_paths + depth > size) {
+			size = (nr_paths + depth) * 2;
+			paths = realloc(paths, size * sizeof(*paths));
+			if (!paths) {
+				printf("out of memory\n");
+				exit(1);
+			}
+		}
+		/* FNV-1a over the path from the outermost caller */
+		hash = 0xcbf29ce484222325ULL;
+		for (j = depth - 1; j >= 0; j--) {
+			hash = (hash ^ ips[j]) * 0x100000001b3ULL;
+			paths[nr_paths++] = hash;
+		}
+	}
+
+	qsort(paths, nr_paths, sizeof(*paths), cmp_u64);
+	*prefixes = 0;
+	for (i = 0; i < nr_paths; i++)
+		if (!i || paths[i] != paths[i - 1])
+			(*prefixes)++;
+	free(paths);
+	return nr;
+}
+
+static void report(void)
+{
+	long stacks, frames, prefixes, used;
+	__u64 res[NR_RESULTS], total;
+	__u32 key;
+	int i, j;
+
+	for (i = 0; i < NR_MAPS; i++) {
+		total = 0;
+		for (j = 0; j < NR_RESULTS; j++) {
+			key = i * NR_RESULTS + j;
+			res[j] = 0;
+			bpf_map_lookup_elem(results_fd, &key, &res[j]);
+			total += res[j];
+		}
+
+		stacks = read_stacks(stack_fd[i], &frames, &prefixes);
+		if (i == MAP_DEDUP)
+			used = prefixes * NODE_SIZE;
+		else
+			used = stacks * BUCKET_SIZE;
+
+		printf("%-12s: %llu samples, %.2f%% stored, %llu collisions, %llu out of space, %llu other errors\n",
+		       map_names[i], total,
+		       total ? 100.0 * res[RES_OK] / total : 0,
+		       res[RES_EXIST], res[RES_NOMEM], res[RES_OTHER]);
+		printf("%-12s  %ld stacks, %ld frames, %ld distinct prefixes, %ld of %zu KB used\n",
+		       "", stacks, frames, prefixes, used >> 10, budget_kb);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_SOFTWARE,
+		.config = PERF_COUNT_SW_CPU_CLOCK,
+		.freq = 1,
+	};
+	int nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	char filename[256];
+	int *pmu_fd;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "+F:d:m:")) != -1) {
+		switch (opt) {
+		case 'F':
+			sample_freq = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'm':
+			budget_kb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-F freq] [-d secs] [-m KB] [command]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (sample_freq <= 0 || duration <= 0 || !budget_kb)
+		return 1;
+
+	size_maps();
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+	if (load_bpf_file_fixup_map(filename, fixup_map)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	for (i = 0; i < map_data_count; i++) {
+		if (!strcmp(map_data[i].name, "stacks"))
+			stack_fd[MAP_BUCKETS] = map_fd[i];
+		else if (!strcmp(map_data[i].name, "dedup_stacks"))
+			stack_fd[MAP_DEDUP] = map_fd[i];
+		else if (!strcmp(map_data[i].name, "results"))
+			results_fd = map_fd[i];
+	}
+
+	printf("%zu KB per map: %u stacks vs %u frames, %d Hz\n", budget_kb,
+	       max_entries[MAP_BUCKETS], max_entries[MAP_DEDUP], sample_freq);
+
+	pmu_fd = calloc(nr_cpus, sizeof(int));
+	if (!pmu_fd)
+		return 1;
+
+	attr.sample_freq = sample_freq;
+	for (i = 0; i < nr_cpus; i++) {
+		pmu_fd[i] = sys_perf_event_open(&attr, -1, i, -1, 0);
+		if (pmu_fd[i] < 0) {
+			/* offline cpu */
+			continue;
+		}
+		if (ioctl(pmu_fd[i], PERF_EVENT_IOC_SET_BPF, prog_fd[0]) ||
+		    ioctl(pmu_fd[i], PERF_EVENT_IOC_ENABLE)) {
+			printf("failed to attach to cpu %d: %s\n", i,
+			       strerror(errno));
+			return 1;
+		}
+	}
+
+	if (optind < argc) {
+		if (system(argv[optind]) < 0)
+			printf("failed to run '%s': %s\n", argv[optind],
+			       strerror(errno));
+	} else {
+		sleep(duration);
+	}
+
+	for (i = 0; i < nr_cpus; i++) {
+		if (pmu_fd[i] < 0)
+			continue;
+		ioctl(pmu_fd[i], PERF_EVENT_IOC_DISABLE);
+		close(pmu_fd[i]);
+	}
+	free(pmu_fd);
+
+	report();
+	return 0;
+}
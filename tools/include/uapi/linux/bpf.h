@@ -107,6 +107,12 @@ enum bpf_cmd {
 	BPF_MAP_LOOKUP_AND_DELETE_ELEM,
 	BPF_MAP_FREEZE,
 	BPF_BTF_GET_NEXT_ID,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
+	BPF_LINK_CREATE,
+	BPF_ITER_CREATE,
 };
 
 enum bpf_map_type {
@@ -136,6 +142,9 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_STACK,
 	BPF_MAP_TYPE_SK_STORAGE,
 	BPF_MAP_TYPE_DEVMAP_HASH,
+	BPF_MAP_TYPE_RINGBUF,
+	BPF_MAP_TYPE_TASK_STORAGE,
+	BPF_MAP_TYPE_INODE_STORAGE,
 };
 
 /* Note that tracing related programs such as
@@ -173,6 +182,7 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_CGROUP_SYSCTL,
 	BPF_PROG_TYPE_RAW_TRACEPOINT_WRITABLE,
 	BPF_PROG_TYPE_CGROUP_SOCKOPT,
+	BPF_PROG_TYPE_ITER,
 };
 
 enum bpf_attach_type {
@@ -199,6 +209,10 @@ enum bpf_attach_type {
 	BPF_CGROUP_UDP6_RECVMSG,
 	BPF_CGROUP_GETSOCKOPT,
 	BPF_CGROUP_SETSOCKOPT,
+	BPF_ITER_TASK,
+	BPF_ITER_TASK_FILE,
+	BPF_ITER_BPF_MAP,
+	BPF_ITER_TCP,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -344,6 +358,11 @@ enum bpf_attach_type {
 /* Clone map from listener for newly accepted socket */
 #define BPF_F_CLONE		(1U << 9)
 
+/* Flag for stack_map, store stacks as chains of frames that share common
+ * caller prefixes, max_entries then is the number of frames
+ */
+#define BPF_F_STACK_DEDUP	(1U << 10)
+
 /* flags for BPF_PROG_QUERY */
 #define BPF_F_QUERY_EFFECTIVE	(1U << 0)
 
@@ -396,6 +415,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -510,6 +546,18 @@ union bpf_attr {
 		__u64		probe_offset;	/* output: probe_offset */
 		__u64		probe_addr;	/* output: probe_addr */
 	} task_fd_query;
+
+	struct { /* struct used by BPF_LINK_CREATE command */
+		__u32		prog_fd;	/* eBPF program to attach */
+		__u32		target_fd;	/* object to attach to */
+		__u32		attach_type;	/* attach type */
+		__u32		flags;		/* extra flags */
+	} link_create;
+
+	struct { /* struct used by BPF_ITER_CREATE command */
+		__u32		link_fd;
+		__u32		flags;
+	} iter_create;
 } __attribute__((aligned(8)));
 
 /* The description below is an attempt at providing documentation to eBPF
@@ -2762,6 +2810,146 @@ union bpf_attr {
  * 		See: clock_gettime(CLOCK_BOOTTIME)
  * 	Return
  * 		Current *ktime*.
+ *
+ * int bpf_ringbuf_output(void *ringbuf, void *data, u64 size, u64 flags)
+ * 	Description
+ * 		Copy *size* bytes from *data* into a ring buffer *ringbuf*.
+ * 		If **BPF_RB_NO_WAKEUP** is specified in *flags*, no notification
+ * 		of new data availability is sent.
+ * 		If **BPF_RB_FORCE_WAKEUP** is specified in *flags*, notification
+ * 		of new data availability is sent unconditionally.
+ * 	Return
+ * 		0 on success, or a negative error in case of failure.
+ *
+ * void *bpf_ringbuf_reserve(void *ringbuf, u64 size, u64 flags)
+ * 	Description
+ * 		Reserve *size* bytes of payload in a ring buffer *ringbuf*.
+ * 		*size* must be a constant known to the verifier.  *flags*
+ * 		must be 0.  The returned pointer has to be passed to
+ * 		**bpf_ringbuf_submit**\ () or **bpf_ringbuf_discard**\ ()
+ * 		before the program exits.
+ * 	Return
+ * 		Valid pointer with *size* bytes of memory available; NULL,
+ * 		otherwise.
+ *
+ * void bpf_ringbuf_submit(void *data, u64 flags)
+ * 	Description
+ * 		Submit reserved ring buffer sample, pointed to by *data*.
+ * 		If **BPF_RB_NO_WAKEUP** is specified in *flags*, no notification
+ * 		of new data availability is sent.
+ * 		If **BPF_RB_FORCE_WAKEUP** is specified in *flags*, notification
+ * 		of new data availability is sent unconditionally.
+ * 	Return
+ * 		Nothing. Always succeeds.
+ *
+ * void bpf_ringbuf_discard(void *data, u64 flags)
+ * 	Description
+ * 		Discard reserved ring buffer sample, pointed to by *data*.
+ * 		If **BPF_RB_NO_WAKEUP** is specified in *flags*, no notification
+ * 		of new data availability is sent.
+ * 		If **BPF_RB_FORCE_WAKEUP** is specified in *flags*, notification
+ * 		of new data availability is sent unconditionally.
+ * 	Return
+ * 		Nothing. Always succeeds.
+ *
+ * u64 bpf_ringbuf_query(void *ringbuf, u64 flags)
+ *	Description
+ *		Query various characteristics of provided ring buffer. What
+ *		exactly is queried is determined by *flags*:
+ *
+ *		* **BPF_RB_AVAIL_DATA**: Amount of data not yet consumed.
+ *		* **BPF_RB_RING_SIZE**: The size of ring buffer.
+ *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
+ *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
+ *
+ *		Data returned is just a momentary snapshot of actual values
+ *		and could be inaccurate, so this facility should be used to
+ *		power heuristics and for reporting, not to make 100% correct
+ *		calculation.
+ *	Return
+ *		Requested value, or 0, if *flags* are not recognized.
+ *
+ * void *bpf_task_storage_get(struct bpf_map *map, u32 pid, void *value, u64 flags)
+ *	Description
+ *		Get a bpf-local-storage from the task with the given *pid*
+ *		(as seen from the init pid namespace), or from the current
+ *		task if *pid* is 0.
+ *
+ *		Logically, it could be thought of as getting the value from
+ *		a *map* with *task* as the **key**.  From this
+ *		perspective,  the usage is not much different from
+ *		**bpf_map_lookup_elem**\ (*map*, **&**\ *task*) except this
+ *		helper enforces the key must be a task and the map must also
+ *		be a **BPF_MAP_TYPE_TASK_STORAGE**.
+ *
+ *		Underneath, the value is stored locally at *task* instead of
+ *		the *map*.  The *map* is used as the bpf-local-storage
+ *		"type". The bpf-local-storage "type" (i.e. the *map*) is
+ *		searched against all bpf-local-storages residing at *task*.
+ *
+ *		An optional *flags* (**BPF_LOCAL_STORAGE_GET_F_CREATE**) can be
+ *		used such that a new bpf-local-storage will be
+ *		created if one does not exist.  *value* can be used
+ *		together with **BPF_LOCAL_STORAGE_GET_F_CREATE** to specify
+ *		the initial value of a bpf-local-storage.  If *value* is
+ *		**NULL**, the new bpf-local-storage will be zero initialized.
+ *		No storage is created from NMI context.
+ *	Return
+ *		A bpf-local-storage pointer is returned on success.
+ *
+ *		**NULL** if not found or there was an error in adding
+ *		a new bpf-local-storage.
+ *
+ * int bpf_task_storage_delete(struct bpf_map *map, u32 pid)
+ *	Description
+ *		Delete a bpf-local-storage from the task with the given
+ *		*pid*, or from the current task if *pid* is 0.
+ *	Return
+ *		0 on success.
+ *
+ *		**-ENOENT** if the bpf-local-storage cannot be found.
+ *
+ *		**-EBUSY** if called from NMI context.
+ *
+ * void *bpf_inode_storage_get(struct bpf_map *map, int fd, void *value, u64 flags)
+ *	Description
+ *		Get a bpf-local-storage from the inode behind the file
+ *		descriptor *fd* of the current task.
+ *
+ *		Works like **bpf_task_storage_get**\ () with the inode as
+ *		the owner of the storage, on a
+ *		**BPF_MAP_TYPE_INODE_STORAGE** *map*.  The storage is freed
+ *		when the inode is destroyed.
+ *	Return
+ *		A bpf-local-storage pointer is returned on success.
+ *
+ *		**NULL** if not found or there was an error in adding
+ *		a new bpf-local-storage.
+ *
+ * int bpf_inode_storage_delete(struct bpf_map *map, int fd)
+ *	Description
+ *		Delete a bpf-local-storage from the inode behind the file
+ *		descriptor *fd* of the current task.
+ *	Return
+ *		0 on success.
+ *
+ *		**-ENOENT** if the bpf-local-storage cannot be found.
+ *
+ *		**-EBADF** if *fd* is not an open file descriptor.
+ *
+ *		**-EBUSY** if called from NMI context.
+ *
+ * int bpf_seq_write(void *ctx, const void *data, u32 len)
+ *	Description
+ *		Append *len* bytes from *data* to the output of the
+ *		iterator whose program was passed *ctx*.  Only available to
+ *		**BPF_PROG_TYPE_ITER** programs.
+ *	Return
+ *		0 on success.
+ *
+ *		**-EOVERFLOW** if the output buffer of the current read()
+ *		is full.  The program is then run again for the same object,
+ *		with the same *seq_num*, once there is room.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -2889,7 +3077,17 @@ union bpf_attr {
 	FN(get_netns_cookie),		\
 	FN(get_current_ancestor_cgroup_id),	\
 	FN(sk_assign),			\
-	FN(ktime_get_boot_ns),
+	FN(ktime_get_boot_ns),		\
+	FN(ringbuf_output),		\
+	FN(ringbuf_reserve),		\
+	FN(ringbuf_submit),		\
+	FN(ringbuf_discard),		\
+	FN(ringbuf_query),		\
+	FN(task_storage_get),		\
+	FN(task_storage_delete),	\
+	FN(inode_storage_get),		\
+	FN(inode_storage_delete),	\
+	FN(seq_write),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -2965,8 +3163,35 @@ enum bpf_func_id {
 /* BPF_FUNC_sysctl_get_name flags. */
 #define BPF_F_SYSCTL_BASE_NAME		(1ULL << 0)
 
-/* BPF_FUNC_sk_storage_get flags */
-#define BPF_SK_STORAGE_GET_F_CREATE	(1ULL << 0)
+/* BPF_FUNC_<kernel_obj>_storage_get flags */
+#define BPF_LOCAL_STORAGE_GET_F_CREATE	(1ULL << 0)
+/* BPF_SK_STORAGE_GET_F_CREATE is only kept for backward compatibility
+ * and BPF_LOCAL_STORAGE_GET_F_CREATE must be used instead.
+ */
+#define BPF_SK_STORAGE_GET_F_CREATE	BPF_LOCAL_STORAGE_GET_F_CREATE
+
+/* BPF_FUNC_ringbuf_output, BPF_FUNC_ringbuf_submit and
+ * BPF_FUNC_ringbuf_discard flags.
+ */
+enum {
+	BPF_RB_NO_WAKEUP		= (1ULL << 0),
+	BPF_RB_FORCE_WAKEUP		= (1ULL << 1),
+};
+
+/* BPF_FUNC_ringbuf_query flags */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* BPF ring buffer constants */
+enum {
+	BPF_RINGBUF_BUSY_BIT		= (1U << 31),
+	BPF_RINGBUF_DISCARD_BIT		= (1U << 30),
+	BPF_RINGBUF_HDR_SZ		= 8,
+};
 
 /* Mode for BPF_FUNC_skb_adjust_room helper. */
 enum bpf_adj_room_mode {
@@ -3280,6 +3505,11 @@ struct bpf_prog_info {
 	__aligned_u64 prog_tags;
 	__u64 run_time_ns;
 	__u64 run_cnt;
+	__u32 verified_insns;
+	__u32 verified_states;
+	__u32 verified_peak_states;
+	__u32 :32;
+	__u64 verification_time_ns;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -3641,4 +3871,64 @@ struct bpf_sockopt {
 	__s32	retval;
 };
 
+/* Context of BPF_PROG_TYPE_ITER programs, one record per object visited.
+ * Every record starts with the number of objects visited before in this
+ * iterator.  Numbers are in the pid, user and network namespaces of the
+ * task that created the iterator.  All fields are read only.
+ */
+struct bpf_iter_task {			/* BPF_ITER_TASK */
+	__u64	seq_num;
+	__u32	pid;
+	__u32	tgid;
+	__u32	ppid;
+	__u32	uid;
+	__u32	state;		/* index into "RSDTtXZPI", as in /proc */
+	__u32	flags;		/* PF_* */
+	__u64	utime;		/* ns */
+	__u64	stime;		/* ns */
+	__u64	start_time;	/* ns since boot */
+	char	comm[16];
+};
+
+struct bpf_iter_task_file {		/* BPF_ITER_TASK_FILE */
+	__u64	seq_num;
+	__u64	ino;
+	__u64	pos;
+	__u32	pid;		/* tgid, threads sharing the table are skipped */
+	__u32	fd;
+	__u32	dev;
+	__u32	mode;		/* i_mode of the inode */
+	__u32	f_flags;
+	__u32	f_mode;
+};
+
+struct bpf_iter_bpf_map {		/* BPF_ITER_BPF_MAP */
+	__u64	seq_num;
+	__u64	memlock;	/* bytes charged to the map */
+	__u32	id;
+	__u32	type;
+	__u32	key_size;
+	__u32	value_size;
+	__u32	max_entries;
+	__u32	map_flags;
+	char	name[BPF_OBJ_NAME_LEN];
+};
+
+struct bpf_iter_tcp {			/* BPF_ITER_TCP */
+	__u64	seq_num;
+	__u64	ino;		/* 0 for request and timewait sockets */
+	__u32	family;
+	__u32	state;
+	__u32	src_ip4;	/* network byte order */
+	__u32	dst_ip4;
+	__u32	src_ip6[4];
+	__u32	dst_ip6[4];
+	__u32	src_port;	/* host byte order */
+	__u32	dst_port;	/* host byte order */
+	__u32	uid;
+	__u32	tx_queue;
+	__u32	rx_queue;
+	__u32	snd_cwnd;
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
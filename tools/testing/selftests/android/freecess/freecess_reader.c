@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stand-in for the freecess FW that measures report delivery latency.
+ *
+ * Binds the MOD_BINDER report channel, either the /dev/freecess ring
+ * (default) or the netlink socket (-n), and consumes binder reports until
+ * none arrived for the idle timeout.  freecess_stress puts the
+ * CLOCK_MONOTONIC time of each report, in usec truncated to 32 bits, in
+ * its flag field, so the time from binder_report() to the reader seeing
+ * it is known for each report.  The count, average, maximum and a log2
+ * histogram of that latency are printed, along with the ring's dropped
+ * and coalesced counters.
+ *
+ * Start this first, then load freecess_stress.  Needs to run as root,
+ * netlink mode switches to the system uid the kernel expects.
+ *
+ * Usage: freecess_reader [-n] [-t idle_seconds]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+/* Keep in sync with include/linux/freecess.h */
+#define NETLINK_KFREECESS	27
+#define KERNEL_ID_NETLINK	0x12341234
+#define LOOPBACK_MSG		1
+#define MSG_TO_USER		3
+#define MOD_BINDER		1
+#define FREECESS_KERNEL_VERSION	1
+
+struct kfreecess_msg_data {
+	int type;
+	int mod;
+	int src_portid;
+	int dst_portid;
+	unsigned int version;
+	int target_uid;
+	int flag;
+	int code;
+	char rpcname[100];
+	struct {
+		int cmd;
+		unsigned int uid;
+	} pkg_info;
+};
+
+struct kfreecess_ring_hdr {
+	unsigned int version;
+	unsigned int nr_slots;
+	unsigned int slot_offset;
+	unsigned int slot_size;
+	unsigned int dropped;
+	unsigned int coalesced;
+	unsigned int head __attribute__((aligned(64)));
+	unsigned int tail __attribute__((aligned(64)));
+};
+
+#define FREECESS_IOC_BIND	_IOW('F', 1, int)
+
+#define NR_BUCKETS		32
+
+static unsigned long long nr_reports, total_us, max_us;
+static unsigned long long buckets[NR_BUCKETS];
+static int idle_ms = 5000;
+
+static uint32_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+}
+
+static void account(const struct kfreecess_msg_data *msg)
+{
+	uint32_t lat = now_us() - (uint32_t)msg->flag;
+	int b = 0;
+
+	if (msg->type != MSG_TO_USER || msg->mod != MOD_BINDER)
+		return;
+
+	nr_reports++;
+	total_us += lat;
+	if (lat > max_us)
+		max_us = lat;
+	while (b < NR_BUCKETS - 1 && lat >> (b + 1))
+		b++;
+	buckets[b]++;
+}
+
+static int read_ring(void)
+{
+	struct kfreecess_ring_hdr *hdr;
+	struct pollfd pfd;
+	unsigned int tail;
+	size_t size;
+	int fd, ret;
+
+	fd = open("/dev/freecess", O_RDWR);
+	if (fd < 0) {
+		perror("/dev/freecess");
+		return -1;
+	}
+	if (ioctl(fd, FREECESS_IOC_BIND, MOD_BINDER)) {
+		perror("FREECESS_IOC_BIND");
+		return -1;
+	}
+
+	/* map the header first to learn the size of the ring */
+	hdr = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	size = hdr->slot_offset + (size_t)hdr->nr_slots * hdr->slot_size;
+	munmap(hdr, getpagesize());
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while ((ret = poll(&pfd, 1, idle_ms)) > 0) {
+		tail = hdr->tail;
+		while (tail != __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE)) {
+			account((void *)hdr + hdr->slot_offset +
+				(tail & (hdr->nr_slots - 1)) * hdr->slot_size);
+			tail++;
+			__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+		}
+	}
+
+	printf("ring: %u slots, %u dropped, %u coalesced\n", hdr->nr_slots,
+	       hdr->dropped, hdr->coalesced);
+	close(fd);
+	return ret;
+}
+
+static int read_netlink(void)
+{
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+	socklen_t len = sizeof(addr);
+	struct {
+		struct nlmsghdr nlh;
+		struct kfreecess_msg_data msg;
+	} req;
+	static char buf[1 << 16];
+	struct nlmsghdr *nlh;
+	struct pollfd pfd;
+	ssize_t n;
+	int fd, ret;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_KFREECESS);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(fd, (struct sockaddr *)&addr, &len)) {
+		perror("netlink");
+		return -1;
+	}
+	/* the kernel only takes the loopback message from the system uid */
+	if (setuid(1000)) {
+		perror("setuid");
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = sizeof(req);
+	req.nlh.nlmsg_pid = addr.nl_pid;
+	req.msg.type = LOOPBACK_MSG;
+	req.msg.mod = MOD_BINDER;
+	req.msg.src_portid = addr.nl_pid;
+	req.msg.dst_portid = KERNEL_ID_NETLINK;
+	req.msg.version = FREECESS_KERNEL_VERSION << 28;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	if (sendto(fd, &req, sizeof(req), 0, (struct sockaddr *)&addr,
+		   sizeof(addr)) < 0) {
+		perror("sendto");
+		return -1;
+	}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while ((ret = poll(&pfd, 1, idle_ms)) > 0) {
+		n = recv(fd, buf, sizeof(buf), 0);
+		if (n < 0) {
+			/* ENOBUFS: the socket overran, reports were lost */
+			if (errno == ENOBUFS)
+				continue;
+			perror("recv");
+			return -1;
+		}
+		for (nlh = (void *)buf; NLMSG_OK(nlh, n); nlh = NLMSG_NEXT(nlh, n))
+			account(NLMSG_DATA(nlh));
+	}
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, netlink = 0, ret, b;
+
+	while ((opt = getopt(argc, argv, "nt:")) != -1) {
+		switch (opt) {
+		case 'n':
+			netlink = 1;
+			break;
+		case 't':
+			idle_ms = atoi(optarg) * 1000;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n] [-t idle_seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	ret = netlink ? read_netlink() : read_ring();
+	if (ret < 0)
+		return 1;
+
+	printf("%llu reports", nr_reports);
+	if (nr_reports)
+		printf(", latency %llu usec avg %llu usec max",
+		       total_us / nr_reports, max_us);
+	printf("\n");
+	for (b = 0; b < NR_BUCKETS; b++)
+		if (buckets[b])
+			printf("  < %10llu usec: %llu\n", 2ull << b, buckets[b]);
+	return 0;
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Load BPF object files and report what it took the verifier to accept
+ * each program: instructions processed, states created, peak states and
+ * wall time, as exported in struct bpf_prog_info.
+ *
+ * Usage: test_verif_stats [-l log_level] file.o...
+ *
+ * e.g. ./test_verif_stats *.o to go over all the selftest programs.
+ * Objects that fail to load are reported and skipped.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#ifndef offsetofend
+#define offsetofend(TYPE, FIELD) \
+	(offsetof(TYPE, FIELD) + sizeof(((TYPE *)0)->FIELD))
+#endif
+
+static int log_level;
+
+static __u64 total_insns, total_states, total_ns;
+static int nr_progs, nr_failed;
+
+static int report_object(const char *path)
+{
+	struct bpf_object_load_attr load_attr = {};
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	int err;
+
+	obj = bpf_object__open(path);
+	err = libbpf_get_error(obj);
+	if (err) {
+		printf("%s: open failed: %d\n", path, err);
+		nr_failed++;
+		return err;
+	}
+
+	load_attr.obj = obj;
+	load_attr.log_level = log_level;
+	err = bpf_object__load_xattr(&load_attr);
+	if (err) {
+		printf("%s: load failed: %d\n", path, err);
+		nr_failed++;
+		goto out;
+	}
+
+	bpf_object__for_each_program(prog, obj) {
+		struct bpf_prog_info info = {};
+		__u32 len = sizeof(info);
+		int fd = bpf_program__fd(prog);
+
+		if (fd < 0)
+			continue;
+		err = bpf_obj_get_info_by_fd(fd, &info, &len);
+		if (err) {
+			printf("%s: %s: can't get prog info: %s\n", path,
+			       bpf_program__title(prog, false), strerror(errno));
+			continue;
+		}
+		/* older kernel, the fields aren't there */
+		if (len < offsetofend(struct bpf_prog_info,
+				      verification_time_ns)) {
+			printf("%s: kernel doesn't report verifier stats\n",
+			       path);
+			err = -EOPNOTSUPP;
+			goto out;
+		}
+
+		printf("%-32s %-32s insns %8u states %6u peak %6u time %8llu us\n",
+		       path, bpf_program__title(prog, false),
+		       info.verified_insns, info.verified_states,
+		       info.verified_peak_states,
+		       info.verification_time_ns / 1000);
+
+		total_insns += info.verified_insns;
+		total_states += info.verified_states;
+		total_ns += info.verification_time_ns;
+		nr_progs++;
+	}
+	err = 0;
+out:
+	bpf_object__close(obj);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "l:")) != -1) {
+		switch (opt) {
+		case 'l':
+			log_level = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc)
+		goto usage;
+
+	for (i = optind; i < argc; i++)
+		if (report_object(argv[i]) == -EOPNOTSUPP)
+			return 1;
+
+	printf("%d programs, %d objects failed: insns %llu states %llu time %llu us\n",
+	       nr_progs, nr_failed, total_insns, total_states,
+	       total_ns / 1000);
+	return 0;
+usage:
+	fprintf(stderr, "usage: %s [-l log_level] file.o...\n", argv[0]);
+	return 1;
+}
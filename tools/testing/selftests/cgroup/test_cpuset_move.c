@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Latency of moving a many-threaded process between cpusets.
+ *
+ * Creates two cpusets under a cgroup2 directory, one on the first half of
+ * the online CPUs and one on the second half, starts a process of that
+ * many threads, mostly sleeping, and writes its pid to the cgroup.procs of
+ * either cpuset in turn, timing every write.  The threads only apply the
+ * new cpumask when they next return to userspace unless -s turns off
+ * /sys/module/cpuset/parameters/defer_affinity for the run.  With -c the
+ * cpuset.cpus of the destination is rewritten with its current value
+ * before every move as well, which has to go through the sched domain
+ * rebuild without changing the domains.  The average, 99th percentile and
+ * maximum latencies are reported.
+ *
+ * Usage: test_cpuset_move [-c] [-s] [-r rounds] [-t threads] [cgroup2 dir]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define DEFER_PARAM	"/sys/module/cpuset/parameters/defer_affinity"
+
+static int rounds = 1000;
+static int nr_threads = 100;
+static int rewrite_cpus;
+static int sync_affinity;
+static const char *root = "/sys/fs/cgroup";
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_file(const char *path, const char *buf)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, buf, strlen(buf)) == (ssize_t)strlen(buf) ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+static int read_file(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	buf[len] = '\0';
+	return 0;
+}
+
+static void *sleeper(void *arg)
+{
+	for (;;)
+		pause();
+	return NULL;
+}
+
+/* A thread that wakes up every 10ms, as most threads of an app would. */
+static void *ticker(void *arg)
+{
+	for (;;)
+		usleep(10000);
+	return NULL;
+}
+
+static void workload(void)
+{
+	pthread_t tid;
+	int i;
+
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&tid, NULL, i % 10 ? sleeper : ticker,
+				   NULL))
+			_exit(1);
+	}
+	sleeper(NULL);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(double *lat, int n)
+{
+	double sum = 0;
+	int i;
+
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%d threads, %d moves: avg %8.1f us, p99 %8.1f us, max %8.1f us\n",
+	       nr_threads, n, sum * 1e6 / n, lat[n * 99 / 100] * 1e6,
+	       lat[n - 1] * 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	char cg[2][4096] = { "", "" }, path[4096], cpus[2][64], buf[64];
+	char defer[8] = "";
+	int opt, i, nr_cpus, ret = KSFT_FAIL;
+	double *lat, t;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "csr:t:")) != -1) {
+		switch (opt) {
+		case 'c':
+			rewrite_cpus = 1;
+			break;
+		case 's':
+			sync_affinity = 1;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-c] [-s] [-r rounds] [-t threads] [cgroup2 dir]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (optind < argc)
+		root = argv[optind];
+	if (rounds <= 0 || nr_threads <= 0)
+		return KSFT_FAIL;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_cpus < 2) {
+		printf("needs at least 2 online CPUs\n");
+		return KSFT_SKIP;
+	}
+	snprintf(cpus[0], sizeof(cpus[0]), "0-%d", nr_cpus / 2 - 1);
+	snprintf(cpus[1], sizeof(cpus[1]), "%d-%d", nr_cpus / 2, nr_cpus - 1);
+
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", root);
+	if (write_file(path, "+cpuset")) {
+		printf("%s: can't enable the cpuset controller: %s\n", root,
+		       strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	if (!read_file(DEFER_PARAM, defer, sizeof(defer)) &&
+	    write_file(DEFER_PARAM, sync_affinity ? "0" : "1")) {
+		perror(DEFER_PARAM);
+		return KSFT_FAIL;
+	}
+
+	lat = calloc(rounds, sizeof(*lat));
+	if (!lat)
+		goto out_param;
+
+	for (i = 0; i < 2; i++) {
+		snprintf(cg[i], sizeof(cg[i]), "%s/cpuset_move.%d", root, i);
+		if (mkdir(cg[i], 0755) && errno != EEXIST) {
+			perror(cg[i]);
+			goto out_rmdir;
+		}
+		snprintf(path, sizeof(path), "%s/cpuset.cpus", cg[i]);
+		if (write_file(path, cpus[i])) {
+			perror(path);
+			goto out_rmdir;
+		}
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		goto out_rmdir;
+	}
+	if (pid == 0) {
+		workload();
+		_exit(0);
+	}
+	snprintf(buf, sizeof(buf), "%d", pid);
+
+	/* Let the threads get going. */
+	usleep(100000 + nr_threads * 100);
+
+	for (i = 0; i < rounds; i++) {
+		int to = i & 1;
+
+		if (rewrite_cpus) {
+			snprintf(path, sizeof(path), "%s/cpuset.cpus", cg[to]);
+			if (write_file(path, cpus[to])) {
+				perror(path);
+				goto out_kill;
+			}
+		}
+
+		snprintf(path, sizeof(path), "%s/cgroup.procs", cg[to]);
+		t = now();
+		if (write_file(path, buf)) {
+			perror(path);
+			goto out_kill;
+		}
+		lat[i] = now() - t;
+	}
+
+	printf("cpusets %s and %s, %s affinity updates%s\n", cpus[0], cpus[1],
+	       !defer[0] ? "synchronous (no " DEFER_PARAM ")" :
+	       sync_affinity ? "synchronous" : "deferred",
+	       rewrite_cpus ? ", cpuset.cpus rewritten" : "");
+	report(lat, rounds);
+	ret = KSFT_PASS;
+
+out_kill:
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+out_rmdir:
+	for (i = 0; i < 2; i++)
+		if (cg[i][0])
+			rmdir(cg[i]);
+	free(lat);
+out_param:
+	if (defer[0])
+		write_file(DEFER_PARAM, defer);
+	return ret;
+}
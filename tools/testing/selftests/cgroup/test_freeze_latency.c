@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Freeze and thaw latency of cgroups with many threads.
+ *
+ * For every thread count, creates a cgroup under a cgroup2 directory with
+ * one process of that many threads in it, half of them spinning and half
+ * of them sleeping, and then freezes and thaws it repeatedly.  The time
+ * from the write to cgroup.freeze until the cgroup has reached the new
+ * state is measured by waiting on an eventfd registered through
+ * cgroup.freeze.event, or with -p by polling cgroup.events the way a
+ * userspace policy would without it.  The average, 99th percentile and
+ * maximum latencies are reported, followed by the kernel's own view from
+ * cgroup.stat.
+ *
+ * Usage: test_freeze_latency [-p] [-r rounds] [-t threads,...] [cgroup2 dir]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+static int rounds = 100;
+static int use_poll;
+static const char *root = "/sys/fs/cgroup";
+static char thread_list[256] = "10,100,1000";
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_file(const char *path, const char *buf)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, buf, strlen(buf)) == (ssize_t)strlen(buf) ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+static int read_file(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	buf[len] = '\0';
+	return 0;
+}
+
+static void *spinner(void *arg)
+{
+	volatile unsigned long n = 0;
+
+	for (;;)
+		n++;
+	return NULL;
+}
+
+static void *sleeper(void *arg)
+{
+	for (;;)
+		pause();
+	return NULL;
+}
+
+/* Runs in the cgroup: nr_threads threads including this one. */
+static void workload(int nr_threads)
+{
+	pthread_t tid;
+	int i;
+
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&tid, NULL, i & 1 ? spinner : sleeper,
+				   NULL))
+			_exit(1);
+	}
+	sleeper(NULL);
+}
+
+/* Wait until cgroup.events says "frozen <frozen>". */
+static int wait_events(const char *events, int frozen)
+{
+	char buf[256], want[16];
+	struct pollfd pfd;
+	int fd;
+
+	snprintf(want, sizeof(want), "frozen %d", frozen);
+	fd = open(events, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	pfd.fd = fd;
+	pfd.events = POLLPRI;
+
+	for (;;) {
+		ssize_t len;
+
+		len = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (len < 0)
+			break;
+		buf[len] = '\0';
+		if (strstr(buf, want)) {
+			close(fd);
+			return 0;
+		}
+		if (poll(&pfd, 1, 10000) <= 0)
+			break;
+	}
+	close(fd);
+	return -1;
+}
+
+static int wait_eventfd(int efd)
+{
+	uint64_t cnt;
+
+	return read(efd, &cnt, sizeof(cnt)) == sizeof(cnt) ? 0 : -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, int nr_threads, double *lat, int n)
+{
+	double sum = 0;
+	int i;
+
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%5d threads %-6s: avg %8.1f us, p99 %8.1f us, max %8.1f us\n",
+	       nr_threads, what, sum * 1e6 / n, lat[n * 99 / 100] * 1e6,
+	       lat[n - 1] * 1e6);
+}
+
+static int run(int nr_threads)
+{
+	char cg[4096], path[4096], buf[1024];
+	double *lat[2], t;
+	int efd = -1, i, ret = KSFT_FAIL;
+	pid_t pid;
+
+	snprintf(cg, sizeof(cg), "%s/freeze_lat.%d", root, nr_threads);
+	if (mkdir(cg, 0755) && errno != EEXIST) {
+		perror(cg);
+		return KSFT_FAIL;
+	}
+
+	lat[0] = calloc(rounds, sizeof(double));
+	lat[1] = calloc(rounds, sizeof(double));
+	if (!lat[0] || !lat[1])
+		goto out_rmdir;
+
+	if (!use_poll) {
+		efd = eventfd(0, 0);
+		snprintf(path, sizeof(path), "%s/cgroup.freeze.event", cg);
+		snprintf(buf, sizeof(buf), "%d", efd);
+		if (efd < 0 || write_file(path, buf)) {
+			printf("%s: no cgroup.freeze.event, use -p\n", cg);
+			ret = KSFT_SKIP;
+			goto out_free;
+		}
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		goto out_free;
+	}
+	if (pid == 0) {
+		snprintf(path, sizeof(path), "%s/cgroup.procs", cg);
+		snprintf(buf, sizeof(buf), "%d", getpid());
+		if (write_file(path, buf))
+			_exit(1);
+		workload(nr_threads);
+	}
+
+	/* Let the threads get going. */
+	usleep(100000 + nr_threads * 100);
+
+	snprintf(path, sizeof(path), "%s/cgroup.freeze", cg);
+	for (i = 0; i < rounds; i++) {
+		int f;
+
+		for (f = 1; f >= 0; f--) {
+			t = now();
+			if (write_file(path, f ? "1" : "0"))
+				goto out_kill;
+			if (use_poll) {
+				char events[4096];
+
+				snprintf(events, sizeof(events),
+					 "%s/cgroup.events", cg);
+				if (wait_events(events, f))
+					goto out_kill;
+			} else if (wait_eventfd(efd)) {
+				goto out_kill;
+			}
+			lat[f][i] = now() - t;
+		}
+	}
+
+	report("freeze", nr_threads, lat[1], rounds);
+	report("thaw", nr_threads, lat[0], rounds);
+
+	snprintf(path, sizeof(path), "%s/cgroup.stat", cg);
+	if (!read_file(path, buf, sizeof(buf)))
+		printf("%s", buf);
+	ret = KSFT_PASS;
+
+out_kill:
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+out_free:
+	if (efd >= 0)
+		close(efd);
+	free(lat[0]);
+	free(lat[1]);
+out_rmdir:
+	rmdir(cg);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, ret = KSFT_PASS;
+	char *tok;
+
+	while ((opt = getopt(argc, argv, "pr:t:")) != -1) {
+		switch (opt) {
+		case 'p':
+			use_poll = 1;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 't':
+			snprintf(thread_list, sizeof(thread_list), "%s",
+				 optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-p] [-r rounds] [-t threads,...] [cgroup2 dir]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (optind < argc)
+		root = argv[optind];
+	if (rounds <= 0)
+		return KSFT_FAIL;
+
+	printf("%d freeze/thaw rounds, waiting on %s\n", rounds,
+	       use_poll ? "cgroup.events" : "cgroup.freeze.event");
+	for (tok = strtok(thread_list, ","); tok; tok = strtok(NULL, ",")) {
+		int nr_threads = atoi(tok);
+
+		if (nr_threads <= 0)
+			continue;
+		ret = run(nr_threads);
+		if (ret != KSFT_PASS)
+			break;
+	}
+	return ret;
+}
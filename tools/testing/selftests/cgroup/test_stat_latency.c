@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stat file read latency with many busy cgroups.
+ *
+ * Creates N child cgroups under a cgroup2 directory, puts one process in
+ * each that keeps faulting in and unmapping anonymous memory, and then
+ * reads memory.stat and cpu.stat of the cgroups round-robin for a while,
+ * reporting the average, 99th percentile and maximum read latency of
+ * each file.
+ *
+ * Usage: test_stat_latency [-c cgroups] [-s secs] [-m MB] [cgroup2 dir]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+static int nr_cgroups = 500;
+static int seconds = 10;
+static size_t fault_mb = 4;
+static const char *root = "/sys/fs/cgroup";
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_file(const char *path, const char *buf)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, buf, strlen(buf)) == (ssize_t)strlen(buf) ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+/* Keep faulting in fault_mb of fresh anonymous memory. */
+static void faulter(void)
+{
+	size_t size = fault_mb << 20, off;
+	long page = sysconf(_SC_PAGESIZE);
+	char *buf;
+
+	for (;;) {
+		buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED)
+			_exit(1);
+		for (off = 0; off < size; off += page)
+			buf[off] = 1;
+		munmap(buf, size);
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *file, double *lat, long n)
+{
+	double sum = 0;
+	long i;
+
+	if (!n) {
+		printf("%-12s: no reads\n", file);
+		return;
+	}
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%-12s: %ld reads, avg %8.1f us, p99 %8.1f us, max %8.1f us\n",
+	       file, n, sum * 1e6 / n, lat[n * 99 / 100] * 1e6,
+	       lat[n - 1] * 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	static const char * const files[] = { "memory.stat", "cpu.stat" };
+	char path[4096], buf[16384];
+	long nr[2] = { 0, 0 }, max_reads;
+	double *lat[2], end, t;
+	int opt, i, f, fd, ret = KSFT_PASS;
+	pid_t *pids;
+
+	while ((opt = getopt(argc, argv, "c:s:m:")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_cgroups = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			fault_mb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-c cgroups] [-s secs] [-m MB] [cgroup2 dir]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+	if (optind < argc)
+		root = argv[optind];
+
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", root);
+	if (write_file(path, "+memory +cpu")) {
+		printf("%s: can't enable memory and cpu controllers: %s\n",
+		       root, strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	pids = calloc(nr_cgroups, sizeof(*pids));
+	max_reads = 1L << 22;
+	lat[0] = calloc(max_reads, sizeof(double));
+	lat[1] = calloc(max_reads, sizeof(double));
+	if (!pids || !lat[0] || !lat[1])
+		return KSFT_FAIL;
+
+	for (i = 0; i < nr_cgroups; i++) {
+		snprintf(path, sizeof(path), "%s/stat_lat.%d", root, i);
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			perror(path);
+			nr_cgroups = i;
+			ret = KSFT_FAIL;
+			goto cleanup;
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			nr_cgroups = i + 1;
+			ret = KSFT_FAIL;
+			goto cleanup;
+		}
+		if (pids[i] == 0) {
+			snprintf(path, sizeof(path),
+				 "%s/stat_lat.%d/cgroup.procs", root, i);
+			snprintf(buf, sizeof(buf), "%d", getpid());
+			if (write_file(path, buf))
+				_exit(1);
+			faulter();
+		}
+	}
+
+	end = now() + seconds;
+	for (i = 0; now() < end; i = (i + 1) % nr_cgroups) {
+		for (f = 0; f < 2 && nr[f] < max_reads; f++) {
+			snprintf(path, sizeof(path), "%s/stat_lat.%d/%s",
+				 root, i, files[f]);
+			t = now();
+			fd = open(path, O_RDONLY);
+			if (fd < 0)
+				continue;
+			while (read(fd, buf, sizeof(buf)) > 0)
+				;
+			close(fd);
+			lat[f][nr[f]++] = now() - t;
+		}
+	}
+
+	printf("%d cgroups faulting %zu MB each, %d s\n", nr_cgroups,
+	       fault_mb, seconds);
+	for (f = 0; f < 2; f++)
+		report(files[f], lat[f], nr[f]);
+
+cleanup:
+	for (i = 0; i < nr_cgroups; i++) {
+		if (pids[i] > 0) {
+			kill(pids[i], SIGKILL);
+			waitpid(pids[i], NULL, 0);
+		}
+		snprintf(path, sizeof(path), "%s/stat_lat.%d", root, i);
+		rmdir(path);
+	}
+	return ret;
+}
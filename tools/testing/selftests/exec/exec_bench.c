@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Startup cost of a binary under each fs.exec_prefetch setting.
+ *
+ * Runs the given command repeatedly with fs.exec_prefetch set to 0, 1
+ * and 2 in turn and reports, for each setting, the time from fork() to
+ * the exit of the command along with the minor and major faults it took.
+ * Pick a command that exits right after its startup, e.g. a large binary
+ * with --version.  With -c the page cache is dropped before every run, so
+ * that the text has to come from storage as on a cold app start.
+ *
+ * Needs root to change the sysctl and to drop caches.
+ *
+ * Usage: exec_bench [-n runs] [-c] command [args...]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PREFETCH_SYSCTL	"/proc/sys/fs/exec_prefetch"
+
+static int nr_runs = 20;
+static int cold;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_file(const char *path, const char *val)
+{
+	ssize_t len = strlen(val);
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	if (write(fd, val, len) != len)
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+static int read_prefetch(void)
+{
+	char buf[16] = "";
+	int fd;
+
+	fd = open(PREFETCH_SYSCTL, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (read(fd, buf, sizeof(buf) - 1) <= 0)
+		buf[0] = '\0';
+	close(fd);
+	return buf[0] ? atoi(buf) : -1;
+}
+
+static int set_prefetch(int mode)
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%d", mode);
+	return write_file(PREFETCH_SYSCTL, buf);
+}
+
+static void drop_caches(void)
+{
+	sync();
+	if (write_file("/proc/sys/vm/drop_caches", "3"))
+		perror("drop_caches");
+}
+
+/* Returns the fork-to-exit time, or a negative value on failure. */
+static double run_once(char **argv, struct rusage *ru)
+{
+	int status, fd;
+	double t;
+	pid_t pid;
+
+	t = now();
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, ru) != pid)
+		return -1;
+	t = now() - t;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+		return -1;
+	return t;
+}
+
+static int bench(char **argv, int mode)
+{
+	double t, total = 0, max = 0;
+	long minflt = 0, majflt = 0;
+	struct rusage ru;
+	int i;
+
+	if (set_prefetch(mode)) {
+		printf("exec_prefetch=%d: %s\n", mode, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < nr_runs; i++) {
+		if (cold)
+			drop_caches();
+		t = run_once(argv, &ru);
+		if (t < 0) {
+			fprintf(stderr, "running %s failed\n", argv[0]);
+			return -1;
+		}
+		total += t;
+		if (t > max)
+			max = t;
+		minflt += ru.ru_minflt;
+		majflt += ru.ru_majflt;
+	}
+
+	printf("exec_prefetch=%d: %10.1f us avg %10.1f us max, %8.1f minor %6.1f major faults\n",
+	       mode, total * 1e6 / nr_runs, max * 1e6,
+	       (double)minflt / nr_runs, (double)majflt / nr_runs);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, mode, old, ret = 0;
+
+	while ((opt = getopt(argc, argv, "+n:c")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_runs = atoi(optarg);
+			break;
+		case 'c':
+			cold = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || nr_runs <= 0)
+		goto usage;
+
+	old = read_prefetch();
+	if (old < 0) {
+		fprintf(stderr, "%s: %s\n", PREFETCH_SYSCTL, strerror(errno));
+		return 1;
+	}
+
+	printf("%s, %d %s runs each\n", argv[optind], nr_runs,
+	       cold ? "cold" : "warm");
+	for (mode = 0; mode <= 2; mode++)
+		ret |= bench(argv + optind, mode);
+
+	set_prefetch(old);
+	return ret ? 1 : 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-n runs] [-c] command [args...]\n",
+		argv[0]);
+	return 1;
+}
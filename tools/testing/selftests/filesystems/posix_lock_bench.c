@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Byte-range lock scalability benchmark.
+ *
+ * Each of N threads opens its own file description of one shared file and
+ * takes open file description (OFD) locks on a private, disjoint set of
+ * ranges, so every request has to be checked against the locks held by all
+ * other threads without ever actually conflicting. Each thread first
+ * builds up a standing set of held locks and then repeatedly locks and
+ * unlocks one more range. The aggregate lock+unlock rate is reported.
+ *
+ * Usage: posix_lock_bench [-t threads] [-l locks per thread] [-s seconds]
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define RANGE_LEN	16
+
+static const char *path = "posix-lock-bench-file";
+static int nr_threads = 8;
+static int nr_locks = 1024;
+static int seconds = 5;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	int fd;
+	unsigned long long ops;
+};
+
+static int ofd_lock(int fd, short type, off_t start)
+{
+	struct flock fl = {
+		.l_type = type,
+		.l_whence = SEEK_SET,
+		.l_start = start,
+		.l_len = RANGE_LEN,
+	};
+
+	return fcntl(fd, F_OFD_SETLKW, &fl);
+}
+
+/* Ranges of different threads interleave, so every lookup sees all of them. */
+static off_t range_start(int id, int n)
+{
+	return ((off_t)n * nr_threads + id) * RANGE_LEN * 2;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	off_t hot = range_start(w->id, nr_locks);
+	int i;
+
+	for (i = 0; i < nr_locks; i++) {
+		if (ofd_lock(w->fd, F_WRLCK, range_start(w->id, i))) {
+			perror("F_OFD_SETLKW");
+			exit(KSFT_FAIL);
+		}
+	}
+
+	while (!stop) {
+		if (ofd_lock(w->fd, F_WRLCK, hot) ||
+		    ofd_lock(w->fd, F_UNLCK, hot)) {
+			perror("F_OFD_SETLKW");
+			exit(KSFT_FAIL);
+		}
+		w->ops++;
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long total = 0;
+	struct worker *workers;
+	struct timespec t0, t1;
+	double elapsed;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "t:l:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'l':
+			nr_locks = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-t threads] [-l locks] [-s seconds]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		return KSFT_FAIL;
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].fd = open(path, O_RDWR | O_CREAT, 0600);
+		if (workers[i].fd < 0) {
+			perror("open");
+			return KSFT_FAIL;
+		}
+	}
+	unlink(path);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&workers[i].thread, NULL, worker_fn, &workers[i]);
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+		close(workers[i].fd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("threads: %d locks/thread: %d held: %d\n",
+	       nr_threads, nr_locks, nr_threads * nr_locks);
+	printf("lock+unlock: %llu in %.2fs (%.0f ops/sec)\n",
+	       total, elapsed, total / elapsed);
+
+	free(workers);
+	return KSFT_PASS;
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Large directory listing benchmark.
+ *
+ * Populates a directory (meant to be on tmpfs) with N empty files, then
+ * has T threads each list it from the start with getdents64(2), using a
+ * small buffer so that every call has to resume from where the previous
+ * one stopped. Each thread checks that it saw every entry exactly once in
+ * count, and the time per full listing is reported.
+ *
+ * Usage: readdir_bench [-d dir] [-n entries] [-t threads] [-b bufsize]
+ */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+struct linux_dirent64 {
+	unsigned long long	d_ino;
+	long long		d_off;
+	unsigned short		d_reclen;
+	unsigned char		d_type;
+	char			d_name[];
+};
+
+static const char *dir = "readdir-bench-dir";
+static int nr_entries = 1000000;
+static int nr_threads = 1;
+static size_t bufsize = 4096;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void populate(int dfd)
+{
+	char name[32];
+	int i, fd;
+
+	for (i = 0; i < nr_entries; i++) {
+		snprintf(name, sizeof(name), "f%08d", i);
+		fd = openat(dfd, name, O_CREAT | O_WRONLY, 0600);
+		if (fd < 0) {
+			perror("openat");
+			exit(KSFT_FAIL);
+		}
+		close(fd);
+	}
+}
+
+static void cleanup(int dfd)
+{
+	char name[32];
+	int i;
+
+	for (i = 0; i < nr_entries; i++) {
+		snprintf(name, sizeof(name), "f%08d", i);
+		unlinkat(dfd, name, 0);
+	}
+}
+
+static void *lister(void *arg)
+{
+	long seen = 0, calls = 0;
+	char *buf = malloc(bufsize);
+	double t;
+	int fd;
+	long n;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0 || !buf) {
+		perror("open");
+		exit(KSFT_FAIL);
+	}
+
+	t = now();
+	while ((n = syscall(SYS_getdents64, fd, buf, bufsize)) > 0) {
+		long off;
+
+		for (off = 0; off < n; ) {
+			struct linux_dirent64 *d = (void *)(buf + off);
+
+			if (d->d_type == DT_REG)
+				seen++;
+			off += d->d_reclen;
+		}
+		calls++;
+	}
+	t = now() - t;
+	if (n < 0) {
+		perror("getdents64");
+		exit(KSFT_FAIL);
+	}
+	if (seen != nr_entries) {
+		fprintf(stderr, "listed %ld entries, expected %d\n",
+			seen, nr_entries);
+		exit(KSFT_FAIL);
+	}
+	printf("%ld entries in %ld calls: %.3f s (%.0f entries/sec)\n",
+	       seen, calls, t, seen / t);
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *threads;
+	int opt, dfd, i;
+
+	while ((opt = getopt(argc, argv, "d:n:t:b:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'n':
+			nr_entries = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'b':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-d dir] [-n entries] [-t threads] [-b bufsize]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	if (mkdir(dir, 0700) && errno != EEXIST) {
+		perror("mkdir");
+		return KSFT_FAIL;
+	}
+	dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0) {
+		perror("open");
+		return KSFT_FAIL;
+	}
+	populate(dfd);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		return KSFT_FAIL;
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&threads[i], NULL, lister, NULL);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	cleanup(dfd);
+	close(dfd);
+	rmdir(dir);
+	free(threads);
+	return KSFT_PASS;
+}
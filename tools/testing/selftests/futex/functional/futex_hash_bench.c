@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/******************************************************************************
+ *
+ * DESCRIPTION
+ *      Futex hash contention benchmark.
+ *
+ *      Runs P processes of T threads each. Every thread owns F futexes and
+ *      repeatedly calls FUTEX_WAIT on them with a mismatched value, so that
+ *      each call hashes its key, takes the bucket lock and returns
+ *      -EWOULDBLOCK without sleeping. No two threads ever share a futex;
+ *      all contention is on the hash buckets. The aggregate rate across all
+ *      threads and processes is reported.
+ *
+ *      With -S, every process first switches to a private futex hash of
+ *      the given number of slots with prctl(PR_FUTEX_HASH).
+ *
+ * Usage: futex_hash_bench [-p procs] [-t threads] [-f futexes] [-s secs]
+ *                         [-S slots] [-P]
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "futextest.h"
+#include "logging.h"
+
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			78
+#define PR_FUTEX_HASH_SET_SLOTS		1
+#define PR_FUTEX_HASH_GET_SLOTS		2
+#endif
+
+static int nr_procs = 1;
+static int nr_threads = 8;
+static int nr_futexes = 1024;
+static int seconds = 5;
+static int slots = -1;
+static int opflags = FUTEX_PRIVATE_FLAG;
+
+/* One counter per thread, shared with the parent across fork() */
+static unsigned long long *ops;
+static volatile int *stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long long *ops;
+	futex_t *futexes;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long n = 0;
+	int i;
+
+	while (!*stop) {
+		for (i = 0; i < nr_futexes; i++)
+			futex_wait(&w->futexes[i], 1, NULL, opflags);
+		n += nr_futexes;
+	}
+	*w->ops = n;
+	return NULL;
+}
+
+static void run_process(int id)
+{
+	struct worker *workers;
+	int i, res;
+
+	if (slots >= 0) {
+		if (prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, slots, 0, 0)) {
+			error("PR_FUTEX_HASH_SET_SLOTS %d\n", errno, slots);
+			exit(RET_ERROR);
+		}
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		exit(RET_ERROR);
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].ops = &ops[id * nr_threads + i];
+		workers[i].futexes = calloc(nr_futexes, sizeof(futex_t));
+		if (!workers[i].futexes)
+			exit(RET_ERROR);
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			error("pthread_create\n", errno);
+			exit(RET_ERROR);
+		}
+	}
+
+	res = prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0);
+	if (id == 0)
+		info("futex hash slots: %s (%d)\n",
+		     res > 0 ? "private" : "global", res);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	exit(RET_PASS);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long total = 0;
+	struct timespec t0, t1;
+	double elapsed;
+	int c, i, status, ret = RET_PASS;
+	void *shared;
+
+	while ((c = getopt(argc, argv, "p:t:f:s:S:Pv:")) != -1) {
+		switch (c) {
+		case 'p':
+			nr_procs = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'f':
+			nr_futexes = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'S':
+			slots = atoi(optarg);
+			break;
+		case 'P':
+			opflags = 0;
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-p procs] [-t threads] [-f futexes] [-s secs] [-S slots] [-P]\n",
+				argv[0]);
+			return RET_ERROR;
+		}
+	}
+
+	shared = mmap(NULL, sizeof(int) + nr_procs * nr_threads * sizeof(*ops),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		      -1, 0);
+	if (shared == MAP_FAILED) {
+		error("mmap\n", errno);
+		return RET_ERROR;
+	}
+	ops = shared;
+	stop = (int *)(ops + nr_procs * nr_threads);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nr_procs; i++) {
+		if (fork() == 0)
+			run_process(i);
+	}
+	sleep(seconds);
+	*stop = 1;
+	for (i = 0; i < nr_procs; i++) {
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != RET_PASS)
+			ret = RET_ERROR;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	for (i = 0; i < nr_procs * nr_threads; i++)
+		total += ops[i];
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("procs: %d threads/proc: %d futexes/thread: %d %s %s hash\n",
+	       nr_procs, nr_threads, nr_futexes,
+	       opflags ? "private" : "shared",
+	       slots > 0 ? "private" : "global");
+	printf("futex_wait: %llu in %.2fs (%.0f ops/sec)\n",
+	       total, elapsed, total / elapsed);
+	return ret;
+}
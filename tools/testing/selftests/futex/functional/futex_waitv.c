@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/******************************************************************************
+ *
+ * DESCRIPTION
+ *      Test FUTEX_WAITV: wait on a vector of private and shared futexes,
+ *      get woken through any one of them, and reject malformed vectors.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+#include <time.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-waitv"
+#define WAKE_WAIT_US 10000
+#define NR_FUTEXES 30
+
+static struct futex_waitv waitv[NR_FUTEXES];
+static futex_t futexes[NR_FUTEXES];
+static int waiter_ret;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void abs_timeout(struct timespec *to, long ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, to);
+	to->tv_nsec += (ms % 1000) * 1000000;
+	to->tv_sec += ms / 1000 + to->tv_nsec / 1000000000;
+	to->tv_nsec %= 1000000000;
+}
+
+static void *waiterfn(void *arg)
+{
+	struct timespec to;
+	int res;
+
+	abs_timeout(&to, 1000);
+	res = futex_waitv(waitv, NR_FUTEXES, &to, 0);
+	if (res < 0) {
+		error("futex_waitv returned %d\n", errno, res);
+		waiter_ret = RET_ERROR;
+	} else if (res != NR_FUTEXES - 1) {
+		fail("futex_waitv returned %d, expected %d\n", res,
+		     NR_FUTEXES - 1);
+		waiter_ret = RET_FAIL;
+	}
+	return NULL;
+}
+
+/* Wait on the whole vector from a thread, then wake its last entry. */
+static int test_wake(futex_t *last, int opflags)
+{
+	pthread_t waiter;
+	int res;
+
+	waiter_ret = RET_PASS;
+	if (pthread_create(&waiter, NULL, waiterfn, NULL)) {
+		error("pthread_create failed\n", errno);
+		return RET_ERROR;
+	}
+
+	usleep(WAKE_WAIT_US);
+
+	res = futex_wake(last, 1, opflags);
+	if (res != 1) {
+		fail("futex_wake returned %d, expected 1\n", res);
+		return RET_FAIL;
+	}
+	pthread_join(waiter, NULL);
+	return waiter_ret;
+}
+
+static int test_private(void)
+{
+	int i;
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		waitv[i].uaddr = (uintptr_t)&futexes[i];
+		waitv[i].val = 0;
+		waitv[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		waitv[i].__reserved = 0;
+	}
+	info("waking private futex\n");
+	return test_wake(&futexes[NR_FUTEXES - 1], FUTEX_PRIVATE_FLAG);
+}
+
+static int test_shared(void)
+{
+	futex_t *shared[NR_FUTEXES];
+	int ret, i;
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		int id = shmget(IPC_PRIVATE, 4096, IPC_CREAT | 0666);
+
+		if (id < 0) {
+			error("shmget failed\n", errno);
+			return RET_ERROR;
+		}
+		shared[i] = shmat(id, NULL, 0);
+		shmctl(id, IPC_RMID, NULL);
+		if (shared[i] == (void *)-1) {
+			error("shmat failed\n", errno);
+			return RET_ERROR;
+		}
+		*shared[i] = 0;
+		waitv[i].uaddr = (uintptr_t)shared[i];
+		waitv[i].val = 0;
+		waitv[i].flags = FUTEX_32;
+		waitv[i].__reserved = 0;
+	}
+	info("waking shared futex\n");
+	ret = test_wake(shared[NR_FUTEXES - 1], 0);
+
+	for (i = 0; i < NR_FUTEXES; i++)
+		shmdt((void *)shared[i]);
+	return ret;
+}
+
+static int expect_error(const char *what, int res, int err)
+{
+	if (res != -1 || errno != err) {
+		fail("%s: returned %d errno %d, expected %s\n", what, res,
+		     errno, strerror(err));
+		return RET_FAIL;
+	}
+	info("%s: %s\n", what, strerror(err));
+	return RET_PASS;
+}
+
+static int test_errors(void)
+{
+	struct timespec to;
+	int ret = RET_PASS;
+
+	waitv[0].uaddr = (uintptr_t)&futexes[0];
+	waitv[0].val = 0;
+	waitv[0].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+	waitv[0].__reserved = 0;
+
+	abs_timeout(&to, 10);
+	ret |= expect_error("timeout",
+			    futex_waitv(waitv, 1, &to, 0), ETIMEDOUT);
+
+	waitv[0].val = 1;
+	ret |= expect_error("value mismatch",
+			    futex_waitv(waitv, 1, NULL, 0), EWOULDBLOCK);
+	waitv[0].val = 0;
+
+	waitv[0].flags = FUTEX_PRIVATE_FLAG;
+	ret |= expect_error("missing FUTEX_32",
+			    futex_waitv(waitv, 1, NULL, 0), EINVAL);
+	waitv[0].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+
+	waitv[0].uaddr = (uintptr_t)&futexes[0] + 1;
+	ret |= expect_error("unaligned futex",
+			    futex_waitv(waitv, 1, NULL, 0), EINVAL);
+	waitv[0].uaddr = (uintptr_t)&futexes[0];
+
+	ret |= expect_error("empty vector",
+			    futex_waitv(waitv, 0, NULL, 0), EINVAL);
+	ret |= expect_error("oversized vector",
+			    futex_waitv(waitv, FUTEX_WAITV_MAX + 1, NULL, 0),
+			    EINVAL);
+	ret |= expect_error("NULL vector",
+			    futex_waitv(NULL, 1, NULL, 0), EINVAL);
+
+	return ret ? RET_FAIL : RET_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	int c, ret;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_print_msg("%s: Test FUTEX_WAITV\n", basename(argv[0]));
+
+	if (futex_waitv(NULL, 0, NULL, 0) == -1 && errno == ENOSYS) {
+		ksft_test_result_skip("FUTEX_WAITV not supported\n");
+		ksft_print_cnts();
+		return KSFT_SKIP;
+	}
+
+	ret = test_private();
+	if (ret == RET_PASS)
+		ret = test_shared();
+	if (ret == RET_PASS)
+		ret = test_errors();
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
@@ -46,6 +46,19 @@ typedef volatile u_int32_t futex_t;
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 #endif
+#ifndef FUTEX_WAITV
+#define FUTEX_WAITV			31
+#endif
+#ifndef FUTEX_WAITV_MAX
+#define FUTEX_32			2
+#define FUTEX_WAITV_MAX			128
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+#endif
 
 /**
  * futex() - SYS_futex syscall wrapper
@@ -80,6 +93,22 @@ futex_wait(futex_t *uaddr, futex_t val, struct timespec *timeout, int opflags)
 	return futex(uaddr, FUTEX_WAIT, val, timeout, NULL, 0, opflags);
 }
 
+/**
+ * futex_waitv() - block until one of several futexes is woken
+ * @waiters:	the futexes to wait on, with their expected values
+ * @nr_waiters:	number of entries in waiters
+ * @timeout:	absolute CLOCK_MONOTONIC timeout, or NULL
+ *
+ * Returns the index of a woken futex.
+ */
+static inline int
+futex_waitv(struct futex_waitv *waiters, unsigned int nr_waiters,
+	    struct timespec *timeout, int opflags)
+{
+	return futex(waiters, FUTEX_WAITV, nr_waiters, timeout, NULL, 0,
+		     opflags);
+}
+
 /**
  * futex_wake() - wake one or more tasks blocked on uaddr
  * @nr_wake:	wake up to this many tasks
@@ -0,0 +1,92 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Time loading a set of modules, e.g. the GKI vendor modules of a QEMU
+# image, the way a boot script does: in modules.load order (or directory
+# order) with up to JOBS insmods in flight.  Run it once with
+# module.sig_async off and once on to see what overlapping the signature
+# check buys.  Everything loaded is unloaded again afterwards.
+#
+# Usage: insmod_bench.sh [-j jobs] [-a] <module dir>
+#   -j  number of concurrent insmods (default: number of CPUs)
+#   -a  set module.sig_async for the run
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+JOBS=$(nproc)
+ASYNC=
+SIG_ASYNC=/sys/module/module/parameters/sig_async
+
+while getopts "j:a" opt; do
+	case $opt in
+	j) JOBS=$OPTARG ;;
+	a) ASYNC=1 ;;
+	*) echo "usage: $0 [-j jobs] [-a] <module dir>"; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+DIR=$1
+
+if [ $UID -ne 0 ]; then
+	echo "$0: must be run as root"
+	exit $ksft_skip
+fi
+
+if [ -z "$DIR" ] || [ ! -d "$DIR" ]; then
+	echo "$0: no module directory given"
+	exit $ksft_skip
+fi
+
+if [ -f "$DIR/modules.load" ]; then
+	MODULES=$(sed "s|^|$DIR/|" "$DIR/modules.load")
+else
+	MODULES=$(ls "$DIR"/*.ko)
+fi
+
+if [ -n "$ASYNC" ]; then
+	if [ ! -w $SIG_ASYNC ]; then
+		echo "$0: kernel has no module.sig_async"
+		exit $ksft_skip
+	fi
+	OLD_ASYNC=$(cat $SIG_ASYNC)
+	echo 1 > $SIG_ASYNC
+fi
+
+before=$(sort /proc/modules | cut -d' ' -f1)
+start=$(date +%s%N)
+
+# Modules may depend on ones still loading: retry until a pass makes no
+# progress, like a boot script racing its own dependencies.
+pending="$MODULES"
+while [ -n "$pending" ]; do
+	failed=
+	for ko in $pending; do
+		while [ $(jobs -r | wc -l) -ge $JOBS ]; do
+			wait -n
+		done
+		( insmod "$ko" 2>/dev/null || echo "$ko" >> /tmp/insmod_bench.$$ ) &
+	done
+	wait
+	[ -f /tmp/insmod_bench.$$ ] && failed=$(cat /tmp/insmod_bench.$$)
+	rm -f /tmp/insmod_bench.$$
+	[ "$failed" = "$pending" ] && break
+	pending=$failed
+done
+
+end=$(date +%s%N)
+
+loaded=$(comm -13 <(echo "$before") <(sort /proc/modules | cut -d' ' -f1))
+echo "loaded $(echo "$loaded" | grep -c .) of $(echo "$MODULES" | wc -w) modules in $(( (end - start) / 1000000 )) ms with $JOBS jobs, sig_async=$(cat $SIG_ASYNC 2>/dev/null || echo n/a)"
+[ -n "$failed" ] && echo "failed: $failed"
+
+# Unload, with a few passes for dependencies.
+for i in 1 2 3; do
+	for mod in $loaded; do
+		rmmod "$mod" 2>/dev/null
+	done
+done
+
+[ -n "$ASYNC" ] && echo "$OLD_ASYNC" > $SIG_ASYNC
+
+exit 0
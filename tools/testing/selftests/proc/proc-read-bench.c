@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Time full reads of large seq_file based proc files.
+ *
+ * Creates a process with many VMAs (and optionally many TCP sockets), then
+ * reads /proc/self/maps and /proc/net/tcp to the end, both with read(2)
+ * and with splice(2) into a pipe, and reports the time per pass.
+ *
+ * Usage: proc-read-bench [-v vmas] [-s sockets] [-n passes] [-b bufsize]
+ */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static int nr_vmas = 10000;
+static int nr_socks;
+static int passes = 10;
+static size_t bufsize = 128 * 1024;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_vmas(int n)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	char *p;
+	int i;
+
+	/* Alternate protections so that neighbouring VMAs cannot merge. */
+	p = mmap(NULL, 2 * n * page, PROT_NONE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(p != MAP_FAILED);
+	for (i = 0; i < n; i++)
+		assert(mprotect(p + 2 * i * page, page, PROT_READ) == 0);
+}
+
+static void make_sockets(int n)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	int i, fd;
+
+	for (i = 0; i < n; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) {
+			fprintf(stderr, "created %d sockets: %s\n", i,
+				strerror(errno));
+			return;
+		}
+		assert(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+		assert(listen(fd, 1) == 0);
+	}
+}
+
+static size_t read_all(const char *path, char *buf)
+{
+	size_t total = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	while ((n = read(fd, buf, bufsize)) > 0)
+		total += n;
+	assert(n == 0);
+	close(fd);
+	return total;
+}
+
+static size_t splice_all(const char *path, int pipefd[2], char *buf)
+{
+	size_t total = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+	while ((n = splice(fd, NULL, pipefd[1], NULL, bufsize, 0)) > 0) {
+		total += n;
+		while (n > 0) {
+			ssize_t r = read(pipefd[0], buf, n);
+
+			assert(r > 0);
+			n -= r;
+		}
+	}
+	close(fd);
+	return n < 0 ? 0 : total;
+}
+
+static void bench(const char *path, char *buf, int pipefd[2])
+{
+	size_t bytes = 0;
+	double t;
+	int i;
+
+	t = now();
+	for (i = 0; i < passes; i++)
+		bytes = read_all(path, buf);
+	printf("%-16s read:   %8zu bytes %10.1f us/pass\n", path, bytes,
+	       (now() - t) * 1e6 / passes);
+
+	t = now();
+	for (i = 0; i < passes; i++)
+		bytes = splice_all(path, pipefd, buf);
+	if (bytes)
+		printf("%-16s splice: %8zu bytes %10.1f us/pass\n", path,
+		       bytes, (now() - t) * 1e6 / passes);
+	else
+		printf("%-16s splice: not supported\n", path);
+}
+
+int main(int argc, char **argv)
+{
+	int pipefd[2];
+	char *buf;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v:s:n:b:")) != -1) {
+		switch (opt) {
+		case 'v':
+			nr_vmas = atoi(optarg);
+			break;
+		case 's':
+			nr_socks = atoi(optarg);
+			break;
+		case 'n':
+			passes = atoi(optarg);
+			break;
+		case 'b':
+			bufsize = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-v vmas] [-s sockets] [-n passes] [-b bufsize]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	buf = malloc(bufsize);
+	assert(buf);
+	assert(pipe(pipefd) == 0);
+	fcntl(pipefd[1], F_SETPIPE_SZ, bufsize);
+
+	make_vmas(nr_vmas);
+	make_sockets(nr_socks);
+
+	bench("/proc/self/maps", buf, pipefd);
+	bench("/proc/net/tcp", buf, pipefd);
+	return 0;
+}
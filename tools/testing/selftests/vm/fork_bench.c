@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Fork latency of processes with large anonymous heaps.
+ *
+ * For each heap size, maps and populates that much anonymous memory (THP
+ * off, so that fork has a pte table per 2MB to deal with) and times fork()
+ * as seen by the parent, with the child exiting right away.  Each size is
+ * timed with a plain fork and again with PR_SET_FORK_SHARE_PTE, which
+ * shares the page tables with the child instead of copying them.  In the
+ * shared mode a child writes to the heap and then the parent does, and
+ * each side checks that it doesn't see the other's writes.
+ *
+ * Usage: fork_bench [-s GB[,GB...]] [-n forks] [-H]
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef PR_SET_FORK_SHARE_PTE
+#define PR_SET_FORK_SHARE_PTE		79
+#define PR_GET_FORK_SHARE_PTE		80
+#endif
+
+static int nr_forks = 10;
+static int allow_thp;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The child flips every page it looks at, the parent must not notice. */
+static int check_child_cow(char *buf, size_t size, long page)
+{
+	size_t off;
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		for (off = 0; off < size; off += 512 * page) {
+			if (buf[off] != 1)
+				_exit(1);
+			buf[off] = 2;
+		}
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+		fprintf(stderr, "child saw the wrong data\n");
+		return -1;
+	}
+	for (off = 0; off < size; off += 512 * page) {
+		if (buf[off] != 1) {
+			fprintf(stderr, "parent saw the child's write at %zu\n",
+				off);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The parent flips the pages while the child waits, the child must still
+ * see the contents from before the fork.
+ */
+static int check_parent_cow(char *buf, size_t size, long page)
+{
+	int fds[2], status;
+	size_t off;
+	pid_t pid;
+	char c;
+
+	if (pipe(fds))
+		return -1;
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		if (read(fds[0], &c, 1) != 1)
+			_exit(2);
+		for (off = 0; off < size; off += 512 * page)
+			if (buf[off] != 1)
+				_exit(1);
+		_exit(0);
+	}
+	close(fds[0]);
+	for (off = 0; off < size; off += 512 * page)
+		buf[off] = 3;
+	c = 0;
+	if (write(fds[1], &c, 1) != 1)
+		perror("write");
+	close(fds[1]);
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+		fprintf(stderr, "child saw the parent's write\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int check_cow(char *buf, size_t size, long page)
+{
+	if (check_child_cow(buf, size, page))
+		return -1;
+	return check_parent_cow(buf, size, page);
+}
+
+static int bench(size_t gb, int share)
+{
+	size_t size = gb << 30, off;
+	long page = sysconf(_SC_PAGESIZE);
+	double t, total = 0, max = 0;
+	int i, status, ret = 0;
+	char *buf;
+	pid_t pid;
+
+	if (prctl(PR_SET_FORK_SHARE_PTE, share, 0, 0, 0) && share) {
+		printf("%4zu GB %-7s fork: not supported\n", gb, "shared");
+		return 0;
+	}
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (buf == MAP_FAILED) {
+		printf("%4zu GB: mmap: %s\n", gb, strerror(errno));
+		return 0;
+	}
+	if (!allow_thp)
+		madvise(buf, size, MADV_NOHUGEPAGE);
+	for (off = 0; off < size; off += page)
+		buf[off] = 1;
+
+	for (i = 0; i < nr_forks; i++) {
+		t = now();
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			ret = -1;
+			break;
+		}
+		if (pid == 0)
+			_exit(0);
+		t = now() - t;
+		waitpid(pid, &status, 0);
+		total += t;
+		if (t > max)
+			max = t;
+	}
+
+	if (!ret && share)
+		ret = check_cow(buf, size, page);
+	if (!ret)
+		printf("%4zu GB %-7s fork: %10.1f us avg %10.1f us max\n", gb,
+		       share ? "shared" : "copied", total * 1e6 / nr_forks,
+		       max * 1e6);
+
+	munmap(buf, size);
+	prctl(PR_SET_FORK_SHARE_PTE, 0, 0, 0, 0);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	char *sizes = strdup("1,4,16"), *s;
+	long avail_gb;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "s:n:H")) != -1) {
+		switch (opt) {
+		case 's':
+			sizes = optarg;
+			break;
+		case 'n':
+			nr_forks = atoi(optarg);
+			break;
+		case 'H':
+			allow_thp = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-s GB[,GB...]] [-n forks] [-H]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	avail_gb = (sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE)) >> 30;
+	for (s = strtok(sizes, ","); s; s = strtok(NULL, ",")) {
+		size_t gb = strtoul(s, NULL, 0);
+
+		if (!gb)
+			continue;
+		if (gb >= avail_gb) {
+			printf("%4zu GB: skipped, %ld GB free\n", gb, avail_gb);
+			continue;
+		}
+		ret |= bench(gb, 0);
+		ret |= bench(gb, 1);
+	}
+	return ret ? 1 : 0;
+}